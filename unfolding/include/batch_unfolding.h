@@ -0,0 +1,34 @@
+#ifndef BATCH_UNFOLDING_H
+#define BATCH_UNFOLDING_H
+
+#include <vector>
+
+#include "response_matrix.h"
+#include "unfolding_workspace.h"
+
+//--------------------------------------------------------------------------------------------------
+// Batched versions of runMLEM and runMLEMSTOP: column i_col of the batch unfolds measurements[i_col]
+// starting from spectra[i_col], exactly as the single-measurement functions would (the results
+// are bit-identical), but all columns are advanced together with one matrix-matrix product per
+// iteration. Columns that meet their stopping criterion are removed from the product.
+//
+// On return spectra[i_col] holds the unfolded spectrum, workspaces[i_col] holds the buffers from
+// the final iteration of that column (mlem_ratio, mlem_estimate, mlem_correction) and
+// num_iterations[i_col] the value the single-measurement function would have returned.
+//--------------------------------------------------------------------------------------------------
+void runMLEMBatch(int cutoff, double error, int num_measurements, int num_bins,
+    std::vector<std::vector<double>>& measurements, std::vector<std::vector<double>>& spectra,
+    ResponseMatrix& nns_response, std::vector<UnfoldingWorkspace>& workspaces,
+    std::vector<int>& num_iterations
+);
+
+// converged[i_col] is set to 0 for columns that reached the cutoff before reaching their J
+// threshold (the case in which runMLEMSTOP throws), 1 otherwise
+void runMLEMSTOPBatch(int cutoff, int num_measurements, int num_bins,
+    std::vector<std::vector<double>>& measurements, std::vector<std::vector<double>>& spectra,
+    ResponseMatrix& nns_response, std::vector<UnfoldingWorkspace>& workspaces,
+    std::vector<double>& j_thresholds, std::vector<double>& j_factors,
+    std::vector<int>& num_iterations, std::vector<int>& converged
+);
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef BINARY_INPUT_H
+#define BINARY_INPUT_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+//--------------------------------------------------------------------------------------------------
+// Read-only, memory-mapped binary input file: a converted copy of one of the CSV input files
+// (response functions, energy bins, ICRP factors, spectra), so that large inputs are loaded without
+// parsing text. The file holds a 32 byte header followed by the values as row-major doubles:
+//  char magic[8], int32 version, int32 num_rows, int32 num_columns, int32 (unused),
+//  uint64 checksum (64 bit FNV-1a hash of the values)
+// Values are stored in the native byte order. A 1D input file is stored as a single column.
+//--------------------------------------------------------------------------------------------------
+class BinaryInputFile {
+    public:
+        int num_rows;
+        int num_columns;
+
+        BinaryInputFile(std::string path);
+        ~BinaryInputFile();
+
+        const double* data() const { return values; }
+        double at(int i_row, int i_column) const { return values[i_row*num_columns + i_column]; }
+
+        static void write(std::string path, std::vector<std::vector<double>>& rows);
+
+    private:
+        void* mapping;
+        std::size_t mapping_size;
+        const double* values;
+
+        static const char MAGIC[8];
+        static const int VERSION;
+
+        // The mapping is owned by this object
+        BinaryInputFile(const BinaryInputFile&);
+        BinaryInputFile& operator=(const BinaryInputFile&);
+};
+
+std::string getBinaryInputPath(std::string csv_path);
+
+bool findBinaryInput(std::string file_name, std::string& binary_path);
+
+#endif
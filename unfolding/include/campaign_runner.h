@@ -0,0 +1,45 @@
+#ifndef CAMPAIGN_RUNNER_H
+#define CAMPAIGN_RUNNER_H
+
+#include <string>
+#include <vector>
+
+#include "custom_classes.h"
+
+//--------------------------------------------------------------------------------------------------
+// One swept setting of a campaign (e.g. name = mlem_cutoff, values = 1000, 5000, 15000)
+//--------------------------------------------------------------------------------------------------
+class CampaignAxis {
+    public:
+        std::string name;
+        std::vector<std::string> values;
+};
+
+//--------------------------------------------------------------------------------------------------
+// A campaign (unfold_spectrum.exe --campaign <spec>) unfolds every measurements file with every
+// combination of the swept settings, i.e. the cartesian product of measurement_files and the values
+// of each axis. Job j unfolds measurement_files[j / num_variants] with variant j % num_variants,
+// where the last axis varies fastest.
+//--------------------------------------------------------------------------------------------------
+class CampaignSpec {
+    public:
+        std::vector<std::string> measurement_files;
+        std::vector<CampaignAxis> axes; // in the order of the spec file
+
+        long numVariants() const;
+        long numJobs() const;
+};
+
+class CampaignSummary {
+    public:
+        long num_jobs;
+        long num_failed;
+        int num_measurement_files_read; // distinct (file, meas_units) pairs read
+        double seconds;
+};
+
+CampaignSpec readCampaignSpec(std::string path_spec, UnfoldingSettings& settings);
+
+CampaignSummary runCampaign(UnfoldingSettings& settings, CampaignSpec& spec, std::string path_output);
+
+#endif
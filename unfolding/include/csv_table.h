@@ -0,0 +1,34 @@
+#ifndef CSV_TABLE_H
+#define CSV_TABLE_H
+
+#include <string>
+#include <vector>
+
+//--------------------------------------------------------------------------------------------------
+// Contents of a CSV file, read into a single buffer and split in place into rows (lines) and
+// fields (comma-delimited), so that large files are parsed without copying each line and token.
+// Rows and fields follow the same rules as reading with getline: a trailing comma does not add an
+// empty field, and an empty line has no fields.
+//--------------------------------------------------------------------------------------------------
+class CSVTable {
+    public:
+        CSVTable(std::string file_name, std::string file_description);
+
+        int num_rows() const { return row_starts.size() - 1; }
+        int num_fields(int i_row) const { return row_starts[i_row+1] - row_starts[i_row]; }
+        const char* field(int i_row, int i_field) const { return fields[row_starts[i_row] + i_field]; }
+        double value(int i_row, int i_field) const;
+
+        void rowValues(int i_row, int first_field, std::vector<double>& row_values) const;
+
+    private:
+        std::vector<char> buffer; // file contents; delimiters are replaced by '\0'
+        std::vector<const char*> fields; // start of each field in buffer
+        std::vector<int> row_starts; // index of the first field of each row in fields, plus the end
+};
+
+// Convert the number at the start of text as strtod does (end: assigned the end of the number, may be
+// NULL)
+double parseCSVNumber(const char* text, const char** end);
+
+#endif
@@ -6,8 +6,14 @@
 #include <vector>
 #include <algorithm>
 #include <iostream>
+#include <memory>
 
+#include "mlemstop_capture.h"
 #include "physics_calculations.h"
+#include "profiler.h"
+#include "response_matrix.h"
+#include "streaming_statistics.h"
+#include "unfolding_workspace.h"
 
 // class Settings {
 //     public:
@@ -25,6 +31,10 @@ class UnfoldingSettings{
         int cutoff; 
         std::string uncertainty_type;
         int num_uncertainty_samples;
+        double uncertainty_rel_tol; // 0 = always draw num_uncertainty_samples
+        int uncertainty_batch_size;
+        std::string uncertainty_bands;
+        std::string sample_initialization;
         int num_meas_per_shell; 
         std::string meas_units; 
 
@@ -40,17 +50,28 @@ class UnfoldingSettings{
         std::string path_icrp_factors;
 
         std::string path_output_spectra;
+        std::string path_results_store; // "" = spectra are only saved to path_output_spectra
         int generate_report;
         std::string path_report;
         int generate_figure;
         std::string path_figure;
+        std::string path_measurements_list; // unfold_batch only
 
         // MAP specific
         double beta; 
         std::string prior;
+        int num_adjacent; // neighbours on either side of a bin used by the mrp, meanrp & gaussians priors
         //MLEM-STOP specific
         int cps_crossover;
         double sigma_j;
+        // MLEM-OR specific
+        double relaxation;
+        // MLEM multigrid specific
+        int multigrid_levels;
+        int multigrid_iterations;
+        // Stream mode specific (unfold_spectrum --stream)
+        double stream_interval; // minimum time between updates [s]
+        double stream_drift_threshold;
         // Optimize specific
         int iteration_min;
         int iteration_max;
@@ -63,6 +84,11 @@ class UnfoldingSettings{
         int derivatives;
         std::string path_output_trend;
         std::string path_ref_spectrum;
+        std::string path_trajectory; // unfold_trend only; "" = do not save the trajectory
+        // Performance specific
+        std::string mlem_kernel;
+        int num_threads;
+        unsigned long seed; // seed for uncertainty sampling; 0 = generate a new seed for each run
 
         UnfoldingSettings(); 
 
@@ -74,6 +100,10 @@ class UnfoldingSettings{
         void set_cutoff(int);
         void set_uncertainty_type(std::string);
         void set_num_uncertainty_samples(int);
+        void set_uncertainty_rel_tol(double);
+        void set_uncertainty_batch_size(int);
+        void set_uncertainty_bands(std::string);
+        void set_sample_initialization(std::string);
         void set_num_meas_per_shell(int);
         void set_meas_units(std::string);
         void set_dose_mu(int);
@@ -82,8 +112,14 @@ class UnfoldingSettings{
         void set_irradiation_conditions(std::string);
         void set_beta(double);
         void set_prior(std::string);
+        void set_num_adjacent(int);
         void set_cps_crossover(int);
         void set_sigma_j(double);
+        void set_relaxation(double);
+        void set_multigrid_levels(int);
+        void set_multigrid_iterations(int);
+        void set_stream_interval(double);
+        void set_stream_drift_threshold(double);
         void set_iteration_min(int);
         void set_iteration_max(int);
         void set_iteration_increment(int);
@@ -93,6 +129,7 @@ class UnfoldingSettings{
         void set_algorithm(std::string);
         void set_trend_type(std::string);
         void set_path_output_spectra(std::string);
+        void set_path_results_store(std::string);
         void set_generate_report(int);
         void set_path_report(std::string);
         void set_generate_figure(int);
@@ -100,11 +137,16 @@ class UnfoldingSettings{
         void set_path_output_trend(std::string);
         void set_derivatives(int);
         void set_path_measurements(std::string);
+        void set_path_measurements_list(std::string);
         void set_path_input_spectrum(std::string);
         void set_path_energy_bins(std::string);
         void set_path_system_response(std::string);
         void set_path_icrp_factors(std::string);
         void set_path_ref_spectrum(std::string);
+        void set_path_trajectory(std::string);
+        void set_mlem_kernel(std::string);
+        void set_num_threads(int);
+        void set_seed(unsigned long);
 };
 
 
@@ -137,16 +179,21 @@ class UncertaintyManagerJ {
         UncertaintyManagerJ();
         UncertaintyManagerJ(double original_j_threshold, double sigma_j);
 
-        void determineSpectrumUncertainty(std::vector<double> &mlemstop_spectrum, 
-            int cutoff, int num_measurements, int num_bins, std::vector<double> &measurements, 
-            std::vector<std::vector<double>> &nns_response, std::vector<double> &normalized_response,
-            std::vector<double> &initial_spectrum);
+        void determineSpectrumUncertainty(std::vector<double> &mlemstop_spectrum, int num_bins,
+            const MLEMSTOPCapture &capture);
 
         void determineDoseUncertainty(double dose, std::vector<double> &mlemstop_spectrum, int num_bins, 
             std::vector<double> &icrp_factors);
 };
 
 
+//--------------------------------------------------------------------------------------------------
+// Summary report of one unfolding. The inputs that are the same for every unfolding of a run
+// (energy bins, NNS response, guess spectrum & ICRP factors) are shared with the caller rather than
+// copied, and the results are moved in by the setters that take them by value (pass std::move(...)
+// if the caller no longer needs them). A report therefore owns everything it writes, and can be
+// written after the caller has moved on to the next unfolding (see report_writer.h).
+//--------------------------------------------------------------------------------------------------
 class UnfoldingReport {
     public:
         const std::string HEADER_DIVIDE = 
@@ -172,7 +219,15 @@ class UnfoldingReport {
         int num_measurements;
         int num_bins;
         std::string uncertainty_type;
-        int num_uncertainty_samples;
+        int num_uncertainty_samples; // # of samples drawn
+        int max_uncertainty_samples;
+        double uncertainty_rel_tol;
+        bool uncertainty_converged;
+        std::string uncertainty_bands;
+        std::string sample_initialization;
+        StreamingStatistics sample_iterations; // # of iterations used to unfold each sample
+        int num_input_starts;
+        unsigned long seed;
         std::string git_commit;
 
         std::vector<double> measurements; // measurements_report
@@ -182,10 +237,10 @@ class UnfoldingReport {
         int duration;
         std::string meas_units;
 
-        std::vector<double> initial_spectrum;
-        std::vector<double> energy_bins;
-        std::vector<std::vector<double>> nns_response;
-        std::vector<double> icrp_factors;
+        std::shared_ptr<const std::vector<double>> initial_spectrum;
+        std::shared_ptr<const std::vector<double>> energy_bins;
+        std::shared_ptr<const ResponseMatrix> nns_response;
+        std::shared_ptr<const std::vector<double>> icrp_factors;
 
         std::vector<double> spectrum;
         std::vector<double> spectrum_uncertainty_upper;
@@ -214,6 +269,8 @@ class UnfoldingReport {
         UncertaintyManagerJ j_manager_high;
         int num_toss;
 
+        Profiler profile; // phase timings & counters, reported if profiling is enabled
+
         UnfoldingReport(); 
 
         void prepare_report();
@@ -223,11 +280,12 @@ class UnfoldingReport {
         void report_inputs(std::ofstream&);
         void report_mlem_info(std::ofstream&);
         void report_results(std::ofstream&);
+        void report_profile(std::ofstream&);
 
         void set_path(std::string);
         void set_irradiation_conditions(std::string);
-        void set_input_files(std::vector<std::string>&);
-        void set_input_file_flags(std::vector<std::string>&);
+        void set_input_files(std::vector<std::string>);
+        void set_input_file_flags(std::vector<std::string>);
 
         void set_cutoff(int);
         void set_error(double);
@@ -237,25 +295,33 @@ class UnfoldingReport {
         void set_num_bins(int);
         void set_uncertainty_type(std::string);
         void set_num_uncertainty_samples(int);
+        void set_max_uncertainty_samples(int);
+        void set_uncertainty_rel_tol(double);
+        void set_uncertainty_converged(bool);
+        void set_uncertainty_bands(std::string);
+        void set_sample_initialization(std::string);
+        void set_sample_iterations(StreamingStatistics&);
+        void set_num_input_starts(int);
+        void set_seed(unsigned long);
         void set_git_commit(std::string);
 
-        void set_measurements(std::vector<double>&);
-        void set_measurements_nc(std::vector<double>&);
+        void set_measurements(std::vector<double>);
+        void set_measurements_nc(std::vector<double>);
         void set_dose_mu(double);
         void set_doserate_mu(double);
         void set_duration(int);
         void set_meas_units(std::string);
 
-        void set_initial_spectrum(std::vector<double>&);
-        void set_energy_bins(std::vector<double>&);
-        void set_nns_response(std::vector<std::vector<double>>&);
-        void set_icrp_factors(std::vector<double>&);
+        void set_initial_spectrum(std::shared_ptr<const std::vector<double>>);
+        void set_energy_bins(std::shared_ptr<const std::vector<double>>);
+        void set_nns_response(std::shared_ptr<const ResponseMatrix>);
+        void set_icrp_factors(std::shared_ptr<const std::vector<double>>);
 
-        void set_spectrum(std::vector<double>&);
-        void set_spectrum_uncertainty_upper(std::vector<double>&);
-        void set_spectrum_uncertainty_lower(std::vector<double>&);
+        void set_spectrum(std::vector<double>);
+        void set_spectrum_uncertainty_upper(std::vector<double>);
+        void set_spectrum_uncertainty_lower(std::vector<double>);
         void set_num_iterations(int);
-        void set_mlem_ratio(std::vector<double>&);
+        void set_mlem_ratio(std::vector<double>);
         void set_dose(double);
         void set_dose_uncertainty_upper(double);
         void set_dose_uncertainty_lower(double);
@@ -274,6 +340,7 @@ class UnfoldingReport {
         void set_j_manager_low(UncertaintyManagerJ);
         void set_j_manager_high(UncertaintyManagerJ);
         void set_num_toss(int);
+        void set_profile(Profiler&);
 };
 
 class SpectraSettings{
@@ -299,6 +366,7 @@ class SpectraSettings{
         std::string error_style;
         int error_fill_style;
         int rows_per_spectrum;
+        std::vector<std::string> selected_spectra;
         std::vector<int> line_style;
         std::vector<int> line_width;
         int border_width;
@@ -349,6 +417,7 @@ class SpectraSettings{
         void set_error_style(std::string);
         void set_error_fill_style(std::string);
         void set_rows_per_spectrum(std::string);
+        void set_selected_spectra(std::string);
         void set_line_style(std::string);
         void set_line_width(std::string);
         void set_border_width(std::string);
@@ -491,6 +560,9 @@ class SurfaceSettings{
         int color_palette;
         int num_color_bins;
         int border_width;
+        int max_x_cells;
+        int max_y_cells;
+        std::string cell_aggregation;
 
         SurfaceSettings(); 
 
@@ -515,6 +587,9 @@ class SurfaceSettings{
         void set_color_palette(std::string);
         void set_num_color_bins(std::string);
         void set_border_width(std::string);
+        void set_max_x_cells(std::string);
+        void set_max_y_cells(std::string);
+        void set_cell_aggregation(std::string);
 };
 
 #endif
\ No newline at end of file
@@ -7,6 +7,7 @@
 #include <map>
 #include <algorithm>
 #include "custom_classes.h"
+#include "response_matrix.h"
 
 bool is_empty(std::ifstream& pFile);
 
@@ -24,6 +25,10 @@ bool checkStringMap(std::string test_key, std::map<std::string, std::string>& te
 
 std::vector<double> getMeasurements(UnfoldingSettings &settings);
 
+int readMeasurementsList(std::string file_name, std::vector<std::string>& entries);
+
+std::vector<double> getInlineMeasurements(std::string entry, UnfoldingSettings &settings);
+
 int saveSpectrumAsRow(std::string spectrum_file, int num_bins, std::string irradiation_conditions, 
     std::vector<double>& spectrum, std::vector<double> &error_lower, std::vector<double> &error_upper,
     std::vector<double>& energy_bins
@@ -37,10 +42,14 @@ int readInputFile1D(std::string file_name, std::vector<double>& input_vector);
 
 int readInputFile2D(std::string file_name, std::vector<std::vector<double>>& input_vector);
 
+int readInputCSV2D(std::string file_name, std::vector<std::vector<double>>& input_vector);
+
+ResponseMatrix readResponseFile(std::string file_name);
+
 int readSpectra(std::string file_name, std::vector<std::string>& header_vector, std::vector<double>& energy_bins, 
     std::vector<std::vector<double>>& spectra_vector, std::vector<std::vector<double>>& error_lower_vector, 
     std::vector<std::vector<double>>& error_upper_vector, bool plot_per_mu, std::vector<int>& number_mu, 
-    std::vector<int>& duration, int rows_per_spectrum
+    std::vector<int>& duration, int rows_per_spectrum, std::vector<std::string>& selected_spectra
 ); 
 
 int checkDimensions(int reference_size, std::string reference_string, int test_size, std::string test_string);
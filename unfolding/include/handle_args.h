@@ -10,5 +10,6 @@ int setfile(std::vector<std::string> &arg_vector, std::string arg_string,
     std::string default_filename, std::string &filename
 );
 void checkUnknownParameters(std::vector<std::string> &arg_vector, std::vector<std::string> input_file_flags);
+bool checkFlag(std::vector<std::string> &arg_vector, std::string arg_string);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,87 @@
+#ifndef LIVE_UNFOLDING_H
+#define LIVE_UNFOLDING_H
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "custom_classes.h"
+#include "response_matrix.h"
+#include "thread_pool.h"
+#include "unfolding_workspace.h"
+
+//--------------------------------------------------------------------------------------------------
+// Running mean & standard error of the mean of the readings of one moderator shell, updated in
+// constant time per reading (Welford's algorithm). Same values as getMeanValueD &
+// getSampleMeanStandardErrorD on all the readings.
+//--------------------------------------------------------------------------------------------------
+class ShellStatistics {
+    public:
+        long count;
+        double mean;
+
+        ShellStatistics();
+
+        void add(double value);
+        double standardError() const; // 0 for fewer than 2 readings
+
+    private:
+        double sum_squared_deviations;
+};
+
+//--------------------------------------------------------------------------------------------------
+// Streaming unfolding of a live feed of shell readings (unfold_spectrum.exe --stream). The energy
+// bins, NNS response, guess spectrum and ICRP factors are read once. Each reading updates the
+// running statistics of its shell, and once every shell has been read, the spectrum is unfolded
+// from the mean of each shell at most every settings.stream_interval seconds:
+//  - the unfolding starts from the previous spectrum (warm start) rather than from the guess
+//    spectrum, so it usually needs only a few iterations once the means settle
+//  - the uncertainties (Monte Carlo samples) are re-estimated only when the mean of a shell has
+//    drifted by more than settings.stream_drift_threshold (relative) from the means they were
+//    estimated with. In between, the relative uncertainties of the last estimate are applied to the
+//    current spectrum & dose.
+// Each update is written as a JSON object on a single line (see instructions_unfold_spectrum.md).
+// settings.f_factor must already be converted to nA/cps.
+//--------------------------------------------------------------------------------------------------
+class LiveUnfolding {
+    public:
+        LiveUnfolding(UnfoldingSettings& settings);
+
+        void addReading(int i_shell, double value); // value in settings.meas_units
+        void reset();
+        bool ready() const;
+        std::string update();
+
+        void run(std::istream& input, std::ostream& output);
+
+    private:
+        UnfoldingSettings settings;
+        int num_measurements;
+        int num_bins;
+        std::vector<double> energy_bins;
+        ResponseMatrix nns_response;
+        std::vector<double> initial_spectrum;
+        std::vector<double> icrp_factors;
+        std::unique_ptr<ThreadPool> pool;
+
+        std::vector<ShellStatistics> shells; // dimension: num_measurements (0 = bare detector)
+        long num_readings;
+        std::vector<double> spectrum; // spectrum of the last update, start of the next unfolding
+        UnfoldingWorkspace workspace;
+        std::chrono::steady_clock::time_point start_time;
+
+        // Last uncertainty estimate
+        bool has_uncertainty;
+        std::vector<double> uncertainty_measurements; // shell means it was estimated with
+        std::vector<double> relative_uncertainty_upper;
+        std::vector<double> relative_uncertainty_lower;
+        double relative_dose_uncertainty_upper;
+        double relative_dose_uncertainty_lower;
+        long num_uncertainty_estimates;
+
+        bool drifted(std::vector<double>& measurements) const;
+};
+
+#endif
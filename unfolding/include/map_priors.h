@@ -0,0 +1,27 @@
+#ifndef MAP_PRIORS_H
+#define MAP_PRIORS_H
+
+#include <string>
+#include <vector>
+
+//--------------------------------------------------------------------------------------------------
+// Energy correction of one MAP iteration: energy_correction[i_bin] is set from the current spectrum
+// for every bin. num_adjacent is the # of neighbours on either side of a bin that are used by the
+// window based priors (mrp, meanrp, gaussians); bins closer than num_adjacent to either edge get no
+// correction. neighbours is a scratch buffer of at least 2*num_adjacent+1 values, so that no memory
+// is allocated inside the MAP iterations.
+//--------------------------------------------------------------------------------------------------
+typedef void (*EnergyCorrectionFunction)(int num_bins, int num_adjacent, double beta,
+    const double* spectrum, double* energy_correction, double* neighbours);
+
+class MAPPrior {
+    public:
+        std::string name;
+        EnergyCorrectionFunction energyCorrection;
+};
+
+std::vector<std::string> getAvailableMAPPriors();
+
+const MAPPrior& getMAPPrior(std::string prior_name, int num_adjacent);
+
+#endif
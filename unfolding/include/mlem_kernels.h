@@ -0,0 +1,66 @@
+#ifndef MLEM_KERNELS_H
+#define MLEM_KERNELS_H
+
+#include <string>
+#include <vector>
+
+#include "response_matrix.h"
+
+//--------------------------------------------------------------------------------------------------
+// Building blocks of an MLEM iteration, implemented once per instruction set:
+//  - forwardProject: mlem_estimate = nns_response x spectrum
+//  - computeRatio: mlem_ratio = measurements / mlem_estimate
+//  - backProject: mlem_correction = transpose(nns_response) x mlem_ratio (not normalized)
+//  - mlemStep: fused project -> ratio -> normalized back projection -> multiplicative update of
+//    spectrum. mlem_estimate, mlem_ratio and mlem_correction are left holding this iteration's values
+//  - mlemStepBatch: mlemStep applied to num_columns independent measurement sets at once, so that
+//    each iteration is a matrix-matrix product instead of num_columns matrix-vector products. Every
+//    argument holds one column per measurement set: element (row, column) is stored at
+//    [row*batch_stride + column]. batch_stride is a multiple of 8 (>= num_columns) and every row
+//    starts on a 64 byte boundary. The SIMD implementations process all batch_stride columns, so
+//    the padding columns must hold valid values (e.g. measurements & spectra of 1)
+// All implementations accumulate each output element in the same order as the scalar loops and do
+// not use fused multiply-add (mlem_kernels.cpp is built with -ffp-contract=off), so every kernel
+// produces bit-identical results.
+//--------------------------------------------------------------------------------------------------
+typedef void (*ForwardProjectKernel)(const ResponseMatrix& nns_response, const double* spectrum,
+    double* mlem_estimate);
+typedef void (*RatioKernel)(int num_measurements, const double* measurements,
+    const double* mlem_estimate, double* mlem_ratio);
+typedef void (*BackProjectKernel)(const ResponseMatrix& nns_response, const double* mlem_ratio,
+    double* mlem_correction);
+typedef void (*MLEMStepKernel)(const ResponseMatrix& nns_response, const double* measurements,
+    double* spectrum, double* mlem_estimate, double* mlem_ratio, double* mlem_correction);
+typedef void (*MLEMStepBatchKernel)(const ResponseMatrix& nns_response, int num_columns,
+    int batch_stride, const double* measurements, double* spectra, double* mlem_estimates,
+    double* mlem_ratios, double* mlem_corrections);
+
+class MLEMKernels {
+    public:
+        std::string name;
+        ForwardProjectKernel forwardProject;
+        RatioKernel computeRatio;
+        BackProjectKernel backProject;
+        MLEMStepKernel mlemStep;
+        MLEMStepBatchKernel mlemStepBatch;
+};
+
+std::vector<std::string> getAvailableMLEMKernels();
+
+const MLEMKernels& getMLEMKernels(std::string kernel_name);
+
+void setMLEMKernels(std::string kernel_name);
+
+const MLEMKernels& getActiveMLEMKernels();
+
+const MLEMKernels& selectMLEMKernels(const ResponseMatrix& nns_response);
+
+double compareMLEMKernels(std::string kernel_name, const ResponseMatrix& nns_response,
+    std::vector<double>& measurements, std::vector<double>& initial_spectrum, int num_iterations,
+    bool fixed_geometry = false);
+
+double compareMLEMReference(std::string kernel_name, const ResponseMatrix& nns_response,
+    std::vector<double>& measurements, std::vector<double>& initial_spectrum, int num_iterations,
+    bool fixed_geometry = false);
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef MLEMSTOP_CAPTURE_H
+#define MLEMSTOP_CAPTURE_H
+
+#include <vector>
+
+#include "response_matrix.h"
+#include "unfolding_workspace.h"
+
+//--------------------------------------------------------------------------------------------------
+// State of an MLEM-STOP trajectory at the first iteration where J <= j_threshold, i.e. where
+// runMLEMSTOP with this threshold would have stopped: num_iterations & j_factor are the values that
+// runMLEMSTOP would have returned, spectrum is the spectrum it would have unfolded, and mlem_estimate,
+// mlem_ratio & mlem_correction are the workspace buffers from that iteration.
+//--------------------------------------------------------------------------------------------------
+class MLEMSTOPCapture {
+    public:
+        double j_threshold;
+        bool reached;
+        int num_iterations;
+        double j_factor;
+        std::vector<double> spectrum;
+        std::vector<double> mlem_estimate;
+        std::vector<double> mlem_ratio;
+        std::vector<double> mlem_correction;
+
+        MLEMSTOPCapture(double j_threshold);
+
+        void restore(std::vector<double>& spectrum, UnfoldingWorkspace& workspace) const;
+};
+
+int runMLEMSTOPCapture(int cutoff, int num_measurements, int num_bins, std::vector<double> &measurements,
+    std::vector<double> &spectrum, ResponseMatrix& nns_response, UnfoldingWorkspace& workspace,
+    std::vector<MLEMSTOPCapture>& captures
+);
+
+#endif
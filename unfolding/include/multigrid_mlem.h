@@ -0,0 +1,37 @@
+#ifndef MULTIGRID_MLEM_H
+#define MULTIGRID_MLEM_H
+
+#include <vector>
+
+#include "response_matrix.h"
+#include "unfolding_workspace.h"
+
+//--------------------------------------------------------------------------------------------------
+// One level of a coarse-to-fine energy grid hierarchy. Each bin of a coarse level merges two
+// adjacent bins of the next finer level (the last bin merges one if the finer level has an odd #
+// of bins): fine bin i_bin belongs to coarse bin i_bin/2. Within each coarse bin, the flux is
+// divided between its fine bins in proportion to the weights of the finer level (the spectrum that
+// the unfolding starts from), so that:
+//  coarse spectrum = sums of the fine spectrum over each coarse bin
+//  coarse response = fine response columns averaged with the fine weights
+// i.e. the coarse response reproduces the measurements estimated from the fine spectrum as long as
+// the shape within each coarse bin is that of the weights.
+//--------------------------------------------------------------------------------------------------
+class MultigridLevel {
+    public:
+        int num_bins;
+        std::vector<double> weights; // sum of the finer weights in each bin, dimension: num_bins
+        ResponseMatrix nns_response;
+        UnfoldingWorkspace workspace;
+        std::vector<double> spectrum;
+
+        MultigridLevel(int num_measurements, const ResponseMatrix& fine_response,
+            const std::vector<double>& fine_weights);
+};
+
+int runMLEMMultigrid(int cutoff, double error, int num_levels, int level_iterations, int num_measurements,
+    int num_bins, std::vector<double> &measurements, std::vector<double> &spectrum,
+    ResponseMatrix& nns_response, UnfoldingWorkspace& workspace
+);
+
+#endif
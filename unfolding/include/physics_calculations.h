@@ -6,6 +6,11 @@
 #include <vector>
 #include <algorithm>
 
+#include "response_matrix.h"
+#include "unfolding_workspace.h"
+
+class UnfoldingSettings; // custom_classes.h includes this header
+
 int processMeasurements(int num_measurements, int num_meas_per_shell, std::vector<double>& measurements, 
     std::vector<double>& std_errors);
 
@@ -13,31 +18,37 @@ double getMeanValueD(std::vector<double>& data);
 
 double getSampleMeanStandardErrorD(std::vector<double>& data, double mean);
 
-std::vector<double> normalizeResponse(int num_bins, int num_measurements, std::vector<std::vector<double>>& system_response);
-
 std::vector<double> normalizeVector(std::vector<double>& unnormalized_vector);
 
-double poisson(double lambda);
-
 int runMLEM(int cutoff, double error, int num_measurements, int num_bins, std::vector<double> &measurements, 
-    std::vector<double> &spectrum, std::vector<std::vector<double>>& nns_response, 
-    std::vector<double> &normalized_response, std::vector<double> &mlem_ratio, 
-    std::vector<double> &mlem_correction, std::vector<double> &mlem_estimate
+    std::vector<double> &spectrum, ResponseMatrix& nns_response, UnfoldingWorkspace& workspace
+);
+
+int runMLEMOR(int cutoff, double error, double relaxation, int num_measurements, int num_bins,
+    std::vector<double> &measurements, std::vector<double> &spectrum, ResponseMatrix& nns_response,
+    UnfoldingWorkspace& workspace
+);
+
+int runSQUAREM(int cutoff, double error, int num_measurements, int num_bins,
+    std::vector<double> &measurements, std::vector<double> &spectrum, ResponseMatrix& nns_response,
+    UnfoldingWorkspace& workspace
 );
 
 int runMLEMSTOP(int cutoff, int num_measurements, int num_bins, std::vector<double> &measurements, 
-    std::vector<double> &spectrum, std::vector<std::vector<double>>& nns_response, 
-    std::vector<double> &normalized_response, std::vector<double> &mlem_ratio, 
-    std::vector<double> &mlem_correction, std::vector<double> &mlem_estimate, double j_threshold,
-    double& j_factor
+    std::vector<double> &spectrum, ResponseMatrix& nns_response, UnfoldingWorkspace& workspace, 
+    double j_threshold, double& j_factor
 );
 
 double determineJThreshold(int num_measurements, std::vector<double>& measurements, double cps_crossover);
 
-int runMAP(std::vector<double> &energy_correction, double beta, std::string prior, int cutoff, 
-    double error, int num_measurements, int num_bins, std::vector<double> &measurements, 
-    std::vector<double> &spectrum, std::vector<std::vector<double>>& nns_response, 
-    std::vector<double> &normalized_response, std::vector<double> &mlem_ratio
+int runMAP(double beta, std::string prior, int cutoff, double error, int num_measurements, int num_bins, 
+    std::vector<double> &measurements, std::vector<double> &spectrum, ResponseMatrix& nns_response, 
+    UnfoldingWorkspace& workspace
+);
+
+int runUnfoldingAlgorithm(UnfoldingSettings& settings, int num_measurements, int num_bins,
+    std::vector<double> &measurements, std::vector<double> &spectrum, ResponseMatrix& nns_response,
+    UnfoldingWorkspace& workspace, double& j_threshold, double& j_factor
 );
 
 double calculateDose(int num_bins, std::vector<double> &spectrum, std::vector<double> &icrp_factors);
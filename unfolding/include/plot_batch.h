@@ -0,0 +1,22 @@
+#ifndef PLOT_BATCH_H
+#define PLOT_BATCH_H
+
+#include <string>
+#include <vector>
+
+//--------------------------------------------------------------------------------------------------
+// Batch rendering of plot_spectra & plot_lines (--manifest). A manifest lists one settings file per
+// figure; the figures are split between num_jobs worker processes (ROOT graphics are not thread
+// safe, so the workers are forked rather than threads), each of which draws its share on a single
+// reused canvas. A figure that fails is reported and skipped: the other figures are still drawn.
+//--------------------------------------------------------------------------------------------------
+// Draws the figure described by a settings file. Errors are reported by throwing.
+typedef void (*PlotFigureFunction)(std::string settings_file);
+
+// Manifest format: one settings file per line. Blank lines and lines starting with # are ignored.
+std::vector<std::string> readPlotManifest(std::string path_manifest);
+
+// Returns the # of figures that could not be drawn
+int runPlotBatch(std::vector<std::string>& settings_files, int num_jobs, PlotFigureFunction plotFigure);
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef PLOT_PLUGIN_H
+#define PLOT_PLUGIN_H
+
+#include <string>
+#include <vector>
+
+//--------------------------------------------------------------------------------------------------
+// Figures are drawn with ROOT by the plotting plugin (plot_plugin.so, built from root_helpers.cpp),
+// which is loaded the first time a figure is requested. The unfolding applications are therefore
+// not linked against ROOT, and run on computers without it (figures are then skipped with a
+// warning). The plugin is looked for in the directory of the executable.
+//--------------------------------------------------------------------------------------------------
+extern const char* PLOT_PLUGIN_FILE;
+extern const char* PLOT_SPECTRUM_SYMBOL;
+
+// Signature of the plotSpectrum entry point exported by the plugin (see root_helpers.h)
+typedef int (*PlotSpectrumFunction)(const char* path_figure, const char* irradiation_conditions,
+    int num_measurements, int num_bins, const double* energy_bins, const double* spectrum,
+    const double* spectrum_uncertainty_upper, const double* spectrum_uncertainty_lower
+);
+
+int plotSpectrumFigure(std::string path_figure,
+    std::string irradiation_conditions, int num_measurements, int num_bins,
+    std::vector<double> &energy_bins, std::vector<double> &spectrum,
+    std::vector<double> &spectrum_uncertainty_upper, std::vector<double> &spectrum_uncertainty_lower
+);
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+//--------------------------------------------------------------------------------------------------
+// Time spent, and the # of memory allocations made (by all threads), in one phase of an application
+// (e.g. input parsing, nominal unfolding, uncertainty sampling). A phase that is timed more than
+// once accumulates.
+//--------------------------------------------------------------------------------------------------
+class ProfilerPhase {
+    public:
+        std::string name;
+        double seconds;
+        long long num_allocations;
+        int num_calls;
+};
+
+class ProfilerCounter {
+    public:
+        std::string name;
+        double value;
+};
+
+//--------------------------------------------------------------------------------------------------
+// Phase timings & counters of one execution, enabled with the --profile <file> option and written
+// to that file as JSON. When disabled (the default), timers do not read the clock and counters are
+// not recorded, so the instrumentation can be left in place. Phases & counters are recorded by the
+// main thread only.
+//--------------------------------------------------------------------------------------------------
+class Profiler {
+    public:
+        bool enabled;
+        std::string application;
+        std::vector<ProfilerPhase> phases; // in the order the phases were first timed
+        std::vector<ProfilerCounter> counters;
+        std::chrono::steady_clock::time_point start_time; // when profiling was enabled
+
+        Profiler();
+
+        void enable(std::string application);
+
+        void addPhase(std::string name, double seconds, long long num_allocations);
+        void setCounter(std::string name, double value);
+
+        double totalSeconds() const; // since profiling was enabled
+        std::string toJSON() const;
+        void writeJSON(std::string path) const;
+
+        static long long numAllocations();
+};
+
+//--------------------------------------------------------------------------------------------------
+// Times a phase from construction until stop() is called or the timer goes out of scope
+//--------------------------------------------------------------------------------------------------
+class ScopedTimer {
+    public:
+        ScopedTimer(Profiler& profiler, std::string phase);
+        ~ScopedTimer();
+
+        void stop();
+
+    private:
+        Profiler& profiler;
+        std::string phase;
+        bool running;
+        std::chrono::steady_clock::time_point start;
+        long long start_allocations;
+
+        ScopedTimer(const ScopedTimer&);
+        ScopedTimer& operator=(const ScopedTimer&);
+};
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef RANDOM_STREAMS_H
+#define RANDOM_STREAMS_H
+
+#include <stdint.h>
+#include <random>
+#include <vector>
+
+//--------------------------------------------------------------------------------------------------
+// Philox4x32-10 counter-based random number generator (Salmon et al. 2011, "Parallel random
+// numbers: as easy as 1, 2, 3"). The output is a fixed function of (seed, stream, counter), so any
+// number of independent substreams can be created from one seed without any shared state: stream
+// i always produces the same sequence regardless of which thread uses it or in which order the
+// streams are used. Satisfies the UniformRandomBitGenerator requirements, so it can be used with
+// the <random> distributions.
+//--------------------------------------------------------------------------------------------------
+class Philox4x32 {
+    public:
+        typedef uint32_t result_type;
+
+        Philox4x32(uint64_t seed, uint64_t stream);
+
+        static result_type min() { return 0; }
+        static result_type max() { return 0xFFFFFFFFu; }
+
+        result_type operator()();
+
+        // Uniformly distributed double in the open interval (0,1)
+        double uniform();
+
+    private:
+        uint32_t key[2];
+        uint32_t counter[4]; // [0],[1]: block # within the stream, [2],[3]: stream #
+        uint32_t block[4]; // output of the current block
+        int block_index; // next unused element of block
+
+        void generateBlock();
+};
+
+//--------------------------------------------------------------------------------------------------
+// Draws pseudo-measurement sets around a fixed set of means. The per-measurement distribution
+// parameters are set up once on construction; each call then fills a whole batch of
+// num_means x num_per_mean variates (ordered by mean, then by draw) from the provided substream.
+// Instances are read-only after construction and may be shared between threads.
+//--------------------------------------------------------------------------------------------------
+class PoissonSampler {
+    public:
+        PoissonSampler(const std::vector<double>& means, int num_per_mean);
+
+        void sample(Philox4x32& generator, std::vector<double>& variates) const;
+
+        int num_means;
+        int num_per_mean;
+
+    private:
+        std::vector<std::poisson_distribution<int>::param_type> parameters;
+};
+
+class GaussianSampler {
+    public:
+        GaussianSampler(const std::vector<double>& means, const std::vector<double>& std_devs,
+            int num_per_mean);
+
+        void sample(Philox4x32& generator, std::vector<double>& variates) const;
+
+        int num_means;
+        int num_per_mean;
+
+    private:
+        std::vector<double> means;
+        std::vector<double> std_devs;
+};
+
+unsigned long generateRandomSeed();
+
+#endif
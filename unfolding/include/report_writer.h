@@ -0,0 +1,41 @@
+#ifndef REPORT_WRITER_H
+#define REPORT_WRITER_H
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "custom_classes.h"
+
+//--------------------------------------------------------------------------------------------------
+// Writes unfolding reports on a thread of its own, so that formatting & writing a report overlaps
+// with the next unfolding instead of delaying it. Reports are written in the order they are
+// submitted. finish (or the destructor) waits until every submitted report is written; an exception
+// thrown while writing a report is rethrown by finish.
+//--------------------------------------------------------------------------------------------------
+class ReportWriter {
+    public:
+        ReportWriter();
+        ~ReportWriter();
+
+        void submit(std::unique_ptr<UnfoldingReport> report);
+        void finish();
+
+    private:
+        std::thread writer;
+        std::deque<std::unique_ptr<UnfoldingReport>> reports;
+        bool finishing;
+        std::exception_ptr first_exception;
+        std::mutex mutex;
+        std::condition_variable condition;
+
+        ReportWriter(const ReportWriter&);
+        ReportWriter& operator=(const ReportWriter&);
+
+        void writerLoop();
+};
+
+#endif
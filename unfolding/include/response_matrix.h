@@ -0,0 +1,83 @@
+#ifndef RESPONSE_MATRIX_H
+#define RESPONSE_MATRIX_H
+
+#include <stdlib.h>
+#include <cstddef>
+#include <new>
+#include <vector>
+
+//--------------------------------------------------------------------------------------------------
+// Minimal allocator that hands out memory aligned to a cache line (64 bytes). Used so that each row
+// of the contiguous response buffers starts on an aligned boundary, which allows vector loads in the
+// unfolding kernels.
+//--------------------------------------------------------------------------------------------------
+template <typename T, std::size_t Alignment = 64>
+class AlignedAllocator {
+    public:
+        typedef T value_type;
+
+        template <typename U>
+        struct rebind { typedef AlignedAllocator<U, Alignment> other; };
+
+        AlignedAllocator() {}
+        template <typename U>
+        AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+        T* allocate(std::size_t n) {
+            void* ptr = NULL;
+            if (posix_memalign(&ptr, Alignment, n*sizeof(T)) != 0) {
+                throw std::bad_alloc();
+            }
+            return static_cast<T*>(ptr);
+        }
+        void deallocate(T* ptr, std::size_t) {
+            free(ptr);
+        }
+};
+
+template <typename T, typename U, std::size_t A>
+bool operator==(const AlignedAllocator<T,A>&, const AlignedAllocator<U,A>&) { return true; }
+template <typename T, typename U, std::size_t A>
+bool operator!=(const AlignedAllocator<T,A>&, const AlignedAllocator<U,A>&) { return false; }
+
+typedef std::vector<double, AlignedAllocator<double>> AlignedVector;
+
+//--------------------------------------------------------------------------------------------------
+// This class stores the NNS response (system) matrix used by the MLEM-style unfolding algorithms.
+// The matrix is held in a single contiguous, aligned, row-major buffer (one row per measurement),
+// alongside a precomputed transpose (one row per energy bin) so that both the forward projection
+// and the back projection walk memory sequentially. The column sums of the matrix (i.e. the
+// normalized response) and their reciprocals are calculated once on construction.
+// Rows are padded with zeros up to a multiple of 8 doubles (64 bytes).
+//--------------------------------------------------------------------------------------------------
+class ResponseMatrix {
+    public:
+        int num_measurements;
+        int num_bins;
+        int row_stride; // padded length of a row of the matrix (>= num_bins)
+        int column_stride; // padded length of a row of the transpose (>= num_measurements)
+
+        ResponseMatrix();
+        ResponseMatrix(std::vector<std::vector<double>>& system_response);
+        ResponseMatrix(int num_measurements, int num_bins, const double* values);
+
+        double at(int i_meas, int i_bin) const { return data[i_meas*row_stride + i_bin]; }
+        const double* row(int i_meas) const { return &data[i_meas*row_stride]; }
+        const double* column(int i_bin) const { return &transpose[i_bin*column_stride]; }
+
+        const std::vector<double>& normalizedResponse() const { return normalized_response; }
+        const double* inverseNormalizedResponse() const { return &inverse_normalized_response[0]; }
+
+        std::vector<std::vector<double>> toNestedVector() const;
+
+    private:
+        AlignedVector data;
+        AlignedVector transpose;
+        std::vector<double> normalized_response;
+        AlignedVector inverse_normalized_response;
+
+        void allocate();
+        void computeNormalization();
+};
+
+#endif
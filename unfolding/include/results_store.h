@@ -0,0 +1,103 @@
+#ifndef RESULTS_STORE_H
+#define RESULTS_STORE_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+//--------------------------------------------------------------------------------------------------
+// One unfolded spectrum of a results store, with its uncertainties and metadata. timestamp is the
+// time at which it was stored (seconds since the Unix epoch).
+//--------------------------------------------------------------------------------------------------
+class StoredSpectrum {
+    public:
+        std::string irradiation_conditions;
+        std::string algorithm;
+        long long timestamp;
+        double dose;
+        double dose_uncertainty_upper;
+        double dose_uncertainty_lower;
+        std::vector<double> spectrum;
+        std::vector<double> uncertainty_upper;
+        std::vector<double> uncertainty_lower;
+};
+
+//--------------------------------------------------------------------------------------------------
+// Location & metadata of one record of a results store (everything but the spectral values)
+//--------------------------------------------------------------------------------------------------
+class ResultsStoreEntry {
+    public:
+        std::string irradiation_conditions;
+        std::string algorithm;
+        long long timestamp;
+        double dose;
+        double dose_uncertainty_upper;
+        double dose_uncertainty_lower;
+        long long offset; // of the record in the file
+};
+
+//--------------------------------------------------------------------------------------------------
+// Append-only binary file of unfolded spectra (path_results_store), an alternative to appending
+// text rows to the unfolded spectrum CSV file. The file holds a header with the energy bins:
+//  char magic[8], int32 version, int32 num_bins, double energy_bins[num_bins]
+// followed by one record per stored spectrum:
+//  int32 record_size, int32 label_size, int32 algorithm_size, int32 (unused), int64 timestamp,
+//  double dose, double dose_uncertainty_upper, double dose_uncertainty_lower,
+//  uint64 checksum (64 bit FNV-1a hash of the rest of the record),
+//  char irradiation_conditions[label_size], char algorithm[algorithm_size] (zero-padded to a
+//  multiple of 8 bytes), double spectrum[num_bins], double uncertainty_upper[num_bins],
+//  double uncertainty_lower[num_bins], int32 record_size, char end_marker[4]
+// Values are stored in the native byte order.
+//
+// Records are appended with a single write while an exclusive lock is held on the file, so that
+// concurrent runs cannot interleave their records. An incomplete final record (interrupted run) is
+// ignored by readers and removed by the next append.
+//
+// Opening a store only reads the record headers, to index the records by irradiation conditions
+// & timestamp. The values of a record are read when it is requested.
+//--------------------------------------------------------------------------------------------------
+class ResultsStore {
+    public:
+        int num_bins;
+        std::vector<double> energy_bins;
+
+        ResultsStore(std::string path);
+
+        int num_records() const;
+        const ResultsStoreEntry& entry(int i_record) const;
+
+        std::vector<int> find(std::string irradiation_conditions) const;
+        int findLatest(std::string irradiation_conditions) const;
+        std::vector<int> findBetween(long long start_time, long long end_time) const;
+
+        void read(int i_record, StoredSpectrum& stored_spectrum) const;
+
+        static void append(std::string path, std::vector<double>& energy_bins, StoredSpectrum& stored_spectrum);
+
+        static bool isStore(std::string path);
+
+    private:
+        std::string path;
+        std::vector<ResultsStoreEntry> entries; // in file order
+        std::multimap<std::string, int> conditions_index;
+        std::multimap<long long, int> timestamp_index;
+
+        static const char MAGIC[8];
+        static const int VERSION;
+};
+
+int saveSpectrumToStore(std::string path, std::vector<double>& energy_bins, std::string irradiation_conditions,
+    std::string algorithm, std::vector<double>& spectrum, std::vector<double>& uncertainty_upper,
+    std::vector<double>& uncertainty_lower, double dose, double dose_uncertainty_upper,
+    double dose_uncertainty_lower
+);
+
+int readStoredSpectra(std::string file_name, std::vector<std::string>& header_vector, std::vector<double>& energy_bins,
+    std::vector<std::vector<double>>& spectra_vector, std::vector<std::vector<double>>& error_lower_vector,
+    std::vector<std::vector<double>>& error_upper_vector, bool plot_per_mu, std::vector<int>& number_mu,
+    std::vector<int>& duration, std::vector<std::string>& selected_spectra
+);
+
+int exportStoreToCSV(std::string store_path, std::string csv_path);
+
+#endif
@@ -0,0 +1,132 @@
+#ifndef STREAMING_STATISTICS_H
+#define STREAMING_STATISTICS_H
+
+#include <string>
+#include <vector>
+
+//--------------------------------------------------------------------------------------------------
+// Streaming estimate of a single quantile, using the P-square algorithm (Jain & Chlamtac 1985, "The
+// P2 algorithm for dynamic calculation of quantiles and histograms without storing observations").
+// Only five markers are kept, so memory does not depend on the number of observations. With fewer
+// than five observations the exact (linearly interpolated) quantile is returned.
+//--------------------------------------------------------------------------------------------------
+class P2Quantile {
+    public:
+        double probability;
+        long num_observations;
+
+        P2Quantile(double probability = 0.5);
+
+        void add(double value);
+        double value() const;
+
+    private:
+        double heights[5]; // marker heights (quantile estimates)
+        double positions[5]; // actual marker positions
+        double desired_positions[5];
+        double increments[5]; // change in the desired positions per observation
+
+        double parabolic(int i_marker, double direction) const;
+        double linear(int i_marker, double direction) const;
+};
+
+//--------------------------------------------------------------------------------------------------
+// Running statistics of one sampled quantity, updated one sample at a time:
+//  - mean & variance (Welford's algorithm), minimum & maximum
+//  - root-mean-square deviation from a reference value (e.g. the nominal unfolded value). The
+//    squared deviations are summed in the order the samples are added, exactly as calculateRMSD does
+//  - optionally, a lower & upper quantile (P2Quantile)
+//--------------------------------------------------------------------------------------------------
+class StreamingStatistics {
+    public:
+        double reference_value;
+        long num_samples;
+        double mean;
+        double minimum;
+        double maximum;
+        double sum_sq_mean_diff; // sum of squared deviations from the running mean
+        double sum_sq_reference_diff; // sum of squared deviations from reference_value
+        bool track_quantiles;
+        P2Quantile lower_quantile;
+        P2Quantile upper_quantile;
+
+        StreamingStatistics(double reference_value = 0, bool track_quantiles = false,
+            double lower_probability = 0.5, double upper_probability = 0.5);
+
+        void add(double value);
+
+        double variance() const; // sample variance (n-1 denominator)
+        double rmsd() const;
+};
+
+//--------------------------------------------------------------------------------------------------
+// Uncertainty statistics of the Monte Carlo uncertainty samples (uncertainty_type = poisson or
+// gaussian): one StreamingStatistics per energy bin of the sampled spectra, plus one for the
+// sampled ambient dose equivalent, with the nominal (unfolded) values as reference. Memory is
+// O(num_bins) regardless of the number of samples. The # of iterations used to unfold each sample
+// is also recorded, along with the # of samples that could not be started from the nominal
+// spectrum when sample_initialization = nominal (see uncertainty_sampling.cpp), and whether the
+// sampling stopped early because the uncertainties converged (uncertainty_rel_tol > 0).
+//
+// The uncertainty bands are either:
+//  - rmsd: root-mean-square deviation of the samples from the nominal value (same upper & lower)
+//  - percentile: distance from the nominal value to the percentiles of the samples bounding the
+//    central 68.27% (i.e. +/- 1 sigma for a normal distribution). Asymmetric; each side is zero if
+//    the nominal value lies outside the interval on that side.
+//--------------------------------------------------------------------------------------------------
+class UncertaintyStatistics {
+    public:
+        static const double LOWER_PERCENTILE;
+        static const double UPPER_PERCENTILE;
+
+        std::string uncertainty_bands;
+        std::vector<StreamingStatistics> spectrum; // dimension: num_bins
+        StreamingStatistics dose;
+        StreamingStatistics num_iterations;
+        int num_input_starts;
+        bool converged;
+
+        UncertaintyStatistics(std::vector<double>& nominal_spectrum, double nominal_dose,
+            std::string uncertainty_bands);
+
+        void addSample(const std::vector<double>& sampled_spectrum, double sampled_dose,
+            int sample_iterations);
+
+        long num_samples() const;
+
+        void getSpectrumUncertainty(std::vector<double>& uncertainty_lower,
+            std::vector<double>& uncertainty_upper) const;
+        void getDoseUncertainty(double& uncertainty_lower, double& uncertainty_upper) const;
+
+    private:
+        void getBand(const StreamingStatistics& statistics, double& uncertainty_lower,
+            double& uncertainty_upper) const;
+};
+
+//--------------------------------------------------------------------------------------------------
+// Convergence check of the Monte Carlo uncertainties, used to stop sampling once the uncertainties
+// no longer change (uncertainty_rel_tol > 0). update is called after each batch of samples: it
+// compares the dose uncertainty and the spectrum uncertainty (all energy bins, as a vector) with
+// those of the previous batch. The uncertainties have converged once both relative changes
+//  |u_batch - u_previous| / |u_batch|
+// are at most rel_tol. The first batch only sets the reference values.
+//--------------------------------------------------------------------------------------------------
+class UncertaintyConvergence {
+    public:
+        double rel_tol;
+        double dose_change; // relative change over the last batch (-1 until two batches are done)
+        double spectrum_change;
+
+        UncertaintyConvergence(double rel_tol);
+
+        bool update(const UncertaintyStatistics& statistics);
+
+    private:
+        bool has_previous;
+        std::vector<double> previous_spectrum; // lower & upper uncertainty of each bin
+        std::vector<double> previous_dose; // lower & upper uncertainty
+        std::vector<double> spectrum_lower;
+        std::vector<double> spectrum_upper;
+};
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef SURFACE_GRID_H
+#define SURFACE_GRID_H
+
+#include <string>
+#include <vector>
+
+//--------------------------------------------------------------------------------------------------
+// 2D grid of values plotted by plot_surface, e.g. a parameter of interest as a function of the # of
+// iterations (x) and beta (y), as written by unfold_trend (algorithm=map). Each cell spans from an
+// edge to the next on both axes; the edges are midway between the x & y values of the file (see
+// readSurfaceGrid), so wide & irregularly spaced grids are drawn without interpolating.
+//--------------------------------------------------------------------------------------------------
+class SurfaceGrid {
+    public:
+        std::vector<double> x_edges; // dimension: num_x + 1, increasing
+        std::vector<double> y_edges; // dimension: num_y + 1, increasing
+        std::vector<double> values; // row-major: value of cell (i_x, i_y) is values[i_y*num_x + i_x]
+
+        int num_x() const { return x_edges.size() - 1; }
+        int num_y() const { return y_edges.size() - 1; }
+        double at(int i_x, int i_y) const { return values[i_y*num_x() + i_x]; }
+};
+
+void readSurfaceGrid(std::string file_name, SurfaceGrid& grid);
+
+void reduceSurfaceGrid(const SurfaceGrid& grid, int max_x_cells, int max_y_cells,
+    std::string cell_aggregation, SurfaceGrid& reduced_grid);
+
+#endif
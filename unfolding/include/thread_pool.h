@@ -0,0 +1,56 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//--------------------------------------------------------------------------------------------------
+// A fixed set of worker threads that execute parallel loops. parallelFor runs a task once for each
+// index in [0, num_tasks); indices are handed out to threads on demand. Each invocation of the
+// task is also given the index of the thread running it (0 to size()-1), so callers can keep one
+// set of buffers per thread. The calling thread takes part in the loop as thread 0, so a pool of
+// size 1 runs everything serially on the calling thread without starting any workers.
+//--------------------------------------------------------------------------------------------------
+class ThreadPool {
+    public:
+        typedef std::function<void(int thread_index, int task_index)> Task;
+
+        ThreadPool(int num_threads);
+        ~ThreadPool();
+
+        int size() const { return num_threads; }
+
+        void parallelFor(int num_tasks, const Task& task);
+
+        static int resolveNumThreads(int num_threads);
+
+    private:
+        int num_threads;
+        std::vector<std::thread> workers;
+
+        std::mutex mutex;
+        std::condition_variable start_condition;
+        std::condition_variable done_condition;
+        bool stopping;
+        unsigned long generation; // incremented each time a new loop is started
+        int num_busy; // number of workers still running the current loop
+
+        // Current loop (valid while generation is unchanged)
+        const Task* task;
+        int num_tasks;
+        std::atomic<int> next_task;
+        std::exception_ptr first_exception;
+
+        ThreadPool(const ThreadPool&);
+        ThreadPool& operator=(const ThreadPool&);
+
+        void workerLoop(int thread_index);
+        void runTasks(int thread_index);
+};
+
+#endif
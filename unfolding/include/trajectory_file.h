@@ -0,0 +1,63 @@
+#ifndef TRAJECTORY_FILE_H
+#define TRAJECTORY_FILE_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "response_matrix.h"
+#include "unfolding_workspace.h"
+
+//--------------------------------------------------------------------------------------------------
+// State of an unfolding trajectory after num_iterations iterations: the values needed to continue
+// unfolding (spectrum) and to calculate quantities of interest (mlem_estimate, mlem_correction; the
+// mlem_ratio is recalculated from the estimate).
+//--------------------------------------------------------------------------------------------------
+class TrajectoryCheckpoint {
+    public:
+        int num_iterations;
+        std::vector<double> spectrum;
+        std::vector<double> mlem_estimate;
+        std::vector<double> mlem_correction;
+};
+
+//--------------------------------------------------------------------------------------------------
+// Binary file of the checkpoints of one unfolding trajectory, so that the trajectory can be
+// reused or extended by later runs instead of being unfolded again from the input spectrum.
+//
+// The file starts with a header identifying the trajectory (algorithm, dimensions and a fingerprint
+// of the settings & inputs that determine it), followed by one record per checkpoint:
+//  int32 num_iterations, double spectrum[num_bins], double mlem_estimate[num_measurements],
+//  double mlem_correction[num_bins]
+// Values are stored in the native byte order. Records are appended as checkpoints are saved, so
+// an interrupted run loses at most the checkpoint being written (incomplete records are dropped
+// when the file is opened).
+//--------------------------------------------------------------------------------------------------
+class TrajectoryFile {
+    public:
+        TrajectoryFile(std::string path, std::string algorithm, double error, double relaxation,
+            int num_measurements, int num_bins, std::vector<double>& measurements,
+            std::vector<double>& initial_spectrum, ResponseMatrix& nns_response);
+
+        int num_checkpoints() const;
+
+        int restoreLatest(int max_iterations, int current_iterations, std::vector<double>& measurements,
+            std::vector<double>& spectrum, UnfoldingWorkspace& workspace) const;
+
+        void save(int num_iterations, std::vector<double>& spectrum, UnfoldingWorkspace& workspace);
+
+    private:
+        std::string path;
+        int num_measurements;
+        int num_bins;
+        std::map<int, TrajectoryCheckpoint> checkpoints; // key: num_iterations
+
+        static const char MAGIC[8];
+        static const int VERSION;
+
+        void load(std::string algorithm, unsigned long long fingerprint);
+        void create(std::string algorithm, unsigned long long fingerprint);
+        void append(const TrajectoryCheckpoint& checkpoint);
+};
+
+#endif
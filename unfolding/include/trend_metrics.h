@@ -0,0 +1,53 @@
+#ifndef TREND_METRICS_H
+#define TREND_METRICS_H
+
+#include <string>
+#include <vector>
+
+#include "unfolding_workspace.h"
+
+//--------------------------------------------------------------------------------------------------
+// State of an unfolding trajectory at one of the sampled numbers of iterations (index i_num), from
+// which the parameters of interest are calculated. workspace holds the buffers from the last
+// iteration (mlem_ratio, mlem_estimate, energy_correction).
+//--------------------------------------------------------------------------------------------------
+class TrendPoint {
+    public:
+        int i_num;
+        int num_measurements;
+        int num_bins;
+        std::vector<double>& measurements;
+        std::vector<double>& spectrum;
+        std::vector<double>& icrp_factors;
+        std::vector<double>& ref_spectrum; // empty unless a metric requires it
+        UnfoldingWorkspace& workspace;
+
+        TrendPoint(int i_num, int num_measurements, int num_bins, std::vector<double>& measurements,
+            std::vector<double>& spectrum, std::vector<double>& icrp_factors,
+            std::vector<double>& ref_spectrum, UnfoldingWorkspace& workspace);
+};
+
+typedef double (*TrendMetricFunction)(TrendPoint& point);
+
+//--------------------------------------------------------------------------------------------------
+// A parameter of interest that can be calculated by unfold_trend:
+//  - label: header of the row in the mlem trend file ("" = use the irradiation conditions)
+//  - requires_ref_spectrum: calculated relative to the reference spectrum (path_ref_spectrum)
+//  - map_only: only meaningful for MAP (e.g. uses the MAP energy correction)
+//--------------------------------------------------------------------------------------------------
+class TrendMetric {
+    public:
+        std::string name;
+        std::string label;
+        bool requires_ref_spectrum;
+        bool map_only;
+        TrendMetricFunction calculate;
+};
+
+std::vector<TrendMetric> getTrendMetrics(std::string parameters_of_interest, std::string algorithm);
+
+bool requiresRefSpectrum(std::vector<TrendMetric>& metrics);
+
+std::string getTrendOutputPath(std::string path_output_trend, std::string metric_name, int num_metrics);
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef UNCERTAINTY_SAMPLING_H
+#define UNCERTAINTY_SAMPLING_H
+
+#include <vector>
+
+#include "custom_classes.h"
+#include "response_matrix.h"
+#include "streaming_statistics.h"
+#include "thread_pool.h"
+
+int runUncertaintySamples(UnfoldingSettings& settings, ThreadPool& pool, unsigned long seed,
+    int num_measurements, int num_bins, std::vector<double>& measurements,
+    std::vector<double>& std_errors, std::vector<double>& initial_spectrum,
+    std::vector<double>& nominal_spectrum, ResponseMatrix& nns_response,
+    std::vector<double>& icrp_factors, UncertaintyStatistics& statistics
+);
+
+#endif
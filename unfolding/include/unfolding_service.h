@@ -0,0 +1,57 @@
+#ifndef UNFOLDING_SERVICE_H
+#define UNFOLDING_SERVICE_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "custom_classes.h"
+#include "response_matrix.h"
+
+class RequestQueue;
+
+// Settings that a request may change for its own measurement set (e.g. algorithm, beta), and how
+// they are applied. Also used for the variants of a campaign (see campaign_runner.h).
+bool isRequestSetting(std::string name);
+void applyRequestSetting(UnfoldingSettings& request_settings, std::string name, std::string value);
+
+// JSON string literal (quoted & escaped) of text
+std::string jsonString(const std::string& text);
+
+// JSON number (null if not finite) or array of numbers, written to output. The precision of output
+// must be set by the caller.
+void writeJsonNumber(std::ostream& output, double value);
+void writeJsonArray(std::ostream& output, std::vector<double>& values);
+
+//--------------------------------------------------------------------------------------------------
+// Resident unfolding service (unfold_spectrum.exe --serve). The energy bins, NNS response, guess
+// spectrum and ICRP factors are read once, then measurement sets are unfolded on request. Requests
+// and responses are JSON objects, one per line (see instructions_unfold_spectrum.md), read from a
+// stream (stdin) or from the connections to a Unix socket. Requests are unfolded concurrently by a
+// pool of settings.num_threads threads; each response is written as soon as it is ready, so
+// responses may be out of order (the "id" of the request is echoed).
+//--------------------------------------------------------------------------------------------------
+class UnfoldingService {
+    public:
+        UnfoldingService(UnfoldingSettings& settings);
+
+        std::string handleRequest(std::string request);
+        std::string unfoldMeasurements(std::string id, UnfoldingSettings& request_settings,
+            std::vector<double> measurements, bool& succeeded);
+
+        void serveStream(std::istream& input, std::ostream& output);
+        void serveSocket(std::string path_socket);
+
+    private:
+        UnfoldingSettings settings; // defaults for every request (f_factor in nA/cps)
+        int num_measurements;
+        int num_bins;
+        std::vector<double> energy_bins;
+        ResponseMatrix nns_response;
+        std::vector<double> initial_spectrum;
+        std::vector<double> icrp_factors;
+
+        void dispatch(RequestQueue& queue);
+};
+
+#endif
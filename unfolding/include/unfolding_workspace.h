@@ -0,0 +1,37 @@
+#ifndef UNFOLDING_WORKSPACE_H
+#define UNFOLDING_WORKSPACE_H
+
+#include <vector>
+
+//--------------------------------------------------------------------------------------------------
+// This class owns every per-iteration buffer used by the unfolding algorithms (runMLEM,
+// runMLEMSTOP, runMAP, ...) as well as the per-sample buffers used when generating Monte Carlo
+// uncertainty samples. The buffers are sized once from the problem dimensions and are overwritten
+// in place on each iteration, so no memory is allocated inside the unfolding loops. After an
+// algorithm returns, the buffers hold the values from its final iteration.
+//--------------------------------------------------------------------------------------------------
+class UnfoldingWorkspace {
+    public:
+        int num_measurements;
+        int num_bins;
+        int num_adjacent; // number of neighbours on either side of a bin used by the MAP priors
+
+        std::vector<double> mlem_ratio; // ratio between measured data and MLEM estimated data
+        std::vector<double> mlem_correction; // correction factors applied in each spectral bin
+        std::vector<double> mlem_estimate; // MLEM estimated data
+        std::vector<double> energy_correction; // MAP energy correction term for each spectral bin
+        std::vector<double> neighbours; // window of spectral values used by the mrp prior
+        std::vector<double> squarem_start; // spectrum at the start of a SQUAREM cycle
+        std::vector<double> squarem_step; // spectrum after the first MLEM step of a SQUAREM cycle
+
+        std::vector<double> sampled_measurements; // pseudo-measurement set for an uncertainty sample
+        std::vector<double> sampled_spectrum; // spectrum unfolded from sampled_measurements
+        std::vector<double> sampled_variates; // raw random draws for one sample (sized by the sampler)
+
+        UnfoldingWorkspace();
+        UnfoldingWorkspace(int num_measurements, int num_bins);
+
+        void resize(int num_measurements, int num_bins);
+};
+
+#endif
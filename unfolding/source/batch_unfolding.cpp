@@ -0,0 +1,216 @@
+//**************************************************************************************************
+// The functions included in this module unfold several measurement sets at once with the same
+// response matrix. The measurement sets are stacked as the columns of a matrix, so that each MLEM
+// iteration is a single matrix-matrix product (see mlemStepBatch in mlem_kernels.h).
+//**************************************************************************************************
+
+#include "batch_unfolding.h"
+#include "mlem_kernels.h"
+#include "physics_calculations.h"
+
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+// Return true if the unfolding of column i_col should end. workspace holds the column's mlem_ratio
+// and mlem_estimate for the current iteration.
+typedef std::function<bool(int i_col, UnfoldingWorkspace& workspace)> BatchStoppingCriterion;
+
+//==================================================================================================
+// Columns of the batch that are still being unfolded, packed contiguously: element (row, k) of
+// each buffer belongs to column columns[k] and is stored at [row*batch_stride + k]. The padding
+// columns (k >= num_active) are unfolded along with the others, so they are given measurements &
+// spectra of 1 to keep their arithmetic finite.
+//==================================================================================================
+class ActiveColumns {
+    public:
+        std::vector<int> columns;
+        int num_active;
+        int batch_stride;
+
+        AlignedVector measurements;
+        AlignedVector spectra;
+        AlignedVector mlem_estimates;
+        AlignedVector mlem_ratios;
+        AlignedVector mlem_corrections;
+
+        ActiveColumns(int num_measurements, int num_bins, std::vector<std::vector<double>>& measurements,
+            std::vector<std::vector<double>>& spectra)
+        {
+            int num_columns = measurements.size();
+            for (int i_col = 0; i_col < num_columns; i_col++) {
+                columns.push_back(i_col);
+            }
+            num_active = num_columns;
+            batch_stride = paddedStride(num_active);
+            resize(num_measurements, num_bins);
+
+            for (int k = 0; k < num_active; k++) {
+                for (int i_meas = 0; i_meas < num_measurements; i_meas++) {
+                    this->measurements[i_meas*batch_stride + k] = measurements[k][i_meas];
+                }
+                for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+                    this->spectra[i_bin*batch_stride + k] = spectra[k][i_bin];
+                }
+            }
+        }
+
+        // Copy column k out of a packed buffer with num_rows rows
+        void gather(const AlignedVector& packed, int num_rows, int k, std::vector<double>& column) const {
+            for (int i_row = 0; i_row < num_rows; i_row++) {
+                column[i_row] = packed[i_row*batch_stride + k];
+            }
+        }
+
+        // Remove the columns for which keep[k] is false, preserving the order of the others
+        void compact(int num_measurements, int num_bins, const std::vector<bool>& keep) {
+            std::vector<int> kept;
+            for (int k = 0; k < num_active; k++) {
+                if (keep[k]) {
+                    kept.push_back(k);
+                }
+            }
+            int num_kept = kept.size();
+            int kept_stride = paddedStride(num_kept);
+            compactBuffer(measurements, num_measurements, kept, kept_stride);
+            compactBuffer(spectra, num_bins, kept, kept_stride);
+            compactBuffer(mlem_estimates, num_measurements, kept, kept_stride);
+            compactBuffer(mlem_ratios, num_measurements, kept, kept_stride);
+            compactBuffer(mlem_corrections, num_bins, kept, kept_stride);
+
+            std::vector<int> kept_columns;
+            for (int i_kept = 0; i_kept < num_kept; i_kept++) {
+                kept_columns.push_back(columns[kept[i_kept]]);
+            }
+            columns = kept_columns;
+            num_active = num_kept;
+            batch_stride = kept_stride;
+        }
+
+    private:
+        static int paddedStride(int num_columns) {
+            return ((num_columns + 7) / 8) * 8;
+        }
+
+        void resize(int num_measurements, int num_bins) {
+            measurements.assign(num_measurements*batch_stride, 1.0);
+            spectra.assign(num_bins*batch_stride, 1.0);
+            mlem_estimates.assign(num_measurements*batch_stride, 1.0);
+            mlem_ratios.assign(num_measurements*batch_stride, 1.0);
+            mlem_corrections.assign(num_bins*batch_stride, 1.0);
+        }
+
+        void compactBuffer(AlignedVector& packed, int num_rows, const std::vector<int>& kept, int kept_stride) {
+            int num_kept = kept.size();
+            AlignedVector compacted(num_rows*kept_stride, 1.0);
+            for (int i_row = 0; i_row < num_rows; i_row++) {
+                for (int i_kept = 0; i_kept < num_kept; i_kept++) {
+                    compacted[i_row*kept_stride + i_kept] = packed[i_row*batch_stride + kept[i_kept]];
+                }
+            }
+            packed.swap(compacted);
+        }
+};
+
+//==================================================================================================
+// Unfold all columns of the batch with MLEM steps until each one meets the stopping criterion or
+// the cutoff is reached. Same iteration count semantics as runMLEM.
+//==================================================================================================
+static void runBatch(int cutoff, int num_measurements, int num_bins,
+    std::vector<std::vector<double>>& measurements, std::vector<std::vector<double>>& spectra,
+    ResponseMatrix& nns_response, std::vector<UnfoldingWorkspace>& workspaces,
+    std::vector<int>& num_iterations, const BatchStoppingCriterion& stop)
+{
+    int num_columns = measurements.size();
+    if ((int) spectra.size() != num_columns) {
+        throw std::logic_error("Batch unfolding requires one initial spectrum per measurement set");
+    }
+    workspaces.resize(num_columns);
+    num_iterations.assign(num_columns, cutoff);
+    for (int i_col = 0; i_col < num_columns; i_col++) {
+        workspaces[i_col].resize(num_measurements, num_bins);
+    }
+
+    ActiveColumns active(num_measurements, num_bins, measurements, spectra);
+    const MLEMKernels& kernels = selectMLEMKernels(nns_response);
+
+    for (int mlem_index = 0; mlem_index < cutoff && active.num_active > 0; mlem_index++) {
+        kernels.mlemStepBatch(nns_response, active.num_active, active.batch_stride, &active.measurements[0],
+            &active.spectra[0], &active.mlem_estimates[0], &active.mlem_ratios[0],
+            &active.mlem_corrections[0]);
+
+        std::vector<bool> keep(active.num_active, true);
+        bool any_finished = false;
+        for (int k = 0; k < active.num_active; k++) {
+            int i_col = active.columns[k];
+            UnfoldingWorkspace& workspace = workspaces[i_col];
+            active.gather(active.mlem_ratios, num_measurements, k, workspace.mlem_ratio);
+            active.gather(active.mlem_estimates, num_measurements, k, workspace.mlem_estimate);
+            if (stop(i_col, workspace)) {
+                num_iterations[i_col] = mlem_index;
+                keep[k] = false;
+                any_finished = true;
+            }
+        }
+
+        // Columns that have finished, or all columns once the cutoff is reached, are copied out
+        bool last_iteration = mlem_index == cutoff-1;
+        if (any_finished || last_iteration) {
+            for (int k = 0; k < active.num_active; k++) {
+                if (!keep[k] || last_iteration) {
+                    int i_col = active.columns[k];
+                    active.gather(active.spectra, num_bins, k, spectra[i_col]);
+                    active.gather(active.mlem_corrections, num_bins, k, workspaces[i_col].mlem_correction);
+                }
+            }
+            active.compact(num_measurements, num_bins, keep);
+        }
+    }
+}
+
+//==================================================================================================
+// Batched runMLEM: each column ends once all of its ratios are within the target error
+//==================================================================================================
+void runMLEMBatch(int cutoff, double error, int num_measurements, int num_bins,
+    std::vector<std::vector<double>>& measurements, std::vector<std::vector<double>>& spectra,
+    ResponseMatrix& nns_response, std::vector<UnfoldingWorkspace>& workspaces,
+    std::vector<int>& num_iterations)
+{
+    runBatch(cutoff, num_measurements, num_bins, measurements, spectra, nns_response, workspaces,
+        num_iterations, [&](int i_col, UnfoldingWorkspace& workspace) {
+            for (int i_meas = 0; i_meas < num_measurements; i_meas++) {
+                if (workspace.mlem_ratio[i_meas] >= (1+error) || workspace.mlem_ratio[i_meas] <= (1-error)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    );
+}
+
+//==================================================================================================
+// Batched runMLEMSTOP: each column ends once its J factor is below its J threshold
+//==================================================================================================
+void runMLEMSTOPBatch(int cutoff, int num_measurements, int num_bins,
+    std::vector<std::vector<double>>& measurements, std::vector<std::vector<double>>& spectra,
+    ResponseMatrix& nns_response, std::vector<UnfoldingWorkspace>& workspaces,
+    std::vector<double>& j_thresholds, std::vector<double>& j_factors,
+    std::vector<int>& num_iterations, std::vector<int>& converged)
+{
+    int num_columns = measurements.size();
+    j_factors.assign(num_columns, 0.0);
+
+    runBatch(cutoff, num_measurements, num_bins, measurements, spectra, nns_response, workspaces,
+        num_iterations, [&](int i_col, UnfoldingWorkspace& workspace) {
+            j_factors[i_col] = calculateJFactor(num_measurements, measurements[i_col], workspace.mlem_estimate);
+            return j_factors[i_col] <= j_thresholds[i_col];
+        }
+    );
+
+    converged.assign(num_columns, 1);
+    for (int i_col = 0; i_col < num_columns; i_col++) {
+        if (num_iterations[i_col] >= cutoff && j_factors[i_col] > j_thresholds[i_col]) {
+            converged[i_col] = 0;
+        }
+    }
+}
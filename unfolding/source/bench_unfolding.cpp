@@ -0,0 +1,355 @@
+//**************************************************************************************************
+// This program benchmarks the unfolding building blocks: the unfolding algorithms (MLEM, MLEM-STOP,
+// and MAP with each prior), one uncertainty sample, and the input file readers. Each benchmark is
+// run on the shipped inputs (input/) and on synthetic NNS responses from 8x52 up to 256x2000, so
+// that changes to the unfolding code can be compared between commits. Results are printed and saved
+// to a CSV file with one row per benchmark & response size.
+//
+// Usage: ./bench_unfolding.exe [--output <csv_file>] [--repetitions <n>] [--mlem_kernel <name>]
+//**************************************************************************************************
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+// Local
+#include "binary_input.h"
+#include "csv_table.h"
+#include "custom_classes.h"
+#include "fileio.h"
+#include "handle_args.h"
+#include "mlem_kernels.h"
+#include "physics_calculations.h"
+#include "response_matrix.h"
+#include "streaming_statistics.h"
+#include "thread_pool.h"
+#include "uncertainty_sampling.h"
+#include "unfolding_workspace.h"
+
+// # of response multiply-adds (num_measurements x num_bins per iteration) that each unfolding
+// benchmark performs, so that every response size takes a comparable time
+const double WORK_PER_RUN = 2e7;
+const int MIN_ITERATIONS = 10;
+const double MAP_BETA = 1e-9;
+
+//--------------------------------------------------------------------------------------------------
+// Inputs of one benchmark case: a response, energy bins, a "true" spectrum, the measurements it
+// produces (forward projection, so every algorithm converges) and a flat guess spectrum
+//--------------------------------------------------------------------------------------------------
+class BenchCase {
+    public:
+        std::string name;
+        int num_measurements;
+        int num_bins;
+        ResponseMatrix nns_response;
+        std::vector<double> energy_bins;
+        std::vector<double> measurements;
+        std::vector<double> initial_spectrum;
+        std::vector<double> icrp_factors;
+        std::vector<std::vector<double>> response_rows; // as read from or written to a CSV file
+};
+
+class BenchResult {
+    public:
+        std::string benchmark;
+        std::string case_name;
+        int num_measurements;
+        int num_bins;
+        int num_iterations;
+        std::string mlem_kernel;
+        std::vector<double> seconds; // one per repetition
+};
+
+//==================================================================================================
+// Return the measurements produced by a spectrum (nns_response x spectrum)
+//==================================================================================================
+static std::vector<double> forwardProject(ResponseMatrix& nns_response, std::vector<double>& spectrum) {
+    std::vector<double> measurements(nns_response.num_measurements);
+    getActiveMLEMKernels().forwardProject(nns_response, &spectrum[0], &measurements[0]);
+    return measurements;
+}
+
+//==================================================================================================
+// Benchmark case using the shipped He-3 response, energy bins & ICRP factors. The measurements are
+// those of the step guess spectrum, and unfolding starts from the uniform guess spectrum.
+//==================================================================================================
+static BenchCase getShippedCase() {
+    BenchCase bench_case;
+    bench_case.name = "shipped";
+    readInputFile1D("input/energy_bins.csv", bench_case.energy_bins);
+    readInputCSV2D("input/response_nns_he3.csv", bench_case.response_rows);
+    bench_case.nns_response = ResponseMatrix(bench_case.response_rows);
+    bench_case.num_measurements = bench_case.nns_response.num_measurements;
+    bench_case.num_bins = bench_case.nns_response.num_bins;
+    readInputFile1D("input/icrp_conversion_coefficients.csv", bench_case.icrp_factors);
+    readInputFile1D("input/spectrum_uniform.csv", bench_case.initial_spectrum);
+
+    std::vector<double> true_spectrum;
+    readInputFile1D("input/spectrum_step.csv", true_spectrum);
+    bench_case.measurements = forwardProject(bench_case.nns_response, true_spectrum);
+    return bench_case;
+}
+
+//==================================================================================================
+// Synthetic benchmark case of num_measurements x num_bins. Energies are log-spaced from 1e-9 to
+// 20 MeV; the response of each measurement is a log-normal bump whose peak moves to higher energies
+// with the measurement index (like the NNS shells), plus a small random background. The same
+// (fixed seed) values are generated on every run.
+//==================================================================================================
+static BenchCase getSyntheticCase(int num_measurements, int num_bins) {
+    BenchCase bench_case;
+    std::ostringstream name;
+    name << "synthetic_" << num_measurements << "x" << num_bins;
+    bench_case.name = name.str();
+    bench_case.num_measurements = num_measurements;
+    bench_case.num_bins = num_bins;
+
+    double log_min = log10(1e-9);
+    double log_max = log10(20.0);
+    for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+        bench_case.energy_bins.push_back(pow(10, log_min + (log_max-log_min)*i_bin/(num_bins-1)));
+    }
+
+    std::mt19937 generator(20191126);
+    std::uniform_real_distribution<double> background(0.0, 0.05);
+    bench_case.response_rows.assign(num_measurements, std::vector<double>(num_bins));
+    for (int i_meas = 0; i_meas < num_measurements; i_meas++) {
+        double peak = log_min + (log_max-log_min)*(i_meas+0.5)/num_measurements;
+        for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+            double x = (log10(bench_case.energy_bins[i_bin]) - peak) / 2.0;
+            bench_case.response_rows[i_meas][i_bin] = exp(-x*x) + background(generator);
+        }
+    }
+    bench_case.nns_response = ResponseMatrix(bench_case.response_rows);
+
+    // Thermal & fast peaks
+    std::vector<double> true_spectrum(num_bins);
+    for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+        double log_energy = log10(bench_case.energy_bins[i_bin]);
+        true_spectrum[i_bin] = 5000*exp(-pow(log_energy+7.5, 2)) + 800*exp(-pow(log_energy, 2)/0.5) + 300;
+    }
+    bench_case.measurements = forwardProject(bench_case.nns_response, true_spectrum);
+    bench_case.initial_spectrum.assign(num_bins, 1000);
+    bench_case.icrp_factors.assign(num_bins, 100);
+    return bench_case;
+}
+
+//==================================================================================================
+// Time function repetitions times (after one untimed warm-up call)
+//==================================================================================================
+static std::vector<double> timeRepetitions(int repetitions, std::function<void()> function) {
+    function();
+    std::vector<double> seconds;
+    for (int i_rep = 0; i_rep < repetitions; i_rep++) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        function();
+        seconds.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    return seconds;
+}
+
+static double getMedian(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    int num_values = values.size();
+    if (num_values % 2 == 1) {
+        return values[num_values/2];
+    }
+    return (values[num_values/2-1] + values[num_values/2]) / 2;
+}
+
+//==================================================================================================
+// Run every benchmark on one case and add the results
+//==================================================================================================
+static void benchmarkCase(BenchCase& bench_case, int repetitions, std::vector<BenchResult>& results) {
+    int num_measurements = bench_case.num_measurements;
+    int num_bins = bench_case.num_bins;
+    int num_iterations = std::max(MIN_ITERATIONS, (int) (WORK_PER_RUN / ((double) num_measurements*num_bins)));
+    UnfoldingWorkspace workspace(num_measurements, num_bins);
+    std::vector<double> spectrum;
+
+    BenchResult result;
+    result.case_name = bench_case.name;
+    result.num_measurements = num_measurements;
+    result.num_bins = num_bins;
+    result.num_iterations = num_iterations;
+    result.mlem_kernel = selectMLEMKernels(bench_case.nns_response).name;
+
+    // MLEM, for a fixed # of iterations (error = 0, so never stops early)
+    result.benchmark = "runMLEM";
+    result.seconds = timeRepetitions(repetitions, [&]() {
+        spectrum = bench_case.initial_spectrum;
+        runMLEM(num_iterations, 0, num_measurements, num_bins, bench_case.measurements, spectrum,
+            bench_case.nns_response, workspace);
+    });
+    results.push_back(result);
+
+    // MLEM-STOP, with the J threshold reached after num_iterations iterations of MLEM
+    double j_threshold = calculateJFactor(num_measurements, bench_case.measurements, workspace.mlem_estimate);
+    double j_factor;
+    result.benchmark = "runMLEMSTOP";
+    result.seconds = timeRepetitions(repetitions, [&]() {
+        spectrum = bench_case.initial_spectrum;
+        result.num_iterations = runMLEMSTOP(num_iterations+1, num_measurements, num_bins,
+            bench_case.measurements, spectrum, bench_case.nns_response, workspace, j_threshold, j_factor) + 1;
+    });
+    results.push_back(result);
+    result.num_iterations = num_iterations;
+
+    // MAP, for each prior
+    const std::string priors[] = {"quadratic", "quadratic_normalized", "mrp", "meanrp", "gaussians"};
+    for (int i_prior = 0; i_prior < 5; i_prior++) {
+        result.benchmark = "runMAP_" + priors[i_prior];
+        result.seconds = timeRepetitions(repetitions, [&]() {
+            spectrum = bench_case.initial_spectrum;
+            runMAP(MAP_BETA, priors[i_prior], num_iterations, 0, num_measurements, num_bins,
+                bench_case.measurements, spectrum, bench_case.nns_response, workspace);
+        });
+        results.push_back(result);
+    }
+
+    // One Poisson uncertainty sample (MLEM, num_iterations iterations) on a single thread
+    UnfoldingSettings settings;
+    settings.set_algorithm("mlem");
+    settings.set_cutoff(num_iterations);
+    settings.set_error(0);
+    settings.set_uncertainty_type("poisson");
+    settings.set_num_uncertainty_samples(1);
+    spectrum = bench_case.initial_spectrum;
+    runMLEM(num_iterations, 0, num_measurements, num_bins, bench_case.measurements, spectrum,
+        bench_case.nns_response, workspace);
+    double dose = calculateDose(num_bins, spectrum, bench_case.icrp_factors);
+    std::vector<double> std_errors;
+    ThreadPool pool(1);
+    result.benchmark = "uncertainty_sample";
+    result.seconds = timeRepetitions(repetitions, [&]() {
+        UncertaintyStatistics statistics(spectrum, dose, settings.uncertainty_bands);
+        runUncertaintySamples(settings, pool, 1, num_measurements, num_bins, bench_case.measurements,
+            std_errors, bench_case.initial_spectrum, spectrum, bench_case.nns_response,
+            bench_case.icrp_factors, statistics);
+    });
+    results.push_back(result);
+
+    //----------------------------------------------------------------------------------------------
+    // Input file readers, on the response written as CSV & binary input files
+    //----------------------------------------------------------------------------------------------
+    result.num_iterations = 0;
+    std::string path_csv = "output/bench_response_" + bench_case.name + ".csv";
+    std::string path_binary = getBinaryInputPath(path_csv);
+    std::ofstream csv_file(path_csv);
+    csv_file << std::setprecision(17);
+    for (int i_meas = 0; i_meas < num_measurements; i_meas++) {
+        for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+            csv_file << bench_case.response_rows[i_meas][i_bin] << (i_bin < num_bins-1 ? "," : "\n");
+        }
+    }
+    csv_file.close();
+    BinaryInputFile::write(path_binary, bench_case.response_rows);
+
+    result.benchmark = "readInputCSV2D";
+    result.seconds = timeRepetitions(repetitions, [&]() {
+        std::vector<std::vector<double>> rows;
+        readInputCSV2D(path_csv, rows);
+    });
+    results.push_back(result);
+
+    result.benchmark = "CSVTable";
+    result.seconds = timeRepetitions(repetitions, [&]() {
+        CSVTable table(path_csv, "benchmark response");
+    });
+    results.push_back(result);
+
+    result.benchmark = "readResponseFile_binary";
+    result.seconds = timeRepetitions(repetitions, [&]() {
+        ResponseMatrix response = readResponseFile(path_binary);
+    });
+    results.push_back(result);
+
+    remove(path_csv.c_str());
+    remove(path_binary.c_str());
+}
+
+int main(int argc, char* argv[])
+{
+    std::vector<std::string> arg_vector;
+    for (int i = 1; i < argc; i++) {
+        arg_vector.push_back(argv[i]);
+    }
+    std::vector<std::string> input_file_flags;
+    input_file_flags.push_back("--output");
+    input_file_flags.push_back("--repetitions");
+    input_file_flags.push_back("--mlem_kernel");
+
+    std::string path_output;
+    std::string repetitions_string;
+    std::string mlem_kernel;
+    setfile(arg_vector, "--output", "output/bench_unfolding.csv", path_output);
+    setfile(arg_vector, "--repetitions", "5", repetitions_string);
+    setfile(arg_vector, "--mlem_kernel", "auto", mlem_kernel);
+    checkUnknownParameters(arg_vector, input_file_flags);
+
+    int repetitions = atoi(repetitions_string.c_str());
+    if (repetitions < 1) {
+        throw std::logic_error("Number of repetitions must be >= 1");
+    }
+    setMLEMKernels(mlem_kernel);
+
+    std::vector<BenchCase> cases;
+    cases.push_back(getShippedCase());
+    const int synthetic_sizes[][2] = {{8, 52}, {16, 100}, {32, 250}, {64, 500}, {128, 1000}, {256, 2000}};
+    for (int i_size = 0; i_size < 6; i_size++) {
+        cases.push_back(getSyntheticCase(synthetic_sizes[i_size][0], synthetic_sizes[i_size][1]));
+    }
+
+    std::vector<BenchResult> results;
+    for (int i_case = 0; i_case < (int) cases.size(); i_case++) {
+        std::cout << "Benchmarking " << cases[i_case].name << " (MLEM kernel: "
+            << selectMLEMKernels(cases[i_case].nns_response).name << ")\n";
+        benchmarkCase(cases[i_case], repetitions, results);
+    }
+
+    //----------------------------------------------------------------------------------------------
+    // Save & display the results. Times are the minimum & median over the repetitions; the time per
+    // iteration (if applicable) is based on the minimum.
+    //----------------------------------------------------------------------------------------------
+    std::ofstream bfile(path_output);
+    if (!bfile.is_open()) {
+        throw std::logic_error("Unable to create benchmark output file: " + path_output);
+    }
+    bfile << "benchmark,case,num_measurements,num_bins,num_iterations,repetitions,min_seconds,"
+        << "median_seconds,seconds_per_iteration,mlem_kernel,git_commit\n";
+    bfile << std::setprecision(6);
+
+    std::cout << "\n" << std::left << std::setw(28) << "Benchmark" << std::setw(24) << "Case"
+        << std::setw(12) << "Iterations" << std::setw(16) << "Min (ms)" << std::setw(16) << "Median (ms)"
+        << "Per iteration (us)\n";
+    for (int i_result = 0; i_result < (int) results.size(); i_result++) {
+        BenchResult& result = results[i_result];
+        double min_seconds = *std::min_element(result.seconds.begin(), result.seconds.end());
+        double median_seconds = getMedian(result.seconds);
+        double seconds_per_iteration = result.num_iterations > 0 ? min_seconds/result.num_iterations : 0;
+
+        bfile << result.benchmark << "," << result.case_name << "," << result.num_measurements << ","
+            << result.num_bins << "," << result.num_iterations << "," << repetitions << "," << min_seconds
+            << "," << median_seconds << "," << seconds_per_iteration << "," << result.mlem_kernel << ","
+            << GIT_COMMIT << "\n";
+
+        std::cout << std::left << std::setw(28) << result.benchmark << std::setw(24) << result.case_name
+            << std::setw(12) << result.num_iterations << std::setw(16) << min_seconds*1e3
+            << std::setw(16) << median_seconds*1e3 << seconds_per_iteration*1e6 << "\n";
+    }
+    bfile.close();
+    std::cout << "\nSaved benchmark results to " << path_output << "\n";
+
+    return 0;
+}
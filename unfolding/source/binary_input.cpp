@@ -0,0 +1,173 @@
+//**************************************************************************************************
+// The functions included in this module write and load the binary copies of the CSV input files
+// (see binary_input.h). Binary files are memory-mapped, so that their values are used in place
+// instead of being parsed.
+//**************************************************************************************************
+
+#include "binary_input.h"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const char BinaryInputFile::MAGIC[8] = {'N','N','S','I','N','P','U','T'};
+const int BinaryInputFile::VERSION = 1;
+
+// Layout of the header that precedes the values. Its size (32 bytes) keeps the values aligned.
+struct BinaryInputHeader {
+    char magic[8];
+    int32_t version;
+    int32_t num_rows;
+    int32_t num_columns;
+    int32_t unused;
+    uint64_t checksum;
+};
+
+//==================================================================================================
+// 64 bit FNV-1a hash of the values
+//==================================================================================================
+static uint64_t checksumValues(const double* values, std::size_t num_values) {
+    const unsigned char* data = (const unsigned char*) values;
+    uint64_t hash = 14695981039346656037ULL;
+    for (std::size_t i_byte = 0; i_byte < num_values*sizeof(double); i_byte++) {
+        hash ^= data[i_byte];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Map the binary input file at path into memory. Throws if the file cannot be mapped, is not a
+// binary input file, or its values do not match the checksum (e.g. truncated or corrupted file).
+//--------------------------------------------------------------------------------------------------
+BinaryInputFile::BinaryInputFile(std::string path) {
+    int file_descriptor = open(path.c_str(), O_RDONLY);
+    if (file_descriptor < 0) {
+        throw std::logic_error("Unable to open input file: " + path);
+    }
+    struct stat file_status;
+    if (fstat(file_descriptor, &file_status) != 0 || file_status.st_size < (off_t) sizeof(BinaryInputHeader)) {
+        close(file_descriptor);
+        throw std::logic_error("Not a binary input file: " + path);
+    }
+    mapping_size = file_status.st_size;
+    mapping = mmap(NULL, mapping_size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+    close(file_descriptor);
+    if (mapping == MAP_FAILED) {
+        throw std::logic_error("Unable to map input file: " + path);
+    }
+
+    const BinaryInputHeader* header = (const BinaryInputHeader*) mapping;
+    values = (const double*) ((const char*) mapping + sizeof(BinaryInputHeader));
+    num_rows = header->num_rows;
+    num_columns = header->num_columns;
+
+    std::string error_message;
+    if (memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 || header->version != VERSION
+        || num_rows < 0 || num_columns < 0)
+    {
+        error_message = "Not a binary input file: " + path;
+    }
+    else if (mapping_size != sizeof(BinaryInputHeader) + (std::size_t) num_rows*num_columns*sizeof(double)
+        || checksumValues(values, (std::size_t) num_rows*num_columns) != header->checksum)
+    {
+        error_message = "Binary input file " + path + " is corrupted. Please convert it again";
+    }
+    if (!error_message.empty()) {
+        munmap(mapping, mapping_size);
+        throw std::logic_error(error_message);
+    }
+}
+
+BinaryInputFile::~BinaryInputFile() {
+    munmap(mapping, mapping_size);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Write rows (e.g. as read from a CSV input file) to a binary input file at path. All rows must
+// have the same number of values.
+//--------------------------------------------------------------------------------------------------
+void BinaryInputFile::write(std::string path, std::vector<std::vector<double>>& rows) {
+    int num_rows = rows.size();
+    int num_columns = num_rows > 0 ? rows[0].size() : 0;
+    std::vector<double> values;
+    values.reserve((std::size_t) num_rows*num_columns);
+    for (int i_row = 0; i_row < num_rows; i_row++) {
+        if ((int) rows[i_row].size() != num_columns) {
+            std::ostringstream error_message;
+            error_message << "Cannot convert " << path << ": row " << i_row << " has "
+                << rows[i_row].size() << " values but row 0 has " << num_columns;
+            throw std::logic_error(error_message.str());
+        }
+        values.insert(values.end(), rows[i_row].begin(), rows[i_row].end());
+    }
+
+    BinaryInputHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.num_rows = num_rows;
+    header.num_columns = num_columns;
+    header.checksum = checksumValues(values.data(), values.size());
+
+    std::ofstream bfile(path, std::ios::binary | std::ios::trunc);
+    if (!bfile.is_open()) {
+        throw std::logic_error("Unable to create binary input file: " + path);
+    }
+    bfile.write((const char*) &header, sizeof(header));
+    bfile.write((const char*) values.data(), values.size()*sizeof(double));
+    if (!bfile) {
+        throw std::logic_error("Unable to write binary input file: " + path);
+    }
+}
+
+//==================================================================================================
+// Return the path of the binary copy of a CSV input file: the extension is replaced by .bin (e.g.
+// input/response_nns_he3.csv -> input/response_nns_he3.bin)
+//==================================================================================================
+std::string getBinaryInputPath(std::string csv_path) {
+    size_t extension_start = csv_path.rfind('.');
+    size_t directory_end = csv_path.rfind('/');
+    if (extension_start == std::string::npos
+        || (directory_end != std::string::npos && extension_start < directory_end))
+    {
+        return csv_path + ".bin";
+    }
+    return csv_path.substr(0, extension_start) + ".bin";
+}
+
+//==================================================================================================
+// Determine whether an input file should be loaded from a binary input file, and which one:
+//  - file_name itself, if it has the .bin extension
+//  - the binary copy next to the CSV file (see getBinaryInputPath), if it exists. A copy that is
+//    older than the CSV file is ignored (with a warning), as the CSV file was edited since.
+//==================================================================================================
+bool findBinaryInput(std::string file_name, std::string& binary_path) {
+    if (file_name.size() > 4 && file_name.compare(file_name.size()-4, 4, ".bin") == 0) {
+        binary_path = file_name;
+        return true;
+    }
+
+    std::string candidate = getBinaryInputPath(file_name);
+    struct stat binary_status;
+    if (candidate == file_name || stat(candidate.c_str(), &binary_status) != 0) {
+        return false;
+    }
+    struct stat csv_status;
+    if (stat(file_name.c_str(), &csv_status) == 0 && csv_status.st_mtime > binary_status.st_mtime) {
+        std::cerr << "Warning: ignored " << candidate << ", which is older than " << file_name << "\n";
+        return false;
+    }
+    binary_path = candidate;
+    return true;
+}
@@ -0,0 +1,280 @@
+//**************************************************************************************************
+// The functions included in this module run unfolding campaigns (see campaign_runner.h): every
+// measurements file is unfolded with every variant of the swept settings, as the unfolding service
+// unfolds a request. The shared inputs (energy bins, NNS response, guess spectrum, ICRP factors)
+// are read once by the service, and each measurements file once. Jobs are run concurrently and the
+// results are written to a single JSON-lines file, in job order.
+//**************************************************************************************************
+
+#include "campaign_runner.h"
+#include "custom_classes.h"
+#include "fileio.h"
+#include "thread_pool.h"
+#include "unfolding_service.h"
+
+#include <chrono>
+#include <climits>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+//==================================================================================================
+// Remove leading & trailing whitespace (incl. the \r of files with Windows line endings)
+//==================================================================================================
+static std::string trimWhitespace(const std::string& text) {
+    size_t first = text.find_first_not_of(" \t\r");
+    if (first == std::string::npos) {
+        return "";
+    }
+    size_t last = text.find_last_not_of(" \t\r");
+    return text.substr(first, last - first + 1);
+}
+
+//==================================================================================================
+// CampaignSpec
+//==================================================================================================
+long CampaignSpec::numVariants() const {
+    long num_variants = 1;
+    for (size_t i_axis = 0; i_axis < axes.size(); i_axis++) {
+        num_variants *= axes[i_axis].values.size();
+    }
+    return num_variants;
+}
+
+long CampaignSpec::numJobs() const {
+    return measurement_files.size() * numVariants();
+}
+
+//--------------------------------------------------------------------------------------------------
+// Value of each axis in variant i_variant (the last axis varies fastest)
+//--------------------------------------------------------------------------------------------------
+static std::vector<std::string> variantValues(const CampaignSpec& spec, long i_variant) {
+    std::vector<std::string> values(spec.axes.size());
+    long remainder = i_variant;
+    for (int i_axis = spec.axes.size() - 1; i_axis >= 0; i_axis--) {
+        const std::vector<std::string>& axis_values = spec.axes[i_axis].values;
+        values[i_axis] = axis_values[remainder % axis_values.size()];
+        remainder /= axis_values.size();
+    }
+    return values;
+}
+
+//==================================================================================================
+// Read a campaign spec file. Each non-empty line that does not start with '#' is
+// <setting>=<value>,<value>,..., where <setting> is path_measurements (the measurements files) or a
+// setting that the unfolding service accepts per request (e.g. algorithm, mlem_cutoff, beta). If no
+// measurements files are listed, settings.path_measurements is used.
+//==================================================================================================
+CampaignSpec readCampaignSpec(std::string path_spec, UnfoldingSettings& settings) {
+    std::ifstream spec_file(path_spec);
+    if (!spec_file.is_open()) {
+        throw std::logic_error("Unable to access campaign file: " + path_spec);
+    }
+
+    CampaignSpec spec;
+    std::string line;
+    while (getline(spec_file, line)) {
+        line = trimWhitespace(line);
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        size_t delimiter = line.find('=');
+        if (delimiter == std::string::npos) {
+            throw std::logic_error("Invalid campaign line (expected <setting>=<values>): " + line);
+        }
+
+        CampaignAxis axis;
+        axis.name = trimWhitespace(line.substr(0, delimiter));
+        std::istringstream value_stream(line.substr(delimiter + 1));
+        std::string value;
+        while (getline(value_stream, value, ',')) {
+            value = trimWhitespace(value);
+            if (!value.empty()) {
+                axis.values.push_back(value);
+            }
+        }
+        if (axis.values.empty()) {
+            throw std::logic_error("No values provided for campaign setting: " + axis.name);
+        }
+
+        bool duplicate = axis.name == "path_measurements" && !spec.measurement_files.empty();
+        for (size_t i_axis = 0; i_axis < spec.axes.size(); i_axis++) {
+            duplicate = duplicate || spec.axes[i_axis].name == axis.name;
+        }
+        if (duplicate) {
+            throw std::logic_error("Campaign setting provided more than once: " + axis.name);
+        }
+
+        if (axis.name == "path_measurements") {
+            spec.measurement_files = axis.values;
+        }
+        else if (isRequestSetting(axis.name)) {
+            spec.axes.push_back(axis);
+        }
+        else {
+            throw std::logic_error("Setting cannot be varied in a campaign: " + axis.name
+                + " (see the settings accepted per request by the service)");
+        }
+    }
+
+    if (spec.measurement_files.empty()) {
+        spec.measurement_files.push_back(settings.path_measurements);
+    }
+    return spec;
+}
+
+//==================================================================================================
+// Measurements file read for a campaign: the values (file order) and the header settings that
+// getMeasurements reads. If the file could not be read, error is set instead.
+//==================================================================================================
+class CampaignMeasurements {
+    public:
+        std::string error;
+        std::vector<double> values;
+        std::string irradiation_conditions;
+        int dose_mu;
+        int doserate_mu;
+        int duration;
+};
+
+static std::string measurementsKey(const std::string& path_measurements, const std::string& meas_units) {
+    return meas_units + ":" + path_measurements; // the header lines read depend on meas_units
+}
+
+//==================================================================================================
+// Writes the results of the jobs in job order, as they complete (results that complete out of order
+// are held until the preceding ones have been written)
+//==================================================================================================
+class OrderedOutput {
+    public:
+        OrderedOutput(std::ostream& output) : output(output) {
+            next_index = 0;
+        }
+
+        void write(long index, const std::string& line) {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending[index] = line;
+            while (!pending.empty() && pending.begin()->first == next_index) {
+                output << pending.begin()->second << '\n';
+                pending.erase(pending.begin());
+                next_index++;
+            }
+        }
+
+    private:
+        std::ostream& output;
+        std::mutex mutex;
+        std::map<long, std::string> pending;
+        long next_index;
+};
+
+//==================================================================================================
+// Run every job of the campaign on settings.num_threads threads and write one JSON line per job to
+// path_output: {"job":<index>,"path_measurements":...,"settings":{<swept settings>},"result":<the
+// service response>}. A job that fails (e.g. MLEM-STOP does not converge, or its measurements file
+// cannot be read) has a result with "status":"error" and does not stop the campaign.
+//==================================================================================================
+CampaignSummary runCampaign(UnfoldingSettings& settings, CampaignSpec& spec, std::string path_output) {
+    std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+
+    long num_jobs = spec.numJobs();
+    long num_variants = spec.numVariants();
+    if (num_jobs > INT_MAX) {
+        throw std::logic_error("Too many campaign jobs: " + std::to_string(num_jobs));
+    }
+
+    // Settings of each variant, applied once rather than for every job
+    std::vector<UnfoldingSettings> variants(num_variants, settings);
+    for (long i_variant = 0; i_variant < num_variants; i_variant++) {
+        std::vector<std::string> values = variantValues(spec, i_variant);
+        for (size_t i_axis = 0; i_axis < spec.axes.size(); i_axis++) {
+            applyRequestSetting(variants[i_variant], spec.axes[i_axis].name, values[i_axis]);
+        }
+    }
+
+    // Read each measurements file once (per meas_units used by the variants)
+    std::map<std::string, CampaignMeasurements> measurements_cache;
+    for (size_t i_file = 0; i_file < spec.measurement_files.size(); i_file++) {
+        for (long i_variant = 0; i_variant < num_variants; i_variant++) {
+            std::string key = measurementsKey(spec.measurement_files[i_file], variants[i_variant].meas_units);
+            if (measurements_cache.count(key)) {
+                continue;
+            }
+            CampaignMeasurements& measurements = measurements_cache[key];
+            UnfoldingSettings file_settings = variants[i_variant];
+            file_settings.set_path_measurements(spec.measurement_files[i_file]);
+            try {
+                measurements.values = getMeasurements(file_settings);
+            }
+            catch (std::exception& error) {
+                measurements.error = error.what();
+            }
+            measurements.irradiation_conditions = file_settings.irradiation_conditions;
+            measurements.dose_mu = file_settings.dose_mu;
+            measurements.doserate_mu = file_settings.doserate_mu;
+            measurements.duration = file_settings.duration;
+        }
+    }
+
+    std::ofstream output_file(path_output);
+    if (!output_file.is_open()) {
+        throw std::logic_error("Unable to open campaign output file: " + path_output);
+    }
+    OrderedOutput output(output_file);
+
+    UnfoldingService service(settings);
+    ThreadPool pool(settings.num_threads);
+    std::vector<long> thread_failures(pool.size(), 0);
+
+    pool.parallelFor(num_jobs, [&](int i_thread, int i_job) {
+        const std::string& path_measurements = spec.measurement_files[i_job / num_variants];
+        long i_variant = i_job % num_variants;
+        UnfoldingSettings job_settings = variants[i_variant];
+        const CampaignMeasurements& measurements
+            = measurements_cache.find(measurementsKey(path_measurements, job_settings.meas_units))->second;
+
+        std::string id = std::to_string(i_job);
+        std::string result;
+        bool succeeded = false;
+        if (!measurements.error.empty()) {
+            result = "{\"id\":" + id + ",\"status\":\"error\",\"error\":" + jsonString(measurements.error) + "}";
+        }
+        else {
+            // Header lines of the file override the settings, as in unfold_spectrum
+            job_settings.irradiation_conditions = measurements.irradiation_conditions;
+            job_settings.dose_mu = measurements.dose_mu;
+            job_settings.doserate_mu = measurements.doserate_mu;
+            job_settings.duration = measurements.duration;
+            result = service.unfoldMeasurements(id, job_settings, measurements.values, succeeded);
+        }
+        if (!succeeded) {
+            thread_failures[i_thread]++;
+        }
+
+        std::ostringstream line;
+        line << "{\"job\":" << i_job << ",\"path_measurements\":" << jsonString(path_measurements) << ",\"settings\":{";
+        std::vector<std::string> axis_values = variantValues(spec, i_variant);
+        for (size_t i_axis = 0; i_axis < spec.axes.size(); i_axis++) {
+            line << (i_axis > 0 ? "," : "") << jsonString(spec.axes[i_axis].name) << ":" << jsonString(axis_values[i_axis]);
+        }
+        line << "},\"result\":" << result << "}";
+        output.write(i_job, line.str());
+    });
+    output_file.close();
+
+    CampaignSummary summary;
+    summary.num_jobs = num_jobs;
+    summary.num_failed = 0;
+    for (size_t i_thread = 0; i_thread < thread_failures.size(); i_thread++) {
+        summary.num_failed += thread_failures[i_thread];
+    }
+    summary.num_measurement_files_read = measurements_cache.size();
+    summary.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    return summary;
+}
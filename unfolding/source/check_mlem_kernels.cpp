@@ -0,0 +1,163 @@
+//**************************************************************************************************
+// This program checks the MLEM kernels (see mlem_kernels.h). Every kernel supported by the CPU is
+// run for a fixed # of MLEM iterations on the shipped He-3 response (input/) and on synthetic
+// responses whose dimensions are not multiples of the SIMD widths, so that the masked tails of the
+// rows are exercised (and the fixed-geometry variants on the 8x52 responses). Each resulting
+// spectrum must be:
+//  - bit-identical to that of the scalar kernel (compareMLEMKernels)
+//  - within REFERENCE_TOLERANCE of that of the division-based loops the kernels replaced
+//    (compareMLEMReference)
+// One line is printed per kernel & response, and the exit status is non-zero if any check fails.
+//
+// Usage: ./check_mlem_kernels.exe (or make check)
+//**************************************************************************************************
+
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Local
+#include "fileio.h"
+#include "mlem_kernels.h"
+#include "response_matrix.h"
+
+const int NUM_ITERATIONS = 200;
+// Largest relative difference allowed from the division-based loops after NUM_ITERATIONS
+const double REFERENCE_TOLERANCE = 1e-12;
+
+//--------------------------------------------------------------------------------------------------
+// Inputs of one check: a response, the measurements of a "true" spectrum (its forward projection)
+// and the spectrum unfolding starts from
+//--------------------------------------------------------------------------------------------------
+class CheckCase {
+    public:
+        std::string name;
+        ResponseMatrix nns_response;
+        std::vector<double> measurements;
+        std::vector<double> initial_spectrum;
+};
+
+//==================================================================================================
+// Return the measurements produced by a spectrum (nns_response x spectrum)
+//==================================================================================================
+static std::vector<double> forwardProject(ResponseMatrix& nns_response, std::vector<double>& spectrum) {
+    std::vector<double> measurements(nns_response.num_measurements);
+    getMLEMKernels("scalar").forwardProject(nns_response, &spectrum[0], &measurements[0]);
+    return measurements;
+}
+
+//==================================================================================================
+// Check case using the shipped He-3 response. The measurements are those of the step guess
+// spectrum, and unfolding starts from the uniform guess spectrum.
+//==================================================================================================
+static CheckCase getShippedCase() {
+    CheckCase check_case;
+    check_case.name = "shipped";
+    std::vector<std::vector<double>> response_rows;
+    readInputFile2D("input/response_nns_he3.csv", response_rows);
+    check_case.nns_response = ResponseMatrix(response_rows);
+    readInputFile1D("input/spectrum_uniform.csv", check_case.initial_spectrum);
+
+    std::vector<double> true_spectrum;
+    readInputFile1D("input/spectrum_step.csv", true_spectrum);
+    check_case.measurements = forwardProject(check_case.nns_response, true_spectrum);
+    return check_case;
+}
+
+//==================================================================================================
+// Synthetic check case of num_measurements x num_bins: the response of each measurement is a bump
+// whose peak moves across the bins with the measurement index, plus a small random background, and
+// the true spectrum has a low & a high energy peak. The same (fixed seed) values are generated on
+// every run.
+//==================================================================================================
+static CheckCase getSyntheticCase(int num_measurements, int num_bins) {
+    CheckCase check_case;
+    std::ostringstream name;
+    name << "synthetic_" << num_measurements << "x" << num_bins;
+    check_case.name = name.str();
+
+    std::mt19937 generator(20191126);
+    std::uniform_real_distribution<double> background(0.0, 0.05);
+    std::vector<std::vector<double>> response_rows(num_measurements, std::vector<double>(num_bins));
+    for (int i_meas = 0; i_meas < num_measurements; i_meas++) {
+        double peak = (i_meas+0.5)/num_measurements;
+        for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+            double x = ((i_bin+0.5)/num_bins - peak)*4;
+            response_rows[i_meas][i_bin] = exp(-x*x) + background(generator);
+        }
+    }
+    check_case.nns_response = ResponseMatrix(response_rows);
+
+    std::vector<double> true_spectrum(num_bins);
+    for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+        double x_low = ((i_bin+0.5)/num_bins - 0.2)*8;
+        double x_high = ((i_bin+0.5)/num_bins - 0.8)*8;
+        true_spectrum[i_bin] = 100*exp(-x_low*x_low) + 300*exp(-x_high*x_high) + 1;
+    }
+    check_case.measurements = forwardProject(check_case.nns_response, true_spectrum);
+    check_case.initial_spectrum.assign(num_bins, 1.0);
+    return check_case;
+}
+
+//==================================================================================================
+// Print the result of one check, and return whether it passed
+//==================================================================================================
+static bool reportCheck(std::string case_name, std::string kernel_label, std::string check_name,
+    double difference, double tolerance)
+{
+    bool passed = (difference <= tolerance);
+    std::cout << std::left << std::setw(20) << case_name << std::setw(24) << kernel_label
+        << std::setw(12) << check_name << (passed ? "ok" : "FAILED") << " (max relative difference: "
+        << difference << ", allowed: " << tolerance << ")\n";
+    return passed;
+}
+
+int main()
+{
+    std::vector<CheckCase> cases;
+    cases.push_back(getShippedCase());
+    const int check_sizes[][2] = {{8, 52}, {3, 5}, {5, 13}, {7, 51}, {9, 53}, {11, 97}, {17, 203}};
+    for (int i_size = 0; i_size < 7; i_size++) {
+        cases.push_back(getSyntheticCase(check_sizes[i_size][0], check_sizes[i_size][1]));
+    }
+
+    std::vector<std::string> kernel_names = getAvailableMLEMKernels();
+    int num_failures = 0;
+    for (int i_case = 0; i_case < (int) cases.size(); i_case++) {
+        CheckCase& check_case = cases[i_case];
+        bool fixed_geometry_case = (check_case.nns_response.num_measurements == 8
+            && check_case.nns_response.num_bins == 52);
+        for (int i_kernel = 0; i_kernel < (int) kernel_names.size(); i_kernel++) {
+            // Only the SIMD kernels have fixed-geometry variants
+            bool has_fixed_geometry = fixed_geometry_case && kernel_names[i_kernel] != "scalar";
+            for (int fixed_geometry = 0; fixed_geometry <= (has_fixed_geometry ? 1 : 0); fixed_geometry++) {
+                std::string kernel_label = kernel_names[i_kernel] + (fixed_geometry ? " (fixed 8x52)" : "");
+                double scalar_difference = compareMLEMKernels(kernel_names[i_kernel],
+                    check_case.nns_response, check_case.measurements, check_case.initial_spectrum,
+                    NUM_ITERATIONS, fixed_geometry);
+                if (!reportCheck(check_case.name, kernel_label, "scalar", scalar_difference, 0)) {
+                    num_failures++;
+                }
+                double reference_difference = compareMLEMReference(kernel_names[i_kernel],
+                    check_case.nns_response, check_case.measurements, check_case.initial_spectrum,
+                    NUM_ITERATIONS, fixed_geometry);
+                if (!reportCheck(check_case.name, kernel_label, "reference", reference_difference,
+                    REFERENCE_TOLERANCE))
+                {
+                    num_failures++;
+                }
+            }
+        }
+    }
+
+    if (num_failures > 0) {
+        std::cout << num_failures << " MLEM kernel check(s) failed\n";
+        return 1;
+    }
+    std::cout << "All MLEM kernel checks passed\n";
+    return 0;
+}
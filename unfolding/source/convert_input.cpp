@@ -0,0 +1,58 @@
+//**************************************************************************************************
+// This program converts CSV input files (NNS response functions, energy bins, ICRP conversion
+// factors, guess spectra) to binary input files. Each binary file is written next to its CSV file,
+// with the extension replaced by .bin (e.g. input/response_nns_he3.bin), where it is automatically
+// used instead of the CSV file by the unfolding applications.
+//
+// Usage: ./convert_input.exe <csv_file> [<csv_file> ...]
+//
+// It also exports the spectra of a results store (path_results_store) to an unfolded spectrum CSV
+// file, for use by tools that read the CSV format:
+//
+// Usage: ./convert_input.exe --export-store <results_store> <csv_file>
+//**************************************************************************************************
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Local
+#include "binary_input.h"
+#include "fileio.h"
+#include "results_store.h"
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2) {
+        std::cout << "Usage: " << argv[0] << " <csv_file> [<csv_file> ...]\n";
+        std::cout << "       " << argv[0] << " --export-store <results_store> <csv_file>\n";
+        return 1;
+    }
+
+    if (std::string(argv[1]) == "--export-store") {
+        if (argc != 4) {
+            throw std::logic_error("Usage: " + std::string(argv[0]) + " --export-store <results_store> <csv_file>");
+        }
+        int num_spectra = exportStoreToCSV(argv[2], argv[3]);
+        std::cout << "Exported " << num_spectra << " spectra from " << argv[2] << " to " << argv[3] << "\n";
+        return 0;
+    }
+
+    for (int i_arg = 1; i_arg < argc; i_arg++) {
+        std::string csv_path = argv[i_arg];
+        std::string binary_path = getBinaryInputPath(csv_path);
+        if (binary_path == csv_path) {
+            throw std::logic_error("Input file is already a binary input file: " + csv_path);
+        }
+
+        std::vector<std::vector<double>> rows;
+        readInputCSV2D(csv_path, rows);
+        BinaryInputFile::write(binary_path, rows);
+
+        std::cout << "Converted " << csv_path << " to " << binary_path << " (" << rows.size() << " x "
+            << (rows.empty() ? 0 : rows[0].size()) << " values)\n";
+    }
+
+    return 0;
+}
@@ -0,0 +1,186 @@
+//**************************************************************************************************
+// The functions included in this module read CSV files in bulk (see csv_table.h) for the
+// applications that load large, accumulated output files (e.g. spectra to be plotted).
+//**************************************************************************************************
+
+#include "csv_table.h"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+// Exact powers of ten (the largest that are exactly representable as doubles)
+static const double EXACT_POWERS_OF_TEN[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16,
+    1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+static const int MAX_EXACT_POWER_OF_TEN = 22;
+static const uint64_t MAX_EXACT_MANTISSA = 1ULL << 53;
+
+//==================================================================================================
+// Convert text with strtod, and assign the end of the number to end (if not NULL)
+//==================================================================================================
+static double convertWithStrtod(const char* text, const char** end) {
+    char* number_end;
+    double value = strtod(text, &number_end);
+    if (end != NULL) {
+        *end = number_end;
+    }
+    return value;
+}
+
+//==================================================================================================
+// Convert the number at the start of text as atof/strtod do, and assign the end of the number to
+// end (if not NULL). Plain decimal numbers whose digits and exponent are exactly representable
+// (e.g. 0.000631, 1.23e-05, the format written by the applications) are converted with a single
+// correctly rounded multiplication or division, which gives the same result as strtod. Anything
+// else (more digits, large exponents, whitespace, inf, nan, hexadecimal, ...) is left to strtod.
+//==================================================================================================
+double parseCSVNumber(const char* text, const char** end) {
+    const char* cursor = text;
+    bool negative = (*cursor == '-');
+    if (negative) {
+        cursor++;
+    }
+
+    uint64_t mantissa = 0;
+    int num_digits = 0;
+    int exponent = 0;
+    while (*cursor >= '0' && *cursor <= '9') {
+        if (mantissa > MAX_EXACT_MANTISSA/10) {
+            return convertWithStrtod(text, end);
+        }
+        mantissa = mantissa*10 + (*cursor - '0');
+        num_digits++;
+        cursor++;
+    }
+    if (*cursor == 'x' || *cursor == 'X') { // hexadecimal
+        return convertWithStrtod(text, end);
+    }
+    if (*cursor == '.') {
+        cursor++;
+        while (*cursor >= '0' && *cursor <= '9') {
+            if (mantissa > MAX_EXACT_MANTISSA/10) {
+                return convertWithStrtod(text, end);
+            }
+            mantissa = mantissa*10 + (*cursor - '0');
+            num_digits++;
+            exponent--;
+            cursor++;
+        }
+    }
+    if (num_digits == 0 || mantissa > MAX_EXACT_MANTISSA) {
+        return convertWithStrtod(text, end);
+    }
+    if (*cursor == 'e' || *cursor == 'E') {
+        cursor++;
+        bool negative_exponent = (*cursor == '-');
+        if (*cursor == '-' || *cursor == '+') {
+            cursor++;
+        }
+        if (!(*cursor >= '0' && *cursor <= '9')) {
+            return convertWithStrtod(text, end);
+        }
+        int written_exponent = 0;
+        while (*cursor >= '0' && *cursor <= '9') {
+            if (written_exponent > 1000) {
+                return convertWithStrtod(text, end);
+            }
+            written_exponent = written_exponent*10 + (*cursor - '0');
+            cursor++;
+        }
+        exponent += negative_exponent ? -written_exponent : written_exponent;
+    }
+    if (exponent < -MAX_EXACT_POWER_OF_TEN || exponent > MAX_EXACT_POWER_OF_TEN) {
+        return convertWithStrtod(text, end);
+    }
+
+    if (end != NULL) {
+        *end = cursor;
+    }
+    double value = (double) mantissa;
+    if (exponent < 0) {
+        value /= EXACT_POWERS_OF_TEN[-exponent];
+    }
+    else {
+        value *= EXACT_POWERS_OF_TEN[exponent];
+    }
+    return negative ? -value : value;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Read the file in one pass and split it into rows & fields. file_description is used in the error
+// thrown if the file cannot be opened (e.g. "spectrum" -> "Unable to open spectrum file: ...").
+//--------------------------------------------------------------------------------------------------
+CSVTable::CSVTable(std::string file_name, std::string file_description) {
+    std::ifstream ifile(file_name, std::ios::binary);
+    if (!ifile.is_open()) {
+        throw std::logic_error("Unable to open " + file_description + " file: " + file_name);
+    }
+    ifile.seekg(0, std::ios::end);
+    size_t file_size = ifile.tellg();
+    ifile.seekg(0, std::ios::beg);
+    buffer.resize(file_size + 1);
+    ifile.read(&buffer[0], file_size);
+    buffer[file_size] = '\0';
+
+    // Reserve the rows & fields up front
+    size_t num_lines = 0;
+    size_t num_commas = 0;
+    for (size_t i_char = 0; i_char < file_size; i_char++) {
+        num_lines += (buffer[i_char] == '\n');
+        num_commas += (buffer[i_char] == ',');
+    }
+    row_starts.reserve(num_lines + 2);
+    fields.reserve(num_lines + num_commas + 1);
+
+    char* line_start = &buffer[0];
+    char* file_end = &buffer[0] + file_size;
+    while (line_start < file_end) {
+        row_starts.push_back(fields.size());
+        char* line_end = (char*) memchr(line_start, '\n', file_end - line_start);
+        if (line_end == NULL) {
+            line_end = file_end;
+        }
+        *line_end = '\0';
+
+        char* field_start = line_start;
+        while (field_start < line_end) {
+            fields.push_back(field_start);
+            char* comma = (char*) memchr(field_start, ',', line_end - field_start);
+            if (comma == NULL) {
+                break;
+            }
+            *comma = '\0';
+            field_start = comma + 1;
+        }
+        line_start = line_end + 1;
+    }
+    row_starts.push_back(fields.size());
+}
+
+//--------------------------------------------------------------------------------------------------
+// Return the numeric value of a field, converted as atof would
+//--------------------------------------------------------------------------------------------------
+double CSVTable::value(int i_row, int i_field) const {
+    return parseCSVNumber(field(i_row, i_field), NULL);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Assign the numeric values of a row, starting at field first_field (e.g. 1 to skip a row header),
+// to row_values
+//--------------------------------------------------------------------------------------------------
+void CSVTable::rowValues(int i_row, int first_field, std::vector<double>& row_values) const {
+    int num_row_fields = num_fields(i_row);
+    row_values.clear();
+    if (num_row_fields > first_field) {
+        row_values.reserve(num_row_fields - first_field);
+    }
+    for (int i_field = first_field; i_field < num_row_fields; i_field++) {
+        row_values.push_back(value(i_row, i_field));
+    }
+}
@@ -11,6 +11,7 @@
 #include <vector>
 #include <algorithm>
 #include <cmath>
+#include <utility>
 
 //--------------------------------------------------------------------------------------------------
 // Default constructor for UnfoldingSettings
@@ -22,6 +23,10 @@ UnfoldingSettings::UnfoldingSettings() {
     cutoff = 15000;
     uncertainty_type = "poisson";
     num_uncertainty_samples = 50;
+    uncertainty_rel_tol = 0;
+    uncertainty_batch_size = 25;
+    uncertainty_bands = "rmsd";
+    sample_initialization = "input";
     num_meas_per_shell = 1;
     meas_units = "nc";
     // Measurement specs
@@ -32,9 +37,18 @@ UnfoldingSettings::UnfoldingSettings() {
     // MAP specific
     beta = 0.0;
     prior = "mrp";
+    num_adjacent = 1;
     // MLEM-STOP specific
     cps_crossover = 30000;
     sigma_j=0.5;
+    // MLEM-OR specific
+    relaxation = 1.5;
+    // MLEM multigrid specific
+    multigrid_levels = 3;
+    multigrid_iterations = 100;
+    // Stream mode specific
+    stream_interval = 1.0;
+    stream_drift_threshold = 0.05;
     // Optimize specific
     iteration_min = 100;
     iteration_max = 10000;
@@ -45,6 +59,7 @@ UnfoldingSettings::UnfoldingSettings() {
     algorithm = "mlem";
     trend_type = "cps";
     path_output_spectra = "output/output_spectra.csv";
+    path_results_store = "";
     generate_report = 1;
     path_report = "";
     generate_figure = 1;
@@ -52,11 +67,16 @@ UnfoldingSettings::UnfoldingSettings() {
     path_output_trend = "output/output_trend.csv";
     derivatives = 0;
     path_measurements = "input/measurements.txt";
+    path_measurements_list = "input/measurements_list.txt";
     path_input_spectrum = "input/spectrum_step.csv";
     path_energy_bins = "input/energy_bins.csv";
     path_system_response = "input/response_nns_he3.csv";
     path_icrp_factors = "input/icrp_conversion_coefficients.csv";
     path_ref_spectrum = "";
+    path_trajectory = "";
+    mlem_kernel = "auto";
+    num_threads = 0;
+    seed = 0;
 }
 
 // Apply a value to a setting:
@@ -76,6 +96,14 @@ void UnfoldingSettings::set_setting(std::string settings_name, std::string setti
         this->set_uncertainty_type(settings_value);
     else if (settings_name == "num_uncertainty_samples")
         this->set_num_uncertainty_samples(atoi(settings_value.c_str()));
+    else if (settings_name == "uncertainty_rel_tol")
+        this->set_uncertainty_rel_tol(atof(settings_value.c_str()));
+    else if (settings_name == "uncertainty_batch_size")
+        this->set_uncertainty_batch_size(atoi(settings_value.c_str()));
+    else if (settings_name == "uncertainty_bands")
+        this->set_uncertainty_bands(settings_value);
+    else if (settings_name == "sample_initialization")
+        this->set_sample_initialization(settings_value);
     else if (settings_name == "num_meas_per_shell")
         this->set_num_meas_per_shell(atoi(settings_value.c_str()));
     else if (settings_name == "meas_units")
@@ -92,10 +120,22 @@ void UnfoldingSettings::set_setting(std::string settings_name, std::string setti
         this->set_beta(atof(settings_value.c_str()));
     else if (settings_name == "prior")
         this->set_prior(settings_value);
+    else if (settings_name == "num_adjacent")
+        this->set_num_adjacent(atoi(settings_value.c_str()));
     else if (settings_name == "cps_crossover")
         this->set_cps_crossover(atoi(settings_value.c_str()));
     else if (settings_name == "sigma_j")
         this->set_sigma_j(atof(settings_value.c_str()));
+    else if (settings_name == "mlem_relaxation")
+        this->set_relaxation(atof(settings_value.c_str()));
+    else if (settings_name == "mlem_multigrid_levels")
+        this->set_multigrid_levels(atoi(settings_value.c_str()));
+    else if (settings_name == "mlem_multigrid_iterations")
+        this->set_multigrid_iterations(atoi(settings_value.c_str()));
+    else if (settings_name == "stream_interval")
+        this->set_stream_interval(atof(settings_value.c_str()));
+    else if (settings_name == "stream_drift_threshold")
+        this->set_stream_drift_threshold(atof(settings_value.c_str()));
     else if (settings_name == "iteration_min")
         this->set_iteration_min(atoi(settings_value.c_str()));
     else if (settings_name == "iteration_max")
@@ -114,6 +154,8 @@ void UnfoldingSettings::set_setting(std::string settings_name, std::string setti
         this->set_trend_type(settings_value);
     else if (settings_name == "path_output_spectra")
         this->set_path_output_spectra(settings_value);
+    else if (settings_name == "path_results_store")
+        this->set_path_results_store(settings_value);
     else if (settings_name == "generate_report")
         this->set_generate_report(atoi(settings_value.c_str()));
     else if (settings_name == "path_report")
@@ -128,6 +170,8 @@ void UnfoldingSettings::set_setting(std::string settings_name, std::string setti
         this->set_derivatives(atoi(settings_value.c_str()));
     else if (settings_name == "path_measurements")
         this->set_path_measurements(settings_value);
+    else if (settings_name == "path_measurements_list")
+        this->set_path_measurements_list(settings_value);
     else if (settings_name == "path_input_spectrum")
         this->set_path_input_spectrum(settings_value);
     else if (settings_name == "path_energy_bins")
@@ -138,6 +182,14 @@ void UnfoldingSettings::set_setting(std::string settings_name, std::string setti
         this->set_path_icrp_factors(settings_value);
     else if (settings_name == "path_ref_spectrum")
         this->set_path_ref_spectrum(settings_value);
+    else if (settings_name == "path_trajectory")
+        this->set_path_trajectory(settings_value);
+    else if (settings_name == "mlem_kernel")
+        this->set_mlem_kernel(settings_value);
+    else if (settings_name == "num_threads")
+        this->set_num_threads(atoi(settings_value.c_str()));
+    else if (settings_name == "seed")
+        this->set_seed(strtoul(settings_value.c_str(), NULL, 10));
     else
         throw std::logic_error("Unrecognized setting: " + settings_name 
             + ". Please refer to the README for allowed settings");
@@ -163,6 +215,18 @@ void UnfoldingSettings::set_uncertainty_type(std::string uncertainty_type) {
 void UnfoldingSettings::set_num_uncertainty_samples(int num_uncertainty_samples) {
     this->num_uncertainty_samples = num_uncertainty_samples;
 }
+void UnfoldingSettings::set_uncertainty_rel_tol(double uncertainty_rel_tol) {
+    this->uncertainty_rel_tol = uncertainty_rel_tol;
+}
+void UnfoldingSettings::set_uncertainty_batch_size(int uncertainty_batch_size) {
+    this->uncertainty_batch_size = uncertainty_batch_size;
+}
+void UnfoldingSettings::set_uncertainty_bands(std::string uncertainty_bands) {
+    this->uncertainty_bands = uncertainty_bands;
+}
+void UnfoldingSettings::set_sample_initialization(std::string sample_initialization) {
+    this->sample_initialization = sample_initialization;
+}
 void UnfoldingSettings::set_num_meas_per_shell(int num_meas_per_shell) {
     this->num_meas_per_shell = num_meas_per_shell;
 }
@@ -187,12 +251,30 @@ void UnfoldingSettings::set_beta(double beta) {
 void UnfoldingSettings::set_prior(std::string prior) {
     this->prior = prior;
 }
+void UnfoldingSettings::set_num_adjacent(int num_adjacent) {
+    this->num_adjacent = num_adjacent;
+}
 void UnfoldingSettings::set_cps_crossover(int cps_crossover) {
     this->cps_crossover = cps_crossover;
 }
 void UnfoldingSettings::set_sigma_j(double sigma_j) {
     this->sigma_j = sigma_j;
 }
+void UnfoldingSettings::set_relaxation(double relaxation) {
+    this->relaxation = relaxation;
+}
+void UnfoldingSettings::set_multigrid_levels(int multigrid_levels) {
+    this->multigrid_levels = multigrid_levels;
+}
+void UnfoldingSettings::set_multigrid_iterations(int multigrid_iterations) {
+    this->multigrid_iterations = multigrid_iterations;
+}
+void UnfoldingSettings::set_stream_interval(double stream_interval) {
+    this->stream_interval = stream_interval;
+}
+void UnfoldingSettings::set_stream_drift_threshold(double stream_drift_threshold) {
+    this->stream_drift_threshold = stream_drift_threshold;
+}
 void UnfoldingSettings::set_iteration_min(int iteration_min) {
     this->iteration_min = iteration_min;
 }
@@ -220,6 +302,9 @@ void UnfoldingSettings::set_trend_type(std::string trend_type) {
 void UnfoldingSettings::set_path_output_spectra(std::string path_output_spectra) {
     this->path_output_spectra = path_output_spectra;
 }
+void UnfoldingSettings::set_path_results_store(std::string path_results_store) {
+    this->path_results_store = path_results_store;
+}
 void UnfoldingSettings::set_generate_report(int generate_report) {
     this->generate_report = generate_report;
 }
@@ -241,6 +326,9 @@ void UnfoldingSettings::set_derivatives(int derivatives) {
 void UnfoldingSettings::set_path_measurements(std::string path_measurements) {
     this->path_measurements = path_measurements;
 }
+void UnfoldingSettings::set_path_measurements_list(std::string path_measurements_list) {
+    this->path_measurements_list = path_measurements_list;
+}
 void UnfoldingSettings::set_path_input_spectrum(std::string path_input_spectrum) {
     this->path_input_spectrum = path_input_spectrum;
 }
@@ -256,6 +344,18 @@ void UnfoldingSettings::set_path_icrp_factors(std::string path_icrp_factors) {
 void UnfoldingSettings::set_path_ref_spectrum(std::string path_ref_spectrum) {
     this->path_ref_spectrum = path_ref_spectrum;
 }
+void UnfoldingSettings::set_path_trajectory(std::string path_trajectory) {
+    this->path_trajectory = path_trajectory;
+}
+void UnfoldingSettings::set_mlem_kernel(std::string mlem_kernel) {
+    this->mlem_kernel = mlem_kernel;
+}
+void UnfoldingSettings::set_num_threads(int num_threads) {
+    this->num_threads = num_threads;
+}
+void UnfoldingSettings::set_seed(unsigned long seed) {
+    this->seed = seed;
+}
 
 
 //--------------------------------------------------------------------------------------------------
@@ -263,6 +363,14 @@ void UnfoldingSettings::set_path_ref_spectrum(std::string path_ref_spectrum) {
 //--------------------------------------------------------------------------------------------------
 UnfoldingReport::UnfoldingReport() {
     path = "output/report.txt";
+    num_uncertainty_samples = 0;
+    max_uncertainty_samples = 0;
+    uncertainty_rel_tol = 0;
+    uncertainty_converged = false;
+    uncertainty_bands = "rmsd";
+    sample_initialization = "input";
+    num_input_starts = 0;
+    seed = 0;
 }
 
 void UnfoldingReport::set_path(std::string path) {
@@ -271,11 +379,11 @@ void UnfoldingReport::set_path(std::string path) {
 void UnfoldingReport::set_irradiation_conditions(std::string irradiation_conditions) {
     this->irradiation_conditions = irradiation_conditions;
 }
-void UnfoldingReport::set_input_files(std::vector<std::string>& input_files) {
-    this->input_files = input_files;
+void UnfoldingReport::set_input_files(std::vector<std::string> input_files) {
+    this->input_files = std::move(input_files);
 }
-void UnfoldingReport::set_input_file_flags(std::vector<std::string>& input_file_flags) {
-    this->input_file_flags = input_file_flags;
+void UnfoldingReport::set_input_file_flags(std::vector<std::string> input_file_flags) {
+    this->input_file_flags = std::move(input_file_flags);
 }
 void UnfoldingReport::set_cutoff(int cutoff) {
     this->cutoff = cutoff;
@@ -301,14 +409,38 @@ void UnfoldingReport::set_uncertainty_type(std::string uncertainty_type) {
 void UnfoldingReport::set_num_uncertainty_samples(int num_uncertainty_samples) {
     this->num_uncertainty_samples = num_uncertainty_samples;
 }
+void UnfoldingReport::set_max_uncertainty_samples(int max_uncertainty_samples) {
+    this->max_uncertainty_samples = max_uncertainty_samples;
+}
+void UnfoldingReport::set_uncertainty_rel_tol(double uncertainty_rel_tol) {
+    this->uncertainty_rel_tol = uncertainty_rel_tol;
+}
+void UnfoldingReport::set_uncertainty_converged(bool uncertainty_converged) {
+    this->uncertainty_converged = uncertainty_converged;
+}
+void UnfoldingReport::set_uncertainty_bands(std::string uncertainty_bands) {
+    this->uncertainty_bands = uncertainty_bands;
+}
+void UnfoldingReport::set_sample_initialization(std::string sample_initialization) {
+    this->sample_initialization = sample_initialization;
+}
+void UnfoldingReport::set_sample_iterations(StreamingStatistics& sample_iterations) {
+    this->sample_iterations = sample_iterations;
+}
+void UnfoldingReport::set_num_input_starts(int num_input_starts) {
+    this->num_input_starts = num_input_starts;
+}
+void UnfoldingReport::set_seed(unsigned long seed) {
+    this->seed = seed;
+}
 void UnfoldingReport::set_git_commit(std::string git_commit) {
     this->git_commit = git_commit;
 }
-void UnfoldingReport::set_measurements(std::vector<double>& measurements) {
-    this->measurements = measurements;
+void UnfoldingReport::set_measurements(std::vector<double> measurements) {
+    this->measurements = std::move(measurements);
 }
-void UnfoldingReport::set_measurements_nc(std::vector<double>& measurements_nc) {
-    this->measurements_nc = measurements_nc;
+void UnfoldingReport::set_measurements_nc(std::vector<double> measurements_nc) {
+    this->measurements_nc = std::move(measurements_nc);
 }
 void UnfoldingReport::set_dose_mu(double dose_mu) {
     this->dose_mu = dose_mu;
@@ -322,32 +454,32 @@ void UnfoldingReport::set_duration(int duration) {
 void UnfoldingReport::set_meas_units(std::string meas_units) {
     this->meas_units = meas_units;
 }
-void UnfoldingReport::set_initial_spectrum(std::vector<double>& initial_spectrum) {
+void UnfoldingReport::set_initial_spectrum(std::shared_ptr<const std::vector<double>> initial_spectrum) {
     this->initial_spectrum = initial_spectrum;
 }
-void UnfoldingReport::set_energy_bins(std::vector<double>& energy_bins) {
+void UnfoldingReport::set_energy_bins(std::shared_ptr<const std::vector<double>> energy_bins) {
     this->energy_bins = energy_bins;
 }
-void UnfoldingReport::set_nns_response(std::vector<std::vector<double>>& nns_response) {
+void UnfoldingReport::set_nns_response(std::shared_ptr<const ResponseMatrix> nns_response) {
     this->nns_response = nns_response;
 }
-void UnfoldingReport::set_icrp_factors(std::vector<double>& icrp_factors) {
+void UnfoldingReport::set_icrp_factors(std::shared_ptr<const std::vector<double>> icrp_factors) {
     this->icrp_factors = icrp_factors;
 }
-void UnfoldingReport::set_spectrum(std::vector<double>& spectrum) {
-    this->spectrum = spectrum;
+void UnfoldingReport::set_spectrum(std::vector<double> spectrum) {
+    this->spectrum = std::move(spectrum);
 }
-void UnfoldingReport::set_spectrum_uncertainty_upper(std::vector<double>& spectrum_uncertainty_upper) {
-    this->spectrum_uncertainty_upper = spectrum_uncertainty_upper;
+void UnfoldingReport::set_spectrum_uncertainty_upper(std::vector<double> spectrum_uncertainty_upper) {
+    this->spectrum_uncertainty_upper = std::move(spectrum_uncertainty_upper);
 }
-void UnfoldingReport::set_spectrum_uncertainty_lower(std::vector<double>& spectrum_uncertainty_lower) {
-    this->spectrum_uncertainty_lower = spectrum_uncertainty_lower;
+void UnfoldingReport::set_spectrum_uncertainty_lower(std::vector<double> spectrum_uncertainty_lower) {
+    this->spectrum_uncertainty_lower = std::move(spectrum_uncertainty_lower);
 }
 void UnfoldingReport::set_num_iterations(int num_iterations) {
     this->num_iterations = num_iterations;
 }
-void UnfoldingReport::set_mlem_ratio(std::vector<double>& mlem_ratio) {
-    this->mlem_ratio = mlem_ratio;
+void UnfoldingReport::set_mlem_ratio(std::vector<double> mlem_ratio) {
+    this->mlem_ratio = std::move(mlem_ratio);
 }
 void UnfoldingReport::set_dose(double dose) {
     this->dose = dose;
@@ -389,15 +521,19 @@ void UnfoldingReport::set_j_final(double j_final) {
     this->j_final = j_final;
 }
 void UnfoldingReport::set_j_manager_low(UncertaintyManagerJ j_manager_low) {
-    this->j_manager_low = j_manager_low;
+    this->j_manager_low = std::move(j_manager_low);
 }
 void UnfoldingReport::set_j_manager_high(UncertaintyManagerJ j_manager_high) {
-    this->j_manager_high = j_manager_high;
+    this->j_manager_high = std::move(j_manager_high);
 }
 void UnfoldingReport::set_num_toss(int num_toss) {
     this->num_toss = num_toss;
 }
 
+void UnfoldingReport::set_profile(Profiler& profile) {
+    this->profile = profile;
+}
+
 //----------------------------------------------------------------------------------------------
 // Prepare summary report of unfolding
 //----------------------------------------------------------------------------------------------
@@ -410,6 +546,7 @@ void UnfoldingReport::prepare_report() {
     report_inputs(rfile);
     report_mlem_info(rfile);
     report_results(rfile);
+    report_profile(rfile);
 
     rfile.close();
 }
@@ -447,6 +584,15 @@ void UnfoldingReport::report_settings(std::ofstream& rfile) {
     rfile << std::left << std::setw(sw) << "NNS calibration factor:" << f_factor << " fA/cps\n";
     rfile << std::left << std::setw(sw) << "Uncertainty type:" << uncertainty_type << " fA/cps\n";
     rfile << std::left << std::setw(sw) << "# of uncertainty samples:" << num_uncertainty_samples << "\n";
+    if (uncertainty_type == "poisson" || uncertainty_type == "gaussian") {
+        if (uncertainty_rel_tol > 0) {
+            rfile << std::left << std::setw(sw) << "Max # of uncertainty samples:" << max_uncertainty_samples << "\n";
+            rfile << std::left << std::setw(sw) << "Uncertainty rel. tolerance:" << uncertainty_rel_tol << "\n";
+        }
+        rfile << std::left << std::setw(sw) << "Uncertainty bands:" << uncertainty_bands << "\n";
+        rfile << std::left << std::setw(sw) << "Sample initialization:" << sample_initialization << "\n";
+        rfile << std::left << std::setw(sw) << "Random seed:" << seed << "\n";
+    }
     if (algorithm == "mlemstop") {
         rfile << std::left << std::setw(sw) << "Crossover CPS value:" << cps_crossover << "\n";
         rfile << std::left << std::setw(sw) << "J threshold:" << j_threshold << "\n";
@@ -507,9 +653,9 @@ void UnfoldingReport::report_inputs(std::ofstream& rfile) {
     rfile << "\n";
 
     for (int i=0; i<num_bins; i++) {
-        rfile << std::left << std::setw(cw) << energy_bins[i] << std::setw(cw) << initial_spectrum[i] << "| ";
+        rfile << std::left << std::setw(cw) << (*energy_bins)[i] << std::setw(cw) << (*initial_spectrum)[i] << "| ";
         for (int j=0; j<num_measurements; j++) {
-            rfile << std::left << std::setw(rw) << nns_response[j][i];
+            rfile << std::left << std::setw(rw) << nns_response->at(j,i);
         }
         rfile << "\n";
     }
@@ -532,6 +678,18 @@ void UnfoldingReport::report_mlem_info(std::ofstream& rfile) {
     if (algorithm == "mlemstop") {
         rfile << std::left << std::setw(sw) << "# samples tossed: " << num_toss << "/" << num_uncertainty_samples+num_toss << "\n\n";
     }
+    if (uncertainty_type == "poisson" || uncertainty_type == "gaussian") {
+        rfile << std::left << std::setw(sw) << "Sample # of iterations: " << "mean " << sample_iterations.mean
+            << " (min " << sample_iterations.minimum << ", max " << sample_iterations.maximum << ")\n";
+        if (sample_initialization == "nominal") {
+            rfile << std::left << std::setw(sw) << "# samples from input: " << num_input_starts << "\n";
+        }
+        if (uncertainty_rel_tol > 0) {
+            rfile << std::left << std::setw(sw) << "Uncertainties converged: " << (uncertainty_converged ? "yes" : "no")
+                << " (" << num_uncertainty_samples << "/" << max_uncertainty_samples << " samples)\n";
+        }
+        rfile << "\n";
+    }
     rfile << "Final unfolding ratio = measured charge / estimated charge:\n";
     int thw = 13; // NNS response column width
     //row 1
@@ -585,14 +743,36 @@ void UnfoldingReport::report_results(std::ofstream& rfile) {
         << COLSTRING << std::setw(cw) << COLSTRING << std::setw(cw) << COLSTRING << COLSTRING << "\n";
     for (int i=0; i<num_bins; i++) {
         std::ostringstream icrp_string;
-        icrp_string << "| " <<icrp_factors[i];
-        double subdose = spectrum[i]*icrp_factors[i]*3600*(1e-9);
-        rfile << std::left << std::setw(cw) << energy_bins[i] << std::setw(cw) << spectrum[i] << std::setw(cw) 
+        icrp_string << "| " <<(*icrp_factors)[i];
+        double subdose = spectrum[i]*(*icrp_factors)[i]*3600*(1e-9);
+        rfile << std::left << std::setw(cw) << (*energy_bins)[i] << std::setw(cw) << spectrum[i] << std::setw(cw) 
             << spectrum_uncertainty_upper[i] << std::setw(cw) << spectrum_uncertainty_lower[i] << std::setw(26) 
             << icrp_string.str() << subdose << "\n";
     }
 }
 
+//----------------------------------------------------------------------------------------------
+// Profile (only if profiling is enabled). Phases that run after the report is generated (e.g.
+// plotting) are only included in the profile file.
+//----------------------------------------------------------------------------------------------
+void UnfoldingReport::report_profile(std::ofstream& rfile) {
+    if (!profile.enabled) {
+        return;
+    }
+    rfile << SECTION_DIVIDE;
+    rfile << "Profile\n\n";
+    rfile << std::left << std::setw(sw) << "Phase" << std::setw(cw) << "Time (s)" << std::setw(cw) << "# of allocations" << "\n";
+    rfile << std::left << std::setw(sw) << COLSTRING << std::setw(cw) << COLSTRING << COLSTRING << "\n";
+    for (int i_phase = 0; i_phase < (int) profile.phases.size(); i_phase++) {
+        rfile << std::left << std::setw(sw) << profile.phases[i_phase].name << std::setw(cw)
+            << profile.phases[i_phase].seconds << profile.phases[i_phase].num_allocations << "\n";
+    }
+    rfile << "\n";
+    for (int i_counter = 0; i_counter < (int) profile.counters.size(); i_counter++) {
+        rfile << std::left << std::setw(sw) << profile.counters[i_counter].name + ":" << profile.counters[i_counter].value << "\n";
+    }
+}
+
 //--------------------------------------------------------------------------------------------------
 // Default constructor to be used to create J Uncertainty Manager object. Required when used as
 // a class member in other classes
@@ -616,25 +796,17 @@ UncertaintyManagerJ::UncertaintyManagerJ(double original_j_threshold, double sig
 
 //--------------------------------------------------------------------------------------------------
 // Method used to calculate a single upper or lower uncertainty on a neutron fluence spectrum. The
-// MLEM-STOP method is used to determine the iteration number at which the J-threshold (scaled by
-// sigma_J) is attained. The spectral difference between this spectrum and the actual MLEM-STOP
-// spectrum is taken to be the uncertainty.
+// bound spectrum is the spectrum of the MLEM-STOP trajectory at which this manager's J-threshold
+// (scaled by sigma_J) is attained, as captured while unfolding (see mlemstop_capture.h). The
+// spectral difference between this spectrum and the actual MLEM-STOP spectrum is taken to be the
+// uncertainty.
 //--------------------------------------------------------------------------------------------------
 void UncertaintyManagerJ::determineSpectrumUncertainty(std::vector<double> &mlemstop_spectrum, 
-    int cutoff, int num_measurements, int num_bins, std::vector<double> &measurements, 
-    std::vector<std::vector<double>> &nns_response, std::vector<double> &normalized_response,
-    std::vector<double> &initial_spectrum) 
+    int num_bins, const MLEMSTOPCapture &capture) 
 {
-    this->bound_spectrum = initial_spectrum;
-
-    std::vector<double> mlem_ratio;
-    std::vector<double> mlem_correction;
-    std::vector<double> mlem_estimate;
-
-    num_iterations = runMLEMSTOP(cutoff, num_measurements, num_bins, measurements,
-        this->bound_spectrum, nns_response, normalized_response, mlem_ratio, mlem_correction, mlem_estimate,
-        this->j_threshold, this->j_factor
-    );
+    this->bound_spectrum = capture.spectrum;
+    num_iterations = capture.num_iterations;
+    j_factor = capture.j_factor;
 
     for (int i_bin = 0; i_bin < num_bins; i_bin++) {
         spectrum_uncertainty.push_back(abs(bound_spectrum[i_bin]-mlemstop_spectrum[i_bin]));
@@ -677,6 +849,7 @@ SpectraSettings::SpectraSettings() {
     error_style = "E2";
     error_fill_style = 3001;
     rows_per_spectrum = 3;
+    selected_spectra = {};
     line_style = {1};
     line_width = {5};
     border_width = 5;
@@ -749,6 +922,8 @@ void SpectraSettings::set_setting(std::string settings_name, std::string setting
         this->set_error_fill_style(settings_value);
     else if (settings_name == "rows_per_spectrum")
         this->set_rows_per_spectrum(settings_value);
+    else if (settings_name == "selected_spectra")
+        this->set_selected_spectra(settings_value);
     else if (settings_name == "line_style")
         this->set_line_style(settings_value);
     else if (settings_name == "line_width")
@@ -863,6 +1038,9 @@ void SpectraSettings::set_error_fill_style(std::string error_fill_style) {
 void SpectraSettings::set_rows_per_spectrum(std::string rows_per_spectrum) {
     this->rows_per_spectrum = stoi(rows_per_spectrum);
 }
+void SpectraSettings::set_selected_spectra(std::string selected_spectra) {
+    stringToSVector(selected_spectra,this->selected_spectra);
+}
 void SpectraSettings::set_line_style(std::string line_style) {
     stringToIVector(line_style,this->line_style);
 }
@@ -1235,6 +1413,9 @@ SurfaceSettings::SurfaceSettings() {
     color_palette = 55;
     num_color_bins = 40;
     border_width = 1;
+    max_x_cells = 0; // 0 = draw every cell of the input file
+    max_y_cells = 0;
+    cell_aggregation = "mean";
 }
 
 // Apply a value to a setting:
@@ -1280,6 +1461,12 @@ void SurfaceSettings::set_setting(std::string settings_name, std::string setting
         this->set_num_color_bins(settings_value);
     else if (settings_name == "border_width")
         this->set_border_width(settings_value);
+    else if (settings_name == "max_x_cells")
+        this->set_max_x_cells(settings_value);
+    else if (settings_name == "max_y_cells")
+        this->set_max_y_cells(settings_value);
+    else if (settings_name == "cell_aggregation")
+        this->set_cell_aggregation(settings_value);
 
     else
         throw std::logic_error("Unrecognized setting: " + settings_name 
@@ -1343,4 +1530,13 @@ void SurfaceSettings::set_num_color_bins(std::string num_color_bins) {
 }
 void SurfaceSettings::set_border_width(std::string border_width) {
     this->border_width = stoi(border_width);
+}
+void SurfaceSettings::set_max_x_cells(std::string max_x_cells) {
+    this->max_x_cells = stoi(max_x_cells);
+}
+void SurfaceSettings::set_max_y_cells(std::string max_y_cells) {
+    this->max_y_cells = stoi(max_y_cells);
+}
+void SurfaceSettings::set_cell_aggregation(std::string cell_aggregation) {
+    this->cell_aggregation = cell_aggregation;
 }
\ No newline at end of file
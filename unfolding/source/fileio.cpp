@@ -3,6 +3,9 @@
 //**************************************************************************************************
 
 #include "fileio.h"
+#include "binary_input.h"
+#include "csv_table.h"
+#include "results_store.h"
 
 #include <iostream>
 #include <iomanip>
@@ -274,6 +277,62 @@ std::vector<double> getMeasurements(UnfoldingSettings &settings)
 }
 
 
+//==================================================================================================
+// Read the list of measurement sets to be unfolded by unfold_batch. Each non-empty line that does
+// not start with '#' is one entry, either:
+//  - the pathname of a measurements file (same format as for unfold_spectrum), or
+//  - an inline measurement set: <irradiation conditions>,<value>,<value>,... (see
+//    getInlineMeasurements)
+//==================================================================================================
+int readMeasurementsList(std::string file_name, std::vector<std::string>& entries) {
+    std::ifstream ifile(file_name);
+    if (!ifile.is_open()) {
+        //throw error
+        throw std::logic_error("Unable to open measurements list: " + file_name);
+    }
+
+    std::string line;
+    while (getline(ifile,line)) {
+        line.erase(std::remove(line.begin(), line.end(), '\r'), line.end());
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        entries.push_back(line);
+    }
+
+    ifile.close();
+    return 1;
+}
+
+
+//==================================================================================================
+// Parse an inline measurement set from a measurements list (one line: description followed by the
+// comma-separated values, in the same order as in a measurements file). Sets the irradiation
+// conditions in settings. Inline sets have no dose/duration header, so the values must be in CPS.
+//==================================================================================================
+std::vector<double> getInlineMeasurements(std::string entry, UnfoldingSettings &settings) {
+    if (settings.meas_units != "cps") {
+        throw std::logic_error("Inline measurement sets must be provided in cps (meas_units=cps): " + entry);
+    }
+
+    std::istringstream line_stream(entry);
+    std::string stoken; // store individual values between delimiters on a line
+    getline(line_stream, stoken, ',');
+    settings.irradiation_conditions = stoken;
+
+    std::vector<double> data_vector;
+    while (getline(line_stream, stoken, ',')) {
+        // Convert negative measurements to positive
+        double measurement = atof(stoken.c_str());
+        if (measurement < 0) {
+            measurement *= -1;
+        }
+        data_vector.push_back(measurement);
+    }
+    return data_vector;
+}
+
+
 //==================================================================================================
 // Save calculated spectrum (and uncertainty spectrum) to file (append to existing data in the file)
 // Subsequent entries are appended as new rows (facilitate processing using ROOT)
@@ -419,13 +478,23 @@ int saveSpectrumAsColumn(std::string spectrum_file, std::string irradiation_cond
 
 
 //==================================================================================================
-// Read a 1D CSV file (i.e. one value per row) and store the data in a vector
+// Read a 1D CSV file (i.e. one value per row) and store the data in a vector. If a binary copy of
+// the file exists (see findBinaryInput), the values are loaded from it instead.
 // Args:
 //  - file_name: the name of the file to be read
 //  - input_vector: the vector that will be assigned values read in from the input file (note passed
 //      by reference)
 //==================================================================================================
 int readInputFile1D(std::string file_name, std::vector<double>& input_vector) {
+    std::string binary_path;
+    if (findBinaryInput(file_name, binary_path)) {
+        BinaryInputFile bfile(binary_path);
+        for (int i_row = 0; i_row < bfile.num_rows; i_row++) {
+            input_vector.push_back(bfile.num_columns > 0 ? bfile.at(i_row,0) : 0.0);
+        }
+        return 1;
+    }
+
     std::ifstream ifile(file_name);
     std::string iline;
 
@@ -446,13 +515,35 @@ int readInputFile1D(std::string file_name, std::vector<double>& input_vector) {
 
 
 //==================================================================================================
-// Read a CSV file and store the data in a 2D vector
+// Read a CSV file and store the data in a 2D vector. If a binary copy of the file exists (see
+// findBinaryInput), the values are loaded from it instead.
 // Args:
 //  - file_name: the name of the file to be read
 //  - input_vector: the vector that will be assigned values read in from the input file (note passed
 //      by reference)
 //==================================================================================================
 int readInputFile2D(std::string file_name, std::vector<std::vector<double>>& input_vector) {
+    std::string binary_path;
+    if (findBinaryInput(file_name, binary_path)) {
+        BinaryInputFile bfile(binary_path);
+        for (int i_row = 0; i_row < bfile.num_rows; i_row++) {
+            const double* row = bfile.data() + (size_t) i_row*bfile.num_columns;
+            input_vector.push_back(std::vector<double>(row, row + bfile.num_columns));
+        }
+        return 1;
+    }
+    return readInputCSV2D(file_name, input_vector);
+}
+
+//==================================================================================================
+// Read a CSV file and store the data in a 2D vector, ignoring any binary copy of the file. Used by
+// readInputFile2D and to convert CSV input files to binary.
+// Args:
+//  - file_name: the name of the file to be read
+//  - input_vector: the vector that will be assigned values read in from the input file (note passed
+//      by reference)
+//==================================================================================================
+int readInputCSV2D(std::string file_name, std::vector<std::vector<double>>& input_vector) {
     std::ifstream ifile(file_name);
     std::string iline;
 
@@ -477,6 +568,23 @@ int readInputFile2D(std::string file_name, std::vector<std::vector<double>>& inp
     return 1;
 }
 
+//==================================================================================================
+// Read an NNS response file directly into the contiguous storage used by the unfolding algorithms
+// (outer index of the file is the measurement, inner index is the energy bin). A binary copy of the
+// file (see findBinaryInput) is used in place, without building an intermediate 2D vector.
+//==================================================================================================
+ResponseMatrix readResponseFile(std::string file_name) {
+    std::string binary_path;
+    if (findBinaryInput(file_name, binary_path)) {
+        BinaryInputFile bfile(binary_path);
+        return ResponseMatrix(bfile.num_rows, bfile.num_columns, bfile.data());
+    }
+
+    std::vector<std::vector<double>> raw_response;
+    readInputCSV2D(file_name, raw_response);
+    return ResponseMatrix(raw_response);
+}
+
 //==================================================================================================
 // Read a CSV file containing neutron spectra, formatted as follows:
 //  - The first row contains the energy bins
@@ -489,96 +597,93 @@ int readInputFile2D(std::string file_name, std::vector<std::vector<double>>& inp
 //  - energy_bins: the vector that will house the energy bins
 //  - spectra_vector: the vector that will be assigned spectra values from the input file
 //  - error_vector: the vector that will be assigned uncertainties from the input file
+//  - selected_spectra: headers of the spectra to be read (and their uncertainties). Other spectra
+//      are skipped without being converted. If empty, all spectra are read.
+//
+// If file_name is a results store (see results_store.h), the spectra are fetched via its index
+// instead (rows_per_spectrum does not apply).
 //==================================================================================================
 int readSpectra(std::string file_name, std::vector<std::string>& header_vector, std::vector<double>& energy_bins, 
     std::vector<std::vector<double>>& spectra_vector, std::vector<std::vector<double>>& error_lower_vector, 
     std::vector<std::vector<double>>& error_upper_vector, bool plot_per_mu, std::vector<int>& number_mu, 
-    std::vector<int>& duration, int rows_per_spectrum) 
+    std::vector<int>& duration, int rows_per_spectrum, std::vector<std::string>& selected_spectra) 
 {
-    std::ifstream ifile(file_name);
-    std::string iline;
+    if (ResultsStore::isStore(file_name)) {
+        return readStoredSpectra(file_name, header_vector, energy_bins, spectra_vector, error_lower_vector,
+            error_upper_vector, plot_per_mu, number_mu, duration, selected_spectra);
+    }
 
-    if (!ifile.is_open()) {
-        //throw error
-        throw std::logic_error("Unable to open spectrum file: " + file_name);
+    if (rows_per_spectrum != 2 && rows_per_spectrum != 3) {
+        throw std::logic_error("Incompatible number for rows_per_spectrum: " + std::to_string(rows_per_spectrum));
     }
 
-    // Loop through each line in the file
-    int i_row = 0;
-    int i_group = 0; // index that is incremented after processing each spectrum & its uncertainties
-    while (getline(ifile,iline)) {
-        std::vector<double> new_row;
-        std::istringstream line_stream(iline);
-        std::string stoken; // store individual values between delimiters on a line
+    CSVTable table(file_name, "spectrum");
+    int num_rows = table.num_rows();
+    if (num_rows == 0) {
+        return 1;
+    }
 
-        // Loop through the line, delimiting at commas
-        int i_col = 0;
-        while (getline(line_stream, stoken, ',')) {
-            // The first token is the header
-            if (i_col == 0) {
-                if (i_row % rows_per_spectrum == 1) {
-                    header_vector.push_back(stoken);
-                }
-            }
-            // Add data to the vector
-            else {
-                // If plotting per MU
-                if (plot_per_mu){
-                    //1st row is the energies
-                    if (i_row !=0) {
-                        new_row.push_back(
-                            atof(stoken.c_str())*duration[i_group%duration.size()]/number_mu[i_group%number_mu.size()]
-                        );
-                    }
-                    else {
-                        new_row.push_back(atof(stoken.c_str()));
-                    }
-                }
-                // If plotting per second
-                else {
-                    new_row.push_back(atof(stoken.c_str()));
-                }
+    // The first row contains the energy bins
+    table.rowValues(0, 1, energy_bins);
+
+    int max_spectra = (num_rows - 1 + rows_per_spectrum - 1) / rows_per_spectrum;
+    if (selected_spectra.empty()) {
+        header_vector.reserve(header_vector.size() + max_spectra);
+        spectra_vector.reserve(spectra_vector.size() + max_spectra);
+        error_upper_vector.reserve(error_upper_vector.size() + max_spectra);
+        error_lower_vector.reserve(error_lower_vector.size() + max_spectra);
+    }
+    std::vector<bool> selected_found(selected_spectra.size(), false);
+
+    // Remaining rows alternate between a spectrum and its uncertainties (upper & lower if
+    // rows_per_spectrum is 3, otherwise a single symmetric uncertainty)
+    int i_group = 0; // index that is incremented after processing each spectrum & its uncertainties
+    std::vector<double> new_row;
+    for (int i_spectrum_row = 1; i_spectrum_row < num_rows; i_spectrum_row += rows_per_spectrum) {
+        bool has_header = table.num_fields(i_spectrum_row) > 0;
+        std::string header = has_header ? table.field(i_spectrum_row, 0) : "";
+
+        if (!selected_spectra.empty()) {
+            std::vector<std::string>::iterator iter_selected = std::find(selected_spectra.begin(),
+                selected_spectra.end(), header);
+            if (iter_selected == selected_spectra.end()) {
+                continue;
             }
-            i_col += 1;
+            selected_found[iter_selected - selected_spectra.begin()] = true;
         }
 
-        //
-        if (rows_per_spectrum == 3) {
-            // The first row contains the energy bins
-            if (i_row == 0) {
-                energy_bins = new_row;
+        for (int i_offset = 0; i_offset < rows_per_spectrum && i_spectrum_row + i_offset < num_rows; i_offset++) {
+            table.rowValues(i_spectrum_row + i_offset, 1, new_row);
+            // If plotting per MU
+            if (plot_per_mu) {
+                for (int i_value = 0; i_value < (int) new_row.size(); i_value++) {
+                    new_row[i_value] = new_row[i_value]*duration[i_group%duration.size()]/number_mu[i_group%number_mu.size()];
+                }
             }
-            // Remaining rows alternate between a spectrum and upper & lower uncertainties
-            else if (i_row % rows_per_spectrum == 1) {
-                spectra_vector.push_back(new_row);
+
+            if (i_offset == 0) {
+                if (has_header) {
+                    header_vector.push_back(header);
+                }
+                spectra_vector.push_back(std::move(new_row));
             }
-            else if (i_row % rows_per_spectrum == 2) {
-                error_upper_vector.push_back(new_row);
+            else if (i_offset == 1) {
+                if (rows_per_spectrum == 2) {
+                    error_lower_vector.push_back(new_row);
+                }
+                error_upper_vector.push_back(std::move(new_row));
                 i_group += 1;
             }
             else {
-                error_lower_vector.push_back(new_row);
-            }
-        }
-        else if (rows_per_spectrum == 2) {
-            // The first row contains the energy bins
-            if (i_row == 0) {
-                energy_bins = new_row;
-            }
-            // Remaining rows alternate between a spectrum and the uncertainty
-            else if (i_row % rows_per_spectrum == 1) {
-                spectra_vector.push_back(new_row);
-            }
-            else {
-                error_upper_vector.push_back(new_row);
-                error_lower_vector.push_back(new_row);
-                i_group += 1;
+                error_lower_vector.push_back(std::move(new_row));
             }
         }
-        else {
-            throw std::logic_error("Incompatible number for rows_per_spectrum: " + std::to_string(rows_per_spectrum));
+    }
+
+    for (int i_selected = 0; i_selected < (int) selected_spectra.size(); i_selected++) {
+        if (!selected_found[i_selected]) {
+            throw std::logic_error("Spectrum " + selected_spectra[i_selected] + " not found in " + file_name);
         }
-        i_row += 1;
     }
 
     return 1;
@@ -676,55 +781,32 @@ void stringToDVector(std::string test_string, std::vector<float>& result_vector)
 int readXYYCSV(std::string file_name, std::vector<std::string>& header_vector,
     std::vector<std::vector<double>>& x_data, std::vector<std::vector<double>>& y_data) 
 {
-    std::ifstream ifile(file_name);
-    std::string iline;
-
-    if (!ifile.is_open()) {
-        //throw error
-        throw std::logic_error("Unable to open data file: " + file_name);
+    CSVTable table(file_name, "data");
+    int num_rows = table.num_rows();
+    if (num_rows == 0) {
+        return 1;
     }
+    header_vector.reserve(header_vector.size() + num_rows - 1);
+    x_data.reserve(x_data.size() + num_rows);
+    y_data.reserve(y_data.size() + num_rows - 1);
 
+    // The first row contains the x data
     std::vector<double> x_row;
-
-    // Loop through each line in the file
-    int i_row = 0;
-    while (getline(ifile,iline)) {
-        std::vector<double> new_row;
-        std::istringstream line_stream(iline);
-        std::string stoken; // store individual values between delimiters on a line
-
-        // Loop through the line, delimiting at commas
-        int i_col = 0;
-        while (getline(line_stream, stoken, ',')) {
-            // The first token is the header
-            if (i_col == 0) {
-                // Only add y-row headers to the header vector
-                if (i_row > 0) {
-                    header_vector.push_back(stoken);
-                }
-            }
-            // Add data to the vector
-            else {
-                new_row.push_back(atof(stoken.c_str()));
-            }
-            i_col += 1;
-        }
-
-        // The first row contains the x data
-        if (i_row == 0) {
-            x_row = new_row;
-            x_data.push_back(x_row);
+    table.rowValues(0, 1, x_row);
+    x_data.push_back(x_row);
+
+    // All remaining rows contain y data (each is paired with a copy of the x data, except the first)
+    std::vector<double> new_row;
+    for (int i_row = 1; i_row < num_rows; i_row++) {
+        // The first token is the header. Only add y-row headers to the header vector
+        if (table.num_fields(i_row) > 0) {
+            header_vector.push_back(table.field(i_row, 0));
         }
-        // The second row contain the y data
-        else if (i_row == 1) {
-            y_data.push_back(new_row);
-        }
-        // All remaining rows contain y data
-        else {
+        table.rowValues(i_row, 1, new_row);
+        if (i_row > 1) {
             x_data.push_back(x_row);
-            y_data.push_back(new_row);
         }
-        i_row += 1;
+        y_data.push_back(std::move(new_row));
     }
     return 1;
 }
@@ -744,47 +826,27 @@ int readXYYCSV(std::string file_name, std::vector<std::string>& header_vector,
 int readXYXYCSV(std::string file_name, std::vector<std::string>& header_vector, 
     std::vector<std::vector<double>>& x_data, std::vector<std::vector<double>>& y_data) 
 {
-    std::ifstream ifile(file_name);
-    std::string iline;
+    CSVTable table(file_name, "data");
+    int num_rows = table.num_rows();
+    header_vector.reserve(header_vector.size() + num_rows/2);
+    x_data.reserve(x_data.size() + (num_rows + 1)/2);
+    y_data.reserve(y_data.size() + num_rows/2);
 
-    if (!ifile.is_open()) {
-        //throw error
-        throw std::logic_error("Unable to open data file: " + file_name);
-    }
-
-    // Loop through each line in the file
-    int i_row = 0;
-    while (getline(ifile,iline)) {
-        std::vector<double> new_row;
-        std::istringstream line_stream(iline);
-        std::string stoken; // store individual values between delimiters on a line
-
-        // Loop through the line, delimiting at commas
-        int i_col = 0;
-        while (getline(line_stream, stoken, ',')) {
-            // The first token is the header
-            if (i_col == 0) {
-                // Only add y-row headers to the header vector
-                if (i_row % 2 == 1) {
-                    header_vector.push_back(stoken);
-                }
-            }
-            // Add data to the vector
-            else {
-                new_row.push_back(atof(stoken.c_str()));
-            }
-            i_col += 1;
-        }
+    std::vector<double> new_row;
+    for (int i_row = 0; i_row < num_rows; i_row++) {
+        table.rowValues(i_row, 1, new_row);
 
         // Even rows (starting at 0) contain the x data
         if (i_row % 2 == 0) {
-            x_data.push_back(new_row);
+            x_data.push_back(std::move(new_row));
         }
-        // Odd rows (starting at 1) contain the y data
+        // Odd rows (starting at 1) contain the y data. Only add y-row headers to the header vector
         else {
-            y_data.push_back(new_row);
+            if (table.num_fields(i_row) > 0) {
+                header_vector.push_back(table.field(i_row, 0));
+            }
+            y_data.push_back(std::move(new_row));
         }
-        i_row += 1;
     }
     return 1;
 }
\ No newline at end of file
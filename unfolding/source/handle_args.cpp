@@ -77,3 +77,20 @@ void checkUnknownParameters(std::vector<std::string> &arg_vector, std::vector<st
         }
     }
 }
+
+//==================================================================================================
+// Check arguments passed to the main function for a flag that takes no value (e.g. --serve). The
+// flag is removed from arg_vector, so that checkUnknownParameters only sees options with values.
+// Args:
+//  - arg_vector: Vector containing all arguments passed to the main function (at command line)
+//  - arg_string: The flag to look for
+// Returns true if the flag was provided
+//==================================================================================================
+bool checkFlag(std::vector<std::string> &arg_vector, std::string arg_string) {
+    std::vector<std::string>::iterator iter_args = std::find(arg_vector.begin(), arg_vector.end(), arg_string);
+    if (iter_args == arg_vector.end()) {
+        return false;
+    }
+    arg_vector.erase(iter_args);
+    return true;
+}
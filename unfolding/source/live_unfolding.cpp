@@ -0,0 +1,332 @@
+//**************************************************************************************************
+// The functions included in this module implement the streaming unfolding of a live feed of shell
+// readings (see live_unfolding.h): running per-shell statistics, warm-started unfolding of the
+// shell means, and re-estimation of the uncertainties when the means drift.
+//**************************************************************************************************
+
+#include "live_unfolding.h"
+#include "custom_classes.h"
+#include "fileio.h"
+#include "physics_calculations.h"
+#include "random_streams.h"
+#include "streaming_statistics.h"
+#include "uncertainty_sampling.h"
+#include "unfolding_service.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+//==================================================================================================
+// ShellStatistics
+//==================================================================================================
+ShellStatistics::ShellStatistics() {
+    count = 0;
+    mean = 0;
+    sum_squared_deviations = 0;
+}
+
+void ShellStatistics::add(double value) {
+    count++;
+    double deviation = value - mean;
+    mean += deviation/count;
+    sum_squared_deviations += deviation*(value - mean);
+}
+
+double ShellStatistics::standardError() const {
+    if (count < 2) {
+        return 0;
+    }
+    return sqrt(sum_squared_deviations/(count-1))/sqrt((double) count);
+}
+
+//==================================================================================================
+// LiveUnfolding
+//==================================================================================================
+//--------------------------------------------------------------------------------------------------
+// Read the inputs shared by all updates (see unfold_spectrum for details). settings.f_factor must
+// already be converted to nA/cps.
+//--------------------------------------------------------------------------------------------------
+LiveUnfolding::LiveUnfolding(UnfoldingSettings& settings) {
+    this->settings = settings;
+
+    if (settings.meas_units == "nc" && settings.duration <= 0) {
+        throw std::logic_error("Stream mode with meas_units=nc requires the duration of each reading (duration > 0)");
+    }
+    else if (settings.meas_units != "nc" && settings.meas_units != "cps") {
+        throw std::logic_error("Unrecognized meas_units: " + settings.meas_units);
+    }
+    if (settings.uncertainty_type != "poisson" && settings.uncertainty_type != "gaussian") {
+        throw std::logic_error("Stream mode requires uncertainty_type=poisson or gaussian");
+    }
+    if (this->settings.seed == 0) {
+        this->settings.set_seed(generateRandomSeed());
+    }
+
+    readInputFile1D(settings.path_energy_bins,energy_bins);
+    num_bins = energy_bins.size();
+
+    nns_response = readResponseFile(settings.path_system_response);
+    num_measurements = nns_response.num_measurements;
+    checkDimensions(num_bins, "number of energy bins", nns_response.num_bins, "NNS response");
+
+    readInputFile1D(settings.path_input_spectrum,initial_spectrum);
+    checkDimensions(num_bins, "number of energy bins", initial_spectrum.size(), "Input spectrum");
+
+    readInputFile1D(settings.path_icrp_factors,icrp_factors);
+    checkDimensions(num_bins, "number of energy bins", icrp_factors.size(), "Number of ICRP factors");
+
+    workspace = UnfoldingWorkspace(num_measurements, num_bins);
+    pool.reset(new ThreadPool(settings.num_threads));
+    num_uncertainty_estimates = 0;
+    start_time = std::chrono::steady_clock::now();
+    reset();
+}
+
+//--------------------------------------------------------------------------------------------------
+// Add a reading of shell i_shell (# of moderator shells, 0 = bare detector)
+//--------------------------------------------------------------------------------------------------
+void LiveUnfolding::addReading(int i_shell, double value) {
+    if (i_shell < 0 || i_shell >= num_measurements) {
+        std::ostringstream error_message;
+        error_message << "Shell " << i_shell << " is out of range (0 to " << num_measurements-1 << ")";
+        throw std::logic_error(error_message.str());
+    }
+    value = std::fabs(value);
+    if (settings.meas_units == "nc") {
+        value = value*settings.norm/settings.f_factor/settings.duration;
+    }
+    shells[i_shell].add(value);
+    num_readings++;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Discard the readings, and start the next unfolding from the guess spectrum (e.g. when moving to
+// a new survey point)
+//--------------------------------------------------------------------------------------------------
+void LiveUnfolding::reset() {
+    shells.assign(num_measurements, ShellStatistics());
+    num_readings = 0;
+    spectrum = initial_spectrum;
+    has_uncertainty = false;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Whether every shell has been read (at least twice for gaussian uncertainties, which need the
+// standard error of each shell)
+//--------------------------------------------------------------------------------------------------
+bool LiveUnfolding::ready() const {
+    long min_count = settings.uncertainty_type == "gaussian" ? 2 : 1;
+    for (int i_shell = 0; i_shell < num_measurements; i_shell++) {
+        if (shells[i_shell].count < min_count) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Whether the mean of a shell differs from the one the uncertainties were estimated with by more
+// than stream_drift_threshold (relative)
+//--------------------------------------------------------------------------------------------------
+bool LiveUnfolding::drifted(std::vector<double>& measurements) const {
+    for (int i_meas = 0; i_meas < num_measurements; i_meas++) {
+        double reference = uncertainty_measurements[i_meas];
+        double change = std::fabs(measurements[i_meas] - reference);
+        if (reference > 0 ? change/reference > settings.stream_drift_threshold : change > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Unfold the current shell means and return the update (a single line). Errors are returned as
+// updates with "status":"error" rather than thrown, and leave the spectrum of the previous update
+// as the start of the next one.
+//--------------------------------------------------------------------------------------------------
+std::string LiveUnfolding::update() {
+    std::ostringstream result;
+    result << std::setprecision(17);
+    std::vector<double> previous_spectrum = spectrum;
+
+    try {
+        if (!ready()) {
+            throw std::logic_error("Not every shell has been read");
+        }
+        std::vector<double> measurements(num_measurements);
+        std::vector<double> std_errors(num_measurements);
+        for (int i_meas = 0; i_meas < num_measurements; i_meas++) {
+            measurements[i_meas] = shells[i_meas].mean;
+            std_errors[i_meas] = shells[i_meas].standardError();
+        }
+
+        // Warm-started from the previous spectrum; the J bounds of MLEM-STOP are not captured
+        double j_threshold = 0;
+        double j_factor = 0;
+        int num_iterations = runUnfoldingAlgorithm(settings, num_measurements, num_bins, measurements,
+            spectrum, nns_response, workspace, j_threshold, j_factor
+        );
+        double ambient_dose_eq = calculateDose(num_bins, spectrum, icrp_factors);
+        double total_flux = calculateTotalFlux(num_bins,spectrum);
+        double avg_energy = calculateAverageEnergy(num_bins,spectrum,energy_bins);
+
+        // Re-estimate the uncertainties if the measurements drifted, and keep them relative to the
+        // spectrum & dose they were estimated around
+        bool refreshed = !has_uncertainty || drifted(measurements);
+        long num_samples = 0;
+        if (refreshed) {
+            UncertaintyStatistics statistics(spectrum, ambient_dose_eq, settings.uncertainty_bands);
+            runUncertaintySamples(settings, *pool, settings.seed, num_measurements, num_bins, measurements,
+                std_errors, initial_spectrum, spectrum, nns_response, icrp_factors, statistics
+            );
+            std::vector<double> uncertainty_lower;
+            std::vector<double> uncertainty_upper;
+            double dose_uncertainty_lower;
+            double dose_uncertainty_upper;
+            statistics.getSpectrumUncertainty(uncertainty_lower, uncertainty_upper);
+            statistics.getDoseUncertainty(dose_uncertainty_lower, dose_uncertainty_upper);
+            num_samples = statistics.num_samples();
+
+            relative_uncertainty_lower.assign(num_bins, 0.0);
+            relative_uncertainty_upper.assign(num_bins, 0.0);
+            for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+                if (spectrum[i_bin] > 0) {
+                    relative_uncertainty_lower[i_bin] = uncertainty_lower[i_bin]/spectrum[i_bin];
+                    relative_uncertainty_upper[i_bin] = uncertainty_upper[i_bin]/spectrum[i_bin];
+                }
+            }
+            relative_dose_uncertainty_lower = ambient_dose_eq > 0 ? dose_uncertainty_lower/ambient_dose_eq : 0;
+            relative_dose_uncertainty_upper = ambient_dose_eq > 0 ? dose_uncertainty_upper/ambient_dose_eq : 0;
+            uncertainty_measurements = measurements;
+            has_uncertainty = true;
+            num_uncertainty_estimates++;
+        }
+
+        std::vector<double> spectrum_uncertainty_lower(num_bins);
+        std::vector<double> spectrum_uncertainty_upper(num_bins);
+        for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+            spectrum_uncertainty_lower[i_bin] = relative_uncertainty_lower[i_bin]*spectrum[i_bin];
+            spectrum_uncertainty_upper[i_bin] = relative_uncertainty_upper[i_bin]*spectrum[i_bin];
+        }
+        double ambient_dose_eq_uncertainty_lower = relative_dose_uncertainty_lower*ambient_dose_eq;
+        double ambient_dose_eq_uncertainty_upper = relative_dose_uncertainty_upper*ambient_dose_eq;
+        double total_flux_uncertainty_upper = calculateSumUncertainty(num_bins,spectrum_uncertainty_upper);
+        double total_flux_uncertainty_lower = calculateSumUncertainty(num_bins,spectrum_uncertainty_lower);
+
+        //------------------------------------------------------------------------------------------
+        // Update
+        //------------------------------------------------------------------------------------------
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+        result << "{\"status\":\"ok\"";
+        result << ",\"time\":" << elapsed.count();
+        result << ",\"irradiation_conditions\":" << jsonString(settings.irradiation_conditions);
+        result << ",\"num_readings\":" << num_readings;
+        result << ",\"num_shell_readings\":[";
+        for (int i_meas = 0; i_meas < num_measurements; i_meas++) {
+            result << (i_meas > 0 ? "," : "") << shells[i_meas].count;
+        }
+        result << "]";
+        result << ",\"measurements\":";
+        writeJsonArray(result, measurements);
+        result << ",\"measurement_std_errors\":";
+        writeJsonArray(result, std_errors);
+        result << ",\"algorithm\":" << jsonString(settings.algorithm);
+        result << ",\"num_iterations\":" << num_iterations;
+        result << ",\"uncertainty_refreshed\":" << (refreshed ? "true" : "false");
+        if (refreshed) {
+            result << ",\"seed\":" << settings.seed;
+            result << ",\"num_uncertainty_samples\":" << num_samples;
+        }
+        result << ",\"dose\":";
+        writeJsonNumber(result, ambient_dose_eq);
+        result << ",\"dose_uncertainty_upper\":";
+        writeJsonNumber(result, ambient_dose_eq_uncertainty_upper);
+        result << ",\"dose_uncertainty_lower\":";
+        writeJsonNumber(result, ambient_dose_eq_uncertainty_lower);
+        result << ",\"total_flux\":";
+        writeJsonNumber(result, total_flux);
+        result << ",\"total_flux_uncertainty_upper\":";
+        writeJsonNumber(result, total_flux_uncertainty_upper);
+        result << ",\"total_flux_uncertainty_lower\":";
+        writeJsonNumber(result, total_flux_uncertainty_lower);
+        result << ",\"avg_energy\":";
+        writeJsonNumber(result, avg_energy);
+        result << ",\"spectrum\":";
+        writeJsonArray(result, spectrum);
+        result << ",\"spectrum_uncertainty_upper\":";
+        writeJsonArray(result, spectrum_uncertainty_upper);
+        result << ",\"spectrum_uncertainty_lower\":";
+        writeJsonArray(result, spectrum_uncertainty_lower);
+        result << "}";
+    }
+    catch (std::exception& error) {
+        spectrum = previous_spectrum;
+        result.str("");
+        result << "{\"status\":\"error\",\"error\":" << jsonString(error.what()) << "}";
+    }
+    return result.str();
+}
+
+//--------------------------------------------------------------------------------------------------
+// Read the feed from input until it is closed, writing the updates to output. Each line is a
+// reading "<shell>,<value>" (or separated by whitespace), or "reset". Empty lines and lines
+// starting with # are ignored. Once every shell has been read, an update is written after a reading
+// if none was written in the last stream_interval seconds, and after the last reading of the feed.
+// A line that cannot be read is answered with an error, and the feed continues.
+//--------------------------------------------------------------------------------------------------
+void LiveUnfolding::run(std::istream& input, std::ostream& output) {
+    bool pending = false; // readings not included in an update yet
+    bool updated = false;
+    std::chrono::steady_clock::time_point last_update;
+
+    std::string line;
+    while (getline(input, line)) {
+        line.erase(std::remove(line.begin(), line.end(), '\r'), line.end());
+        std::replace(line.begin(), line.end(), ',', ' ');
+        std::istringstream line_stream(line);
+        std::string first_token;
+        if (!(line_stream >> first_token) || first_token[0] == '#') {
+            continue;
+        }
+        if (first_token == "reset") {
+            reset();
+            pending = false;
+            continue;
+        }
+
+        try {
+            char* end;
+            long i_shell = strtol(first_token.c_str(), &end, 10);
+            double value;
+            std::string extra;
+            if (*end != '\0' || !(line_stream >> value) || (line_stream >> extra)) {
+                throw std::logic_error("Invalid reading (expected <shell>,<value>): " + line);
+            }
+            addReading(i_shell, value);
+            pending = true;
+        }
+        catch (std::exception& error) {
+            output << "{\"status\":\"error\",\"error\":" << jsonString(error.what()) << "}\n" << std::flush;
+            continue;
+        }
+
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        std::chrono::duration<double> since_update = now - last_update;
+        if (ready() && (!updated || since_update.count() >= settings.stream_interval)) {
+            output << update() << '\n' << std::flush;
+            last_update = now;
+            updated = true;
+            pending = false;
+        }
+    }
+
+    if (pending && ready()) {
+        output << update() << '\n' << std::flush;
+    }
+}
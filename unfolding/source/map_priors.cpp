@@ -0,0 +1,257 @@
+//**************************************************************************************************
+// The functions included in this module implement the priors of the MAP unfolding algorithm. Each
+// prior computes the energy correction of every bin from the current spectrum, in place and without
+// allocating memory. The prior (and, for the window based priors, a 3 bin stencil when num_adjacent
+// is 1) is resolved once per unfolding by getMAPPrior instead of on every iteration.
+//**************************************************************************************************
+
+#include "map_priors.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+//==================================================================================================
+// Helpers for the window of 2*num_adjacent+1 spectral values centred on a bin
+//==================================================================================================
+// The window is monotonically increasing or decreasing (ties allowed). Uses the same comparisons as
+// std::is_sorted on the window and on the reversed window.
+static inline bool isMonotonic(const double* window, int window_size) {
+    bool increasing = true;
+    bool decreasing = true;
+    for (int i_n = 1; i_n < window_size; i_n++) {
+        if (window[i_n] < window[i_n-1]) {
+            increasing = false;
+        }
+        if (window[i_n-1] < window[i_n]) {
+            decreasing = false;
+        }
+    }
+    return increasing || decreasing;
+}
+
+static inline bool isMonotonic3(double a, double b, double c) {
+    return !((b < a || c < b) && (a < b || b < c));
+}
+
+static inline double median3(double a, double b, double c) {
+    return std::max(std::min(a, b), std::min(std::max(a, b), c));
+}
+
+static inline void clearEdges(int num_bins, int num_adjacent, double* energy_correction) {
+    for (int i_bin = 0; i_bin < num_adjacent; i_bin++) {
+        energy_correction[i_bin] = 0;
+        energy_correction[num_bins-1-i_bin] = 0;
+    }
+}
+
+//==================================================================================================
+// Quadratic prior (smoothing, no edge preservation). Uses the nearest neighbours only
+//==================================================================================================
+static void quadraticPrior(int num_bins, int num_adjacent, double beta, const double* spectrum,
+    double* energy_correction, double* neighbours)
+{
+    double diff_next = spectrum[0]-spectrum[1];
+    energy_correction[0] = beta*(diff_next*diff_next);
+    for (int i_bin = 1; i_bin < num_bins-1; i_bin++) {
+        double diff_previous = spectrum[i_bin]-spectrum[i_bin-1];
+        diff_next = spectrum[i_bin]-spectrum[i_bin+1];
+        energy_correction[i_bin] = beta*(diff_previous*diff_previous + diff_next*diff_next);
+    }
+    double diff_previous = spectrum[num_bins-1]-spectrum[num_bins-2];
+    energy_correction[num_bins-1] = beta*(diff_previous*diff_previous);
+}
+
+//==================================================================================================
+// Normalized quadratic prior. Uses the nearest neighbours only
+//==================================================================================================
+static void quadraticNormalizedPrior(int num_bins, int num_adjacent, double beta, const double* spectrum,
+    double* energy_correction, double* neighbours)
+{
+    double diff_next = spectrum[0]-spectrum[1];
+    energy_correction[0] = beta*sqrt(diff_next*diff_next)/spectrum[0];
+    for (int i_bin = 1; i_bin < num_bins-1; i_bin++) {
+        double diff_previous = spectrum[i_bin]-spectrum[i_bin-1];
+        diff_next = spectrum[i_bin]-spectrum[i_bin+1];
+        energy_correction[i_bin] = beta*sqrt(diff_previous*diff_previous + diff_next*diff_next)
+            / (2*spectrum[i_bin]);
+    }
+    double diff_previous = spectrum[num_bins-1]-spectrum[num_bins-2];
+    energy_correction[num_bins-1] = beta*sqrt(diff_previous*diff_previous)/spectrum[num_bins-1];
+}
+
+//==================================================================================================
+// Median Root Prior (edge preservation by not penalizing areas of monotonic increase or decrease)
+//==================================================================================================
+static void mrpPrior3(int num_bins, int num_adjacent, double beta, const double* spectrum,
+    double* energy_correction, double* neighbours)
+{
+    energy_correction[0] = 0; // no correction for first term
+    for (int i_bin = 1; i_bin < num_bins-1; i_bin++) {
+        double previous = spectrum[i_bin-1];
+        double current = spectrum[i_bin];
+        double next = spectrum[i_bin+1];
+
+        if (isMonotonic3(previous, current, next)) {
+            energy_correction[i_bin] = 0;
+        }
+        else {
+            double median = median3(previous, current, next);
+            energy_correction[i_bin] = beta*(current-median)/median;
+        }
+    }
+    energy_correction[num_bins-1] = 0; // no correction for last term
+}
+
+static void mrpPrior(int num_bins, int num_adjacent, double beta, const double* spectrum,
+    double* energy_correction, double* neighbours)
+{
+    const int window_size = 2*num_adjacent+1;
+
+    clearEdges(num_bins, num_adjacent, energy_correction);
+    for (int i_bin = num_adjacent; i_bin < num_bins-num_adjacent; i_bin++) {
+        const double* window = spectrum + i_bin - num_adjacent;
+
+        if (isMonotonic(window, window_size)) {
+            energy_correction[i_bin] = 0;
+        }
+        else {
+            std::copy(window, window + window_size, neighbours);
+            std::nth_element(neighbours, neighbours + num_adjacent, neighbours + window_size);
+            double median = neighbours[num_adjacent];
+            energy_correction[i_bin] = beta*(spectrum[i_bin]-median)/median;
+        }
+    }
+}
+
+//==================================================================================================
+// Custom Mean Root Prior: same as mrp, but relative to the sum of the window instead of its median
+//==================================================================================================
+static void meanrpPrior3(int num_bins, int num_adjacent, double beta, const double* spectrum,
+    double* energy_correction, double* neighbours)
+{
+    energy_correction[0] = 0; // no correction for first term
+    for (int i_bin = 1; i_bin < num_bins-1; i_bin++) {
+        double previous = spectrum[i_bin-1];
+        double current = spectrum[i_bin];
+        double next = spectrum[i_bin+1];
+
+        if (isMonotonic3(previous, current, next)) {
+            energy_correction[i_bin] = 0;
+        }
+        else {
+            double mean = previous + current + next;
+            energy_correction[i_bin] = beta*(current-mean)/mean;
+        }
+    }
+    energy_correction[num_bins-1] = 0; // no correction for last term
+}
+
+static void meanrpPrior(int num_bins, int num_adjacent, double beta, const double* spectrum,
+    double* energy_correction, double* neighbours)
+{
+    const int window_size = 2*num_adjacent+1;
+
+    clearEdges(num_bins, num_adjacent, energy_correction);
+    for (int i_bin = num_adjacent; i_bin < num_bins-num_adjacent; i_bin++) {
+        const double* window = spectrum + i_bin - num_adjacent;
+
+        if (isMonotonic(window, window_size)) {
+            energy_correction[i_bin] = 0;
+        }
+        else {
+            double mean = 0.0;
+            for (int i_n = 0; i_n < window_size; i_n++) {
+                mean += window[i_n];
+            }
+            energy_correction[i_bin] = beta*(spectrum[i_bin]-mean)/mean;
+        }
+    }
+}
+
+//==================================================================================================
+// Gaussians prior: penalizes the difference from the mean of the window (no edge preservation)
+//==================================================================================================
+static void gaussiansPrior3(int num_bins, int num_adjacent, double beta, const double* spectrum,
+    double* energy_correction, double* neighbours)
+{
+    energy_correction[0] = 0; // no correction for first term
+    for (int i_bin = 1; i_bin < num_bins-1; i_bin++) {
+        double mean = (spectrum[i_bin-1] + spectrum[i_bin] + spectrum[i_bin+1]) / 3;
+        energy_correction[i_bin] = beta*(spectrum[i_bin]-mean)/mean;
+    }
+    energy_correction[num_bins-1] = 0; // no correction for last term
+}
+
+static void gaussiansPrior(int num_bins, int num_adjacent, double beta, const double* spectrum,
+    double* energy_correction, double* neighbours)
+{
+    const int window_size = 2*num_adjacent+1;
+
+    clearEdges(num_bins, num_adjacent, energy_correction);
+    for (int i_bin = num_adjacent; i_bin < num_bins-num_adjacent; i_bin++) {
+        const double* window = spectrum + i_bin - num_adjacent;
+        double mean = 0.0;
+        for (int i_n = 0; i_n < window_size; i_n++) {
+            mean += window[i_n];
+        }
+        mean = mean / window_size;
+        energy_correction[i_bin] = beta*(spectrum[i_bin]-mean)/mean;
+    }
+}
+
+//==================================================================================================
+// Prior tables
+//==================================================================================================
+static const MAPPrior quadratic_prior = {"quadratic", quadraticPrior};
+static const MAPPrior quadratic_normalized_prior = {"quadratic_normalized", quadraticNormalizedPrior};
+static const MAPPrior mrp_prior = {"mrp", mrpPrior};
+static const MAPPrior meanrp_prior = {"meanrp", meanrpPrior};
+static const MAPPrior gaussians_prior = {"gaussians", gaussiansPrior};
+
+// 3 bin stencils of the window based priors (num_adjacent = 1)
+static const MAPPrior mrp_prior3 = {"mrp", mrpPrior3};
+static const MAPPrior meanrp_prior3 = {"meanrp", meanrpPrior3};
+static const MAPPrior gaussians_prior3 = {"gaussians", gaussiansPrior3};
+
+//==================================================================================================
+// Return the names of the priors accepted by getMAPPrior (i.e. the allowed values of 'prior')
+//==================================================================================================
+std::vector<std::string> getAvailableMAPPriors() {
+    std::vector<std::string> prior_names;
+    prior_names.push_back("quadratic");
+    prior_names.push_back("quadratic_normalized");
+    prior_names.push_back("mrp");
+    prior_names.push_back("meanrp");
+    prior_names.push_back("gaussians");
+    return prior_names;
+}
+
+//==================================================================================================
+// Return the prior with the provided name, using the 3 bin stencil of the window based priors if
+// num_adjacent is 1. Throws if the prior is unknown or num_adjacent is < 1.
+//==================================================================================================
+const MAPPrior& getMAPPrior(std::string prior_name, int num_adjacent) {
+    if (num_adjacent < 1) {
+        throw std::logic_error("num_adjacent must be >= 1");
+    }
+
+    if (prior_name == "quadratic") {
+        return quadratic_prior;
+    }
+    if (prior_name == "quadratic_normalized") {
+        return quadratic_normalized_prior;
+    }
+    if (prior_name == "mrp") {
+        return num_adjacent == 1 ? mrp_prior3 : mrp_prior;
+    }
+    if (prior_name == "meanrp") {
+        return num_adjacent == 1 ? meanrp_prior3 : meanrp_prior;
+    }
+    if (prior_name == "gaussians") {
+        return num_adjacent == 1 ? gaussians_prior3 : gaussians_prior;
+    }
+    throw std::logic_error("Unrecognized prior: " + prior_name + ". Please refer to the README for allowed priors");
+}
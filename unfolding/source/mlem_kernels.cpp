@@ -0,0 +1,741 @@
+//**************************************************************************************************
+// The functions included in this module implement the inner loops of the MLEM-style unfolding
+// algorithms (forward projection, ratio, back projection and spectral update) for several
+// instruction sets. The implementation used is selected at runtime from the features reported by
+// the CPU, so that a single executable can be run on any x86-64 machine.
+//**************************************************************************************************
+
+#include "mlem_kernels.h"
+#include "response_matrix.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MLEM_KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+//==================================================================================================
+// Scalar (portable) kernels
+//==================================================================================================
+static void forwardProjectScalar(const ResponseMatrix& nns_response, const double* spectrum,
+    double* mlem_estimate)
+{
+    for (int i_meas = 0; i_meas < nns_response.num_measurements; i_meas++) {
+        const double* response_row = nns_response.row(i_meas);
+        double temp_value = 0;
+        for (int i_bin = 0; i_bin < nns_response.num_bins; i_bin++) {
+            temp_value += response_row[i_bin]*spectrum[i_bin];
+        }
+        mlem_estimate[i_meas] = temp_value;
+    }
+}
+
+static void computeRatioScalar(int num_measurements, const double* measurements,
+    const double* mlem_estimate, double* mlem_ratio)
+{
+    for (int i_meas = 0; i_meas < num_measurements; i_meas++) {
+        mlem_ratio[i_meas] = measurements[i_meas]/mlem_estimate[i_meas];
+    }
+}
+
+static void backProjectScalar(const ResponseMatrix& nns_response, const double* mlem_ratio,
+    double* mlem_correction)
+{
+    for (int i_bin = 0; i_bin < nns_response.num_bins; i_bin++) {
+        const double* response_column = nns_response.column(i_bin);
+        double temp_value = 0;
+        for (int i_meas = 0; i_meas < nns_response.num_measurements; i_meas++) {
+            temp_value += response_column[i_meas]*mlem_ratio[i_meas];
+        }
+        mlem_correction[i_bin] = temp_value;
+    }
+}
+
+static void mlemStepScalar(const ResponseMatrix& nns_response, const double* measurements,
+    double* spectrum, double* mlem_estimate, double* mlem_ratio, double* mlem_correction)
+{
+    const double* inverse_normalized_response = nns_response.inverseNormalizedResponse();
+
+    forwardProjectScalar(nns_response, spectrum, mlem_estimate);
+    computeRatioScalar(nns_response.num_measurements, measurements, mlem_estimate, mlem_ratio);
+    backProjectScalar(nns_response, mlem_ratio, mlem_correction);
+
+    for (int i_bin = 0; i_bin < nns_response.num_bins; i_bin++) {
+        mlem_correction[i_bin] = mlem_correction[i_bin]*inverse_normalized_response[i_bin];
+        spectrum[i_bin] = spectrum[i_bin]*mlem_correction[i_bin];
+    }
+}
+
+//==================================================================================================
+// Batched MLEM step (see mlem_kernels.h). Each column is accumulated in the same order as the scalar
+// kernels, so results are bit-identical to unfolding each measurement set on its own.
+//==================================================================================================
+static void mlemStepBatchScalar(const ResponseMatrix& nns_response, int num_columns, int batch_stride,
+    const double* measurements, double* spectra, double* mlem_estimates, double* mlem_ratios,
+    double* mlem_corrections)
+{
+    const int num_measurements = nns_response.num_measurements;
+    const int num_bins = nns_response.num_bins;
+    const double* inverse_normalized_response = nns_response.inverseNormalizedResponse();
+
+    // Forward projection & ratio
+    for (int i_meas = 0; i_meas < num_measurements; i_meas++) {
+        const double* response_row = nns_response.row(i_meas);
+        double* estimate = mlem_estimates + i_meas*batch_stride;
+        for (int i_col = 0; i_col < num_columns; i_col++) {
+            estimate[i_col] = 0;
+        }
+        for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+            const double* spectrum = spectra + i_bin*batch_stride;
+            for (int i_col = 0; i_col < num_columns; i_col++) {
+                estimate[i_col] += response_row[i_bin]*spectrum[i_col];
+            }
+        }
+        const double* measurement = measurements + i_meas*batch_stride;
+        double* ratio = mlem_ratios + i_meas*batch_stride;
+        for (int i_col = 0; i_col < num_columns; i_col++) {
+            ratio[i_col] = measurement[i_col]/estimate[i_col];
+        }
+    }
+
+    // Normalized back projection fused with the multiplicative update
+    for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+        const double* response_column = nns_response.column(i_bin);
+        double* correction = mlem_corrections + i_bin*batch_stride;
+        for (int i_col = 0; i_col < num_columns; i_col++) {
+            correction[i_col] = 0;
+        }
+        for (int i_meas = 0; i_meas < num_measurements; i_meas++) {
+            const double* ratio = mlem_ratios + i_meas*batch_stride;
+            for (int i_col = 0; i_col < num_columns; i_col++) {
+                correction[i_col] += response_column[i_meas]*ratio[i_col];
+            }
+        }
+        double* spectrum = spectra + i_bin*batch_stride;
+        for (int i_col = 0; i_col < num_columns; i_col++) {
+            correction[i_col] = correction[i_col]*inverse_normalized_response[i_bin];
+            spectrum[i_col] = spectrum[i_col]*correction[i_col];
+        }
+    }
+}
+
+//==================================================================================================
+// Reference MLEM step: the loops of runMLEM before the kernels were introduced, which divide each
+// term of the back projection by the normalized response instead of multiplying the sum by its
+// reciprocal. Only used to check the kernels (see compareMLEMReference).
+//==================================================================================================
+static void mlemStepDivisionReference(const ResponseMatrix& nns_response, const double* measurements,
+    double* spectrum, double* mlem_estimate, double* mlem_ratio, double* mlem_correction)
+{
+    const std::vector<double>& normalized_response = nns_response.normalizedResponse();
+
+    for (int i_meas = 0; i_meas < nns_response.num_measurements; i_meas++) {
+        double temp_value = 0;
+        for (int i_bin = 0; i_bin < nns_response.num_bins; i_bin++) {
+            temp_value += nns_response.at(i_meas,i_bin)*spectrum[i_bin];
+        }
+        mlem_estimate[i_meas] = temp_value;
+    }
+    for (int i_meas = 0; i_meas < nns_response.num_measurements; i_meas++) {
+        mlem_ratio[i_meas] = measurements[i_meas]/mlem_estimate[i_meas];
+    }
+    for (int i_bin = 0; i_bin < nns_response.num_bins; i_bin++) {
+        double temp_value = 0;
+        for (int i_meas = 0; i_meas < nns_response.num_measurements; i_meas++) {
+            temp_value += nns_response.at(i_meas,i_bin)*mlem_ratio[i_meas]/normalized_response[i_bin];
+        }
+        mlem_correction[i_bin] = temp_value;
+    }
+    for (int i_bin = 0; i_bin < nns_response.num_bins; i_bin++) {
+        spectrum[i_bin] = spectrum[i_bin]*mlem_correction[i_bin];
+    }
+}
+
+#ifdef MLEM_KERNELS_X86
+//==================================================================================================
+// Problem dimensions seen by the SIMD kernels. The generic kernels are instantiated with
+// NMeas = NBins = 0 and read the dimensions from the response matrix at runtime. The fixed-geometry
+// kernels are instantiated with the spectrometer dimensions, so loop trip counts, matrix strides and
+// tail masks become compile-time constants and the short loops can be unrolled by the compiler.
+// The padded strides must match the layout of ResponseMatrix (rows padded to multiples of 8).
+//==================================================================================================
+template <int NMeas, int NBins>
+class KernelDimensions {
+    public:
+        static const int fixed_row_stride = ((NBins + 7) / 8) * 8;
+        static const int fixed_column_stride = ((NMeas + 7) / 8) * 8;
+
+        const int num_measurements;
+        const int num_bins;
+        const int row_stride;
+        const int column_stride;
+
+        explicit KernelDimensions(const ResponseMatrix& nns_response)
+            : num_measurements(NMeas > 0 ? NMeas : nns_response.num_measurements),
+              num_bins(NBins > 0 ? NBins : nns_response.num_bins),
+              row_stride(NBins > 0 ? fixed_row_stride : nns_response.row_stride),
+              column_stride(NMeas > 0 ? fixed_column_stride : nns_response.column_stride)
+        {}
+
+        static bool matches(const ResponseMatrix& nns_response) {
+            return nns_response.num_measurements == NMeas && nns_response.num_bins == NBins
+                && nns_response.row_stride == fixed_row_stride
+                && nns_response.column_stride == fixed_column_stride;
+        }
+};
+
+//==================================================================================================
+// AVX2 kernels (4 doubles per register)
+// Each output element is accumulated in a separate vector lane, by broadcasting one input value at
+// a time against a contiguous row of the matrix (or its transpose). This keeps the summation order
+// identical to the scalar kernels. Rows are zero-padded to whole cache lines, so matrix loads
+// never need masking; only the unpadded caller vectors are loaded/stored with a mask at the tail.
+//==================================================================================================
+__attribute__((target("avx2")))
+static inline __m256i tailMaskAVX2(int num_remaining) {
+    return _mm256_set_epi64x(num_remaining > 3 ? -1 : 0, num_remaining > 2 ? -1 : 0,
+        num_remaining > 1 ? -1 : 0, num_remaining > 0 ? -1 : 0);
+}
+
+template <int NMeas, int NBins>
+__attribute__((target("avx2")))
+static void forwardProjectAVX2(const ResponseMatrix& nns_response, const double* spectrum,
+    double* mlem_estimate)
+{
+    const KernelDimensions<NMeas,NBins> dims(nns_response);
+    const double* transpose = nns_response.column(0);
+    for (int i_meas = 0; i_meas < dims.num_measurements; i_meas += 4) {
+        __m256d temp_value = _mm256_setzero_pd();
+        for (int i_bin = 0; i_bin < dims.num_bins; i_bin++) {
+            __m256d response = _mm256_load_pd(transpose + i_bin*dims.column_stride + i_meas);
+            temp_value = _mm256_add_pd(temp_value, _mm256_mul_pd(response, _mm256_set1_pd(spectrum[i_bin])));
+        }
+        if (i_meas + 4 <= dims.num_measurements) {
+            _mm256_storeu_pd(mlem_estimate + i_meas, temp_value);
+        }
+        else {
+            _mm256_maskstore_pd(mlem_estimate + i_meas, tailMaskAVX2(dims.num_measurements - i_meas), temp_value);
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+static void computeRatioAVX2(int num_measurements, const double* measurements,
+    const double* mlem_estimate, double* mlem_ratio)
+{
+    int i_meas = 0;
+    for (; i_meas + 4 <= num_measurements; i_meas += 4) {
+        _mm256_storeu_pd(mlem_ratio + i_meas,
+            _mm256_div_pd(_mm256_loadu_pd(measurements + i_meas), _mm256_loadu_pd(mlem_estimate + i_meas)));
+    }
+    for (; i_meas < num_measurements; i_meas++) {
+        mlem_ratio[i_meas] = measurements[i_meas]/mlem_estimate[i_meas];
+    }
+}
+
+template <int NMeas, int NBins>
+__attribute__((target("avx2")))
+static void backProjectAVX2(const ResponseMatrix& nns_response, const double* mlem_ratio,
+    double* mlem_correction)
+{
+    const KernelDimensions<NMeas,NBins> dims(nns_response);
+    const double* response = nns_response.row(0);
+    for (int i_bin = 0; i_bin < dims.num_bins; i_bin += 4) {
+        __m256d temp_value = _mm256_setzero_pd();
+        for (int i_meas = 0; i_meas < dims.num_measurements; i_meas++) {
+            __m256d response_value = _mm256_load_pd(response + i_meas*dims.row_stride + i_bin);
+            temp_value = _mm256_add_pd(temp_value, _mm256_mul_pd(response_value, _mm256_set1_pd(mlem_ratio[i_meas])));
+        }
+        if (i_bin + 4 <= dims.num_bins) {
+            _mm256_storeu_pd(mlem_correction + i_bin, temp_value);
+        }
+        else {
+            _mm256_maskstore_pd(mlem_correction + i_bin, tailMaskAVX2(dims.num_bins - i_bin), temp_value);
+        }
+    }
+}
+
+template <int NMeas, int NBins>
+__attribute__((target("avx2")))
+static void mlemStepAVX2(const ResponseMatrix& nns_response, const double* measurements,
+    double* spectrum, double* mlem_estimate, double* mlem_ratio, double* mlem_correction)
+{
+    const KernelDimensions<NMeas,NBins> dims(nns_response);
+    const double* response = nns_response.row(0);
+    const double* inverse_normalized_response = nns_response.inverseNormalizedResponse();
+
+    forwardProjectAVX2<NMeas,NBins>(nns_response, spectrum, mlem_estimate);
+    computeRatioAVX2(dims.num_measurements, measurements, mlem_estimate, mlem_ratio);
+
+    // Normalized back projection fused with the multiplicative update
+    for (int i_bin = 0; i_bin < dims.num_bins; i_bin += 4) {
+        __m256d temp_value = _mm256_setzero_pd();
+        for (int i_meas = 0; i_meas < dims.num_measurements; i_meas++) {
+            __m256d response_value = _mm256_load_pd(response + i_meas*dims.row_stride + i_bin);
+            temp_value = _mm256_add_pd(temp_value, _mm256_mul_pd(response_value, _mm256_set1_pd(mlem_ratio[i_meas])));
+        }
+        __m256d correction = _mm256_mul_pd(temp_value, _mm256_load_pd(inverse_normalized_response + i_bin));
+        if (i_bin + 4 <= dims.num_bins) {
+            _mm256_storeu_pd(mlem_correction + i_bin, correction);
+            _mm256_storeu_pd(spectrum + i_bin, _mm256_mul_pd(_mm256_loadu_pd(spectrum + i_bin), correction));
+        }
+        else {
+            __m256i mask = tailMaskAVX2(dims.num_bins - i_bin);
+            _mm256_maskstore_pd(mlem_correction + i_bin, mask, correction);
+            _mm256_maskstore_pd(spectrum + i_bin, mask,
+                _mm256_mul_pd(_mm256_maskload_pd(spectrum + i_bin, mask), correction));
+        }
+    }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Batched MLEM step on a block of NVec*4 adjacent columns. The columns are independent, so the whole
+// step is done one block at a time, with the block's running sums held in registers (the loops over
+// column groups are unrolled so the sums are not spilled). Each matrix element is broadcast against
+// one register per column group.
+//--------------------------------------------------------------------------------------------------
+template <int NVec>
+__attribute__((target("avx2")))
+static inline void mlemStepBatchBlockAVX2(const ResponseMatrix& nns_response, int batch_stride,
+    const double* measurements, double* spectra, double* mlem_estimates, double* mlem_ratios,
+    double* mlem_corrections)
+{
+    const double* inverse_normalized_response = nns_response.inverseNormalizedResponse();
+    __m256d temp_value[NVec];
+
+    for (int i_meas = 0; i_meas < nns_response.num_measurements; i_meas++) {
+        const double* response_row = nns_response.row(i_meas);
+        #pragma GCC unroll 4
+        for (int i_vec = 0; i_vec < NVec; i_vec++) {
+            temp_value[i_vec] = _mm256_setzero_pd();
+        }
+        for (int i_bin = 0; i_bin < nns_response.num_bins; i_bin++) {
+            __m256d response_value = _mm256_set1_pd(response_row[i_bin]);
+            const double* spectrum = spectra + i_bin*batch_stride;
+            #pragma GCC unroll 4
+            for (int i_vec = 0; i_vec < NVec; i_vec++) {
+                temp_value[i_vec] = _mm256_add_pd(temp_value[i_vec],
+                    _mm256_mul_pd(response_value, _mm256_load_pd(spectrum + 4*i_vec)));
+            }
+        }
+        int offset = i_meas*batch_stride;
+        #pragma GCC unroll 4
+        for (int i_vec = 0; i_vec < NVec; i_vec++) {
+            _mm256_store_pd(mlem_estimates + offset + 4*i_vec, temp_value[i_vec]);
+            _mm256_store_pd(mlem_ratios + offset + 4*i_vec,
+                _mm256_div_pd(_mm256_load_pd(measurements + offset + 4*i_vec), temp_value[i_vec]));
+        }
+    }
+
+    for (int i_bin = 0; i_bin < nns_response.num_bins; i_bin++) {
+        const double* response_column = nns_response.column(i_bin);
+        #pragma GCC unroll 4
+        for (int i_vec = 0; i_vec < NVec; i_vec++) {
+            temp_value[i_vec] = _mm256_setzero_pd();
+        }
+        for (int i_meas = 0; i_meas < nns_response.num_measurements; i_meas++) {
+            __m256d response_value = _mm256_set1_pd(response_column[i_meas]);
+            const double* ratio = mlem_ratios + i_meas*batch_stride;
+            #pragma GCC unroll 4
+            for (int i_vec = 0; i_vec < NVec; i_vec++) {
+                temp_value[i_vec] = _mm256_add_pd(temp_value[i_vec],
+                    _mm256_mul_pd(response_value, _mm256_load_pd(ratio + 4*i_vec)));
+            }
+        }
+        __m256d inverse_value = _mm256_set1_pd(inverse_normalized_response[i_bin]);
+        int offset = i_bin*batch_stride;
+        #pragma GCC unroll 4
+        for (int i_vec = 0; i_vec < NVec; i_vec++) {
+            __m256d correction = _mm256_mul_pd(temp_value[i_vec], inverse_value);
+            _mm256_store_pd(mlem_corrections + offset + 4*i_vec, correction);
+            _mm256_store_pd(spectra + offset + 4*i_vec,
+                _mm256_mul_pd(_mm256_load_pd(spectra + offset + 4*i_vec), correction));
+        }
+    }
+}
+
+// All batch_stride columns are processed (including the padding), in blocks of 16 then 8 columns
+__attribute__((target("avx2")))
+static void mlemStepBatchAVX2(const ResponseMatrix& nns_response, int num_columns, int batch_stride,
+    const double* measurements, double* spectra, double* mlem_estimates, double* mlem_ratios,
+    double* mlem_corrections)
+{
+    int i_col = 0;
+    for (; i_col + 16 <= batch_stride; i_col += 16) {
+        mlemStepBatchBlockAVX2<4>(nns_response, batch_stride, measurements + i_col, spectra + i_col,
+            mlem_estimates + i_col, mlem_ratios + i_col, mlem_corrections + i_col);
+    }
+    for (; i_col < batch_stride; i_col += 8) {
+        mlemStepBatchBlockAVX2<2>(nns_response, batch_stride, measurements + i_col, spectra + i_col,
+            mlem_estimates + i_col, mlem_ratios + i_col, mlem_corrections + i_col);
+    }
+}
+
+//==================================================================================================
+// AVX-512 kernels (8 doubles per register). Same structure as the AVX2 kernels; the tail is handled
+// with AVX-512 mask registers.
+//==================================================================================================
+static inline __mmask8 tailMaskAVX512(int num_remaining) {
+    return num_remaining >= 8 ? (__mmask8) 0xFF : (__mmask8) ((1u << num_remaining) - 1);
+}
+
+template <int NMeas, int NBins>
+__attribute__((target("avx512f")))
+static void forwardProjectAVX512(const ResponseMatrix& nns_response, const double* spectrum,
+    double* mlem_estimate)
+{
+    const KernelDimensions<NMeas,NBins> dims(nns_response);
+    const double* transpose = nns_response.column(0);
+    for (int i_meas = 0; i_meas < dims.num_measurements; i_meas += 8) {
+        __m512d temp_value = _mm512_setzero_pd();
+        for (int i_bin = 0; i_bin < dims.num_bins; i_bin++) {
+            __m512d response = _mm512_load_pd(transpose + i_bin*dims.column_stride + i_meas);
+            temp_value = _mm512_add_pd(temp_value, _mm512_mul_pd(response, _mm512_set1_pd(spectrum[i_bin])));
+        }
+        _mm512_mask_storeu_pd(mlem_estimate + i_meas, tailMaskAVX512(dims.num_measurements - i_meas), temp_value);
+    }
+}
+
+__attribute__((target("avx512f")))
+static void computeRatioAVX512(int num_measurements, const double* measurements,
+    const double* mlem_estimate, double* mlem_ratio)
+{
+    for (int i_meas = 0; i_meas < num_measurements; i_meas += 8) {
+        __mmask8 mask = tailMaskAVX512(num_measurements - i_meas);
+        // Masked-off lanes divide 1 by 1 so no spurious floating point exceptions are raised
+        __m512d numerator = _mm512_mask_loadu_pd(_mm512_set1_pd(1.0), mask, measurements + i_meas);
+        __m512d denominator = _mm512_mask_loadu_pd(_mm512_set1_pd(1.0), mask, mlem_estimate + i_meas);
+        _mm512_mask_storeu_pd(mlem_ratio + i_meas, mask, _mm512_div_pd(numerator, denominator));
+    }
+}
+
+template <int NMeas, int NBins>
+__attribute__((target("avx512f")))
+static void backProjectAVX512(const ResponseMatrix& nns_response, const double* mlem_ratio,
+    double* mlem_correction)
+{
+    const KernelDimensions<NMeas,NBins> dims(nns_response);
+    const double* response = nns_response.row(0);
+    for (int i_bin = 0; i_bin < dims.num_bins; i_bin += 8) {
+        __m512d temp_value = _mm512_setzero_pd();
+        for (int i_meas = 0; i_meas < dims.num_measurements; i_meas++) {
+            __m512d response_value = _mm512_load_pd(response + i_meas*dims.row_stride + i_bin);
+            temp_value = _mm512_add_pd(temp_value, _mm512_mul_pd(response_value, _mm512_set1_pd(mlem_ratio[i_meas])));
+        }
+        _mm512_mask_storeu_pd(mlem_correction + i_bin, tailMaskAVX512(dims.num_bins - i_bin), temp_value);
+    }
+}
+
+template <int NMeas, int NBins>
+__attribute__((target("avx512f")))
+static void mlemStepAVX512(const ResponseMatrix& nns_response, const double* measurements,
+    double* spectrum, double* mlem_estimate, double* mlem_ratio, double* mlem_correction)
+{
+    const KernelDimensions<NMeas,NBins> dims(nns_response);
+    const double* response = nns_response.row(0);
+    const double* inverse_normalized_response = nns_response.inverseNormalizedResponse();
+
+    forwardProjectAVX512<NMeas,NBins>(nns_response, spectrum, mlem_estimate);
+    computeRatioAVX512(dims.num_measurements, measurements, mlem_estimate, mlem_ratio);
+
+    // Normalized back projection fused with the multiplicative update
+    for (int i_bin = 0; i_bin < dims.num_bins; i_bin += 8) {
+        __m512d temp_value = _mm512_setzero_pd();
+        for (int i_meas = 0; i_meas < dims.num_measurements; i_meas++) {
+            __m512d response_value = _mm512_load_pd(response + i_meas*dims.row_stride + i_bin);
+            temp_value = _mm512_add_pd(temp_value, _mm512_mul_pd(response_value, _mm512_set1_pd(mlem_ratio[i_meas])));
+        }
+        __mmask8 mask = tailMaskAVX512(dims.num_bins - i_bin);
+        __m512d correction = _mm512_mul_pd(temp_value, _mm512_load_pd(inverse_normalized_response + i_bin));
+        _mm512_mask_storeu_pd(mlem_correction + i_bin, mask, correction);
+        _mm512_mask_storeu_pd(spectrum + i_bin, mask,
+            _mm512_mul_pd(_mm512_maskz_loadu_pd(mask, spectrum + i_bin), correction));
+    }
+}
+// Batched MLEM step on a block of NVec*8 adjacent columns (see mlemStepBatchBlockAVX2)
+template <int NVec>
+__attribute__((target("avx512f")))
+static inline void mlemStepBatchBlockAVX512(const ResponseMatrix& nns_response, int batch_stride,
+    const double* measurements, double* spectra, double* mlem_estimates, double* mlem_ratios,
+    double* mlem_corrections)
+{
+    const double* inverse_normalized_response = nns_response.inverseNormalizedResponse();
+    __m512d temp_value[NVec];
+
+    for (int i_meas = 0; i_meas < nns_response.num_measurements; i_meas++) {
+        const double* response_row = nns_response.row(i_meas);
+        #pragma GCC unroll 4
+        for (int i_vec = 0; i_vec < NVec; i_vec++) {
+            temp_value[i_vec] = _mm512_setzero_pd();
+        }
+        for (int i_bin = 0; i_bin < nns_response.num_bins; i_bin++) {
+            __m512d response_value = _mm512_set1_pd(response_row[i_bin]);
+            const double* spectrum = spectra + i_bin*batch_stride;
+            #pragma GCC unroll 4
+            for (int i_vec = 0; i_vec < NVec; i_vec++) {
+                temp_value[i_vec] = _mm512_add_pd(temp_value[i_vec],
+                    _mm512_mul_pd(response_value, _mm512_load_pd(spectrum + 8*i_vec)));
+            }
+        }
+        int offset = i_meas*batch_stride;
+        #pragma GCC unroll 4
+        for (int i_vec = 0; i_vec < NVec; i_vec++) {
+            _mm512_store_pd(mlem_estimates + offset + 8*i_vec, temp_value[i_vec]);
+            _mm512_store_pd(mlem_ratios + offset + 8*i_vec,
+                _mm512_div_pd(_mm512_load_pd(measurements + offset + 8*i_vec), temp_value[i_vec]));
+        }
+    }
+
+    for (int i_bin = 0; i_bin < nns_response.num_bins; i_bin++) {
+        const double* response_column = nns_response.column(i_bin);
+        #pragma GCC unroll 4
+        for (int i_vec = 0; i_vec < NVec; i_vec++) {
+            temp_value[i_vec] = _mm512_setzero_pd();
+        }
+        for (int i_meas = 0; i_meas < nns_response.num_measurements; i_meas++) {
+            __m512d response_value = _mm512_set1_pd(response_column[i_meas]);
+            const double* ratio = mlem_ratios + i_meas*batch_stride;
+            #pragma GCC unroll 4
+            for (int i_vec = 0; i_vec < NVec; i_vec++) {
+                temp_value[i_vec] = _mm512_add_pd(temp_value[i_vec],
+                    _mm512_mul_pd(response_value, _mm512_load_pd(ratio + 8*i_vec)));
+            }
+        }
+        __m512d inverse_value = _mm512_set1_pd(inverse_normalized_response[i_bin]);
+        int offset = i_bin*batch_stride;
+        #pragma GCC unroll 4
+        for (int i_vec = 0; i_vec < NVec; i_vec++) {
+            __m512d correction = _mm512_mul_pd(temp_value[i_vec], inverse_value);
+            _mm512_store_pd(mlem_corrections + offset + 8*i_vec, correction);
+            _mm512_store_pd(spectra + offset + 8*i_vec,
+                _mm512_mul_pd(_mm512_load_pd(spectra + offset + 8*i_vec), correction));
+        }
+    }
+}
+
+// All batch_stride columns are processed (including the padding), in blocks of 32 then 8 columns
+__attribute__((target("avx512f")))
+static void mlemStepBatchAVX512(const ResponseMatrix& nns_response, int num_columns, int batch_stride,
+    const double* measurements, double* spectra, double* mlem_estimates, double* mlem_ratios,
+    double* mlem_corrections)
+{
+    int i_col = 0;
+    for (; i_col + 32 <= batch_stride; i_col += 32) {
+        mlemStepBatchBlockAVX512<4>(nns_response, batch_stride, measurements + i_col, spectra + i_col,
+            mlem_estimates + i_col, mlem_ratios + i_col, mlem_corrections + i_col);
+    }
+    for (; i_col < batch_stride; i_col += 8) {
+        mlemStepBatchBlockAVX512<1>(nns_response, batch_stride, measurements + i_col, spectra + i_col,
+            mlem_estimates + i_col, mlem_ratios + i_col, mlem_corrections + i_col);
+    }
+}
+#endif
+
+//==================================================================================================
+// Kernel tables
+//==================================================================================================
+static const MLEMKernels scalar_kernels = {
+    "scalar", forwardProjectScalar, computeRatioScalar, backProjectScalar, mlemStepScalar,
+    mlemStepBatchScalar
+};
+#ifdef MLEM_KERNELS_X86
+static const MLEMKernels avx2_kernels = {
+    "avx2", forwardProjectAVX2<0,0>, computeRatioAVX2, backProjectAVX2<0,0>, mlemStepAVX2<0,0>,
+    mlemStepBatchAVX2
+};
+static const MLEMKernels avx512_kernels = {
+    "avx512", forwardProjectAVX512<0,0>, computeRatioAVX512, backProjectAVX512<0,0>, mlemStepAVX512<0,0>,
+    mlemStepBatchAVX512
+};
+
+// Fixed-geometry kernels for the NNS: 8 moderator configurations x 52 energy bins
+static const MLEMKernels avx2_nns_kernels = {
+    "avx2_8x52", forwardProjectAVX2<8,52>, computeRatioAVX2, backProjectAVX2<8,52>, mlemStepAVX2<8,52>,
+    mlemStepBatchAVX2
+};
+static const MLEMKernels avx512_nns_kernels = {
+    "avx512_8x52", forwardProjectAVX512<8,52>, computeRatioAVX512, backProjectAVX512<8,52>,
+    mlemStepAVX512<8,52>, mlemStepBatchAVX512
+};
+#endif
+
+// Kernel set used by the unfolding algorithms. Set once at startup via setMLEMKernels
+static const MLEMKernels* active_kernels = &scalar_kernels;
+
+//==================================================================================================
+// Return the names of the kernels that can be run on this machine, fastest first
+//==================================================================================================
+std::vector<std::string> getAvailableMLEMKernels() {
+    std::vector<std::string> kernel_names;
+#ifdef MLEM_KERNELS_X86
+    if (__builtin_cpu_supports("avx512f")) {
+        kernel_names.push_back("avx512");
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        kernel_names.push_back("avx2");
+    }
+#endif
+    kernel_names.push_back("scalar");
+    return kernel_names;
+}
+
+//==================================================================================================
+// Return the kernel set with the provided name. "auto" selects the fastest kernel supported by the
+// CPU. Throws if the requested kernel is unknown or is not supported on this machine.
+//==================================================================================================
+const MLEMKernels& getMLEMKernels(std::string kernel_name) {
+    std::vector<std::string> kernel_names = getAvailableMLEMKernels();
+
+    if (kernel_name == "auto") {
+        kernel_name = kernel_names[0];
+    }
+    if (kernel_name != "scalar" && kernel_name != "avx2" && kernel_name != "avx512") {
+        throw std::logic_error("Unrecognized MLEM kernel: " + kernel_name
+            + ". Please refer to the README for allowed kernels");
+    }
+    if (std::find(kernel_names.begin(), kernel_names.end(), kernel_name) == kernel_names.end()) {
+        throw std::logic_error("MLEM kernel " + kernel_name + " is not supported by this CPU");
+    }
+
+#ifdef MLEM_KERNELS_X86
+    if (kernel_name == "avx512") {
+        return avx512_kernels;
+    }
+    if (kernel_name == "avx2") {
+        return avx2_kernels;
+    }
+#endif
+    return scalar_kernels;
+}
+
+//==================================================================================================
+// Select the kernel set used by all subsequent unfolding. Must be called before any unfolding
+// threads are started.
+//==================================================================================================
+void setMLEMKernels(std::string kernel_name) {
+    active_kernels = &getMLEMKernels(kernel_name);
+}
+
+//==================================================================================================
+// Return the kernel set currently used by the unfolding algorithms
+//==================================================================================================
+const MLEMKernels& getActiveMLEMKernels() {
+    return *active_kernels;
+}
+
+//==================================================================================================
+// Return the fixed-geometry variant of the provided kernel set if the response matrix has a known
+// geometry, otherwise the provided (generic) kernel set. Only the SIMD kernels have fixed-geometry
+// variants; the scalar kernel is only used as a fallback and for validation.
+//==================================================================================================
+static const MLEMKernels& getFixedGeometryMLEMKernels(const MLEMKernels& kernels,
+    const ResponseMatrix& nns_response)
+{
+#ifdef MLEM_KERNELS_X86
+    if (KernelDimensions<8,52>::matches(nns_response)) {
+        if (&kernels == &avx512_kernels) {
+            return avx512_nns_kernels;
+        }
+        if (&kernels == &avx2_kernels) {
+            return avx2_nns_kernels;
+        }
+    }
+#endif
+    return kernels;
+}
+
+//==================================================================================================
+// Return the kernel set to be used by the unfolding algorithms with the provided response matrix.
+// Dispatches to the compile-time specialized kernels when the geometry is known.
+//==================================================================================================
+const MLEMKernels& selectMLEMKernels(const ResponseMatrix& nns_response) {
+    return getFixedGeometryMLEMKernels(*active_kernels, nns_response);
+}
+
+//==================================================================================================
+// Return the largest difference between test_spectrum and reference_spectrum, relative to each
+// element of reference_spectrum (absolute where it is 0)
+//==================================================================================================
+static double maxRelativeDifference(std::vector<double>& test_spectrum,
+    std::vector<double>& reference_spectrum)
+{
+    double max_difference = 0;
+    for (int i_bin = 0; i_bin < (int) reference_spectrum.size(); i_bin++) {
+        double difference = std::abs(test_spectrum[i_bin]-reference_spectrum[i_bin]);
+        if (reference_spectrum[i_bin] != 0) {
+            difference /= std::abs(reference_spectrum[i_bin]);
+        }
+        if (difference > max_difference) {
+            max_difference = difference;
+        }
+    }
+    return max_difference;
+}
+
+//==================================================================================================
+// Run num_iterations MLEM steps from initial_spectrum with both the named kernel and the scalar
+// kernel, and return the largest relative difference between the resulting spectra. Used to check
+// a kernel against the reference (scalar) implementation; the expected result is exactly 0. If
+// fixed_geometry is set, the fixed-geometry variant of the named kernel is tested (if one exists).
+//==================================================================================================
+double compareMLEMKernels(std::string kernel_name, const ResponseMatrix& nns_response,
+    std::vector<double>& measurements, std::vector<double>& initial_spectrum, int num_iterations,
+    bool fixed_geometry)
+{
+    const MLEMKernels& kernels = fixed_geometry
+        ? getFixedGeometryMLEMKernels(getMLEMKernels(kernel_name), nns_response)
+        : getMLEMKernels(kernel_name);
+    int num_measurements = nns_response.num_measurements;
+    int num_bins = nns_response.num_bins;
+
+    std::vector<double> reference_spectrum = initial_spectrum;
+    std::vector<double> test_spectrum = initial_spectrum;
+    std::vector<double> mlem_estimate(num_measurements);
+    std::vector<double> mlem_ratio(num_measurements);
+    std::vector<double> mlem_correction(num_bins);
+
+    for (int i_iter = 0; i_iter < num_iterations; i_iter++) {
+        scalar_kernels.mlemStep(nns_response, &measurements[0], &reference_spectrum[0],
+            &mlem_estimate[0], &mlem_ratio[0], &mlem_correction[0]);
+        kernels.mlemStep(nns_response, &measurements[0], &test_spectrum[0],
+            &mlem_estimate[0], &mlem_ratio[0], &mlem_correction[0]);
+    }
+
+    return maxRelativeDifference(test_spectrum, reference_spectrum);
+}
+
+//==================================================================================================
+// Same as compareMLEMKernels, but against the division-based loops that the kernels replaced (see
+// mlemStepDivisionReference). Multiplying by the reciprocal of the normalized response rounds
+// differently, so the result is not exactly 0: it is compared with a tolerance.
+//==================================================================================================
+double compareMLEMReference(std::string kernel_name, const ResponseMatrix& nns_response,
+    std::vector<double>& measurements, std::vector<double>& initial_spectrum, int num_iterations,
+    bool fixed_geometry)
+{
+    const MLEMKernels& kernels = fixed_geometry
+        ? getFixedGeometryMLEMKernels(getMLEMKernels(kernel_name), nns_response)
+        : getMLEMKernels(kernel_name);
+    int num_measurements = nns_response.num_measurements;
+    int num_bins = nns_response.num_bins;
+
+    std::vector<double> reference_spectrum = initial_spectrum;
+    std::vector<double> test_spectrum = initial_spectrum;
+    std::vector<double> mlem_estimate(num_measurements);
+    std::vector<double> mlem_ratio(num_measurements);
+    std::vector<double> mlem_correction(num_bins);
+
+    for (int i_iter = 0; i_iter < num_iterations; i_iter++) {
+        mlemStepDivisionReference(nns_response, &measurements[0], &reference_spectrum[0],
+            &mlem_estimate[0], &mlem_ratio[0], &mlem_correction[0]);
+        kernels.mlemStep(nns_response, &measurements[0], &test_spectrum[0],
+            &mlem_estimate[0], &mlem_ratio[0], &mlem_correction[0]);
+    }
+
+    return maxRelativeDifference(test_spectrum, reference_spectrum);
+}
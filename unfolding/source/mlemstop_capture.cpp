@@ -0,0 +1,86 @@
+//**************************************************************************************************
+// The functions included in this module run a single MLEM-STOP trajectory and capture its state at
+// several J thresholds. MLEM-STOP runs from the same starting spectrum follow the same trajectory
+// and only differ by where they stop, so e.g. the nominal spectrum and both j_bounds spectra of
+// unfold_spectrum are obtained from one run (to the lowest threshold) instead of three.
+//**************************************************************************************************
+
+#include "mlemstop_capture.h"
+#include "mlem_kernels.h"
+#include "physics_calculations.h"
+
+#include <stdexcept>
+#include <vector>
+
+//--------------------------------------------------------------------------------------------------
+// Construct a capture of the trajectory at the provided J threshold (not yet reached)
+//--------------------------------------------------------------------------------------------------
+MLEMSTOPCapture::MLEMSTOPCapture(double j_threshold) {
+    this->j_threshold = j_threshold;
+    reached = false;
+    num_iterations = 0;
+    j_factor = 0;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Copy the captured spectrum & workspace buffers back, e.g. to continue as if runMLEMSTOP had
+// stopped at this capture
+//--------------------------------------------------------------------------------------------------
+void MLEMSTOPCapture::restore(std::vector<double>& spectrum, UnfoldingWorkspace& workspace) const {
+    spectrum = this->spectrum;
+    workspace.mlem_estimate = mlem_estimate;
+    workspace.mlem_ratio = mlem_ratio;
+    workspace.mlem_correction = mlem_correction;
+}
+
+//==================================================================================================
+// Run MLEM-STOP from spectrum until J <= the j_threshold of every capture, capturing the trajectory
+// when each threshold is first reached. Every capture is identical to the result of runMLEMSTOP
+// with its threshold. On return, spectrum & workspace hold the final iteration (that of the lowest
+// threshold), and the # of iterations performed is returned. Throws if the cutoff is reached before
+// every threshold.
+//==================================================================================================
+int runMLEMSTOPCapture(int cutoff, int num_measurements, int num_bins, std::vector<double> &measurements,
+    std::vector<double> &spectrum, ResponseMatrix &nns_response, UnfoldingWorkspace &workspace,
+    std::vector<MLEMSTOPCapture>& captures)
+{
+    int mlem_index; // index of MLEM iteration
+    int num_remaining = captures.size();
+
+    workspace.resize(num_measurements, num_bins);
+    std::vector<double> &mlem_ratio = workspace.mlem_ratio;
+    std::vector<double> &mlem_correction = workspace.mlem_correction;
+    std::vector<double> &mlem_estimate = workspace.mlem_estimate;
+    const MLEMKernels& kernels = selectMLEMKernels(nns_response);
+
+    for (int i_capture = 0; i_capture < (int) captures.size(); i_capture++) {
+        captures[i_capture].reached = false;
+    }
+
+    for (mlem_index = 0; mlem_index < cutoff && num_remaining > 0; mlem_index++) {
+        // One MLEM step (see runMLEMSTOP)
+        kernels.mlemStep(nns_response, &measurements[0], &spectrum[0], &mlem_estimate[0], 
+            &mlem_ratio[0], &mlem_correction[0]);
+
+        double j_factor = calculateJFactor(num_measurements,measurements,mlem_estimate);
+        for (int i_capture = 0; i_capture < (int) captures.size(); i_capture++) {
+            MLEMSTOPCapture& capture = captures[i_capture];
+            if (!capture.reached && j_factor <= capture.j_threshold) {
+                capture.reached = true;
+                capture.num_iterations = mlem_index;
+                capture.j_factor = j_factor;
+                capture.spectrum = spectrum;
+                capture.mlem_estimate = mlem_estimate;
+                capture.mlem_ratio = mlem_ratio;
+                capture.mlem_correction = mlem_correction;
+                num_remaining--;
+            }
+        }
+    }
+
+    if (num_remaining > 0) {
+        throw std::logic_error("MLEM-STOP reached cutoff # of iterations before reaching J threshold");
+    }
+
+    return mlem_index;
+}
@@ -0,0 +1,120 @@
+//**************************************************************************************************
+// The functions included in this module unfold a spectrum with MLEM on a sequence of coarse-to-fine
+// energy grids (algorithm = mlem_multigrid). The low-frequency components of the spectrum converge
+// slowly on a fine grid, but quickly on a coarse one: unfolding on the coarse grids first and using
+// the result as the starting spectrum of the next finer grid reduces the # of iterations needed on
+// the native grid. This matters most for response matrices with many energy bins.
+//**************************************************************************************************
+
+#include "multigrid_mlem.h"
+#include "physics_calculations.h"
+
+#include <stdexcept>
+#include <vector>
+
+//--------------------------------------------------------------------------------------------------
+// Construct the level that merges pairs of adjacent bins of the finer level with the provided
+// response & weights
+//--------------------------------------------------------------------------------------------------
+MultigridLevel::MultigridLevel(int num_measurements, const ResponseMatrix& fine_response,
+    const std::vector<double>& fine_weights)
+{
+    int num_fine_bins = fine_weights.size();
+    num_bins = (num_fine_bins + 1)/2;
+
+    weights.assign(num_bins, 0.0);
+    for (int i_bin = 0; i_bin < num_fine_bins; i_bin++) {
+        weights[i_bin/2] += fine_weights[i_bin];
+    }
+
+    // Weighted average of the fine response columns of each coarse bin (plain average if the
+    // weights of the bin are all zero)
+    std::vector<double> values((size_t) num_measurements*num_bins, 0.0);
+    for (int i_meas = 0; i_meas < num_measurements; i_meas++) {
+        const double* fine_row = fine_response.row(i_meas);
+        double* row = &values[(size_t) i_meas*num_bins];
+        for (int i_bin = 0; i_bin < num_fine_bins; i_bin++) {
+            int i_coarse = i_bin/2;
+            if (weights[i_coarse] > 0) {
+                row[i_coarse] += fine_row[i_bin]*fine_weights[i_bin]/weights[i_coarse];
+            }
+            else {
+                int group_size = (2*i_coarse + 1 < num_fine_bins) ? 2 : 1;
+                row[i_coarse] += fine_row[i_bin]/group_size;
+            }
+        }
+    }
+    nns_response = ResponseMatrix(num_measurements, num_bins, &values[0]);
+    workspace = UnfoldingWorkspace(num_measurements, num_bins);
+    spectrum = weights;
+}
+
+//==================================================================================================
+// Divide the flux of each coarse bin between its fine bins in proportion to the current values of
+// fine_spectrum (which must still hold the weights used to construct the coarse level), in place
+//==================================================================================================
+static void prolongSpectrum(const MultigridLevel& coarse_level, std::vector<double>& fine_spectrum) {
+    int num_fine_bins = fine_spectrum.size();
+    for (int i_bin = 0; i_bin < num_fine_bins; i_bin++) {
+        int i_coarse = i_bin/2;
+        double coarse_weight = coarse_level.weights[i_coarse];
+        if (coarse_weight > 0) {
+            fine_spectrum[i_bin] = coarse_level.spectrum[i_coarse]*fine_spectrum[i_bin]/coarse_weight;
+        }
+        else {
+            int group_size = (2*i_coarse + 1 < num_fine_bins) ? 2 : 1;
+            fine_spectrum[i_bin] = coarse_level.spectrum[i_coarse]/group_size;
+        }
+    }
+}
+
+//==================================================================================================
+// Multi-resolution MLEM. The energy grid is coarsened num_levels-1 times by merging pairs of
+// adjacent bins (see MultigridLevel), starting from the provided spectrum; coarsening stops early
+// once a level has a single bin. Starting from the coarsest level, level_iterations MLEM iterations
+// are run on each coarse level, and the result is prolonged to the next finer level as its starting
+// spectrum. The coarse levels run a fixed # of iterations: the stopping criterion (error) and the
+// maximum # of iterations (cutoff) apply only to the final MLEM on the native grid, and the
+// returned # of iterations is that of the native grid (as returned by runMLEM). num_levels = 1 is
+// standard MLEM.
+//
+// The coarse response matrices are built from the starting spectrum on each call, at a cost
+// similar to one MLEM iteration per level.
+//==================================================================================================
+int runMLEMMultigrid(int cutoff, double error, int num_levels, int level_iterations, int num_measurements,
+    int num_bins, std::vector<double> &measurements, std::vector<double> &spectrum,
+    ResponseMatrix& nns_response, UnfoldingWorkspace& workspace)
+{
+    if (num_levels < 1) {
+        throw std::logic_error("mlem_multigrid_levels must be >= 1");
+    }
+    if (level_iterations < 0) {
+        throw std::logic_error("mlem_multigrid_iterations must be >= 0");
+    }
+
+    // Fine to coarse. Reserved so that references to the levels remain valid.
+    std::vector<MultigridLevel> levels;
+    levels.reserve(num_levels-1);
+    for (int i_level = 1; i_level < num_levels; i_level++) {
+        const ResponseMatrix& fine_response = levels.empty() ? nns_response : levels.back().nns_response;
+        const std::vector<double>& fine_weights = levels.empty() ? spectrum : levels.back().spectrum;
+        if (fine_weights.size() < 2) {
+            break;
+        }
+        levels.push_back(MultigridLevel(num_measurements, fine_response, fine_weights));
+    }
+
+    // Coarse to fine. Each finer level still holds its weights when the coarser result is prolonged.
+    for (int i_level = (int) levels.size()-1; i_level >= 0; i_level--) {
+        MultigridLevel& level = levels[i_level];
+        // error = 0 never stops early
+        runMLEM(level_iterations, 0, num_measurements, level.num_bins, measurements, level.spectrum,
+            level.nns_response, level.workspace
+        );
+        prolongSpectrum(level, i_level > 0 ? levels[i_level-1].spectrum : spectrum);
+    }
+
+    return runMLEM(cutoff, error, num_measurements, num_bins, measurements, spectrum, nns_response,
+        workspace
+    );
+}
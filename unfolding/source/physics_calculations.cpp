@@ -4,6 +4,10 @@
 //**************************************************************************************************
 
 #include "physics_calculations.h"
+#include "mlem_kernels.h"
+#include "map_priors.h"
+#include "custom_classes.h"
+#include "multigrid_mlem.h"
 
 #include <iostream>
 #include <iomanip>
@@ -15,10 +19,6 @@
 #include <algorithm>
 #include <vector>
 
-// mt19937 is a random number generator class based on the Mersenne Twister algorithm
-// Create an mt19937 object, called mrand, that is seeded with the current time in seconds
-std::mt19937 mrand(std::time(0));
-
 //==================================================================================================
 // Process Measurements: obtain sample mean measured value and standard error of sample mean for 
 // each shell
@@ -91,30 +91,6 @@ double getSampleMeanStandardErrorD(std::vector<double>& data, double mean) {
     return sample_mean_standard_error;
 }
 
-//==================================================================================================
-// Return a 1D normalized vector of a system matrix used in MLEM-style reconstruction algorithms
-//==================================================================================================
-std::vector<double> normalizeResponse(int num_bins, int num_measurements, std::vector<std::vector<double>>& system_response)
-{
-    std::vector<double> normalized_vector;
-    // Create the normalization factors to be applied to MLEM-estimated spectral values:
-    //  - each element of f stores the sum of 8 elements of the transpose system (response)
-    //    matrix. The 8 elements correspond to the relative contributions of each MLEM-estimated
-    //    data point to the MLEM-estimated spectral value.
-    for(int i_bin = 0; i_bin < num_bins; i_bin++)
-    {
-        double temp_value = 0;
-        for(int i_meas = 0; i_meas < num_measurements; i_meas++)
-        {
-            temp_value += system_response[i_meas][i_bin];
-        }
-        normalized_vector.push_back(temp_value);
-    }
-
-    return normalized_vector;
-}
-
-
 //==================================================================================================
 // Normalize a vector of doubles such that the largest value in the vector is set as one. The vector
 // passed to this function is unaffected; a new normalized vector is returned.
@@ -140,19 +116,6 @@ std::vector<double> normalizeVector(std::vector<double>& unnormalized_vector)
 }
 
 
-//==================================================================================================
-// Return a poisson_distribution object, d that can be sampled from
-//  - accept a parameter 'lamda', that is used as the mean & std. dev of the poisson distribution
-//  - use the 'mrand' generator as the random number generator for the distribution
-//==================================================================================================
-double poisson(double lambda)
-{
-    std::poisson_distribution<int> d(lambda); // initialization
-
-    return d(mrand); // sample
-}
-
-
 //==================================================================================================
 // Calculate the root-mean-square deviation of a vector of values from a "true" value.
 //==================================================================================================
@@ -542,61 +505,30 @@ void calculateDerivatives(std::vector<double> &derivatives, int num_points, std:
 // Accept a series of measurements and an estimated input spectrum and perform the MLEM algorithm
 // until the true spectrum has been unfolded. Use the provided target error (error) and the maximum
 // number of MLEM iterations (cutoff) to determine when to cease execution of the algorithm. Note
-// that spectrum is updated as the algorithm progresses (passed by reference). Similarly for 
-// mlem_ratio
+// that spectrum is updated as the algorithm progresses (passed by reference). Similarly for the
+// mlem_ratio, mlem_correction and mlem_estimate buffers owned by workspace
 //==================================================================================================
 int runMLEM(int cutoff, double error, int num_measurements, int num_bins, std::vector<double> &measurements, 
-    std::vector<double> &spectrum, std::vector<std::vector<double>> &nns_response, std::vector<double> &normalized_response, 
-    std::vector<double> &mlem_ratio, std::vector<double> &mlem_correction, std::vector<double> &mlem_estimate) 
+    std::vector<double> &spectrum, ResponseMatrix &nns_response, UnfoldingWorkspace &workspace) 
 {
     int mlem_index; // index of MLEM iteration
 
-    for (mlem_index = 0; mlem_index < cutoff; mlem_index++) {
-        mlem_ratio.clear(); // wipe previous ratios for each iteration
-        mlem_correction.clear(); // wipe previous corrections for each iteration
-        mlem_estimate.clear();
-        // vector that stores the MLEM-estimated data to be compared with measured data
-        // std::vector<double> mlem_estimate;
-
-        // Apply system matrix, the nns_response, to current spectral estimate to get MLEM-estimated
-        // data. Save results in mlem_estimate
-        // Units: mlem_estimate [cps] = nns_response [cm^2] x spectru  [cps / cm^2]
-        for(int i_meas = 0; i_meas < num_measurements; i_meas++)
-        {
-            double temp_value = 0;
-            for(int i_bin = 0; i_bin < num_bins; i_bin++)
-            {
-                temp_value += nns_response[i_meas][i_bin]*spectrum[i_bin];
-            }
-            mlem_estimate.push_back(temp_value);
-        }
-
-        // Calculate ratio between each measured data point and corresponding MLEM-estimated data point
-        for(int i_meas = 0; i_meas < num_measurements; i_meas++)
-        {
-            mlem_ratio.push_back(measurements[i_meas]/mlem_estimate[i_meas]);
-        }
-
-        // matrix that stores the correction factor to be applied to each MLEM-estimated spectral value
-        // std::vector<double> mlem_correction;
-
-        // Create the correction factors to be applied to MLEM-estimated spectral values:
-        //  - multiply transpose system matrix by ratio values
-        for(int i_bin = 0; i_bin < num_bins; i_bin++)
-        {
-            double temp_value = 0;
-            for(int i_meas = 0; i_meas < num_measurements; i_meas++)
-            {
-                temp_value += nns_response[i_meas][i_bin]*mlem_ratio[i_meas]/normalized_response[i_bin];
-            }
-            mlem_correction.push_back(temp_value);
-        }
+    workspace.resize(num_measurements, num_bins);
+    std::vector<double> &mlem_ratio = workspace.mlem_ratio;
+    std::vector<double> &mlem_correction = workspace.mlem_correction;
+    std::vector<double> &mlem_estimate = workspace.mlem_estimate;
+    const MLEMKernels& kernels = selectMLEMKernels(nns_response);
 
-        // Apply correction factors and normalization to get new spectral estimate
-        for(int i_bin=0; i_bin < num_bins; i_bin++)
-        {
-            spectrum[i_bin] = (spectrum[i_bin]*mlem_correction[i_bin]);
-        }
+    for (mlem_index = 0; mlem_index < cutoff; mlem_index++) {
+        // One MLEM step (see mlem_kernels.h):
+        //  - apply system matrix, the nns_response, to current spectral estimate to get 
+        //    MLEM-estimated data, mlem_estimate [cps] = nns_response [cm^2] x spectrum [cps / cm^2]
+        //  - calculate ratio between each measured data point and MLEM-estimated data point
+        //  - create the correction factors by multiplying the transpose system matrix by the ratio
+        //    values, normalized by the column sums of the system matrix
+        //  - apply correction factors to get new spectral estimate
+        kernels.mlemStep(nns_response, &measurements[0], &spectrum[0], &mlem_estimate[0], 
+            &mlem_ratio[0], &mlem_correction[0]);
 
         // End MLEM iterations if ratio between measured and MLEM-estimated data points is within
         // tolerace specified by 'error'
@@ -617,62 +549,188 @@ int runMLEM(int cutoff, double error, int num_measurements, int num_bins, std::v
 
 
 //==================================================================================================
-// A modified version of the MLEM algorithm. A J value (Bouallegue et al 2013) is calculated at each
-// iteration and unfolding is terminated when J is less than the pre-determined J threshold value.
+// Return true if every ratio between measured and MLEM-estimated data is within the tolerance
+// specified by 'error' (the stopping criterion of runMLEM)
 //==================================================================================================
-int runMLEMSTOP(int cutoff, int num_measurements, int num_bins, std::vector<double> &measurements, 
-    std::vector<double> &spectrum, std::vector<std::vector<double>> &nns_response, std::vector<double> &normalized_response, 
-    std::vector<double> &mlem_ratio, std::vector<double> &mlem_correction, std::vector<double> &mlem_estimate,
-    double j_threshold, double& j_factor) 
+static bool ratiosWithinError(int num_measurements, double error, std::vector<double> &mlem_ratio) {
+    for (int i_meas=0; i_meas < num_measurements; i_meas++) {
+        if (mlem_ratio[i_meas] >= (1+error) || mlem_ratio[i_meas] <= (1-error)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+//==================================================================================================
+// Over-relaxed MLEM (Lewitt & Muehllehner 1986): each MLEM correction factor is raised to the power
+// 'relaxation' before being applied, i.e. spectrum *= mlem_correction^relaxation. relaxation = 1
+// is standard MLEM; values between 1 and 2 take proportionally larger steps along the MLEM update
+// direction. The update is multiplicative, so the spectrum stays positive. Same stopping criterion
+// and iteration count semantics as runMLEM.
+//==================================================================================================
+int runMLEMOR(int cutoff, double error, double relaxation, int num_measurements, int num_bins,
+    std::vector<double> &measurements, std::vector<double> &spectrum, ResponseMatrix &nns_response,
+    UnfoldingWorkspace &workspace)
 {
     int mlem_index; // index of MLEM iteration
 
+    workspace.resize(num_measurements, num_bins);
+    std::vector<double> &mlem_ratio = workspace.mlem_ratio;
+    std::vector<double> &mlem_correction = workspace.mlem_correction;
+    std::vector<double> &mlem_estimate = workspace.mlem_estimate;
+    const MLEMKernels& kernels = selectMLEMKernels(nns_response);
+
     for (mlem_index = 0; mlem_index < cutoff; mlem_index++) {
-        mlem_ratio.clear(); // wipe previous ratios for each iteration
-        mlem_correction.clear(); // wipe previous corrections for each iteration
-        mlem_estimate.clear();
-        // vector that stores the MLEM-estimated data to be compared with measured data
-        // std::vector<double> mlem_estimate;
+        // One MLEM step (spectrum *= mlem_correction), then apply the remaining factor of the
+        // over-relaxed correction
+        kernels.mlemStep(nns_response, &measurements[0], &spectrum[0], &mlem_estimate[0], 
+            &mlem_ratio[0], &mlem_correction[0]);
+        for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+            spectrum[i_bin] = spectrum[i_bin]*pow(mlem_correction[i_bin], relaxation-1);
+        }
 
-        // Apply system matrix, the nns_response, to current spectral estimate to get MLEM-estimated
-        // data. Save results in mlem_estimate
-        // Units: mlem_estimate [cps] = nns_response [cm^2] x spectru  [cps / cm^2]
-        for(int i_meas = 0; i_meas < num_measurements; i_meas++)
-        {
-            double temp_value = 0;
-            for(int i_bin = 0; i_bin < num_bins; i_bin++)
-            {
-                temp_value += nns_response[i_meas][i_bin]*spectrum[i_bin];
-            }
-            mlem_estimate.push_back(temp_value);
+        if (ratiosWithinError(num_measurements, error, mlem_ratio)) {
+            break;
         }
+    }
 
-        // Calculate ratio between each measured data point and corresponding MLEM-estimated data point
-        for(int i_meas = 0; i_meas < num_measurements; i_meas++)
-        {
-            mlem_ratio.push_back(measurements[i_meas]/mlem_estimate[i_meas]);
+    return mlem_index;
+}
+
+
+//==================================================================================================
+// SQUAREM extrapolation (Varadhan & Roland 2008, scheme S3) of the spectra spectrum_0 -> spectrum_1 ->
+// spectrum_2 produced by two consecutive MLEM steps:
+//  spectrum = spectrum_0 - 2*alpha*r + alpha^2*v, with r = spectrum_1 - spectrum_0 and
+//  v = spectrum_2 - 2*spectrum_1 + spectrum_0
+// Returns false (spectrum not modified) if any extrapolated value is not positive.
+//==================================================================================================
+static bool extrapolateSQUAREM(double alpha, int num_bins, std::vector<double> &spectrum_0,
+    std::vector<double> &spectrum_1, std::vector<double> &spectrum)
+{
+    for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+        double r = spectrum_1[i_bin] - spectrum_0[i_bin];
+        double v = spectrum[i_bin] - 2*spectrum_1[i_bin] + spectrum_0[i_bin];
+        double extrapolated = spectrum_0[i_bin] - 2*alpha*r + alpha*alpha*v;
+        if (extrapolated <= 0 && spectrum[i_bin] > 0) {
+            return false;
         }
+    }
+    for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+        double r = spectrum_1[i_bin] - spectrum_0[i_bin];
+        double v = spectrum[i_bin] - 2*spectrum_1[i_bin] + spectrum_0[i_bin];
+        spectrum[i_bin] = std::max(0.0, spectrum_0[i_bin] - 2*alpha*r + alpha*alpha*v);
+    }
+    return true;
+}
 
-        // matrix that stores the correction factor to be applied to each MLEM-estimated spectral value
-        // std::vector<double> mlem_correction;
+//==================================================================================================
+// Maximum # of times the SQUAREM step length is moved towards -1 (plain MLEM) to keep the
+// extrapolated spectrum positive
+//==================================================================================================
+static const int SQUAREM_MAX_BACKTRACKS = 10;
 
-        // Create the correction factors to be applied to MLEM-estimated spectral values:
-        //  - multiply transpose system matrix by ratio values
-        for(int i_bin = 0; i_bin < num_bins; i_bin++)
-        {
-            double temp_value = 0;
-            for(int i_meas = 0; i_meas < num_measurements; i_meas++)
-            {
-                temp_value += nns_response[i_meas][i_bin]*mlem_ratio[i_meas]/normalized_response[i_bin];
+//==================================================================================================
+// MLEM accelerated with SQUAREM (Varadhan & Roland 2008). Each cycle takes two MLEM steps, jumps
+// along the extrapolated path (see extrapolateSQUAREM) and takes a third, stabilizing MLEM step from
+// the extrapolated spectrum. The step length alpha = -|r|/|v| (at most -1; -1 gives the result of
+// the two MLEM steps) is halved towards -1 until the extrapolated spectrum is positive. Every MLEM
+// step counts as one iteration and is checked against the runMLEM stopping criterion, so 'cutoff',
+// 'error' and the returned # of iterations have the same meaning as for runMLEM.
+//==================================================================================================
+int runSQUAREM(int cutoff, double error, int num_measurements, int num_bins,
+    std::vector<double> &measurements, std::vector<double> &spectrum, ResponseMatrix &nns_response,
+    UnfoldingWorkspace &workspace)
+{
+    int mlem_index = 0; // index of MLEM iteration
+
+    workspace.resize(num_measurements, num_bins);
+    std::vector<double> &mlem_ratio = workspace.mlem_ratio;
+    std::vector<double> &mlem_correction = workspace.mlem_correction;
+    std::vector<double> &mlem_estimate = workspace.mlem_estimate;
+    std::vector<double> &spectrum_0 = workspace.squarem_start;
+    std::vector<double> &spectrum_1 = workspace.squarem_step;
+    const MLEMKernels& kernels = selectMLEMKernels(nns_response);
+
+    while (mlem_index < cutoff) {
+        // Two MLEM steps from the start of the cycle. The buffers have the same size, so they are
+        // copied without reallocating
+        spectrum_0 = spectrum;
+        kernels.mlemStep(nns_response, &measurements[0], &spectrum[0], &mlem_estimate[0], 
+            &mlem_ratio[0], &mlem_correction[0]);
+        if (ratiosWithinError(num_measurements, error, mlem_ratio) || ++mlem_index >= cutoff) {
+            break;
+        }
+        spectrum_1 = spectrum;
+        kernels.mlemStep(nns_response, &measurements[0], &spectrum[0], &mlem_estimate[0], 
+            &mlem_ratio[0], &mlem_correction[0]);
+        if (ratiosWithinError(num_measurements, error, mlem_ratio) || ++mlem_index >= cutoff) {
+            break;
+        }
+
+        // Step length
+        double r_norm = 0;
+        double v_norm = 0;
+        for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+            double r = spectrum_1[i_bin] - spectrum_0[i_bin];
+            double v = spectrum[i_bin] - 2*spectrum_1[i_bin] + spectrum_0[i_bin];
+            r_norm += r*r;
+            v_norm += v*v;
+        }
+        double alpha = -1;
+        if (v_norm > 0) {
+            alpha = std::min(-1.0, -sqrt(r_norm/v_norm));
+        }
+
+        // Extrapolate. If no positive extrapolation is found, spectrum is left as the result of 
+        // the two MLEM steps (alpha = -1)
+        for (int i_backtrack = 0; i_backtrack < SQUAREM_MAX_BACKTRACKS && alpha < -1; i_backtrack++) {
+            if (extrapolateSQUAREM(alpha, num_bins, spectrum_0, spectrum_1, spectrum)) {
+                break;
             }
-            mlem_correction.push_back(temp_value);
+            alpha = (alpha-1)/2;
         }
 
-        // Apply correction factors and normalization to get new spectral estimate
-        for(int i_bin=0; i_bin < num_bins; i_bin++)
-        {
-            spectrum[i_bin] = (spectrum[i_bin]*mlem_correction[i_bin]);
+        // Stabilizing MLEM step from the extrapolated spectrum
+        kernels.mlemStep(nns_response, &measurements[0], &spectrum[0], &mlem_estimate[0], 
+            &mlem_ratio[0], &mlem_correction[0]);
+        if (ratiosWithinError(num_measurements, error, mlem_ratio)) {
+            break;
         }
+        mlem_index++;
+    }
+
+    return mlem_index;
+}
+
+
+//==================================================================================================
+// A modified version of the MLEM algorithm. A J value (Bouallegue et al 2013) is calculated at each
+// iteration and unfolding is terminated when J is less than the pre-determined J threshold value.
+//==================================================================================================
+int runMLEMSTOP(int cutoff, int num_measurements, int num_bins, std::vector<double> &measurements, 
+    std::vector<double> &spectrum, ResponseMatrix &nns_response, UnfoldingWorkspace &workspace,
+    double j_threshold, double& j_factor) 
+{
+    int mlem_index; // index of MLEM iteration
+
+    workspace.resize(num_measurements, num_bins);
+    std::vector<double> &mlem_ratio = workspace.mlem_ratio;
+    std::vector<double> &mlem_correction = workspace.mlem_correction;
+    std::vector<double> &mlem_estimate = workspace.mlem_estimate;
+    const MLEMKernels& kernels = selectMLEMKernels(nns_response);
+
+    for (mlem_index = 0; mlem_index < cutoff; mlem_index++) {
+        // One MLEM step (see mlem_kernels.h):
+        //  - apply system matrix, the nns_response, to current spectral estimate to get 
+        //    MLEM-estimated data, mlem_estimate [cps] = nns_response [cm^2] x spectrum [cps / cm^2]
+        //  - calculate ratio between each measured data point and MLEM-estimated data point
+        //  - create the correction factors by multiplying the transpose system matrix by the ratio
+        //    values, normalized by the column sums of the system matrix
+        //  - apply correction factors to get new spectral estimate
+        kernels.mlemStep(nns_response, &measurements[0], &spectrum[0], &mlem_estimate[0], 
+            &mlem_ratio[0], &mlem_correction[0]);
 
         // End MLEM iterations if the calculated j factor is below the threshold j value
         bool continue_mlem = true;
@@ -720,169 +778,49 @@ double determineJThreshold(int num_measurements, std::vector<double>& measuremen
 // Accept a series of measurements and an estimated input spectrum and perform the MLEM algorithm
 // until the true spectrum has been unfolded. Use the provided target error (error) and the maximum
 // number of MLEM iterations (cutoff) to determine when to cease execution of the algorithm. Note
-// that spectrum is updated as the algorithm progresses (passed by reference). Similarly for 
-// mlem_ratio
+// that spectrum is updated as the algorithm progresses (passed by reference). Similarly for the
+// mlem_ratio, mlem_correction, mlem_estimate and energy_correction buffers owned by workspace
 //==================================================================================================
-int runMAP(std::vector<double> &energy_correction, double beta, std::string prior, int cutoff, double error, 
-    int num_measurements, int num_bins, std::vector<double> &measurements, std::vector<double> &spectrum, 
-    std::vector<std::vector<double>> &nns_response, std::vector<double> &normalized_response, std::vector<double> &mlem_ratio) 
+int runMAP(double beta, std::string prior, int cutoff, double error, int num_measurements, int num_bins, 
+    std::vector<double> &measurements, std::vector<double> &spectrum, ResponseMatrix &nns_response, 
+    UnfoldingWorkspace &workspace) 
 {
     int mlem_index; // index of MLEM iteration
 
-    for (mlem_index = 0; mlem_index < cutoff; mlem_index++) {
-        mlem_ratio.clear(); // wipe previous ratios for each iteration
+    workspace.resize(num_measurements, num_bins);
+    std::vector<double> &mlem_ratio = workspace.mlem_ratio;
+    std::vector<double> &mlem_correction = workspace.mlem_correction;
+    std::vector<double> &mlem_estimate = workspace.mlem_estimate;
+    std::vector<double> &energy_correction = workspace.energy_correction;
+    std::vector<double> &neighbours = workspace.neighbours;
+    const int num_adjacent = workspace.num_adjacent; // on either side
+    const std::vector<double>& normalized_response = nns_response.normalizedResponse();
+    const MLEMKernels& kernels = selectMLEMKernels(nns_response);
+    const MAPPrior& map_prior = getMAPPrior(prior, num_adjacent);
 
-        // vector that stores the MLEM-estimated data to be compared with measured data
-        std::vector<double> mlem_estimate;
+    if (2*num_adjacent+1 > num_bins) {
+        throw std::logic_error("num_adjacent is too large for the # of energy bins");
+    }
+    if ((int) neighbours.size() < 2*num_adjacent+1) {
+        neighbours.assign(2*num_adjacent+1, 0.0);
+    }
 
+    for (mlem_index = 0; mlem_index < cutoff; mlem_index++) {
         // Apply system matrix, the nns_response, to current spectral estimate to get MLEM-estimated
         // data. Save results in mlem_estimate
         // Units: mlem_estimate [cps] = nns_response [cm^2] x spectru  [cps / cm^2]
-        for(int i_meas = 0; i_meas < num_measurements; i_meas++)
-        {
-            double temp_value = 0;
-            for(int i_bin = 0; i_bin < num_bins; i_bin++)
-            {
-                temp_value += nns_response[i_meas][i_bin]*spectrum[i_bin];
-            }
-            mlem_estimate.push_back(temp_value);
-        }
+        kernels.forwardProject(nns_response, &spectrum[0], &mlem_estimate[0]);
 
         // Calculate ratio between each measured data point and corresponding MLEM-estimated data point
-        for(int i_meas = 0; i_meas < num_measurements; i_meas++)
-        {
-            mlem_ratio.push_back(measurements[i_meas]/mlem_estimate[i_meas]);
-        }
-
-        // matrix that stores the correction factor to be applied to each MLEM-estimated spectral value
-        std::vector<double> mlem_correction;
+        kernels.computeRatio(num_measurements, &measurements[0], &mlem_estimate[0], &mlem_ratio[0]);
 
         // Create the correction factors to be applied to MLEM-estimated spectral values:
         //  - multiply transpose system matrix by ratio values
-        for(int i_bin = 0; i_bin < num_bins; i_bin++)
-        {
-            double temp_value = 0;
-            for(int i_meas = 0; i_meas < num_measurements; i_meas++)
-            {
-                temp_value += nns_response[i_meas][i_bin]*mlem_ratio[i_meas];
-            }
-            mlem_correction.push_back(temp_value);
-        }
+        kernels.backProject(nns_response, &mlem_ratio[0], &mlem_correction[0]);
 
-        //------------------------------------------------------------------------------------------
         // Create the MAP energy correction factors to be incorporated in the normalization
-        // std::vector<double> energy_correction;
-        energy_correction.clear();
-
-        // Quadratic prior (smoothing, no edge preservation):
-        if (prior == "quadratic") {
-            energy_correction.push_back(beta*pow(spectrum[0]-spectrum[1],2));
-            for (int i_bin=1; i_bin < num_bins-1; i_bin++)
-            {
-                double temp_value = 0;
-                temp_value = beta * (pow(spectrum[i_bin]-spectrum[i_bin-1],2)+pow(spectrum[i_bin]-spectrum[i_bin+1],2));          
-                energy_correction.push_back(temp_value);
-            }
-            energy_correction.push_back(beta*pow(spectrum[num_bins-1]-spectrum[num_bins-2],2));
-        }
-        // Normalized quadratic prior
-        else if (prior == "quadratic_normalized") {
-            energy_correction.push_back(beta*sqrt(pow(spectrum[0]-spectrum[1],2))/spectrum[0]);
-            for (int i_bin=1; i_bin < num_bins-1; i_bin++)
-            {
-                double temp_value = 0;
-                temp_value = beta * 
-                    sqrt(pow(spectrum[i_bin]-spectrum[i_bin-1],2)+pow(spectrum[i_bin]-spectrum[i_bin+1],2))
-                    / (2*spectrum[i_bin]);          
-                energy_correction.push_back(temp_value);
-            }
-            energy_correction.push_back(beta*sqrt(pow(spectrum[num_bins-1]-spectrum[num_bins-2],2))/spectrum[num_bins-1]);
-        }
-        // Median Root Prior (edge preservation by not penalizing areas of monotonic increase or decrease)
-        else if (prior == "mrp") {
-            int num_adjacent = 1; // on either side
-            energy_correction.push_back(0); // no correction for first term
-            for (int i_bin=num_adjacent; i_bin < num_bins-num_adjacent; i_bin++)
-            {
-                double median;
-
-                std::vector<double> neighbours(spectrum.begin()+i_bin-num_adjacent,spectrum.begin()+i_bin+num_adjacent+1);
-
-                // Determine if spectrum is monotonically increasing or decreasing by comparing
-                // current value with its neighbours
-                bool increasing = std::is_sorted(neighbours.begin(), neighbours.end());
-                std::reverse(neighbours.begin(),neighbours.end());
-                bool decreasing = std::is_sorted(neighbours.begin(), neighbours.end());
-
-                // if values are monotonically increasing or decreasing, no energy correction
-                if (increasing || decreasing) {
-                    energy_correction.push_back(0);
-                }
-                // Otherwise, apply energy correction 
-                else {
-                    std::sort(neighbours.begin(),neighbours.end());
-                    median = neighbours[num_adjacent];
-                    double temp_value = beta*(spectrum[i_bin]-median)/median;
-                    energy_correction.push_back(temp_value);
-                }
-            }
-            energy_correction.push_back(0); // no correction for last term
-        }
-        // Custom Mean Root Prior
-        else if (prior == "meanrp") {
-            int num_adjacent = 1; // on either side
-            energy_correction.push_back(0); // no correction for first term
-            for (int i_bin=num_adjacent; i_bin < num_bins-num_adjacent; i_bin++)
-            {
-                double mean = 0.0;
-
-                for (int i_n=i_bin-num_adjacent; i_n <= i_bin+num_adjacent; i_n++) {
-                    mean += spectrum[i_n];
-                }
-
-                std::vector<double> neighbours(spectrum.begin()+i_bin-num_adjacent,spectrum.begin()+i_bin+num_adjacent+1);
-
-                // Determine if spectrum is monotonically increasing or decreasing by comparing
-                // current value with its neighbours
-                bool increasing = std::is_sorted(neighbours.begin(), neighbours.end());
-                std::reverse(neighbours.begin(),neighbours.end());
-                bool decreasing = std::is_sorted(neighbours.begin(), neighbours.end());
-
-                // if values are monotonically increasing or decreasing, no energy correction
-                if (increasing || decreasing) {
-                    energy_correction.push_back(0);
-                }
-                // Otherwise, apply energy correction 
-                else {
-                    double temp_value = beta*(spectrum[i_bin]-mean)/mean;
-                    energy_correction.push_back(temp_value);
-                }
-            }
-            energy_correction.push_back(0); // no correction for last term
-        }
-        // Custom Mean Root Prior
-        else if (prior == "gaussians") {
-            int num_adjacent = 1; // on either side
-            energy_correction.push_back(0); // no correction for first term
-            for (int i_bin=num_adjacent; i_bin < num_bins-num_adjacent; i_bin++)
-            {
-                double mean = 0.0;
-
-                for (int i_n=i_bin-num_adjacent; i_n <= i_bin+num_adjacent; i_n++) {
-                    mean += spectrum[i_n];
-                }
-                
-                mean = mean / ((2*num_adjacent)+1);
-
-                double temp_value = beta*(spectrum[i_bin]-mean)/mean;
-                energy_correction.push_back(temp_value);
-            }
-            energy_correction.push_back(0); // no correction for last term
-        }
-        else {
-            throw std::logic_error("Unrecognized prior: " + prior + ". Please refer to the README for allowed priors");
-        }
-        //------------------------------------------------------------------------------------------
+        map_prior.energyCorrection(num_bins, num_adjacent, beta, &spectrum[0], &energy_correction[0],
+            &neighbours[0]);
 
         // Apply correction factors and normalization to get new spectral estimate
         for(int i_bin=0; i_bin < num_bins; i_bin++)
@@ -907,6 +845,54 @@ int runMAP(std::vector<double> &energy_correction, double beta, std::string prio
     return mlem_index;
 }
 
+//==================================================================================================
+// Unfold measurements with settings.algorithm (mlem, mlem_or, squarem, mlem_multigrid, mlemstop or
+// map) and the parameters of that algorithm in settings, starting from (and replacing) spectrum.
+// Returns the # of iterations. If algorithm = mlemstop, j_threshold is assigned the J threshold of
+// the measurements (see determineJThreshold) and j_factor the J factor of the unfolded spectrum;
+// otherwise both are left unchanged. The MLEM-STOP variant that captures the J bound spectra
+// (uncertainty_type = j_bounds, see mlemstop_capture.h) is left to the callers.
+//==================================================================================================
+int runUnfoldingAlgorithm(UnfoldingSettings& settings, int num_measurements, int num_bins,
+    std::vector<double> &measurements, std::vector<double> &spectrum, ResponseMatrix& nns_response,
+    UnfoldingWorkspace& workspace, double& j_threshold, double& j_factor)
+{
+    if (settings.algorithm == "mlem") {
+        return runMLEM(settings.cutoff, settings.error, num_measurements, num_bins, measurements, spectrum,
+            nns_response, workspace
+        );
+    }
+    else if (settings.algorithm == "mlem_or") {
+        return runMLEMOR(settings.cutoff, settings.error, settings.relaxation, num_measurements, num_bins,
+            measurements, spectrum, nns_response, workspace
+        );
+    }
+    else if (settings.algorithm == "squarem") {
+        return runSQUAREM(settings.cutoff, settings.error, num_measurements, num_bins, measurements, spectrum,
+            nns_response, workspace
+        );
+    }
+    else if (settings.algorithm == "mlem_multigrid") {
+        return runMLEMMultigrid(settings.cutoff, settings.error, settings.multigrid_levels,
+            settings.multigrid_iterations, num_measurements, num_bins, measurements, spectrum, nns_response,
+            workspace
+        );
+    }
+    else if (settings.algorithm == "mlemstop") {
+        j_threshold = determineJThreshold(num_measurements,measurements,settings.cps_crossover);
+        return runMLEMSTOP(settings.cutoff, num_measurements, num_bins, measurements, spectrum, nns_response,
+            workspace, j_threshold, j_factor
+        );
+    }
+    else if (settings.algorithm == "map") {
+        workspace.num_adjacent = settings.num_adjacent;
+        return runMAP(settings.beta, settings.prior, settings.cutoff, settings.error, num_measurements,
+            num_bins, measurements, spectrum, nns_response, workspace
+        );
+    }
+    throw std::logic_error("Unrecognized unfolding algorithm: " + settings.algorithm);
+}
+
 
 //==================================================================================================
 // Create a linearly interpolated vector of doubles with a minimum value a and a maximum value b 
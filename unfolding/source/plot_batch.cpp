@@ -0,0 +1,112 @@
+//**************************************************************************************************
+// The functions included in this module draw a list of figures (the batch mode of plot_spectra and
+// plot_lines, see plot_batch.h) in several worker processes. Nothing here depends on ROOT: the
+// figures are drawn by the PlotFigureFunction of the application.
+//**************************************************************************************************
+
+#include "plot_batch.h"
+
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+//==================================================================================================
+// Read the settings files listed in a manifest (one per line, # starts a comment line)
+//==================================================================================================
+std::vector<std::string> readPlotManifest(std::string path_manifest) {
+    std::ifstream manifest_file(path_manifest);
+    if (!manifest_file.is_open()) {
+        throw std::logic_error("Unable to open manifest file: " + path_manifest);
+    }
+
+    std::vector<std::string> settings_files;
+    std::string line;
+    while (std::getline(manifest_file, line)) {
+        // Trim whitespace (incl. the \r of files with Windows line endings)
+        size_t first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos || line[first] == '#') {
+            continue;
+        }
+        size_t last = line.find_last_not_of(" \t\r");
+        settings_files.push_back(line.substr(first, last - first + 1));
+    }
+    return settings_files;
+}
+
+//==================================================================================================
+// Draw figures i_job, i_job + num_jobs, ... of the manifest. Returns the # of figures that failed.
+//==================================================================================================
+static int plotShare(std::vector<std::string>& settings_files, int i_job, int num_jobs,
+    PlotFigureFunction plotFigure)
+{
+    int num_failed = 0;
+    for (size_t i_fig = i_job; i_fig < settings_files.size(); i_fig += num_jobs) {
+        try {
+            plotFigure(settings_files[i_fig]);
+        }
+        catch (const std::exception& error) {
+            std::cerr << "Error: figure " << settings_files[i_fig] << " was not drawn: " << error.what() << "\n";
+            num_failed++;
+        }
+    }
+    return num_failed;
+}
+
+//==================================================================================================
+// Draw every figure of the manifest using num_jobs worker processes (in this process if num_jobs
+// is 1). Each worker reports the # of figures it failed to draw through its exit status.
+//==================================================================================================
+int runPlotBatch(std::vector<std::string>& settings_files, int num_jobs, PlotFigureFunction plotFigure) {
+    int num_figures = settings_files.size();
+    if (num_jobs < 1) {
+        throw std::logic_error("Number of plotting jobs must be >= 1");
+    }
+    if (num_jobs > num_figures) {
+        num_jobs = num_figures;
+    }
+    if (num_jobs <= 1) {
+        return plotShare(settings_files, 0, 1, plotFigure);
+    }
+
+    // Flush before forking so that buffered output is not written by every worker
+    std::cout.flush();
+    std::cerr.flush();
+
+    std::vector<pid_t> workers;
+    int num_failed = 0;
+    for (int i_job = 0; i_job < num_jobs; i_job++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            int worker_failed = plotShare(settings_files, i_job, num_jobs, plotFigure);
+            std::cout.flush();
+            std::cerr.flush();
+            _exit(worker_failed < 255 ? worker_failed : 255);
+        }
+        if (pid < 0) {
+            // Draw the share of a worker that could not be started in this process
+            std::cerr << "Warning: unable to start plotting job " << i_job << "; drawing its figures serially\n";
+            num_failed += plotShare(settings_files, i_job, num_jobs, plotFigure);
+            continue;
+        }
+        workers.push_back(pid);
+    }
+
+    for (size_t i_worker = 0; i_worker < workers.size(); i_worker++) {
+        int status = 0;
+        if (waitpid(workers[i_worker], &status, 0) < 0 || !WIFEXITED(status)) {
+            std::cerr << "Error: a plotting job terminated abnormally\n";
+            num_failed++;
+        }
+        else {
+            num_failed += WEXITSTATUS(status);
+        }
+    }
+    return num_failed;
+}
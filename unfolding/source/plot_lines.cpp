@@ -1,6 +1,7 @@
 //**************************************************************************************************
 // This program reads in an arbitrary number of data series from a CSV file and plots them as line
-// graphs on a single set of axes.
+// graphs on a single set of axes. With --manifest, draws one figure per settings file listed in the
+// manifest (see plot_batch.h), reusing the canvas between figures.
 //**************************************************************************************************
 
 #include <iostream>
@@ -14,6 +15,8 @@
 
 #include "custom_classes.h"
 #include "fileio.h"
+#include "handle_args.h"
+#include "plot_batch.h"
 #include "root_helpers.h"
 
 // Root
@@ -38,10 +41,21 @@
 #include "TVectorD.h"
 #include "TVirtualPad.h"
 
-int main(int argc, char* argv[])
+//==================================================================================================
+// Canvas, created for the first figure and reused by the following figures of a batch, and the
+// objects drawn on it for the current figure
+//==================================================================================================
+static TCanvas *c1 = NULL;
+static TMultiGraph *mg = NULL; // owns the graphs of the figure
+static TLegend *leg = NULL;
+static TPaveText *pt = NULL;
+
+//==================================================================================================
+// Draw the figure described by the provided settings file
+//==================================================================================================
+static void plotLinesFigure(std::string settings_file)
 {
     // Read in settings
-    std::string settings_file = "input/plot_lines.cfg";
     PlotSettings settings;
     setPlotSettings(settings_file, settings); // Fill settings with any user provided settings
 
@@ -62,34 +76,38 @@ int main(int argc, char* argv[])
     // int num_points = x_data[0].size(); // Number of entries 
     int num_series = y_data.size();
 
-    // Generate the plot area
-    TCanvas *c1 = new TCanvas("c1","c1",settings.x_res,settings.y_res); // Resolution of the graph (px) specified in parameters
-    if (settings.x_log) {
-        c1->SetLogx();
+    // Generate the plot area (or clear the one of the previous figure, and delete the objects that
+    // were drawn on it)
+    if (!c1) {
+        c1 = new TCanvas("c1","c1",settings.x_res,settings.y_res); // Resolution of the graph (px) specified in parameters
     }
-    if (settings.y_log) {
-        c1->SetLogy();
-    }
-    if (settings.grayscale){
-        c1->GetCanvas()->SetGrayscale();
+    else {
+        c1->Clear();
+        c1->cd();
+        c1->SetCanvasSize(settings.x_res,settings.y_res);
     }
+    delete mg;
+    mg = NULL;
+    delete leg;
+    leg = NULL;
+    delete pt;
+    pt = NULL;
 
-    if (settings.x_grid) {
-        c1->SetGridx(1);
-    }
-    if (settings.y_grid) {
-        c1->SetGridy(1);
-    }
+    c1->SetLogx(settings.x_log ? 1 : 0);
+    c1->SetLogy(settings.y_log ? 1 : 0);
+    c1->GetCanvas()->SetGrayscale(settings.grayscale != 0);
+    c1->SetGridx(settings.x_grid ? 1 : 0);
+    c1->SetGridy(settings.y_grid ? 1 : 0);
 
     // Generate the legend
-    TLegend* leg = new TLegend(settings.legend_coords[0], settings.legend_coords[1], settings.legend_coords[2], 
+    leg = new TLegend(settings.legend_coords[0], settings.legend_coords[1], settings.legend_coords[2], 
         settings.legend_coords[3]); // with a text box
     leg->SetBorderSize(settings.legend_border_size);
     leg->SetTextSize(settings.legend_text_size);
     leg->SetFillStyle(0);
 
     // TVectorD xtv(num_points, &x_data[0]);
-    TMultiGraph *mg = new TMultiGraph();
+    mg = new TMultiGraph();
 
     // Loop through all series to be plotted
     for (int i_y = 0; i_y < num_series; i_y++) {
@@ -183,7 +201,7 @@ int main(int argc, char* argv[])
     if(settings.textbox){
         // TPaveText* pt = new TPaveText(0.15, 0.75, 0.4, 0.85, "nbNDC"); 
         // nb specifies no border, NDC specifies method of defining coordinates
-        TPaveText* pt = new TPaveText(settings.textbox_coords[0], settings.textbox_coords[1], 
+        pt = new TPaveText(settings.textbox_coords[0], settings.textbox_coords[1], 
             settings.textbox_coords[2], settings.textbox_coords[3], "nbNDC"); 
         pt->SetFillColorAlpha(kWhite,1);
         pt->SetTextAlign(12);
@@ -208,6 +226,37 @@ int main(int argc, char* argv[])
     // Output the plot to file
     const char *cstr_figure_file = settings.path_output_figure.c_str();
     c1->Print(cstr_figure_file);
+}
+
+int main(int argc, char* argv[])
+{
+    // Put arguments in vector for easier processing
+    std::vector<std::string> arg_vector;
+    for (int i = 1; i < argc; i++) {
+        arg_vector.push_back(argv[i]);
+    }
+
+    // Batch mode: manifest of settings files, and # of worker processes used to draw them
+    std::string path_manifest;
+    setfile(arg_vector, "--manifest", "", path_manifest);
+    std::string num_jobs_string;
+    setfile(arg_vector, "--jobs", "1", num_jobs_string);
+
+    std::vector<std::string> allowed_flags;
+    allowed_flags.push_back("--manifest");
+    allowed_flags.push_back("--jobs");
+    checkUnknownParameters(arg_vector, allowed_flags);
+
+    // Figures are only written to file: no graphics are needed
+    gROOT->SetBatch(kTRUE);
+
+    if (path_manifest.empty()) {
+        plotLinesFigure("input/plot_lines.cfg");
+        return 1;
+    }
 
-    return 1;
+    std::vector<std::string> settings_files = readPlotManifest(path_manifest);
+    int num_failed = runPlotBatch(settings_files, atoi(num_jobs_string.c_str()), plotLinesFigure);
+    std::cout << "Drew " << settings_files.size() - num_failed << " of " << settings_files.size() << " figures\n";
+    return num_failed > 0 ? 1 : 0;
 }
\ No newline at end of file
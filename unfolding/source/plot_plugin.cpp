@@ -0,0 +1,74 @@
+//**************************************************************************************************
+// The functions included in this module load the ROOT plotting plugin on demand (see
+// plot_plugin.h), so that the unfolding applications do not depend on ROOT.
+//**************************************************************************************************
+
+#include "plot_plugin.h"
+
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <dlfcn.h>
+#include <limits.h>
+#include <unistd.h>
+
+const char* PLOT_PLUGIN_FILE = "plot_plugin.so";
+const char* PLOT_SPECTRUM_SYMBOL = "unfoldingPlotSpectrum";
+
+//==================================================================================================
+// Return the path of the plotting plugin: next to the running executable, or in the current
+// directory if the location of the executable cannot be determined
+//==================================================================================================
+static std::string getPlotPluginPath() {
+    char path_executable[PATH_MAX];
+    ssize_t path_length = readlink("/proc/self/exe", path_executable, sizeof(path_executable) - 1);
+    if (path_length <= 0) {
+        return std::string("./") + PLOT_PLUGIN_FILE;
+    }
+    std::string directory(path_executable, path_length);
+    return directory.substr(0, directory.rfind('/') + 1) + PLOT_PLUGIN_FILE;
+}
+
+//==================================================================================================
+// Load the plotting plugin (once) and return its plotSpectrum entry point. Returns NULL, after
+// warning the user, if the plugin cannot be loaded (e.g. ROOT is not installed).
+//==================================================================================================
+static PlotSpectrumFunction loadPlotSpectrum() {
+    static std::once_flag load_flag;
+    static PlotSpectrumFunction plot_spectrum = NULL;
+    std::call_once(load_flag, []() {
+        std::string path_plugin = getPlotPluginPath();
+        void* handle = dlopen(path_plugin.c_str(), RTLD_NOW | RTLD_LOCAL);
+        if (handle == NULL) {
+            std::cerr << "Warning: figures are not generated, as the plotting plugin could not be loaded ("
+                << dlerror() << "). Build it with 'make plot_plugin.so' (requires ROOT), or set generate_figure=0\n";
+            return;
+        }
+        plot_spectrum = (PlotSpectrumFunction) dlsym(handle, PLOT_SPECTRUM_SYMBOL);
+        if (plot_spectrum == NULL) {
+            std::cerr << "Warning: figures are not generated, as " << path_plugin
+                << " is not a valid plotting plugin (" << dlerror() << ")\n";
+        }
+    });
+    return plot_spectrum;
+}
+
+//==================================================================================================
+// Plot a single flux spectrum (and its uncertainty) as a function of energy, using the plotting
+// plugin (see plotSpectrum in root_helpers.cpp). Returns 0 if the figure was generated.
+//==================================================================================================
+int plotSpectrumFigure(std::string path_figure, std::string irradiation_conditions,
+    int num_measurements, int num_bins, std::vector<double> &energy_bins, std::vector<double> &spectrum,
+    std::vector<double> &spectrum_uncertainty_upper, std::vector<double> &spectrum_uncertainty_lower)
+{
+    PlotSpectrumFunction plot_spectrum = loadPlotSpectrum();
+    if (plot_spectrum == NULL) {
+        return 1;
+    }
+    return plot_spectrum(path_figure.c_str(), irradiation_conditions.c_str(), num_measurements,
+        num_bins, energy_bins.data(), spectrum.data(), spectrum_uncertainty_upper.data(),
+        spectrum_uncertainty_lower.data()
+    );
+}
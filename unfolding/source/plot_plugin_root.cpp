@@ -0,0 +1,29 @@
+//**************************************************************************************************
+// Entry point of the ROOT plotting plugin (plot_plugin.so, see plot_plugin.h). The plugin is built
+// from this module and root_helpers.cpp, and is loaded by the unfolding applications only when a
+// figure is requested.
+//**************************************************************************************************
+
+#include "plot_plugin.h"
+#include "root_helpers.h"
+
+#include <string>
+#include <vector>
+
+//==================================================================================================
+// Unmangled wrapper of plotSpectrum, resolved by name when the plugin is loaded (must match
+// PlotSpectrumFunction)
+//==================================================================================================
+extern "C" int unfoldingPlotSpectrum(const char* path_figure, const char* irradiation_conditions,
+    int num_measurements, int num_bins, const double* energy_bins, const double* spectrum,
+    const double* spectrum_uncertainty_upper, const double* spectrum_uncertainty_lower)
+{
+    std::vector<double> energy_bins_vector(energy_bins, energy_bins + num_bins);
+    std::vector<double> spectrum_vector(spectrum, spectrum + num_bins);
+    std::vector<double> spectrum_uncertainty_upper_vector(spectrum_uncertainty_upper, spectrum_uncertainty_upper + num_bins);
+    std::vector<double> spectrum_uncertainty_lower_vector(spectrum_uncertainty_lower, spectrum_uncertainty_lower + num_bins);
+    return plotSpectrum(path_figure, irradiation_conditions, num_measurements, num_bins,
+        energy_bins_vector, spectrum_vector, spectrum_uncertainty_upper_vector,
+        spectrum_uncertainty_lower_vector
+    );
+}
@@ -1,6 +1,7 @@
 //**************************************************************************************************
 // This program reads in an arbitrary number of spectra and their uncertainties from a text file and
-// plots them on a single set of axes.
+// plots them on a single set of axes. With --manifest, draws one figure per settings file listed in
+// the manifest (see plot_batch.h), reusing the canvas & histograms between figures.
 //**************************************************************************************************
 
 #include <iostream>
@@ -14,6 +15,8 @@
 
 #include "custom_classes.h"
 #include "fileio.h"
+#include "handle_args.h"
+#include "plot_batch.h"
 #include "root_helpers.h"
 
 // Root
@@ -38,10 +41,23 @@
 #include "TVector.h"
 #include "TVirtualPad.h"
 
-int main(int argc, char* argv[])
+//==================================================================================================
+// Canvas & drawing objects, created for the first figure and reused by the following figures of a
+// batch. The histograms are rebinned for each figure.
+//==================================================================================================
+static TCanvas *c1 = NULL;
+static TH1F *ghosthist = NULL;
+static std::vector<TH1F*> histograms;
+static TLegend *leg = NULL;
+static TPaveText *pt = NULL;
+static std::vector<TGraphAsymmErrors*> uncertainty_graphs;
+
+//==================================================================================================
+// Draw the figure described by the provided settings file
+//==================================================================================================
+static void plotSpectraFigure(std::string settings_file)
 {
     // Set Settings
-    std::string settings_file = "input/plot_spectra.cfg";
     SpectraSettings settings;
     setSpectraSettings(settings_file, settings);
 
@@ -52,7 +68,8 @@ int main(int argc, char* argv[])
     std::vector<std::vector<double>> error_upper_array;
     std::vector<std::vector<double>> error_lower_array;
     readSpectra(settings.path_input_data, headers, energy_bins, spectra_array, error_lower_array, error_upper_array,
-        settings.plot_per_mu, settings.number_mu, settings.duration, settings.rows_per_spectrum);
+        settings.plot_per_mu, settings.number_mu, settings.duration, settings.rows_per_spectrum,
+        settings.selected_spectra);
 
     int num_spectra = spectra_array.size();
     int num_bins = energy_bins.size() - 1;
@@ -76,11 +93,25 @@ int main(int argc, char* argv[])
         }
     }
 
-    // Generate the plot area
-    TCanvas *c1 = new TCanvas("c1","c1",settings.x_res,settings.y_res); // Resolution of the graph (px) specified in parameters
-    if (settings.grayscale){
-        c1->GetCanvas()->SetGrayscale();
+    // Generate the plot area (or clear the one of the previous figure). Objects drawn on the
+    // previous figure that are not reused are deleted once they are no longer on the canvas.
+    if (!c1) {
+        c1 = new TCanvas("c1","c1",settings.x_res,settings.y_res); // Resolution of the graph (px) specified in parameters
+    }
+    else {
+        c1->Clear();
+        c1->cd();
+        c1->SetCanvasSize(settings.x_res,settings.y_res);
     }
+    c1->GetCanvas()->SetGrayscale(settings.grayscale != 0);
+    delete leg;
+    leg = NULL;
+    delete pt;
+    pt = NULL;
+    for (size_t i_graph = 0; i_graph < uncertainty_graphs.size(); i_graph++) {
+        delete uncertainty_graphs[i_graph];
+    }
+    uncertainty_graphs.clear();
 
     // Create a ghost histogram that defines the x range. There are no other options in ROOT to
     // suitably set the x range of a TH1 object. See:
@@ -93,7 +124,15 @@ int main(int argc, char* argv[])
         settings.x_max = energy_bins[num_bins];
     }
 
-    TH1F *ghosthist = new TH1F ("","",1,settings.x_min,settings.x_max) ;
+    if (!ghosthist) {
+        ghosthist = new TH1F ("","",1,settings.x_min,settings.x_max) ;
+    }
+    else {
+        ghosthist->SetBins(1,settings.x_min,settings.x_max);
+        ghosthist->Reset();
+        ghosthist->SetMinimum(); // automatic y axis limits unless set below
+        ghosthist->SetMaximum();
+    }
     ghosthist->SetBinContent(1,0); // ghosthist has one bin that extends from min to max, value 0
     ghosthist->SetLineWidth(0); // don't show the ghosthist bin
 
@@ -149,6 +188,8 @@ int main(int argc, char* argv[])
     // refer to https://root.cern.ch/doc/master/classTAttAxis.html#ae3067b6d4218970d09418291cbd84084
     if (settings.y_num_divs != 0)
         ghosthist->GetYaxis()->SetNdivisions(settings.y_num_divs,kFALSE);
+    else
+        ghosthist->GetYaxis()->SetNdivisions(510); // ROOT default
 
     // Add ghost to the canvas
     ghosthist->Draw("HIST");
@@ -157,14 +198,14 @@ int main(int argc, char* argv[])
     gStyle->SetOptStat(0); // Turns off the statistics box that is generated by default
 
     // Generate the legend
-    TLegend* leg = new TLegend(
+    leg = new TLegend(
         settings.legend_coords[0], settings.legend_coords[1], settings.legend_coords[2], settings.legend_coords[3]
     ); // with a text box
     leg->SetBorderSize(0);
     leg->SetTextSize(0.035*settings.font_size*settings.font_size_legend);
 
     // Convert spectral data from vector to array (array is necessary in TH1F constructors)
-    double bins_arr[num_bins];
+    std::vector<double> bins_arr(num_bins+1);
     for (int i_bin = 0; i_bin <= num_bins; i_bin++)
     {
         bins_arr[i_bin] = energy_bins[i_bin];
@@ -173,10 +214,15 @@ int main(int argc, char* argv[])
     int setting_size; // normalize all settings by the number of entries in that setting 
                       // (e.g. if have 10 colors set, the 11th plot series should reuse the 1st color)
 
-    // Create histograms
-    std::vector<TH1F*> histograms;
+    // Create histograms (or rebin and empty the ones of the previous figure)
     for (int i_spec = 0; i_spec < num_spectra; i_spec++) {
-        histograms.push_back(new TH1F("","",num_bins,bins_arr));
+        if (i_spec < (int) histograms.size()) {
+            histograms[i_spec]->SetBins(num_bins,&bins_arr[0]);
+            histograms[i_spec]->Reset();
+        }
+        else {
+            histograms.push_back(new TH1F("","",num_bins,&bins_arr[0]));
+        }
     }
 
     // Apply settings to the newly-created histograms
@@ -223,7 +269,7 @@ int main(int argc, char* argv[])
     if(settings.textbox){
         // TPaveText* pt = new TPaveText(0.15, 0.75, 0.4, 0.85, "nbNDC"); 
         // nb specifies no border, NDC specifies method of defining coordinates
-        TPaveText* pt = new TPaveText(settings.textbox_coords[0], settings.textbox_coords[1], 
+        pt = new TPaveText(settings.textbox_coords[0], settings.textbox_coords[1], 
             settings.textbox_coords[2], settings.textbox_coords[3], "nbNDC"
         );
         pt->SetFillColorAlpha(kWhite,0);
@@ -263,6 +309,7 @@ int main(int argc, char* argv[])
             num_bins, &(bins_log_avg[0]), &(spectra_array[i_spec][0]), &(xerror_lower_array[0]), &(xerror_upper_array[0]), 
             &(error_lower_array[i_spec][0]), &(error_upper_array[i_spec][0])
         );
+        uncertainty_graphs.push_back(ge);
 
         setting_size = settings.color_error.size();
         ge->SetFillColor(TColor::GetColor(settings.color_error[i_spec%setting_size].c_str()));
@@ -293,6 +340,38 @@ int main(int argc, char* argv[])
     // Output the plot to file
     const char *cstr_figure_file = settings.path_output_figure.c_str();
     c1->Print(cstr_figure_file);
+}
+
+int main(int argc, char* argv[])
+{
+    // Put arguments in vector for easier processing
+    std::vector<std::string> arg_vector;
+    for (int i = 1; i < argc; i++) {
+        arg_vector.push_back(argv[i]);
+    }
+
+    // Batch mode: manifest of settings files, and # of worker processes used to draw them
+    std::string path_manifest;
+    setfile(arg_vector, "--manifest", "", path_manifest);
+    std::string num_jobs_string;
+    setfile(arg_vector, "--jobs", "1", num_jobs_string);
+
+    std::vector<std::string> allowed_flags;
+    allowed_flags.push_back("--manifest");
+    allowed_flags.push_back("--jobs");
+    checkUnknownParameters(arg_vector, allowed_flags);
+
+    // Figures are only written to file: no graphics are needed
+    gROOT->SetBatch(kTRUE);
+    TH1::AddDirectory(kFALSE);
+
+    if (path_manifest.empty()) {
+        plotSpectraFigure("input/plot_spectra.cfg");
+        return 0;
+    }
 
-    return 0;
+    std::vector<std::string> settings_files = readPlotManifest(path_manifest);
+    int num_failed = runPlotBatch(settings_files, atoi(num_jobs_string.c_str()), plotSpectraFigure);
+    std::cout << "Drew " << settings_files.size() - num_failed << " of " << settings_files.size() << " figures\n";
+    return num_failed > 0 ? 1 : 0;
 }
\ No newline at end of file
@@ -1,6 +1,8 @@
 //**************************************************************************************************
-// This program reads in an arbitrary number of data series from a CSV file and plots them as a 2D
-// surface plot.
+// This program reads in a 2D grid of values (e.g. a parameter of interest as a function of beta & the
+// # of iterations, written by unfold_trend with algorithm=map) from a CSV or binary input file and
+// plots it as a 2D surface plot. Large grids can be reduced to fewer cells before they are drawn
+// (max_x_cells, max_y_cells).
 //**************************************************************************************************
 
 #include <iostream>
@@ -15,6 +17,7 @@
 #include "custom_classes.h"
 #include "fileio.h"
 #include "root_helpers.h"
+#include "surface_grid.h"
 
 // Root
 #include "TApplication.h"
@@ -24,9 +27,8 @@
 #include "TFrame.h"
 #include "TGaxis.h"
 #include "TGraph.h"
-#include "TGraph2D.h"
 #include "TGraphErrors.h"
-#include "TH2F.h"
+#include "TH2D.h"
 #include "TLatex.h"
 #include "TLine.h"
 #include "TLegend.h"
@@ -47,28 +49,27 @@ int main(int argc, char* argv[])
     SurfaceSettings settings;
     setSurfaceSettings(settings_file, settings); // Fill settings with any user provided settings
 
-    // Read in data
-    std::vector<std::string> headers;
-    std::vector<std::vector<double>> x_data;
-    std::vector<std::vector<double>> y_data;
-    readXYYCSV(settings.path_input_data, headers, x_data, y_data);
+    // Read in data. Each value is drawn as a cell spanning midway to its neighbours (see
+    // surface_grid.h), reduced to at most max_x_cells x max_y_cells cells if requested
+    SurfaceGrid grid;
+    readSurfaceGrid(settings.path_input_data, grid);
+    if (settings.max_x_cells > 0 || settings.max_y_cells > 0) {
+        reduceSurfaceGrid(grid, settings.max_x_cells, settings.max_y_cells, settings.cell_aggregation, grid);
+    }
 
-    int num_x = x_data[0].size();
-    int num_y = y_data.size();
+    int num_x = grid.num_x();
+    int num_y = grid.num_y();
 
     // Generate the plot area
     TCanvas *c1 = new TCanvas("c1","c1",settings.x_res,settings.y_res); // Resulution of the graph (px) specified in parameters
-    TGraph2D *dt = new TGraph2D();
-    std::string tgraph_titles = settings.title + "; " + settings.x_label + "; " + settings.y_label + "; " + settings.z_label;
-    dt->SetTitle(tgraph_titles.c_str());
-
-    int k=0;
-
-    // Populate with data
-    for (int i=1; i<num_y; i++) {
-        for (int j=1; j<num_x; j++) {
-            dt->SetPoint(k,x_data[i][j],stod(headers[i]),y_data[i][j]);
-            k++;
+    std::string histogram_titles = settings.title + "; " + settings.x_label + "; " + settings.y_label + "; " + settings.z_label;
+    TH2D *dt = new TH2D("surface", histogram_titles.c_str(), num_x, &grid.x_edges[0], num_y, &grid.y_edges[0]);
+    dt->SetStats(0);
+
+    // Populate with data (bin 0 is the underflow bin)
+    for (int i_y = 0; i_y < num_y; i_y++) {
+        for (int i_x = 0; i_x < num_x; i_x++) {
+            dt->SetBinContent(i_x+1, i_y+1, grid.at(i_x, i_y));
         }
     }
 
@@ -79,7 +80,6 @@ int main(int argc, char* argv[])
 
     // Set plot type
     dt->Draw("COLZ");
-    // dt->Draw("PCOLZ"); // 3D, no interpolation
 
     // Set axes ranges
     if (settings.z_min != settings.z_max) {
@@ -87,10 +87,10 @@ int main(int argc, char* argv[])
         dt->SetMaximum(settings.z_max);
     }
     if (settings.y_min != settings.y_max){
-        dt->GetYaxis()->SetLimits(settings.y_min,settings.y_max);
+        dt->GetYaxis()->SetRangeUser(settings.y_min,settings.y_max);
     }
     if (settings.x_min != settings.x_max){
-        dt->GetXaxis()->SetLimits(settings.x_min,settings.x_max);
+        dt->GetXaxis()->SetRangeUser(settings.x_min,settings.x_max);
     }
 
     // Axes title positions
@@ -109,7 +109,9 @@ int main(int argc, char* argv[])
         dt->GetZaxis()->SetNdivisions(settings.z_num_divs,kFALSE);
     }
 
-    c1->SetLogy(); // logarithmic y axis
+    if (grid.y_edges[0] > 0) {
+        c1->SetLogy(); // logarithmic y axis
+    }
 
     // Axes ticks
     c1->SetTickx(); // No parameter means show tick marks on both sides, labels on one
@@ -0,0 +1,224 @@
+//**************************************************************************************************
+// The functions included in this module record the phase timings & counters of an application
+// (see profiler.h). Memory allocations are counted by replacing the global operator new; the count
+// is only updated while a profiler is enabled.
+//**************************************************************************************************
+
+#include "profiler.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+static std::atomic<bool> count_allocations(false);
+static std::atomic<long long> num_allocations(0);
+
+//==================================================================================================
+// Global allocation functions. Identical to the default ones, apart from counting allocations while
+// profiling is enabled.
+//==================================================================================================
+static void* allocate(std::size_t size) {
+    if (count_allocations.load(std::memory_order_relaxed)) {
+        num_allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (size == 0) {
+        size = 1;
+    }
+    while (true) {
+        void* memory = std::malloc(size);
+        if (memory != NULL) {
+            return memory;
+        }
+        std::new_handler handler = std::get_new_handler();
+        if (handler == NULL) {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+
+void* operator new(std::size_t size) {
+    return allocate(size);
+}
+
+void* operator new[](std::size_t size) {
+    return allocate(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return allocate(size);
+    }
+    catch (std::bad_alloc&) {
+        return NULL;
+    }
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return allocate(size);
+    }
+    catch (std::bad_alloc&) {
+        return NULL;
+    }
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, const std::nothrow_t&) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void* memory, const std::nothrow_t&) noexcept {
+    std::free(memory);
+}
+
+//==================================================================================================
+// Profiler
+//==================================================================================================
+Profiler::Profiler() {
+    enabled = false;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Start profiling the application (the total time is measured from here)
+//--------------------------------------------------------------------------------------------------
+void Profiler::enable(std::string application) {
+    enabled = true;
+    this->application = application;
+    start_time = std::chrono::steady_clock::now();
+    count_allocations.store(true);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Add the time & allocations of one execution of a phase
+//--------------------------------------------------------------------------------------------------
+void Profiler::addPhase(std::string name, double seconds, long long num_allocations) {
+    if (!enabled) {
+        return;
+    }
+    for (int i_phase = 0; i_phase < (int) phases.size(); i_phase++) {
+        if (phases[i_phase].name == name) {
+            phases[i_phase].seconds += seconds;
+            phases[i_phase].num_allocations += num_allocations;
+            phases[i_phase].num_calls++;
+            return;
+        }
+    }
+    ProfilerPhase phase;
+    phase.name = name;
+    phase.seconds = seconds;
+    phase.num_allocations = num_allocations;
+    phase.num_calls = 1;
+    phases.push_back(phase);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Set the value of a counter (e.g. the # of iterations), replacing any previous value
+//--------------------------------------------------------------------------------------------------
+void Profiler::setCounter(std::string name, double value) {
+    if (!enabled) {
+        return;
+    }
+    for (int i_counter = 0; i_counter < (int) counters.size(); i_counter++) {
+        if (counters[i_counter].name == name) {
+            counters[i_counter].value = value;
+            return;
+        }
+    }
+    ProfilerCounter counter;
+    counter.name = name;
+    counter.value = value;
+    counters.push_back(counter);
+}
+
+double Profiler::totalSeconds() const {
+    if (!enabled) {
+        return 0;
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+}
+
+//--------------------------------------------------------------------------------------------------
+// Return the profile as a JSON object:
+//  {"application":..., "total_seconds":..., "total_allocations":...,
+//   "phases":[{"name":..., "seconds":..., "allocations":..., "calls":...}, ...],
+//   "counters":{<name>:<value>, ...}}
+//--------------------------------------------------------------------------------------------------
+std::string Profiler::toJSON() const {
+    std::ostringstream json;
+    json << std::setprecision(9);
+    json << "{\n";
+    json << "  \"application\": \"" << application << "\",\n";
+    json << "  \"total_seconds\": " << totalSeconds() << ",\n";
+    json << "  \"total_allocations\": " << numAllocations() << ",\n";
+    json << "  \"phases\": [";
+    for (int i_phase = 0; i_phase < (int) phases.size(); i_phase++) {
+        json << (i_phase == 0 ? "\n" : ",\n");
+        json << "    {\"name\": \"" << phases[i_phase].name << "\", \"seconds\": " << phases[i_phase].seconds
+            << ", \"allocations\": " << phases[i_phase].num_allocations
+            << ", \"calls\": " << phases[i_phase].num_calls << "}";
+    }
+    json << "\n  ],\n";
+    json << "  \"counters\": {";
+    for (int i_counter = 0; i_counter < (int) counters.size(); i_counter++) {
+        json << (i_counter == 0 ? "\n" : ",\n");
+        json << "    \"" << counters[i_counter].name << "\": " << counters[i_counter].value;
+    }
+    json << "\n  }\n";
+    json << "}\n";
+    return json.str();
+}
+
+void Profiler::writeJSON(std::string path) const {
+    std::ofstream pfile(path);
+    if (!pfile.is_open()) {
+        throw std::logic_error("Unable to create profile file: " + path);
+    }
+    pfile << toJSON();
+}
+
+//--------------------------------------------------------------------------------------------------
+// # of memory allocations made since profiling was enabled
+//--------------------------------------------------------------------------------------------------
+long long Profiler::numAllocations() {
+    return num_allocations.load(std::memory_order_relaxed);
+}
+
+//==================================================================================================
+// ScopedTimer
+//==================================================================================================
+ScopedTimer::ScopedTimer(Profiler& profiler, std::string phase) : profiler(profiler) {
+    running = profiler.enabled;
+    if (running) {
+        this->phase = phase;
+        start_allocations = Profiler::numAllocations();
+        start = std::chrono::steady_clock::now();
+    }
+}
+
+ScopedTimer::~ScopedTimer() {
+    stop();
+}
+
+void ScopedTimer::stop() {
+    if (!running) {
+        return;
+    }
+    running = false;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    profiler.addPhase(phase, seconds, Profiler::numAllocations() - start_allocations);
+}
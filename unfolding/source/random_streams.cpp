@@ -0,0 +1,178 @@
+//**************************************************************************************************
+// The functions included in this module provide the random numbers used to generate sampled
+// (pseudo-) measurement sets for the Monte Carlo uncertainty estimates. All random numbers are
+// derived from a single run seed, so uncertainty runs are reproducible.
+//**************************************************************************************************
+
+#include "random_streams.h"
+
+#include <stdint.h>
+#include <cmath>
+#include <ctime>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+//==================================================================================================
+// Philox4x32 constants (multipliers & Weyl sequence increments for the key schedule)
+//==================================================================================================
+static const uint32_t PHILOX_M0 = 0xD2511F53u;
+static const uint32_t PHILOX_M1 = 0xCD9E8D57u;
+static const uint32_t PHILOX_W0 = 0x9E3779B9u;
+static const uint32_t PHILOX_W1 = 0xBB67AE85u;
+static const int PHILOX_ROUNDS = 10;
+
+//--------------------------------------------------------------------------------------------------
+// Create the generator for substream 'stream' of the provided seed, positioned at its start
+//--------------------------------------------------------------------------------------------------
+Philox4x32::Philox4x32(uint64_t seed, uint64_t stream) {
+    key[0] = (uint32_t) seed;
+    key[1] = (uint32_t) (seed >> 32);
+    counter[0] = 0;
+    counter[1] = 0;
+    counter[2] = (uint32_t) stream;
+    counter[3] = (uint32_t) (stream >> 32);
+    block_index = 4; // no block generated yet
+}
+
+//--------------------------------------------------------------------------------------------------
+// Encrypt the current counter into block and advance the counter to the next block
+//--------------------------------------------------------------------------------------------------
+void Philox4x32::generateBlock() {
+    uint32_t x0 = counter[0];
+    uint32_t x1 = counter[1];
+    uint32_t x2 = counter[2];
+    uint32_t x3 = counter[3];
+    uint32_t k0 = key[0];
+    uint32_t k1 = key[1];
+
+    for (int i_round = 0; i_round < PHILOX_ROUNDS; i_round++) {
+        uint64_t product0 = (uint64_t) PHILOX_M0 * x0;
+        uint64_t product1 = (uint64_t) PHILOX_M1 * x2;
+        uint32_t y0 = (uint32_t) (product1 >> 32) ^ x1 ^ k0;
+        uint32_t y1 = (uint32_t) product1;
+        uint32_t y2 = (uint32_t) (product0 >> 32) ^ x3 ^ k1;
+        uint32_t y3 = (uint32_t) product0;
+        x0 = y0;
+        x1 = y1;
+        x2 = y2;
+        x3 = y3;
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    }
+
+    block[0] = x0;
+    block[1] = x1;
+    block[2] = x2;
+    block[3] = x3;
+    block_index = 0;
+
+    // 64-bit block counter within the stream
+    if (++counter[0] == 0) {
+        counter[1]++;
+    }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Return the next 32 random bits of the stream
+//--------------------------------------------------------------------------------------------------
+Philox4x32::result_type Philox4x32::operator()() {
+    if (block_index >= 4) {
+        generateBlock();
+    }
+    return block[block_index++];
+}
+
+//--------------------------------------------------------------------------------------------------
+// Return a uniformly distributed double in (0,1), built from 53 random bits. Zero is never
+// returned, so the result can safely be passed to log().
+//--------------------------------------------------------------------------------------------------
+double Philox4x32::uniform() {
+    uint64_t high = (*this)();
+    uint64_t low = (*this)();
+    uint64_t bits = ((high << 32) | low) >> 11;
+    return (bits + 0.5) * (1.0 / 9007199254740992.0); // 2^53
+}
+
+//--------------------------------------------------------------------------------------------------
+// Set up one Poisson distribution per mean (the expensive part of std::poisson_distribution)
+//--------------------------------------------------------------------------------------------------
+PoissonSampler::PoissonSampler(const std::vector<double>& means, int num_per_mean) {
+    if (num_per_mean < 1) {
+        throw std::logic_error("Number of Poisson samples per mean must be >= 1");
+    }
+    this->num_means = means.size();
+    this->num_per_mean = num_per_mean;
+    for (int i_mean = 0; i_mean < num_means; i_mean++) {
+        parameters.push_back(std::poisson_distribution<int>::param_type(means[i_mean]));
+    }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Fill variates (resized to num_means x num_per_mean) with Poisson draws. variates[i*num_per_mean+j]
+// is the j-th draw for mean i.
+//--------------------------------------------------------------------------------------------------
+void PoissonSampler::sample(Philox4x32& generator, std::vector<double>& variates) const {
+    variates.resize(num_means*num_per_mean);
+    std::poisson_distribution<int> distribution;
+    for (int i_mean = 0; i_mean < num_means; i_mean++) {
+        for (int i_draw = 0; i_draw < num_per_mean; i_draw++) {
+            variates[i_mean*num_per_mean + i_draw] = distribution(generator, parameters[i_mean]);
+        }
+    }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Store the mean & standard deviation of each Gaussian
+//--------------------------------------------------------------------------------------------------
+GaussianSampler::GaussianSampler(const std::vector<double>& means, const std::vector<double>& std_devs,
+    int num_per_mean)
+{
+    if (means.size() != std_devs.size()) {
+        throw std::logic_error("Gaussian sampling requires one standard deviation per mean");
+    }
+    if (num_per_mean < 1) {
+        throw std::logic_error("Number of Gaussian samples per mean must be >= 1");
+    }
+    this->num_means = means.size();
+    this->num_per_mean = num_per_mean;
+    this->means = means;
+    this->std_devs = std_devs;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Fill variates (resized to num_means x num_per_mean, same layout as PoissonSampler) with Gaussian
+// draws. Standard normal values are generated in pairs with the Box-Muller transform, so no state
+// is carried between calls.
+//--------------------------------------------------------------------------------------------------
+void GaussianSampler::sample(Philox4x32& generator, std::vector<double>& variates) const {
+    const double two_pi = 6.283185307179586;
+    int num_variates = num_means*num_per_mean;
+    variates.resize(num_variates);
+
+    for (int i_variate = 0; i_variate < num_variates; i_variate += 2) {
+        double radius = std::sqrt(-2.0*std::log(generator.uniform()));
+        double angle = two_pi*generator.uniform();
+        variates[i_variate] = radius*std::cos(angle);
+        if (i_variate+1 < num_variates) {
+            variates[i_variate+1] = radius*std::sin(angle);
+        }
+    }
+
+    for (int i_mean = 0; i_mean < num_means; i_mean++) {
+        for (int i_draw = 0; i_draw < num_per_mean; i_draw++) {
+            double& variate = variates[i_mean*num_per_mean + i_draw];
+            variate = means[i_mean] + std_devs[i_mean]*variate;
+        }
+    }
+}
+
+//==================================================================================================
+// Return a new (non-zero) run seed, for runs where no seed is provided by the user. The seed used
+// is written to the report so that the run can be reproduced.
+//==================================================================================================
+unsigned long generateRandomSeed() {
+    std::random_device device;
+    unsigned long seed = ((unsigned long) device() << 16 << 16) ^ device() ^ (unsigned long) std::time(0);
+    return seed != 0 ? seed : 1;
+}
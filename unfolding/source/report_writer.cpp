@@ -0,0 +1,88 @@
+//**************************************************************************************************
+// The functions included in this module implement the asynchronous writing of unfolding reports
+// (see report_writer.h).
+//**************************************************************************************************
+
+#include "report_writer.h"
+
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+//--------------------------------------------------------------------------------------------------
+// Start the writer thread
+//--------------------------------------------------------------------------------------------------
+ReportWriter::ReportWriter() {
+    finishing = false;
+    writer = std::thread(&ReportWriter::writerLoop, this);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Write the remaining reports and join the writer thread. Errors are only reported by finish.
+//--------------------------------------------------------------------------------------------------
+ReportWriter::~ReportWriter() {
+    try {
+        finish();
+    }
+    catch (...) {
+    }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Queue a report to be written (prepare_report)
+//--------------------------------------------------------------------------------------------------
+void ReportWriter::submit(std::unique_ptr<UnfoldingReport> report) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        reports.push_back(std::move(report));
+    }
+    condition.notify_one();
+}
+
+//--------------------------------------------------------------------------------------------------
+// Wait until every submitted report is written, and stop the writer thread
+//--------------------------------------------------------------------------------------------------
+void ReportWriter::finish() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        finishing = true;
+    }
+    condition.notify_one();
+    if (writer.joinable()) {
+        writer.join();
+    }
+    if (first_exception) {
+        std::exception_ptr exception = first_exception;
+        first_exception = nullptr;
+        std::rethrow_exception(exception);
+    }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Write the queued reports one at a time until finish is called and none remain
+//--------------------------------------------------------------------------------------------------
+void ReportWriter::writerLoop() {
+    while (true) {
+        std::unique_ptr<UnfoldingReport> report;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this] { return !reports.empty() || finishing; });
+            if (reports.empty()) {
+                return;
+            }
+            report = std::move(reports.front());
+            reports.pop_front();
+        }
+        try {
+            report->prepare_report();
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!first_exception) {
+                first_exception = std::current_exception();
+            }
+        }
+    }
+}
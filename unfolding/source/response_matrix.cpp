@@ -0,0 +1,132 @@
+//**************************************************************************************************
+// The functions included in this module manage the contiguous storage of the NNS response matrix
+// used by the unfolding algorithms.
+//**************************************************************************************************
+
+#include "response_matrix.h"
+
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <stdlib.h>
+#include <vector>
+
+// Number of doubles that fill one 64-byte cache line; rows are padded to a multiple of this
+const int DOUBLES_PER_LINE = 8;
+
+//==================================================================================================
+// Round a length up to the next multiple of the cache line length (in doubles)
+//==================================================================================================
+static int padLength(int length) {
+    return ((length + DOUBLES_PER_LINE - 1) / DOUBLES_PER_LINE) * DOUBLES_PER_LINE;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Default constructor for an empty ResponseMatrix. Required when used as a class member.
+//--------------------------------------------------------------------------------------------------
+ResponseMatrix::ResponseMatrix() {
+    num_measurements = 0;
+    num_bins = 0;
+    row_stride = 0;
+    column_stride = 0;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Construct a ResponseMatrix from the 2D vector returned by readInputFile2D (outer index is the
+// measurement, inner index is the energy bin). The data are copied into the contiguous buffer and
+// the transpose and normalization factors are prepared.
+//--------------------------------------------------------------------------------------------------
+ResponseMatrix::ResponseMatrix(std::vector<std::vector<double>>& system_response) {
+    num_measurements = system_response.size();
+    if (num_measurements == 0) {
+        throw std::logic_error("Cannot create a response matrix from an empty response file.");
+    }
+    num_bins = system_response[0].size();
+    for (int i_meas = 1; i_meas < num_measurements; i_meas++) {
+        if ((int) system_response[i_meas].size() != num_bins) {
+            std::ostringstream error_message;
+            error_message << "NNS response row " << i_meas << " has " << system_response[i_meas].size()
+                << " values but row 0 has " << num_bins << ".";
+            throw std::logic_error(error_message.str());
+        }
+    }
+
+    allocate();
+    for (int i_meas = 0; i_meas < num_measurements; i_meas++) {
+        for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+            data[i_meas*row_stride + i_bin] = system_response[i_meas][i_bin];
+            transpose[i_bin*column_stride + i_meas] = system_response[i_meas][i_bin];
+        }
+    }
+
+    computeNormalization();
+}
+
+//--------------------------------------------------------------------------------------------------
+// Construct a ResponseMatrix from num_measurements rows of num_bins values, stored contiguously in
+// row-major order (e.g. a memory-mapped binary response file)
+//--------------------------------------------------------------------------------------------------
+ResponseMatrix::ResponseMatrix(int num_measurements, int num_bins, const double* values) {
+    if (num_measurements == 0) {
+        throw std::logic_error("Cannot create a response matrix from an empty response file.");
+    }
+    this->num_measurements = num_measurements;
+    this->num_bins = num_bins;
+
+    allocate();
+    for (int i_meas = 0; i_meas < num_measurements; i_meas++) {
+        const double* values_row = values + (size_t) i_meas*num_bins;
+        for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+            data[i_meas*row_stride + i_bin] = values_row[i_bin];
+            transpose[i_bin*column_stride + i_meas] = values_row[i_bin];
+        }
+    }
+
+    computeNormalization();
+}
+
+//--------------------------------------------------------------------------------------------------
+// Set the padded strides and allocate the (zeroed) matrix and transpose for the current dimensions
+//--------------------------------------------------------------------------------------------------
+void ResponseMatrix::allocate() {
+    row_stride = padLength(num_bins);
+    column_stride = padLength(num_measurements);
+
+    data.assign(num_measurements*row_stride, 0.0);
+    transpose.assign(num_bins*column_stride, 0.0);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Create the normalization factors to be applied to MLEM-estimated spectral values:
+//  - each element stores the sum of the elements in a column of the system (response) matrix,
+//    i.e. the relative contributions of each MLEM-estimated data point to the spectral value.
+//  - the reciprocals are also stored so kernels can multiply rather than divide.
+// Rows are accumulated in order so the sums match a straightforward loop over measurements.
+//--------------------------------------------------------------------------------------------------
+void ResponseMatrix::computeNormalization() {
+    normalized_response.assign(num_bins, 0.0);
+    inverse_normalized_response.assign(row_stride, 0.0);
+
+    for (int i_meas = 0; i_meas < num_measurements; i_meas++) {
+        const double* response_row = row(i_meas);
+        for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+            normalized_response[i_bin] += response_row[i_bin];
+        }
+    }
+    for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+        inverse_normalized_response[i_bin] = 1.0/normalized_response[i_bin];
+    }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Return a copy of the matrix in the 2D vector layout used by readInputFile2D
+//--------------------------------------------------------------------------------------------------
+std::vector<std::vector<double>> ResponseMatrix::toNestedVector() const {
+    std::vector<std::vector<double>> nested(num_measurements, std::vector<double>(num_bins));
+    for (int i_meas = 0; i_meas < num_measurements; i_meas++) {
+        for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+            nested[i_meas][i_bin] = at(i_meas,i_bin);
+        }
+    }
+    return nested;
+}
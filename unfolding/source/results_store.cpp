@@ -0,0 +1,526 @@
+//**************************************************************************************************
+// The functions included in this module append unfolded spectra to a results store and read them
+// back (see results_store.h). Appends are serialized between processes by locking the file, and
+// readers fetch individual spectra via an index instead of parsing every stored spectrum.
+//**************************************************************************************************
+
+#include "results_store.h"
+#include "fileio.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const char ResultsStore::MAGIC[8] = {'N','N','S','R','E','S','L','T'};
+const int ResultsStore::VERSION = 1;
+
+static const char END_MARKER[4] = {'N','N','S','E'};
+
+// Layout of the header at the start of each record. Its size (56 bytes) keeps the values aligned.
+struct ResultsRecordHeader {
+    int32_t record_size;
+    int32_t label_size;
+    int32_t algorithm_size;
+    int32_t unused;
+    int64_t timestamp;
+    double dose;
+    double dose_uncertainty_upper;
+    double dose_uncertainty_lower;
+    uint64_t checksum;
+};
+
+struct ResultsRecordFooter {
+    int32_t record_size;
+    char end_marker[4];
+};
+
+//==================================================================================================
+// Helpers for the file layout
+//==================================================================================================
+// Size of the file header: magic, version, num_bins & the energy bins
+static long long fileHeaderSize(int num_bins) {
+    return 16 + (long long) num_bins*sizeof(double);
+}
+
+// Size of the (zero-padded) strings of a record
+static long long paddedStringsSize(long long label_size, long long algorithm_size) {
+    return (label_size + algorithm_size + 7) / 8 * 8;
+}
+
+static long long recordSize(int num_bins, long long label_size, long long algorithm_size) {
+    return sizeof(ResultsRecordHeader) + paddedStringsSize(label_size, algorithm_size)
+        + 3*(long long) num_bins*sizeof(double) + sizeof(ResultsRecordFooter);
+}
+
+// 64 bit FNV-1a hash of a block of bytes
+static uint64_t checksumBytes(const char* bytes, std::size_t num_bytes) {
+    const unsigned char* data = (const unsigned char*) bytes;
+    uint64_t hash = 14695981039346656037ULL;
+    for (std::size_t i_byte = 0; i_byte < num_bytes; i_byte++) {
+        hash ^= data[i_byte];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Read exactly num_bytes at offset. Returns false at the end of the file.
+static bool readAt(int file_descriptor, void* buffer, std::size_t num_bytes, long long offset) {
+    char* destination = (char*) buffer;
+    while (num_bytes > 0) {
+        ssize_t num_read = pread(file_descriptor, destination, num_bytes, offset);
+        if (num_read < 0 && errno == EINTR) {
+            continue;
+        }
+        if (num_read <= 0) {
+            return false;
+        }
+        destination += num_read;
+        num_bytes -= num_read;
+        offset += num_read;
+    }
+    return true;
+}
+
+static void writeAll(int file_descriptor, const char* buffer, std::size_t num_bytes, std::string path) {
+    while (num_bytes > 0) {
+        ssize_t num_written = write(file_descriptor, buffer, num_bytes);
+        if (num_written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (num_written <= 0) {
+            throw std::logic_error("Unable to write to results store: " + path);
+        }
+        buffer += num_written;
+        num_bytes -= num_written;
+    }
+}
+
+//==================================================================================================
+// Holds a lock on a results store file for the lifetime of the object (exclusive for writers,
+// shared for readers), and closes the file when released
+//==================================================================================================
+class LockedStoreFile {
+    public:
+        int file_descriptor;
+
+        LockedStoreFile(std::string path, bool exclusive) {
+            file_descriptor = exclusive ? open(path.c_str(), O_RDWR | O_CREAT, 0644) : open(path.c_str(), O_RDONLY);
+            if (file_descriptor < 0) {
+                throw std::logic_error("Unable to open results store: " + path);
+            }
+            while (flock(file_descriptor, exclusive ? LOCK_EX : LOCK_SH) != 0) {
+                if (errno != EINTR) {
+                    close(file_descriptor);
+                    throw std::logic_error("Unable to lock results store: " + path);
+                }
+            }
+        }
+
+        ~LockedStoreFile() {
+            flock(file_descriptor, LOCK_UN);
+            close(file_descriptor);
+        }
+
+        long long size() const {
+            struct stat file_status;
+            if (fstat(file_descriptor, &file_status) != 0) {
+                return 0;
+            }
+            return file_status.st_size;
+        }
+
+    private:
+        LockedStoreFile(const LockedStoreFile&);
+        LockedStoreFile& operator=(const LockedStoreFile&);
+};
+
+//==================================================================================================
+// Read the file header: returns false if the file is not a results store (or its header is
+// incomplete)
+//==================================================================================================
+static bool readFileHeader(int file_descriptor, const char* magic, int version, std::vector<double>& energy_bins) {
+    char file_magic[8];
+    int32_t file_version, num_bins;
+    if (!readAt(file_descriptor, file_magic, sizeof(file_magic), 0)
+        || !readAt(file_descriptor, &file_version, sizeof(file_version), 8)
+        || !readAt(file_descriptor, &num_bins, sizeof(num_bins), 12)
+        || memcmp(file_magic, magic, sizeof(file_magic)) != 0 || file_version != version || num_bins <= 0)
+    {
+        return false;
+    }
+    energy_bins.resize(num_bins);
+    return readAt(file_descriptor, &energy_bins[0], num_bins*sizeof(double), 16);
+}
+
+//==================================================================================================
+// Walk the records that follow the file header, reading their headers only. Returns the end of the
+// last complete record. If entries is provided, the metadata of each complete record is added to it.
+//==================================================================================================
+static long long scanRecords(int file_descriptor, long long file_size, int num_bins,
+    std::vector<ResultsStoreEntry>* entries)
+{
+    long long offset = fileHeaderSize(num_bins);
+    while (offset + (long long) sizeof(ResultsRecordHeader) <= file_size) {
+        ResultsRecordHeader header;
+        ResultsRecordFooter footer;
+        if (!readAt(file_descriptor, &header, sizeof(header), offset)
+            || header.label_size < 0 || header.algorithm_size < 0
+            || header.record_size != recordSize(num_bins, header.label_size, header.algorithm_size)
+            || offset + header.record_size > file_size
+            || !readAt(file_descriptor, &footer, sizeof(footer), offset + header.record_size - sizeof(footer))
+            || footer.record_size != header.record_size
+            || memcmp(footer.end_marker, END_MARKER, sizeof(END_MARKER)) != 0)
+        {
+            break;
+        }
+
+        if (entries) {
+            std::vector<char> strings(header.label_size + header.algorithm_size);
+            if (!strings.empty() && !readAt(file_descriptor, &strings[0], strings.size(), offset + sizeof(header))) {
+                break;
+            }
+            ResultsStoreEntry entry;
+            entry.irradiation_conditions.assign(strings.begin(), strings.begin() + header.label_size);
+            entry.algorithm.assign(strings.begin() + header.label_size, strings.end());
+            entry.timestamp = header.timestamp;
+            entry.dose = header.dose;
+            entry.dose_uncertainty_upper = header.dose_uncertainty_upper;
+            entry.dose_uncertainty_lower = header.dose_uncertainty_lower;
+            entry.offset = offset;
+            entries->push_back(entry);
+        }
+        offset += header.record_size;
+    }
+    return offset;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Open the results store at path and index its records. Throws if the file cannot be opened or is
+// not a results store.
+//--------------------------------------------------------------------------------------------------
+ResultsStore::ResultsStore(std::string path) {
+    this->path = path;
+    LockedStoreFile store_file(path, false);
+    if (!readFileHeader(store_file.file_descriptor, MAGIC, VERSION, energy_bins)) {
+        throw std::logic_error("Not a results store: " + path);
+    }
+    num_bins = energy_bins.size();
+    scanRecords(store_file.file_descriptor, store_file.size(), num_bins, &entries);
+
+    for (int i_record = 0; i_record < (int) entries.size(); i_record++) {
+        conditions_index.insert(std::make_pair(entries[i_record].irradiation_conditions, i_record));
+        timestamp_index.insert(std::make_pair(entries[i_record].timestamp, i_record));
+    }
+}
+
+int ResultsStore::num_records() const {
+    return entries.size();
+}
+
+const ResultsStoreEntry& ResultsStore::entry(int i_record) const {
+    return entries[i_record];
+}
+
+//--------------------------------------------------------------------------------------------------
+// Return the records with the provided irradiation conditions, from oldest to newest
+//--------------------------------------------------------------------------------------------------
+std::vector<int> ResultsStore::find(std::string irradiation_conditions) const {
+    std::vector<std::pair<long long, int>> matches;
+    typedef std::multimap<std::string, int>::const_iterator ConditionsIterator;
+    std::pair<ConditionsIterator, ConditionsIterator> range = conditions_index.equal_range(irradiation_conditions);
+    for (ConditionsIterator it = range.first; it != range.second; ++it) {
+        matches.push_back(std::make_pair(entries[it->second].timestamp, it->second));
+    }
+    std::sort(matches.begin(), matches.end());
+
+    std::vector<int> records;
+    for (int i_match = 0; i_match < (int) matches.size(); i_match++) {
+        records.push_back(matches[i_match].second);
+    }
+    return records;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Return the newest record with the provided irradiation conditions (-1 if there is none)
+//--------------------------------------------------------------------------------------------------
+int ResultsStore::findLatest(std::string irradiation_conditions) const {
+    std::vector<int> records = find(irradiation_conditions);
+    return records.empty() ? -1 : records.back();
+}
+
+//--------------------------------------------------------------------------------------------------
+// Return the records stored between start_time & end_time (inclusive), from oldest to newest
+//--------------------------------------------------------------------------------------------------
+std::vector<int> ResultsStore::findBetween(long long start_time, long long end_time) const {
+    std::vector<int> records;
+    std::multimap<long long, int>::const_iterator it = timestamp_index.lower_bound(start_time);
+    std::multimap<long long, int>::const_iterator end = timestamp_index.upper_bound(end_time);
+    for (; it != end; ++it) {
+        records.push_back(it->second);
+    }
+    return records;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Read the spectrum, uncertainties & metadata of a record. Throws if the record is corrupted.
+//--------------------------------------------------------------------------------------------------
+void ResultsStore::read(int i_record, StoredSpectrum& stored_spectrum) const {
+    const ResultsStoreEntry& record = entries.at(i_record);
+    long long record_size = recordSize(num_bins, record.irradiation_conditions.size(), record.algorithm.size());
+    std::vector<char> buffer(record_size);
+
+    int file_descriptor = open(path.c_str(), O_RDONLY);
+    bool read_ok = file_descriptor >= 0 && readAt(file_descriptor, &buffer[0], buffer.size(), record.offset);
+    if (file_descriptor >= 0) {
+        close(file_descriptor);
+    }
+    ResultsRecordHeader header;
+    memcpy(&header, &buffer[0], sizeof(header));
+    const char* body = &buffer[0] + sizeof(header);
+    std::size_t body_size = record_size - sizeof(header) - sizeof(ResultsRecordFooter);
+    if (!read_ok || header.record_size != record_size || checksumBytes(body, body_size) != header.checksum) {
+        throw std::logic_error("Record of " + record.irradiation_conditions + " in results store " + path
+            + " is corrupted");
+    }
+
+    stored_spectrum.irradiation_conditions = record.irradiation_conditions;
+    stored_spectrum.algorithm = record.algorithm;
+    stored_spectrum.timestamp = record.timestamp;
+    stored_spectrum.dose = record.dose;
+    stored_spectrum.dose_uncertainty_upper = record.dose_uncertainty_upper;
+    stored_spectrum.dose_uncertainty_lower = record.dose_uncertainty_lower;
+
+    const double* values = (const double*) (body + paddedStringsSize(header.label_size, header.algorithm_size));
+    stored_spectrum.spectrum.assign(values, values + num_bins);
+    stored_spectrum.uncertainty_upper.assign(values + num_bins, values + 2*num_bins);
+    stored_spectrum.uncertainty_lower.assign(values + 2*num_bins, values + 3*num_bins);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Append a spectrum to the results store at path, creating the store if it does not exist. Throws
+// if the store was created with different energy bins.
+//--------------------------------------------------------------------------------------------------
+void ResultsStore::append(std::string path, std::vector<double>& energy_bins, StoredSpectrum& stored_spectrum) {
+    int num_bins = energy_bins.size();
+    if (num_bins == 0 || (int) stored_spectrum.spectrum.size() != num_bins
+        || (int) stored_spectrum.uncertainty_upper.size() != num_bins
+        || (int) stored_spectrum.uncertainty_lower.size() != num_bins)
+    {
+        throw std::logic_error("Cannot store spectrum of " + stored_spectrum.irradiation_conditions
+            + ": the spectrum, its uncertainties and the energy bins differ in size");
+    }
+
+    // Assemble the record, so that it is appended with a single write
+    int label_size = stored_spectrum.irradiation_conditions.size();
+    int algorithm_size = stored_spectrum.algorithm.size();
+    long long record_size = recordSize(num_bins, label_size, algorithm_size);
+    std::vector<char> record(record_size, 0);
+
+    char* body = &record[0] + sizeof(ResultsRecordHeader);
+    memcpy(body, stored_spectrum.irradiation_conditions.data(), label_size);
+    memcpy(body + label_size, stored_spectrum.algorithm.data(), algorithm_size);
+    double* values = (double*) (body + paddedStringsSize(label_size, algorithm_size));
+    std::copy(stored_spectrum.spectrum.begin(), stored_spectrum.spectrum.end(), values);
+    std::copy(stored_spectrum.uncertainty_upper.begin(), stored_spectrum.uncertainty_upper.end(), values + num_bins);
+    std::copy(stored_spectrum.uncertainty_lower.begin(), stored_spectrum.uncertainty_lower.end(), values + 2*num_bins);
+
+    ResultsRecordHeader header;
+    memset(&header, 0, sizeof(header));
+    header.record_size = record_size;
+    header.label_size = label_size;
+    header.algorithm_size = algorithm_size;
+    header.timestamp = stored_spectrum.timestamp;
+    header.dose = stored_spectrum.dose;
+    header.dose_uncertainty_upper = stored_spectrum.dose_uncertainty_upper;
+    header.dose_uncertainty_lower = stored_spectrum.dose_uncertainty_lower;
+    header.checksum = checksumBytes(body, record_size - sizeof(ResultsRecordHeader) - sizeof(ResultsRecordFooter));
+    memcpy(&record[0], &header, sizeof(header));
+
+    ResultsRecordFooter footer;
+    footer.record_size = record_size;
+    memcpy(footer.end_marker, END_MARKER, sizeof(END_MARKER));
+    memcpy(&record[record_size - sizeof(footer)], &footer, sizeof(footer));
+
+    // Other runs wait until the record is written
+    LockedStoreFile store_file(path, true);
+    int file_descriptor = store_file.file_descriptor;
+    long long file_size = store_file.size();
+
+    std::vector<double> store_energy_bins;
+    if (file_size == 0) {
+        // New store: write the file header
+        int32_t version = VERSION;
+        int32_t file_num_bins = num_bins;
+        std::vector<char> file_header(fileHeaderSize(num_bins));
+        memcpy(&file_header[0], MAGIC, sizeof(MAGIC));
+        memcpy(&file_header[8], &version, sizeof(version));
+        memcpy(&file_header[12], &file_num_bins, sizeof(file_num_bins));
+        memcpy(&file_header[16], &energy_bins[0], num_bins*sizeof(double));
+        writeAll(file_descriptor, &file_header[0], file_header.size(), path);
+        file_size = file_header.size();
+    }
+    else if (!readFileHeader(file_descriptor, MAGIC, VERSION, store_energy_bins)) {
+        throw std::logic_error("Not a results store: " + path);
+    }
+    else if (store_energy_bins != energy_bins) {
+        throw std::logic_error("Results store " + path + " holds spectra with different energy bins. "
+            "Please provide another path_results_store");
+    }
+    else {
+        // Remove an incomplete final record (interrupted run), unless the last record is complete
+        bool tail_complete = file_size == fileHeaderSize(num_bins);
+        ResultsRecordFooter last_footer;
+        if (!tail_complete && file_size > fileHeaderSize(num_bins) + (long long) sizeof(last_footer)
+            && readAt(file_descriptor, &last_footer, sizeof(last_footer), file_size - sizeof(last_footer))
+            && memcmp(last_footer.end_marker, END_MARKER, sizeof(END_MARKER)) == 0
+            && last_footer.record_size > 0 && file_size - last_footer.record_size >= fileHeaderSize(num_bins))
+        {
+            int32_t last_record_size;
+            tail_complete = readAt(file_descriptor, &last_record_size, sizeof(last_record_size),
+                file_size - last_footer.record_size) && last_record_size == last_footer.record_size;
+        }
+        if (!tail_complete) {
+            file_size = scanRecords(file_descriptor, file_size, num_bins, NULL);
+            if (ftruncate(file_descriptor, file_size) != 0) {
+                throw std::logic_error("Unable to write to results store: " + path);
+            }
+        }
+    }
+
+    if (lseek(file_descriptor, file_size, SEEK_SET) != file_size) {
+        throw std::logic_error("Unable to write to results store: " + path);
+    }
+    writeAll(file_descriptor, &record[0], record.size(), path);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Determine whether the file at path is a results store (rather than e.g. a CSV file)
+//--------------------------------------------------------------------------------------------------
+bool ResultsStore::isStore(std::string path) {
+    int file_descriptor = open(path.c_str(), O_RDONLY);
+    if (file_descriptor < 0) {
+        return false;
+    }
+    char magic[8];
+    bool is_store = readAt(file_descriptor, magic, sizeof(magic), 0) && memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+    close(file_descriptor);
+    return is_store;
+}
+
+//==================================================================================================
+// Save calculated spectrum (and uncertainty spectra) to a results store, with the current time as
+// timestamp
+//
+// Args:
+//  - path: the results store to which the spectrum is appended (created if it does not exist)
+//  - energy_bins: the energy bins corresponding to spectral values
+//  - irradiation_conditions: string that specifies measurement conditions
+//  - algorithm: the unfolding algorithm
+//  - spectrum: the unfolded neutron flux spectrum
+//  - uncertainty_upper: the upper uncertainty spectrum for the neutron flux
+//  - uncertainty_lower: the lower uncertainty spectrum for the neutron flux
+//  - dose, dose_uncertainty_upper, dose_uncertainty_lower: the ambient dose equivalent (rate) and
+//      its uncertainties
+//==================================================================================================
+int saveSpectrumToStore(std::string path, std::vector<double>& energy_bins, std::string irradiation_conditions,
+    std::string algorithm, std::vector<double>& spectrum, std::vector<double>& uncertainty_upper,
+    std::vector<double>& uncertainty_lower, double dose, double dose_uncertainty_upper,
+    double dose_uncertainty_lower)
+{
+    StoredSpectrum stored_spectrum;
+    stored_spectrum.irradiation_conditions = irradiation_conditions;
+    stored_spectrum.algorithm = algorithm;
+    stored_spectrum.timestamp = time(NULL);
+    stored_spectrum.dose = dose;
+    stored_spectrum.dose_uncertainty_upper = dose_uncertainty_upper;
+    stored_spectrum.dose_uncertainty_lower = dose_uncertainty_lower;
+    stored_spectrum.spectrum = spectrum;
+    stored_spectrum.uncertainty_upper = uncertainty_upper;
+    stored_spectrum.uncertainty_lower = uncertainty_lower;
+
+    ResultsStore::append(path, energy_bins, stored_spectrum);
+    return 1;
+}
+
+//==================================================================================================
+// Read spectra and their uncertainties from a results store, like readSpectra does from a CSV file
+// of spectra. If selected_spectra is provided, only the newest record of each selected irradiation
+// conditions is read (in the order they were stored); otherwise, every record is read.
+//==================================================================================================
+int readStoredSpectra(std::string file_name, std::vector<std::string>& header_vector, std::vector<double>& energy_bins,
+    std::vector<std::vector<double>>& spectra_vector, std::vector<std::vector<double>>& error_lower_vector,
+    std::vector<std::vector<double>>& error_upper_vector, bool plot_per_mu, std::vector<int>& number_mu,
+    std::vector<int>& duration, std::vector<std::string>& selected_spectra)
+{
+    ResultsStore store(file_name);
+    energy_bins = store.energy_bins;
+
+    std::vector<int> records;
+    if (selected_spectra.empty()) {
+        for (int i_record = 0; i_record < store.num_records(); i_record++) {
+            records.push_back(i_record);
+        }
+    }
+    else {
+        for (int i_selected = 0; i_selected < (int) selected_spectra.size(); i_selected++) {
+            int i_record = store.findLatest(selected_spectra[i_selected]);
+            if (i_record < 0) {
+                throw std::logic_error("Spectrum " + selected_spectra[i_selected] + " not found in " + file_name);
+            }
+            if (std::find(records.begin(), records.end(), i_record) == records.end()) {
+                records.push_back(i_record);
+            }
+        }
+        std::sort(records.begin(), records.end());
+    }
+
+    StoredSpectrum stored_spectrum;
+    for (int i_group = 0; i_group < (int) records.size(); i_group++) {
+        store.read(records[i_group], stored_spectrum);
+        // If plotting per MU
+        if (plot_per_mu) {
+            int group_duration = duration[i_group%duration.size()];
+            int group_number_mu = number_mu[i_group%number_mu.size()];
+            for (int i_bin = 0; i_bin < store.num_bins; i_bin++) {
+                stored_spectrum.spectrum[i_bin] = stored_spectrum.spectrum[i_bin]*group_duration/group_number_mu;
+                stored_spectrum.uncertainty_upper[i_bin] = stored_spectrum.uncertainty_upper[i_bin]*group_duration/group_number_mu;
+                stored_spectrum.uncertainty_lower[i_bin] = stored_spectrum.uncertainty_lower[i_bin]*group_duration/group_number_mu;
+            }
+        }
+        header_vector.push_back(stored_spectrum.irradiation_conditions);
+        spectra_vector.push_back(stored_spectrum.spectrum);
+        error_upper_vector.push_back(stored_spectrum.uncertainty_upper);
+        error_lower_vector.push_back(stored_spectrum.uncertainty_lower);
+    }
+
+    return 1;
+}
+
+//==================================================================================================
+// Export every spectrum of a results store (in the order they were stored) to an unfolded spectrum
+// CSV file, in the format written by saveSpectrumAsRow. Spectra are appended if csv_path exists.
+//==================================================================================================
+int exportStoreToCSV(std::string store_path, std::string csv_path) {
+    ResultsStore store(store_path);
+    StoredSpectrum stored_spectrum;
+    for (int i_record = 0; i_record < store.num_records(); i_record++) {
+        store.read(i_record, stored_spectrum);
+        saveSpectrumAsRow(csv_path, store.num_bins, stored_spectrum.irradiation_conditions,
+            stored_spectrum.spectrum, stored_spectrum.uncertainty_upper, stored_spectrum.uncertainty_lower,
+            store.energy_bins
+        );
+    }
+    return store.num_records();
+}
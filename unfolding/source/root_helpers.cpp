@@ -34,7 +34,8 @@
 
 //==================================================================================================
 // Plot a single flux spectrum (and its uncertainty) as a function of energy. Output the generated
-// plot to a file using arguments passed to the function.
+// plot to a file using arguments passed to the function. The canvas & histogram are created by the
+// first call and reused by the following ones (e.g. one figure per column of unfold_batch).
 //==================================================================================================
 int plotSpectrum(std::string path_figure, std::string irradiation_conditions, 
     int num_measurements, int num_bins, std::vector<double> &energy_bins, std::vector<double> &spectrum, 
@@ -56,8 +57,22 @@ int plotSpectrum(std::string path_figure, std::string irradiation_conditions,
     // Setup plot of the spectrum
     int NBINS = num_bins-1;
 
-    TCanvas *c1 = new TCanvas("c1","c1",2400,1800); // Resulution of the graph (px) specified in parameters
-    TH1F *h1 = new TH1F("h1","h1",NBINS,edges);
+    static TCanvas *c1 = NULL;
+    static TH1F *h1 = NULL;
+    static TGraphAsymmErrors *ge = NULL;
+    if (!c1) {
+        gROOT->SetBatch(kTRUE); // figures are only written to file
+        c1 = new TCanvas("c1","c1",2400,1800); // Resulution of the graph (px) specified in parameters
+        h1 = new TH1F("h1","h1",NBINS,edges);
+        h1->SetDirectory(0);
+    }
+    else {
+        c1->Clear();
+        c1->cd();
+        delete ge;
+        h1->SetBins(NBINS,edges);
+        h1->Reset();
+    }
 
     for (int i_bin = 0; i_bin < num_bins; i_bin++)
     {
@@ -113,7 +128,7 @@ int plotSpectrum(std::string path_figure, std::string irradiation_conditions,
     // Setup plot of the uncertainty
     // TGraphErrors *ge = new TGraphErrors(NBINS, &(bins_line_avr[0]), &(spectrum[0]), 0, &(s_line[0]));
 
-    TGraphAsymmErrors *ge = new TGraphAsymmErrors(
+    ge = new TGraphAsymmErrors(
         num_bins, &(bins_log_avg[0]), &(spectrum[0]), &(xerror_lower_array[0]), &(xerror_upper_array[0]), 
         &(spectrum_uncertainty_lower[0]), &(spectrum_uncertainty_upper[0])
     );
@@ -0,0 +1,326 @@
+//**************************************************************************************************
+// The classes included in this module accumulate statistics of sampled quantities one sample at a
+// time, so that the Monte Carlo uncertainty estimates do not need to store every sampled spectrum.
+//**************************************************************************************************
+
+#include "streaming_statistics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+//--------------------------------------------------------------------------------------------------
+// Create an empty estimator of the quantile with the given probability (0 < probability < 1)
+//--------------------------------------------------------------------------------------------------
+P2Quantile::P2Quantile(double probability) {
+    if (probability <= 0 || probability >= 1) {
+        throw std::logic_error("Quantile probability must be between 0 and 1");
+    }
+    this->probability = probability;
+    num_observations = 0;
+
+    for (int i_marker = 0; i_marker < 5; i_marker++) {
+        heights[i_marker] = 0;
+        positions[i_marker] = i_marker;
+    }
+    desired_positions[0] = 0;
+    desired_positions[1] = 2*probability;
+    desired_positions[2] = 4*probability;
+    desired_positions[3] = 2 + 2*probability;
+    desired_positions[4] = 4;
+    increments[0] = 0;
+    increments[1] = probability/2;
+    increments[2] = probability;
+    increments[3] = (1 + probability)/2;
+    increments[4] = 1;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Add an observation. The first five observations initialize the markers; subsequent observations
+// shift the markers, adjusting the height of those that drift from their desired position.
+//--------------------------------------------------------------------------------------------------
+void P2Quantile::add(double value) {
+    if (num_observations < 5) {
+        heights[num_observations] = value;
+        num_observations++;
+        if (num_observations == 5) {
+            std::sort(heights, heights+5);
+        }
+        return;
+    }
+    num_observations++;
+
+    // Find the cell containing the observation, extending the range if required
+    int cell;
+    if (value < heights[0]) {
+        heights[0] = value;
+        cell = 0;
+    }
+    else if (value >= heights[4]) {
+        heights[4] = value;
+        cell = 3;
+    }
+    else {
+        cell = 0;
+        while (value >= heights[cell+1]) {
+            cell++;
+        }
+    }
+
+    for (int i_marker = cell+1; i_marker < 5; i_marker++) {
+        positions[i_marker] += 1;
+    }
+    for (int i_marker = 0; i_marker < 5; i_marker++) {
+        desired_positions[i_marker] += increments[i_marker];
+    }
+
+    // Adjust the heights of the middle markers if they are off their desired position
+    for (int i_marker = 1; i_marker < 4; i_marker++) {
+        double offset = desired_positions[i_marker] - positions[i_marker];
+        if ((offset >= 1 && positions[i_marker+1] - positions[i_marker] > 1)
+            || (offset <= -1 && positions[i_marker-1] - positions[i_marker] < -1))
+        {
+            double direction = offset > 0 ? 1 : -1;
+            double height = parabolic(i_marker, direction);
+            if (heights[i_marker-1] < height && height < heights[i_marker+1]) {
+                heights[i_marker] = height;
+            }
+            else {
+                heights[i_marker] = linear(i_marker, direction);
+            }
+            positions[i_marker] += direction;
+        }
+    }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Return the current quantile estimate (0 if there are no observations)
+//--------------------------------------------------------------------------------------------------
+double P2Quantile::value() const {
+    if (num_observations == 0) {
+        return 0;
+    }
+    if (num_observations < 5) {
+        std::vector<double> sorted(heights, heights+num_observations);
+        std::sort(sorted.begin(), sorted.end());
+        double rank = probability*(num_observations-1);
+        int lower_rank = (int) rank;
+        if (lower_rank + 1 >= num_observations) {
+            return sorted[lower_rank];
+        }
+        return sorted[lower_rank] + (rank-lower_rank)*(sorted[lower_rank+1]-sorted[lower_rank]);
+    }
+    return heights[2];
+}
+
+// Piecewise-parabolic prediction of the new height of a marker moved by direction (+/- 1)
+double P2Quantile::parabolic(int i_marker, double direction) const {
+    double n_lower = positions[i_marker-1];
+    double n = positions[i_marker];
+    double n_upper = positions[i_marker+1];
+    return heights[i_marker] + direction/(n_upper-n_lower)*(
+        (n-n_lower+direction)*(heights[i_marker+1]-heights[i_marker])/(n_upper-n)
+        + (n_upper-n-direction)*(heights[i_marker]-heights[i_marker-1])/(n-n_lower));
+}
+
+// Linear prediction, used when the parabolic prediction would put the markers out of order
+double P2Quantile::linear(int i_marker, double direction) const {
+    int i_neighbour = i_marker + (int) direction;
+    return heights[i_marker] + direction*(heights[i_neighbour]-heights[i_marker])
+        /(positions[i_neighbour]-positions[i_marker]);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Create empty statistics for a quantity with the given reference value. The quantile
+// probabilities are only used if track_quantiles is true.
+//--------------------------------------------------------------------------------------------------
+StreamingStatistics::StreamingStatistics(double reference_value, bool track_quantiles,
+    double lower_probability, double upper_probability)
+    : lower_quantile(lower_probability), upper_quantile(upper_probability)
+{
+    this->reference_value = reference_value;
+    this->track_quantiles = track_quantiles;
+    num_samples = 0;
+    mean = 0;
+    minimum = 0;
+    maximum = 0;
+    sum_sq_mean_diff = 0;
+    sum_sq_reference_diff = 0;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Add a sample
+//--------------------------------------------------------------------------------------------------
+void StreamingStatistics::add(double value) {
+    if (num_samples == 0 || value < minimum) {
+        minimum = value;
+    }
+    if (num_samples == 0 || value > maximum) {
+        maximum = value;
+    }
+    num_samples++;
+    double mean_diff = value - mean;
+    mean += mean_diff/num_samples;
+    sum_sq_mean_diff += mean_diff*(value - mean);
+
+    sum_sq_reference_diff += ((reference_value - value)*(reference_value - value));
+
+    if (track_quantiles) {
+        lower_quantile.add(value);
+        upper_quantile.add(value);
+    }
+}
+
+double StreamingStatistics::variance() const {
+    if (num_samples < 2) {
+        return 0;
+    }
+    return sum_sq_mean_diff/(num_samples-1);
+}
+
+double StreamingStatistics::rmsd() const {
+    if (num_samples == 0) {
+        return 0;
+    }
+    return sqrt(sum_sq_reference_diff/num_samples);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Percentiles bounding the central 68.27% of a normal distribution (mean +/- 1 sigma)
+//--------------------------------------------------------------------------------------------------
+const double UncertaintyStatistics::LOWER_PERCENTILE = 0.158655;
+const double UncertaintyStatistics::UPPER_PERCENTILE = 0.841345;
+
+//--------------------------------------------------------------------------------------------------
+// Create empty statistics around the nominal spectrum & dose. Quantiles are only tracked if they
+// are needed for the requested uncertainty bands.
+//--------------------------------------------------------------------------------------------------
+UncertaintyStatistics::UncertaintyStatistics(std::vector<double>& nominal_spectrum,
+    double nominal_dose, std::string uncertainty_bands)
+{
+    bool track_quantiles;
+    if (uncertainty_bands == "rmsd") {
+        track_quantiles = false;
+    }
+    else if (uncertainty_bands == "percentile") {
+        track_quantiles = true;
+    }
+    else {
+        throw std::logic_error("Unrecognized uncertainty bands: " + uncertainty_bands);
+    }
+    this->uncertainty_bands = uncertainty_bands;
+
+    int num_bins = nominal_spectrum.size();
+    for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+        spectrum.push_back(StreamingStatistics(nominal_spectrum[i_bin], track_quantiles,
+            LOWER_PERCENTILE, UPPER_PERCENTILE));
+    }
+    dose = StreamingStatistics(nominal_dose, track_quantiles, LOWER_PERCENTILE, UPPER_PERCENTILE);
+    num_input_starts = 0;
+    converged = false;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Add one sampled spectrum, its ambient dose equivalent and the # of iterations used to unfold it
+//--------------------------------------------------------------------------------------------------
+void UncertaintyStatistics::addSample(const std::vector<double>& sampled_spectrum, double sampled_dose,
+    int sample_iterations)
+{
+    int num_bins = spectrum.size();
+    for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+        spectrum[i_bin].add(sampled_spectrum[i_bin]);
+    }
+    dose.add(sampled_dose);
+    num_iterations.add(sample_iterations);
+}
+
+long UncertaintyStatistics::num_samples() const {
+    return dose.num_samples;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Return the lower & upper uncertainty (both >= 0) of each energy bin of the nominal spectrum
+//--------------------------------------------------------------------------------------------------
+void UncertaintyStatistics::getSpectrumUncertainty(std::vector<double>& uncertainty_lower,
+    std::vector<double>& uncertainty_upper) const
+{
+    int num_bins = spectrum.size();
+    uncertainty_lower.resize(num_bins);
+    uncertainty_upper.resize(num_bins);
+    for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+        getBand(spectrum[i_bin], uncertainty_lower[i_bin], uncertainty_upper[i_bin]);
+    }
+}
+
+void UncertaintyStatistics::getDoseUncertainty(double& uncertainty_lower, double& uncertainty_upper) const {
+    getBand(dose, uncertainty_lower, uncertainty_upper);
+}
+
+void UncertaintyStatistics::getBand(const StreamingStatistics& statistics, double& uncertainty_lower,
+    double& uncertainty_upper) const
+{
+    if (uncertainty_bands == "percentile") {
+        uncertainty_lower = std::max(0.0, statistics.reference_value - statistics.lower_quantile.value());
+        uncertainty_upper = std::max(0.0, statistics.upper_quantile.value() - statistics.reference_value);
+    }
+    else {
+        uncertainty_lower = statistics.rmsd();
+        uncertainty_upper = uncertainty_lower;
+    }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Relative (Euclidean) change between the current & previous values of a set of uncertainties.
+// Updates previous to the current values.
+//--------------------------------------------------------------------------------------------------
+static double relativeChange(const std::vector<double>& current, std::vector<double>& previous) {
+    double sum_sq_change = 0;
+    double sum_sq_current = 0;
+    for (int i_value = 0; i_value < (int) current.size(); i_value++) {
+        double change = current[i_value] - previous[i_value];
+        sum_sq_change += change*change;
+        sum_sq_current += current[i_value]*current[i_value];
+    }
+    previous = current;
+    if (sum_sq_current == 0) {
+        return sum_sq_change == 0 ? 0 : HUGE_VAL;
+    }
+    return sqrt(sum_sq_change/sum_sq_current);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Create a convergence check with the given relative tolerance (> 0)
+//--------------------------------------------------------------------------------------------------
+UncertaintyConvergence::UncertaintyConvergence(double rel_tol) {
+    if (rel_tol <= 0) {
+        throw std::logic_error("Uncertainty relative tolerance must be > 0");
+    }
+    this->rel_tol = rel_tol;
+    dose_change = -1;
+    spectrum_change = -1;
+    has_previous = false;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Compare the uncertainties of statistics with those at the previous call. Returns true if they have
+// converged.
+//--------------------------------------------------------------------------------------------------
+bool UncertaintyConvergence::update(const UncertaintyStatistics& statistics) {
+    statistics.getSpectrumUncertainty(spectrum_lower, spectrum_upper);
+    std::vector<double> spectrum(spectrum_lower);
+    spectrum.insert(spectrum.end(), spectrum_upper.begin(), spectrum_upper.end());
+    std::vector<double> dose(2);
+    statistics.getDoseUncertainty(dose[0], dose[1]);
+
+    if (!has_previous) {
+        previous_spectrum = spectrum;
+        previous_dose = dose;
+        has_previous = true;
+        return false;
+    }
+    spectrum_change = relativeChange(spectrum, previous_spectrum);
+    dose_change = relativeChange(dose, previous_dose);
+    return spectrum_change <= rel_tol && dose_change <= rel_tol;
+}
@@ -0,0 +1,295 @@
+//**************************************************************************************************
+// The functions included in this module load the 2D grids plotted by plot_surface (see
+// surface_grid.h) and reduce them to the resolution that is drawn.
+//**************************************************************************************************
+
+#include "surface_grid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "binary_input.h"
+#include "csv_table.h"
+
+//==================================================================================================
+// Parse the comma-delimited numbers from cursor to line_end, appending them to values. Numbers are
+// converted as atof would, and a trailing comma does not add a value (as with readXYYCSV). Returns
+// the # of numbers parsed.
+//==================================================================================================
+static int parseRowValues(const char* cursor, const char* line_end, std::vector<double>& values) {
+    int num_values = 0;
+    while (cursor < line_end) {
+        const char* number_end;
+        values.push_back(parseCSVNumber(cursor, &number_end));
+        num_values++;
+        const char* comma = (const char*) memchr(number_end, ',', line_end - number_end);
+        if (comma == NULL) {
+            break;
+        }
+        cursor = comma + 1;
+    }
+    return num_values;
+}
+
+//==================================================================================================
+// Read a surface CSV file in a single pass over one buffer, without splitting it into lines or
+// fields. The first row contains the x values (after a first cell that is ignored). Each other row
+// contains a y value followed by the value of each x.
+//==================================================================================================
+static void readSurfaceCSV(std::string file_name, std::vector<double>& x_values,
+    std::vector<double>& y_values, std::vector<double>& values)
+{
+    std::ifstream ifile(file_name, std::ios::binary);
+    if (!ifile.is_open()) {
+        throw std::logic_error("Unable to open surface file: " + file_name);
+    }
+    ifile.seekg(0, std::ios::end);
+    size_t file_size = ifile.tellg();
+    ifile.seekg(0, std::ios::beg);
+    std::vector<char> buffer(file_size + 1);
+    ifile.read(&buffer[0], file_size);
+    buffer[file_size] = '\0';
+
+    char* line_start = &buffer[0];
+    char* file_end = &buffer[0] + file_size;
+    size_t num_lines = std::count(line_start, file_end, '\n') + 1;
+    bool header_read = false;
+    int num_x = 0;
+    int i_line = 0;
+    while (line_start < file_end) {
+        i_line++;
+        char* line_end = (char*) memchr(line_start, '\n', file_end - line_start);
+        if (line_end == NULL) {
+            line_end = file_end;
+        }
+        char* next_line = line_end + 1;
+        if (line_end > line_start && line_end[-1] == '\r') {
+            line_end--;
+        }
+        *line_end = '\0'; // so that a number is never parsed past the end of its line
+        if (line_end == line_start) { // empty line
+            line_start = next_line;
+            continue;
+        }
+
+        if (!header_read) {
+            const char* comma = (const char*) memchr(line_start, ',', line_end - line_start);
+            if (comma != NULL) {
+                num_x = parseRowValues(comma + 1, line_end, x_values);
+            }
+            y_values.reserve(num_lines);
+            values.reserve(num_lines*num_x);
+            header_read = true;
+        }
+        else {
+            const char* number_end;
+            double y_value = parseCSVNumber(line_start, &number_end);
+            if (number_end == line_start) {
+                std::ostringstream error_message;
+                error_message << "Line " << i_line << " of surface file " << file_name
+                    << " does not start with a y value";
+                throw std::logic_error(error_message.str());
+            }
+            y_values.push_back(y_value);
+
+            int num_row_values = 0;
+            const char* comma = (const char*) memchr(number_end, ',', line_end - number_end);
+            if (comma != NULL) {
+                num_row_values = parseRowValues(comma + 1, line_end, values);
+            }
+            if (num_row_values != num_x) {
+                std::ostringstream error_message;
+                error_message << "Line " << i_line << " of surface file " << file_name << " has "
+                    << num_row_values << " values but the first line has " << num_x << " x values";
+                throw std::logic_error(error_message.str());
+            }
+        }
+        line_start = next_line;
+    }
+}
+
+//==================================================================================================
+// Read a surface from a binary input file (see binary_input.h), e.g. a surface CSV file converted by
+// convert_input.exe. Same layout as the CSV file: row 0 holds the x values (after column 0), and
+// column 0 of the other rows holds the y values.
+//==================================================================================================
+static void readSurfaceBinary(std::string binary_path, std::vector<double>& x_values,
+    std::vector<double>& y_values, std::vector<double>& values)
+{
+    BinaryInputFile binary_file(binary_path);
+    int num_rows = binary_file.num_rows;
+    int num_columns = binary_file.num_columns;
+    if (num_rows == 0 || num_columns < 2) {
+        return;
+    }
+    const double* data = binary_file.data();
+    x_values.assign(data + 1, data + num_columns);
+    y_values.reserve(num_rows - 1);
+    values.reserve((size_t) (num_rows - 1)*(num_columns - 1));
+    for (int i_row = 1; i_row < num_rows; i_row++) {
+        const double* row = data + (size_t) i_row*num_columns;
+        y_values.push_back(row[0]);
+        values.insert(values.end(), row + 1, row + num_columns);
+    }
+}
+
+//==================================================================================================
+// Assign the edges of the cells centred on each of the (increasing) centres: midway between
+// adjacent centres, and as far beyond the first & last centres as the adjacent edge is inside.
+// geometric = true: midway on a log scale (geometric mean); only for positive centres.
+//==================================================================================================
+static void calculateCellEdges(const std::vector<double>& centres, bool geometric,
+    std::vector<double>& edges)
+{
+    int num_centres = centres.size();
+    edges.resize(num_centres + 1);
+    if (num_centres == 1) {
+        edges[0] = geometric ? centres[0]/2 : centres[0] - 0.5;
+        edges[1] = geometric ? centres[0]*2 : centres[0] + 0.5;
+        return;
+    }
+    for (int i_edge = 1; i_edge < num_centres; i_edge++) {
+        edges[i_edge] = geometric ? sqrt(centres[i_edge-1]*centres[i_edge])
+            : (centres[i_edge-1] + centres[i_edge])/2;
+    }
+    double first = centres[0];
+    double last = centres[num_centres-1];
+    edges[0] = geometric ? first*first/edges[1] : 2*first - edges[1];
+    edges[num_centres] = geometric ? last*last/edges[num_centres-1] : 2*last - edges[num_centres-1];
+}
+
+//==================================================================================================
+// Read the surface stored in file_name into grid. The values are read from a binary copy of the file
+// if there is one (see findBinaryInput), and otherwise parsed from the CSV file. The file format is
+// described in instructions_plot_surface.md.
+//  - The x values must be increasing.
+//  - The rows are ordered by y value, and a row that repeats the y value of a previous row is
+//    ignored (e.g. unfold_trend with algorithm=map calculates the beta at the end of each decade
+//    twice).
+//  - If every y value is positive, the y edges are placed on a log scale (plot_surface draws a log
+//    scale y axis).
+//==================================================================================================
+void readSurfaceGrid(std::string file_name, SurfaceGrid& grid) {
+    std::vector<double> x_values;
+    std::vector<double> y_values;
+    std::vector<double> values;
+    std::string binary_path;
+    if (findBinaryInput(file_name, binary_path)) {
+        readSurfaceBinary(binary_path, x_values, y_values, values);
+    }
+    else {
+        readSurfaceCSV(file_name, x_values, y_values, values);
+    }
+
+    int num_x = x_values.size();
+    int num_rows = y_values.size();
+    if (num_x == 0 || num_rows == 0) {
+        throw std::logic_error("No values in surface file: " + file_name);
+    }
+    for (int i_x = 1; i_x < num_x; i_x++) {
+        if (!(x_values[i_x] > x_values[i_x-1])) {
+            throw std::logic_error("The x values of surface file " + file_name + " are not increasing");
+        }
+    }
+
+    // Order the rows by y value, dropping repeated values
+    std::vector<int> row_order(num_rows);
+    for (int i_row = 0; i_row < num_rows; i_row++) {
+        row_order[i_row] = i_row;
+    }
+    std::stable_sort(row_order.begin(), row_order.end(),
+        [&y_values](int a, int b) { return y_values[a] < y_values[b]; });
+    std::vector<double> y_centres;
+    y_centres.reserve(num_rows);
+    grid.values.clear();
+    grid.values.reserve(values.size());
+    for (int i_row = 0; i_row < num_rows; i_row++) {
+        double y_value = y_values[row_order[i_row]];
+        if (!y_centres.empty() && std::abs(y_value - y_centres.back()) <= 1e-9*std::abs(y_value)) {
+            continue;
+        }
+        y_centres.push_back(y_value);
+        std::vector<double>::const_iterator row = values.begin() + (size_t) row_order[i_row]*num_x;
+        grid.values.insert(grid.values.end(), row, row + num_x);
+    }
+
+    calculateCellEdges(x_values, false, grid.x_edges);
+    calculateCellEdges(y_centres, y_centres[0] > 0, grid.y_edges);
+}
+
+//==================================================================================================
+// Reduce grid to at most max_x_cells x max_y_cells cells (0 = no limit on that axis), e.g. so that a
+// very large grid is drawn at the resolution of the figure. Adjacent cells are merged in blocks of
+// equal size (except the last block of each axis), and each merged cell is assigned the
+// cell_aggregation {mean, max, min} of the cells it contains. reduced_grid may be grid.
+//==================================================================================================
+void reduceSurfaceGrid(const SurfaceGrid& grid, int max_x_cells, int max_y_cells,
+    std::string cell_aggregation, SurfaceGrid& reduced_grid)
+{
+    if (cell_aggregation != "mean" && cell_aggregation != "max" && cell_aggregation != "min") {
+        throw std::logic_error("Unrecognized cell_aggregation: " + cell_aggregation
+            + ". Please refer to the README for allowed settings");
+    }
+    int num_x = grid.num_x();
+    int num_y = grid.num_y();
+    int x_block = (max_x_cells > 0 && num_x > max_x_cells) ? (num_x + max_x_cells - 1)/max_x_cells : 1;
+    int y_block = (max_y_cells > 0 && num_y > max_y_cells) ? (num_y + max_y_cells - 1)/max_y_cells : 1;
+    int num_reduced_x = (num_x + x_block - 1)/x_block;
+    int num_reduced_y = (num_y + y_block - 1)/y_block;
+
+    std::vector<double> x_edges(num_reduced_x + 1);
+    for (int i_x = 0; i_x <= num_reduced_x; i_x++) {
+        x_edges[i_x] = grid.x_edges[std::min(i_x*x_block, num_x)];
+    }
+    std::vector<double> y_edges(num_reduced_y + 1);
+    for (int i_y = 0; i_y <= num_reduced_y; i_y++) {
+        y_edges[i_y] = grid.y_edges[std::min(i_y*y_block, num_y)];
+    }
+
+    bool mean = (cell_aggregation == "mean");
+    bool max = (cell_aggregation == "max");
+    double initial_value = 0;
+    if (max) {
+        initial_value = -std::numeric_limits<double>::infinity();
+    }
+    else if (!mean) {
+        initial_value = std::numeric_limits<double>::infinity();
+    }
+    std::vector<double> values((size_t) num_reduced_x*num_reduced_y, initial_value);
+    for (int i_y = 0; i_y < num_y; i_y++) {
+        double* reduced_row = &values[(size_t) (i_y/y_block)*num_reduced_x];
+        const double* row = &grid.values[(size_t) i_y*num_x];
+        for (int i_x = 0; i_x < num_x; i_x++) {
+            double& cell = reduced_row[i_x/x_block];
+            if (mean) {
+                cell += row[i_x];
+            }
+            else if (max) {
+                cell = std::max(cell, row[i_x]);
+            }
+            else {
+                cell = std::min(cell, row[i_x]);
+            }
+        }
+    }
+    if (mean) {
+        for (int i_y = 0; i_y < num_reduced_y; i_y++) {
+            int num_block_y = std::min(y_block, num_y - i_y*y_block);
+            for (int i_x = 0; i_x < num_reduced_x; i_x++) {
+                int num_block_x = std::min(x_block, num_x - i_x*x_block);
+                values[(size_t) i_y*num_reduced_x + i_x] /= num_block_x*num_block_y;
+            }
+        }
+    }
+
+    reduced_grid.x_edges.swap(x_edges);
+    reduced_grid.y_edges.swap(y_edges);
+    reduced_grid.values.swap(values);
+}
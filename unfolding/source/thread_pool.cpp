@@ -0,0 +1,138 @@
+//**************************************************************************************************
+// The functions included in this module implement a small thread pool used to run independent
+// unfoldings (e.g. Monte Carlo uncertainty samples) concurrently.
+//**************************************************************************************************
+
+#include "thread_pool.h"
+
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//--------------------------------------------------------------------------------------------------
+// Start num_threads-1 worker threads (the calling thread is the remaining one). A value of 0 (or
+// less) uses every hardware thread available.
+//--------------------------------------------------------------------------------------------------
+ThreadPool::ThreadPool(int num_threads) {
+    this->num_threads = resolveNumThreads(num_threads);
+    stopping = false;
+    generation = 0;
+    num_busy = 0;
+    task = NULL;
+    num_tasks = 0;
+    next_task = 0;
+
+    for (int i_thread = 1; i_thread < this->num_threads; i_thread++) {
+        workers.push_back(std::thread(&ThreadPool::workerLoop, this, i_thread));
+    }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Stop and join all worker threads
+//--------------------------------------------------------------------------------------------------
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    start_condition.notify_all();
+    for (std::size_t i_thread = 0; i_thread < workers.size(); i_thread++) {
+        workers[i_thread].join();
+    }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Return the number of threads to use for a requested thread count, where 0 (or less) means one
+// per hardware thread
+//--------------------------------------------------------------------------------------------------
+int ThreadPool::resolveNumThreads(int num_threads) {
+    if (num_threads > 0) {
+        return num_threads;
+    }
+    int num_hardware_threads = std::thread::hardware_concurrency();
+    return num_hardware_threads > 0 ? num_hardware_threads : 1;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Run task(thread_index, task_index) for every task_index in [0, num_tasks) and wait for all of
+// them to finish. If a task throws, no further tasks are started and the first exception is
+// rethrown here once the running tasks have finished. Must not be called from within a task.
+//--------------------------------------------------------------------------------------------------
+void ThreadPool::parallelFor(int num_tasks, const Task& task) {
+    if (num_tasks <= 0) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->task = &task;
+        this->num_tasks = num_tasks;
+        next_task = 0;
+        first_exception = std::exception_ptr();
+        num_busy = workers.size();
+        generation++;
+    }
+    start_condition.notify_all();
+
+    runTasks(0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done_condition.wait(lock, [this] { return num_busy == 0; });
+    this->task = NULL;
+    if (first_exception) {
+        std::exception_ptr exception = first_exception;
+        first_exception = std::exception_ptr();
+        std::rethrow_exception(exception);
+    }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Claim and run tasks of the current loop until none remain
+//--------------------------------------------------------------------------------------------------
+void ThreadPool::runTasks(int thread_index) {
+    while (true) {
+        int task_index = next_task++;
+        if (task_index >= num_tasks) {
+            break;
+        }
+        try {
+            (*task)(thread_index, task_index);
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!first_exception) {
+                first_exception = std::current_exception();
+            }
+            next_task = num_tasks; // do not start any more tasks
+        }
+    }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Body of each worker thread: wait for a new loop to be started, take part in it, then report
+// completion
+//--------------------------------------------------------------------------------------------------
+void ThreadPool::workerLoop(int thread_index) {
+    unsigned long last_generation = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            start_condition.wait(lock, [this, last_generation] {
+                return stopping || generation != last_generation;
+            });
+            if (stopping) {
+                return;
+            }
+            last_generation = generation;
+        }
+
+        runTasks(thread_index);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            num_busy--;
+        }
+        done_condition.notify_one();
+    }
+}
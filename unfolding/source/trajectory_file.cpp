@@ -0,0 +1,208 @@
+//**************************************************************************************************
+// The functions included in this module save & restore checkpoints of an unfolding trajectory
+// (see trajectory_file.h), so that unfold_trend can reuse or extend a previously unfolded
+// trajectory instead of unfolding it again.
+//**************************************************************************************************
+
+#include "trajectory_file.h"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+const char TrajectoryFile::MAGIC[8] = {'N','N','S','T','R','A','J','\0'};
+const int TrajectoryFile::VERSION = 1;
+
+// Length of the (zero-padded) algorithm name stored in the header
+static const int ALGORITHM_NAME_LENGTH = 16;
+
+//==================================================================================================
+// 64 bit FNV-1a hash of a block of bytes, continuing from the provided hash
+//==================================================================================================
+static unsigned long long hashBytes(unsigned long long hash, const void* bytes, size_t num_bytes) {
+    const unsigned char* data = (const unsigned char*) bytes;
+    for (size_t i_byte = 0; i_byte < num_bytes; i_byte++) {
+        hash ^= data[i_byte];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static unsigned long long hashVector(unsigned long long hash, const std::vector<double>& values) {
+    return hashBytes(hash, &values[0], values.size()*sizeof(double));
+}
+
+//--------------------------------------------------------------------------------------------------
+// Open the trajectory file at path, creating it if it does not exist (or is empty). Existing
+// checkpoints are loaded. Throws if the file holds a trajectory unfolded with a different
+// algorithm, stopping error, relaxation (mlem_or), measurements, input spectrum or response.
+//--------------------------------------------------------------------------------------------------
+TrajectoryFile::TrajectoryFile(std::string path, std::string algorithm, double error, double relaxation,
+    int num_measurements, int num_bins, std::vector<double>& measurements,
+    std::vector<double>& initial_spectrum, ResponseMatrix& nns_response)
+{
+    if ((int) algorithm.size() >= ALGORITHM_NAME_LENGTH) {
+        throw std::logic_error("Algorithm name too long for trajectory file: " + algorithm);
+    }
+    this->path = path;
+    this->num_measurements = num_measurements;
+    this->num_bins = num_bins;
+
+    unsigned long long fingerprint = 14695981039346656037ULL;
+    fingerprint = hashBytes(fingerprint, algorithm.c_str(), algorithm.size());
+    fingerprint = hashBytes(fingerprint, &error, sizeof(error));
+    if (algorithm == "mlem_or") {
+        fingerprint = hashBytes(fingerprint, &relaxation, sizeof(relaxation));
+    }
+    fingerprint = hashVector(fingerprint, measurements);
+    fingerprint = hashVector(fingerprint, initial_spectrum);
+    for (int i_meas = 0; i_meas < num_measurements; i_meas++) {
+        fingerprint = hashBytes(fingerprint, nns_response.row(i_meas), num_bins*sizeof(double));
+    }
+
+    load(algorithm, fingerprint);
+}
+
+int TrajectoryFile::num_checkpoints() const {
+    return checkpoints.size();
+}
+
+//--------------------------------------------------------------------------------------------------
+// Restore the latest checkpoint with at most max_iterations iterations, if it is further along
+// than the current state (current_iterations): spectrum and the mlem_estimate, mlem_ratio &
+// mlem_correction buffers of workspace are set as they were when the checkpoint was saved. Returns
+// the # of iterations of the resulting state (current_iterations if nothing was restored).
+//--------------------------------------------------------------------------------------------------
+int TrajectoryFile::restoreLatest(int max_iterations, int current_iterations,
+    std::vector<double>& measurements, std::vector<double>& spectrum, UnfoldingWorkspace& workspace) const
+{
+    std::map<int, TrajectoryCheckpoint>::const_iterator next = checkpoints.upper_bound(max_iterations);
+    if (next == checkpoints.begin()) {
+        return current_iterations;
+    }
+    const TrajectoryCheckpoint& checkpoint = (--next)->second;
+    if (checkpoint.num_iterations <= current_iterations) {
+        return current_iterations;
+    }
+
+    workspace.resize(num_measurements, num_bins);
+    spectrum = checkpoint.spectrum;
+    workspace.mlem_estimate = checkpoint.mlem_estimate;
+    workspace.mlem_correction = checkpoint.mlem_correction;
+    for (int i_meas = 0; i_meas < num_measurements; i_meas++) {
+        workspace.mlem_ratio[i_meas] = measurements[i_meas]/workspace.mlem_estimate[i_meas];
+    }
+    return checkpoint.num_iterations;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Save the state after num_iterations iterations as a checkpoint (appended to the file). Nothing is
+// saved if there already is a checkpoint with that # of iterations.
+//--------------------------------------------------------------------------------------------------
+void TrajectoryFile::save(int num_iterations, std::vector<double>& spectrum, UnfoldingWorkspace& workspace) {
+    if (checkpoints.count(num_iterations)) {
+        return;
+    }
+    TrajectoryCheckpoint& checkpoint = checkpoints[num_iterations];
+    checkpoint.num_iterations = num_iterations;
+    checkpoint.spectrum = spectrum;
+    checkpoint.mlem_estimate = workspace.mlem_estimate;
+    checkpoint.mlem_correction = workspace.mlem_correction;
+    append(checkpoint);
+}
+
+void TrajectoryFile::load(std::string algorithm, unsigned long long fingerprint) {
+    std::ifstream tfile(path, std::ios::binary);
+    if (!tfile.is_open() || tfile.peek() == std::ifstream::traits_type::eof()) {
+        tfile.close();
+        create(algorithm, fingerprint);
+        return;
+    }
+
+    char magic[8];
+    int32_t version, file_num_measurements, file_num_bins;
+    uint64_t file_fingerprint;
+    char file_algorithm[ALGORITHM_NAME_LENGTH];
+    tfile.read(magic, sizeof(magic));
+    tfile.read((char*) &version, sizeof(version));
+    tfile.read((char*) &file_num_measurements, sizeof(file_num_measurements));
+    tfile.read((char*) &file_num_bins, sizeof(file_num_bins));
+    tfile.read((char*) &file_fingerprint, sizeof(file_fingerprint));
+    tfile.read(file_algorithm, sizeof(file_algorithm));
+    if (!tfile || memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 || version != VERSION) {
+        throw std::logic_error("Not a trajectory file: " + path);
+    }
+    file_algorithm[ALGORITHM_NAME_LENGTH-1] = '\0';
+    if (file_num_measurements != num_measurements || file_num_bins != num_bins
+        || algorithm != file_algorithm || file_fingerprint != fingerprint)
+    {
+        throw std::logic_error("Trajectory file " + path + " was unfolded with a different algorithm, "
+            "settings, measurements, input spectrum or response. Delete it or provide another path_trajectory");
+    }
+
+    // Read complete records; an incomplete final record (interrupted run) is dropped
+    bool complete = true;
+    while (tfile.peek() != std::ifstream::traits_type::eof()) {
+        TrajectoryCheckpoint checkpoint;
+        int32_t num_iterations;
+        checkpoint.spectrum.resize(num_bins);
+        checkpoint.mlem_estimate.resize(num_measurements);
+        checkpoint.mlem_correction.resize(num_bins);
+        tfile.read((char*) &num_iterations, sizeof(num_iterations));
+        tfile.read((char*) &checkpoint.spectrum[0], num_bins*sizeof(double));
+        tfile.read((char*) &checkpoint.mlem_estimate[0], num_measurements*sizeof(double));
+        tfile.read((char*) &checkpoint.mlem_correction[0], num_bins*sizeof(double));
+        if (!tfile) {
+            complete = false;
+            break;
+        }
+        checkpoint.num_iterations = num_iterations;
+        checkpoints[num_iterations] = checkpoint;
+    }
+    tfile.close();
+
+    // Rewrite the file without the incomplete record, so that new records can be appended
+    if (!complete) {
+        create(algorithm, fingerprint);
+        for (std::map<int, TrajectoryCheckpoint>::iterator it = checkpoints.begin(); it != checkpoints.end(); ++it) {
+            append(it->second);
+        }
+    }
+}
+
+void TrajectoryFile::create(std::string algorithm, unsigned long long fingerprint) {
+    std::ofstream tfile(path, std::ios::binary | std::ios::trunc);
+    if (!tfile.is_open()) {
+        throw std::logic_error("Unable to create trajectory file: " + path);
+    }
+    int32_t version = VERSION;
+    int32_t file_num_measurements = num_measurements;
+    int32_t file_num_bins = num_bins;
+    uint64_t file_fingerprint = fingerprint;
+    char file_algorithm[ALGORITHM_NAME_LENGTH] = {0};
+    strncpy(file_algorithm, algorithm.c_str(), ALGORITHM_NAME_LENGTH-1);
+    tfile.write(MAGIC, sizeof(MAGIC));
+    tfile.write((const char*) &version, sizeof(version));
+    tfile.write((const char*) &file_num_measurements, sizeof(file_num_measurements));
+    tfile.write((const char*) &file_num_bins, sizeof(file_num_bins));
+    tfile.write((const char*) &file_fingerprint, sizeof(file_fingerprint));
+    tfile.write(file_algorithm, sizeof(file_algorithm));
+    tfile.close();
+}
+
+void TrajectoryFile::append(const TrajectoryCheckpoint& checkpoint) {
+    std::ofstream tfile(path, std::ios::binary | std::ios::app);
+    if (!tfile.is_open()) {
+        throw std::logic_error("Unable to write to trajectory file: " + path);
+    }
+    int32_t num_iterations = checkpoint.num_iterations;
+    tfile.write((const char*) &num_iterations, sizeof(num_iterations));
+    tfile.write((const char*) &checkpoint.spectrum[0], num_bins*sizeof(double));
+    tfile.write((const char*) &checkpoint.mlem_estimate[0], num_measurements*sizeof(double));
+    tfile.write((const char*) &checkpoint.mlem_correction[0], num_bins*sizeof(double));
+    tfile.close();
+}
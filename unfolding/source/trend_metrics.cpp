@@ -0,0 +1,167 @@
+//**************************************************************************************************
+// The functions included in this module calculate the parameters of interest tracked by
+// unfold_trend. The requested parameters are looked up once in a table of metrics, so that every
+// point of an unfolding trajectory is evaluated for all of them without re-parsing their names.
+//**************************************************************************************************
+
+#include "trend_metrics.h"
+#include "fileio.h"
+#include "physics_calculations.h"
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+//--------------------------------------------------------------------------------------------------
+// Constructor for TrendPoint
+//--------------------------------------------------------------------------------------------------
+TrendPoint::TrendPoint(int i_num, int num_measurements, int num_bins, std::vector<double>& measurements,
+    std::vector<double>& spectrum, std::vector<double>& icrp_factors, std::vector<double>& ref_spectrum,
+    UnfoldingWorkspace& workspace)
+    : measurements(measurements), spectrum(spectrum), icrp_factors(icrp_factors),
+    ref_spectrum(ref_spectrum), workspace(workspace)
+{
+    this->i_num = i_num;
+    this->num_measurements = num_measurements;
+    this->num_bins = num_bins;
+}
+
+//==================================================================================================
+// Metric functions
+//==================================================================================================
+static double totalFluence(TrendPoint& point) {
+    return calculateTotalFlux(point.num_bins, point.spectrum);
+}
+
+static double totalDose(TrendPoint& point) {
+    return calculateDose(point.num_bins, point.spectrum, point.icrp_factors);
+}
+
+// Total energy (penalty) term
+static double totalEnergyCorrection(TrendPoint& point) {
+    return calculateTotalEnergyCorrection(point.workspace.energy_correction);
+}
+
+// Maximum "error" in MLEM ratio
+static double maxMLEMRatio(TrendPoint& point) {
+    return calculateMaxRatio(point.num_measurements, point.workspace.mlem_ratio);
+}
+
+// Average "error" in MLEM ratio
+static double avgMLEMRatio(TrendPoint& point) {
+    return calculateAvgRatio(point.num_measurements, point.workspace.mlem_ratio);
+}
+
+static double jFactor(TrendPoint& point) {
+    return calculateJFactor(point.num_measurements, point.measurements, point.workspace.mlem_estimate);
+}
+
+static double jFactor2(TrendPoint& point) {
+    return calculateJFactor2(point.num_measurements, point.measurements, point.workspace.mlem_estimate);
+}
+
+static double noise(TrendPoint& point) {
+    return calculateNoise(15, 30, point.spectrum);
+}
+
+static double reducedChiSquared(TrendPoint& point) {
+    return calculateChiSquared(point.i_num, point.num_bins, point.num_measurements, point.spectrum,
+        point.measurements, point.workspace.mlem_ratio);
+}
+
+static double rmsEstimator(TrendPoint& point) {
+    return calculateRMSEstimator(point.num_bins, point.ref_spectrum, point.spectrum);
+}
+
+static double nrmsd(TrendPoint& point) {
+    return calculateNRMSD(point.num_bins, point.ref_spectrum, point.spectrum);
+}
+
+static double chiSquaredG(TrendPoint& point) {
+    return calculateChiSquaredG(point.num_bins, point.ref_spectrum, point.spectrum);
+}
+
+//==================================================================================================
+// Table of the available parameters of interest: name, label, requires_ref_spectrum, map_only,
+// function
+//==================================================================================================
+static const TrendMetric TREND_METRICS[] = {
+    {"total_fluence", "", false, false, totalFluence},
+    {"total_dose", "Total dose", false, false, totalDose},
+    {"total_energy_correction", "", false, true, totalEnergyCorrection},
+    {"max_mlem_ratio", "", false, false, maxMLEMRatio},
+    {"avg_mlem_ratio", "", false, false, avgMLEMRatio},
+    {"j_factor", "", false, false, jFactor},
+    {"j_factor2", "", false, false, jFactor2},
+    {"noise", "", false, false, noise},
+    {"reduced_chi_squared", "", false, false, reducedChiSquared},
+    {"rms", "", true, false, rmsEstimator},
+    {"nrmsd", "", true, false, nrmsd},
+    {"chi_squared_g", "", true, false, chiSquaredG},
+};
+static const int NUM_TREND_METRICS = sizeof(TREND_METRICS)/sizeof(TREND_METRICS[0]);
+
+//==================================================================================================
+// Return the metrics for a comma-delimited list of parameters of interest (e.g.
+// "total_dose,j_factor"), in the order listed. Throws if a parameter is unknown or cannot be
+// calculated for the provided algorithm.
+//==================================================================================================
+std::vector<TrendMetric> getTrendMetrics(std::string parameters_of_interest, std::string algorithm) {
+    std::vector<std::string> names;
+    stringToSVector(parameters_of_interest, names);
+
+    std::vector<TrendMetric> metrics;
+    for (int i_name = 0; i_name < (int) names.size(); i_name++) {
+        int i_metric = 0;
+        while (i_metric < NUM_TREND_METRICS && TREND_METRICS[i_metric].name != names[i_name]) {
+            i_metric++;
+        }
+        if (i_metric == NUM_TREND_METRICS) {
+            throw std::logic_error("Unrecognized parameter of interest: " + names[i_name]
+                + ". Please refer to the README for allowed parameters"
+            );
+        }
+        if (TREND_METRICS[i_metric].map_only && algorithm != "map") {
+            throw std::logic_error("Parameter of interest " + names[i_name] + " requires algorithm=map");
+        }
+        metrics.push_back(TREND_METRICS[i_metric]);
+    }
+
+    if (metrics.empty()) {
+        throw std::logic_error("No parameter of interest provided");
+    }
+
+    return metrics;
+}
+
+//==================================================================================================
+// Return true if any of the metrics is calculated relative to the reference spectrum
+//==================================================================================================
+bool requiresRefSpectrum(std::vector<TrendMetric>& metrics) {
+    for (int i_metric = 0; i_metric < (int) metrics.size(); i_metric++) {
+        if (metrics[i_metric].requires_ref_spectrum) {
+            return true;
+        }
+    }
+    return false;
+}
+
+//==================================================================================================
+// Return the output file for a metric. With a single metric this is path_output_trend; otherwise
+// the metric name is appended to the file name (e.g. output/output_trend_total_dose.csv).
+//==================================================================================================
+std::string getTrendOutputPath(std::string path_output_trend, std::string metric_name, int num_metrics) {
+    if (num_metrics == 1) {
+        return path_output_trend;
+    }
+
+    size_t extension_start = path_output_trend.rfind('.');
+    size_t directory_end = path_output_trend.rfind('/');
+    if (extension_start == std::string::npos
+        || (directory_end != std::string::npos && extension_start < directory_end))
+    {
+        return path_output_trend + "_" + metric_name;
+    }
+    return path_output_trend.substr(0, extension_start) + "_" + metric_name
+        + path_output_trend.substr(extension_start);
+}
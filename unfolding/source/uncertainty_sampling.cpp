@@ -0,0 +1,248 @@
+//**************************************************************************************************
+// The functions included in this module generate the Monte Carlo uncertainty samples used by
+// unfold_spectrum (uncertainty_type = poisson or gaussian). Samples are unfolded concurrently on a
+// ThreadPool. Each sample draws its pseudo-measurements from its own random number stream, derived
+// from the run seed and the sample index, so the results do not depend on the number of threads
+// or on the order in which samples complete. The sampled spectra are not kept: they are added to
+// streaming statistics (see streaming_statistics.h) in sample order.
+//**************************************************************************************************
+
+#include "uncertainty_sampling.h"
+#include "custom_classes.h"
+#include "mlem_kernels.h"
+#include "physics_calculations.h"
+#include "random_streams.h"
+#include "streaming_statistics.h"
+#include "thread_pool.h"
+#include "unfolding_workspace.h"
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+//==================================================================================================
+// Generate a set of pseudo-measurements (using the measurements as the means) from the provided
+// substream. Poisson-sampled values are the average of num_meas_per_shell draws per shell.
+//==================================================================================================
+static void sampleMeasurements(const PoissonSampler* poisson_sampler,
+    const GaussianSampler* gaussian_sampler, Philox4x32& generator, std::vector<double>& variates,
+    std::vector<double>& sampled_measurements)
+{
+    if (poisson_sampler) {
+        poisson_sampler->sample(generator, variates);
+        int num_per_mean = poisson_sampler->num_per_mean;
+        for (int i_meas = 0; i_meas < poisson_sampler->num_means; i_meas++) {
+            double sampled_value = 0;
+            for (int i_shell = 0; i_shell < num_per_mean; i_shell++) {
+                sampled_value += variates[i_meas*num_per_mean + i_shell];
+            }
+            sampled_measurements[i_meas] = sampled_value / num_per_mean;
+        }
+    }
+    else {
+        gaussian_sampler->sample(generator, sampled_measurements);
+    }
+}
+
+//==================================================================================================
+// True if every measurement is within the fractional error of its reconstructed value, i.e. the
+// stopping criterion of runMLEM, runMLEMOR, runSQUAREM & runMAP is already met by the spectrum that produced the estimate
+//==================================================================================================
+static bool withinError(int num_measurements, double error, std::vector<double>& measurements,
+    std::vector<double>& estimate)
+{
+    for (int i_meas = 0; i_meas < num_measurements; i_meas++) {
+        double ratio = measurements[i_meas]/estimate[i_meas];
+        if (ratio >= (1+error) || ratio <= (1-error)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//==================================================================================================
+// # of samples unfolded between updates of the statistics, per thread. Only sets the size of the
+// buffers, which are reused for every wave of samples; the results do not depend on it.
+//==================================================================================================
+static const int SAMPLES_PER_THREAD_PER_WAVE = 16;
+
+//==================================================================================================
+// Generate settings.num_uncertainty_samples sampled measurement sets and unfold each of them. Each
+// kept sampled spectrum, its ambient dose equivalent and the # of iterations used are added to
+// statistics, in sample order.
+//
+// Samples start from initial_spectrum (sample_initialization = input) or from nominal_spectrum, the
+// spectrum unfolded from the measurements themselves (sample_initialization = nominal). The sampled
+// measurements are close to the measurements, so a warm start skips most of the slow early MLEM
+// iterations. The stopping criterion (J <= the sample's J threshold for MLEM-STOP, all ratios within
+// settings.error for the others) is only meaningful if it is not met at the start: a sample for
+// which the nominal spectrum already satisfies it would stop after one iteration and just reproduce
+// the nominal spectrum, underestimating the spread. Such samples are started from initial_spectrum
+// instead, and counted in statistics.num_input_starts. A warm start requires a stopping criterion,
+// so it is rejected for the others with a fixed # of iterations (settings.error <= 0).
+//
+// Samples are unfolded in waves of a fixed number of samples; once a wave is complete its spectra
+// are added to the statistics and the buffers are reused for the next wave, so memory does not grow
+// with the number of samples.
+//
+// If settings.uncertainty_rel_tol > 0, settings.num_uncertainty_samples is the maximum # of samples:
+// the uncertainties are checked after each batch of settings.uncertainty_batch_size samples (see
+// UncertaintyConvergence), and sampling stops once they have converged (statistics.converged).
+// Waves end at batch boundaries, so the # of samples does not depend on the # of threads.
+//
+// MLEM-STOP does not converge for some sampled measurement sets. Those samples are discarded and
+// redrawn (from the same stream, so the result is still reproducible). The total number of
+// discarded samples is returned so it can be reported to the user.
+//==================================================================================================
+int runUncertaintySamples(UnfoldingSettings& settings, ThreadPool& pool, unsigned long seed,
+    int num_measurements, int num_bins, std::vector<double>& measurements,
+    std::vector<double>& std_errors, std::vector<double>& initial_spectrum,
+    std::vector<double>& nominal_spectrum, ResponseMatrix& nns_response,
+    std::vector<double>& icrp_factors, UncertaintyStatistics& statistics)
+{
+    bool warm_start;
+    if (settings.sample_initialization == "input") {
+        warm_start = false;
+    }
+    else if (settings.sample_initialization == "nominal") {
+        warm_start = true;
+    }
+    else {
+        throw std::logic_error("Unrecognized sample initialization: " + settings.sample_initialization);
+    }
+    if (warm_start && settings.algorithm != "mlemstop" && settings.error <= 0) {
+        throw std::logic_error("sample_initialization=nominal requires mlem_max_error > 0 or algorithm=mlemstop");
+    }
+
+    int num_samples = settings.num_uncertainty_samples;
+    bool adaptive = settings.uncertainty_rel_tol > 0;
+    if (adaptive && settings.uncertainty_batch_size < 1) {
+        throw std::logic_error("uncertainty_batch_size must be >= 1");
+    }
+    int batch_size = adaptive ? settings.uncertainty_batch_size : num_samples;
+    std::unique_ptr<UncertaintyConvergence> convergence;
+    if (adaptive) {
+        convergence.reset(new UncertaintyConvergence(settings.uncertainty_rel_tol));
+    }
+    int wave_size = std::min(num_samples, SAMPLES_PER_THREAD_PER_WAVE*pool.size());
+    std::vector<std::vector<double>> wave_spectra(wave_size, std::vector<double>(num_bins));
+    std::vector<double> wave_dose(wave_size, 0.0);
+    std::vector<int> wave_iterations(wave_size, 0);
+    std::vector<int> wave_input_starts(wave_size, 0);
+
+    // Reconstructed measurements of the nominal spectrum, used to check the stopping criterion of
+    // each warm start
+    std::vector<double> nominal_estimate(num_measurements);
+    if (warm_start) {
+        selectMLEMKernels(nns_response).forwardProject(nns_response, &nominal_spectrum[0],
+            &nominal_estimate[0]);
+    }
+
+    // One workspace per thread (holds the sampled measurements & spectrum buffers). Tosses are
+    // counted per sample so that no counter is shared between threads.
+    std::vector<UnfoldingWorkspace> workspaces(pool.size(), UnfoldingWorkspace(num_measurements, num_bins));
+    std::vector<int> sample_tosses(wave_size, 0);
+
+    // Distributions are set up once and shared (read-only) by all samples. Gaussian-sampling
+    // draws one value per shell from the mean & standard error of the measurements for that shell
+    std::unique_ptr<PoissonSampler> poisson_sampler;
+    std::unique_ptr<GaussianSampler> gaussian_sampler;
+    if (settings.uncertainty_type == "poisson") {
+        poisson_sampler.reset(new PoissonSampler(measurements, settings.num_meas_per_shell));
+    }
+    else if (settings.uncertainty_type == "gaussian") {
+        gaussian_sampler.reset(new GaussianSampler(measurements, std_errors, 1));
+    }
+    else {
+        throw std::logic_error("Unrecognized sampling uncertainty type: " + settings.uncertainty_type);
+    }
+
+    int num_toss = 0;
+    int num_wave_samples = 0;
+    for (int first_sample = 0; first_sample < num_samples; first_sample += num_wave_samples) {
+        int batch_end = std::min(num_samples, (first_sample/batch_size + 1)*batch_size);
+        num_wave_samples = std::min(wave_size, batch_end - first_sample);
+        pool.parallelFor(num_wave_samples, [&](int i_thread, int i_wave) {
+            int i_samp = first_sample + i_wave;
+            UnfoldingWorkspace& workspace = workspaces[i_thread];
+            std::vector<double> &sampled_measurements = workspace.sampled_measurements;
+            std::vector<double> &sampled_spectrum = workspace.sampled_spectrum;
+
+            // Random number substream for this sample
+            Philox4x32 generator(seed, i_samp);
+
+            // Whether the kept sample was started from the input spectrum (a tossed attempt is not
+            // counted)
+            bool keep_sample = false;
+            bool input_start = false;
+            int sample_iterations = 0;
+            while (!keep_sample) {
+                input_start = false;
+                sampleMeasurements(poisson_sampler.get(), gaussian_sampler.get(), generator,
+                    workspace.sampled_variates, sampled_measurements);
+                // same size, so copied without reallocating
+                sampled_spectrum = warm_start ? nominal_spectrum : initial_spectrum;
+                if (warm_start && settings.algorithm != "mlemstop"
+                    && withinError(num_measurements, settings.error, sampled_measurements, nominal_estimate))
+                {
+                    sampled_spectrum = initial_spectrum;
+                    input_start = true;
+                }
+
+                if (warm_start && settings.algorithm == "mlemstop") {
+                    double sampled_j_threshold = determineJThreshold(num_measurements,sampled_measurements,
+                        settings.cps_crossover);
+                    if (calculateJFactor(num_measurements, sampled_measurements, nominal_estimate)
+                        <= sampled_j_threshold)
+                    {
+                        sampled_spectrum = initial_spectrum;
+                        input_start = true;
+                    }
+                }
+
+                // Do unfolding on the starting spectrum & sampled measurement values. MLEM-STOP uses
+                // a unique J threshold for each sample.
+                keep_sample = true;
+                double sampled_j_threshold = 0;
+                double sampled_j_factor = 0;
+                try {
+                    sample_iterations = runUnfoldingAlgorithm(settings, num_measurements, num_bins,
+                        sampled_measurements, sampled_spectrum, nns_response, workspace, sampled_j_threshold,
+                        sampled_j_factor
+                    );
+                }
+                // Despite best efforts, sometimes MLEM-STOP will never converge for some samples.
+                // Current best approach is to discard those samples and draw a new one.
+                catch (const std::logic_error&) {
+                    if (settings.algorithm != "mlemstop") {
+                        throw;
+                    }
+                    sample_tosses[i_wave]++;
+                    keep_sample = false;
+                }
+            }
+
+            wave_input_starts[i_wave] = input_start ? 1 : 0;
+            wave_spectra[i_wave] = sampled_spectrum;
+            wave_dose[i_wave] = calculateDose(num_bins, sampled_spectrum, icrp_factors);
+            wave_iterations[i_wave] = sample_iterations;
+        });
+
+        // Add the wave's samples to the statistics in sample order
+        for (int i_wave = 0; i_wave < num_wave_samples; i_wave++) {
+            statistics.addSample(wave_spectra[i_wave], wave_dose[i_wave], wave_iterations[i_wave]);
+            statistics.num_input_starts += wave_input_starts[i_wave];
+            num_toss += sample_tosses[i_wave];
+            sample_tosses[i_wave] = 0;
+        }
+
+        if (adaptive && first_sample + num_wave_samples == batch_end && convergence->update(statistics)) {
+            statistics.converged = true;
+            break;
+        }
+    }
+
+    return num_toss;
+}
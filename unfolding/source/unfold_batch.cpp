@@ -0,0 +1,441 @@
+//**************************************************************************************************
+// This program unfolds many sets of measurements (in nC or CPS) obtained using a Nested Neutron
+// Spectrometer in a single run. It produces the same results as running unfold_spectrum on each
+// measurement set in turn, but the response matrix, energy bins, guess spectrum and dose
+// conversion factors are only read once, and the measurement sets are unfolded together: they are
+// stacked as the columns of a matrix so that each MLEM iteration is one matrix-matrix product.
+// The measurement sets to unfold are listed in the file given by the path_measurements_list
+// setting. For each measurement set, the program outputs:
+//  - the spectrum and its uncertainty (appended as rows to the output spectra file)
+//  - optionally, a report and a figure, named after the irradiation conditions
+//**************************************************************************************************
+
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <fstream>
+#include <sstream>
+#include <cmath>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+// Local
+#include "custom_classes.h"
+#include "fileio.h"
+#include "handle_args.h"
+#include "plot_plugin.h"
+#include "physics_calculations.h"
+#include "mlem_kernels.h"
+#include "mlemstop_capture.h"
+#include "batch_unfolding.h"
+#include "random_streams.h"
+#include "report_writer.h"
+#include "results_store.h"
+#include "streaming_statistics.h"
+#include "thread_pool.h"
+#include "uncertainty_sampling.h"
+
+//--------------------------------------------------------------------------------------------------
+// One entry of the measurements list, processed into CPS per moderator shell (ordered 0-7). The
+// per-entry settings hold the header information read from the measurements file (irradiation
+// conditions, dose, dose rate & duration).
+//--------------------------------------------------------------------------------------------------
+class BatchMeasurement {
+    public:
+        UnfoldingSettings settings;
+        std::vector<double> measurements;
+        std::vector<double> measurements_nc;
+        std::vector<double> std_errors;
+};
+
+//==================================================================================================
+// Read & process a measurement set the same way unfold_spectrum does
+//==================================================================================================
+static BatchMeasurement getBatchMeasurement(std::string entry, UnfoldingSettings& settings) {
+    BatchMeasurement batch_measurement;
+    batch_measurement.settings = settings;
+    UnfoldingSettings& entry_settings = batch_measurement.settings;
+    std::vector<double>& measurements = batch_measurement.measurements;
+
+    if (entry.find(',') != std::string::npos) {
+        measurements = getInlineMeasurements(entry, entry_settings);
+    }
+    else {
+        entry_settings.set_path_measurements(entry);
+        measurements = getMeasurements(entry_settings);
+    }
+    int num_measurements = measurements.size();
+    std::reverse(measurements.begin(),measurements.end()); // readin 7-0 but want 0-7
+
+    // Handle nC input (save nC values for report, then convert to CPS)
+    if (entry_settings.meas_units == "nc") {
+        batch_measurement.measurements_nc = measurements;
+        for (int i_meas=0; i_meas < num_measurements; i_meas++) {
+            measurements[i_meas] = measurements[i_meas]*entry_settings.norm/entry_settings.f_factor/entry_settings.duration;
+        }
+    }
+
+    // Process data wherein multiple measurements were acquired for each shell
+    if (entry_settings.num_meas_per_shell > 1) {
+        processMeasurements(num_measurements,entry_settings.num_meas_per_shell,measurements,
+            batch_measurement.std_errors);
+    }
+    else if (entry_settings.num_meas_per_shell == 1 && entry_settings.uncertainty_type == "gaussian"){
+        throw std::logic_error("Cannot generate Gaussian-sampled pseudo-measurements with only single measurement per shell.");
+    }
+    else if (entry_settings.num_meas_per_shell < 1) {
+        throw std::logic_error("Number of measurements per shell must be >= 1");
+    }
+
+    return batch_measurement;
+}
+
+//==================================================================================================
+// Return the pathname of a per-measurement output file: <directory>/<prefix><irradiation
+// conditions><extension>, where directory defaults to output/
+//==================================================================================================
+static std::string getBatchOutputPath(std::string directory, std::string prefix,
+    std::string irradiation_conditions, std::string extension)
+{
+    if (directory.empty()) {
+        directory = "output";
+    }
+    if (directory[directory.size()-1] != '/') {
+        directory += "/";
+    }
+    return directory + prefix + irradiation_conditions + extension;
+}
+
+int main(int argc, char* argv[])
+{
+    // Put arguments in vector for easier processing
+    std::vector<std::string> arg_vector;
+    for (int i = 1; i < argc; i++) {
+        arg_vector.push_back(argv[i]);
+    }
+
+    // NOTE: Indices are linked between the following arrays and vectors (see unfold_spectrum)
+    const int num_ifiles = 1;
+    std::string input_file_flags_arr[num_ifiles] = {
+        "--configuration"
+    };
+    std::string input_file_defaults_arr[num_ifiles] = {
+        "input/unfold_batch.cfg"
+    };
+
+    std::vector<std::string> input_files; // Store the actual input filenames to be used
+    std::vector<std::string> input_file_flags;
+    std::vector<std::string> input_file_defaults;
+    for (int i=0; i<num_ifiles; i++) {
+        input_files.push_back("");
+        input_file_flags.push_back(input_file_flags_arr[i]);
+        input_file_defaults.push_back(input_file_defaults_arr[i]);
+    }
+
+    // Use provided arguments (files) and/or defaults to determine the input files to be used
+    for (int i=0; i<num_ifiles; i++) {
+        setfile(arg_vector, input_file_flags[i], input_file_defaults[i], input_files[i]);
+    }
+
+    // Notify user if unknown parameters were received
+    checkUnknownParameters(arg_vector, input_file_flags);
+
+    // Apply some settings read in from a config file
+    UnfoldingSettings settings;
+    setSettings(input_files[0], settings);
+
+    // Select the MLEM kernel implementation (instruction set) used for unfolding
+    setMLEMKernels(settings.mlem_kernel);
+
+    double f_factor_report = settings.f_factor; // original value read in
+    settings.set_f_factor(settings.f_factor / 1e6); // Convert f_factor from fA/cps to nA/cps
+
+    //----------------------------------------------------------------------------------------------
+    // Read in every measurement set of the batch
+    //----------------------------------------------------------------------------------------------
+    std::vector<std::string> entries;
+    readMeasurementsList(settings.path_measurements_list, entries);
+    if (entries.empty()) {
+        throw std::logic_error("No measurement sets found in " + settings.path_measurements_list);
+    }
+
+    std::vector<BatchMeasurement> batch;
+    for (int i_entry = 0; i_entry < (int) entries.size(); i_entry++) {
+        batch.push_back(getBatchMeasurement(entries[i_entry], settings));
+    }
+    int num_columns = batch.size();
+    int num_measurements = batch[0].measurements.size();
+    for (int i_col = 1; i_col < num_columns; i_col++) {
+        checkDimensions(num_measurements, "number of measurements", batch[i_col].measurements.size(),
+            "Measurement set " + batch[i_col].settings.irradiation_conditions);
+    }
+    std::cout << "Read " << num_columns << " measurement sets from " << settings.path_measurements_list << "\n";
+
+    //----------------------------------------------------------------------------------------------
+    // Read in the inputs shared by all measurement sets (see unfold_spectrum for details). They are
+    // shared with the reports rather than copied into each one.
+    //----------------------------------------------------------------------------------------------
+    std::shared_ptr<std::vector<double>> shared_energy_bins = std::make_shared<std::vector<double>>();
+    std::vector<double>& energy_bins = *shared_energy_bins;
+    readInputFile1D(settings.path_energy_bins,energy_bins);
+    int num_bins = energy_bins.size();
+
+    std::shared_ptr<ResponseMatrix> shared_nns_response = std::make_shared<ResponseMatrix>(
+        readResponseFile(settings.path_system_response)
+    );
+    ResponseMatrix& nns_response = *shared_nns_response;
+    checkDimensions(num_measurements, "number of measurements", nns_response.num_measurements, "NNS response");
+    checkDimensions(num_bins, "number of energy bins", nns_response.num_bins, "NNS response");
+
+    std::shared_ptr<std::vector<double>> shared_initial_spectrum = std::make_shared<std::vector<double>>();
+    std::vector<double>& initial_spectrum = *shared_initial_spectrum;
+    readInputFile1D(settings.path_input_spectrum,initial_spectrum);
+    checkDimensions(num_bins, "number of energy bins", initial_spectrum.size(), "Input spectrum");
+
+    std::shared_ptr<std::vector<double>> shared_icrp_factors = std::make_shared<std::vector<double>>();
+    std::vector<double>& icrp_factors = *shared_icrp_factors;
+    readInputFile1D(settings.path_icrp_factors,icrp_factors);
+    checkDimensions(num_bins, "number of energy bins", icrp_factors.size(), "Number of ICRP factors");
+
+    //----------------------------------------------------------------------------------------------
+    // Unfold all measurement sets together. MLEM-OR, SQUAREM, multigrid MLEM and MAP have no
+    // batched implementation, so their measurement sets are unfolded one at a time.
+    //----------------------------------------------------------------------------------------------
+    std::vector<std::vector<double>> measurements(num_columns);
+    std::vector<std::vector<double>> spectra(num_columns, initial_spectrum);
+    for (int i_col = 0; i_col < num_columns; i_col++) {
+        measurements[i_col] = batch[i_col].measurements;
+    }
+    std::vector<UnfoldingWorkspace> workspaces(num_columns, UnfoldingWorkspace(num_measurements, num_bins));
+    std::vector<int> num_iterations(num_columns, 0);
+    std::vector<int> converged(num_columns, 1);
+
+    // MLEM-STOP specific parameters, initialized here for use later
+    std::vector<double> j_factors(num_columns, 0);
+    std::vector<double> j_thresholds(num_columns, 0);
+
+    if (settings.algorithm == "mlem") {
+        runMLEMBatch(settings.cutoff, settings.error, num_measurements, num_bins, measurements, spectra,
+            nns_response, workspaces, num_iterations
+        );
+    }
+    else if (settings.algorithm == "mlemstop") {
+        for (int i_col = 0; i_col < num_columns; i_col++) {
+            j_thresholds[i_col] = determineJThreshold(num_measurements,measurements[i_col],settings.cps_crossover);
+        }
+        runMLEMSTOPBatch(settings.cutoff, num_measurements, num_bins, measurements, spectra,
+            nns_response, workspaces, j_thresholds, j_factors, num_iterations, converged
+        );
+    }
+    else {
+        for (int i_col = 0; i_col < num_columns; i_col++) {
+            num_iterations[i_col] = runUnfoldingAlgorithm(settings, num_measurements, num_bins,
+                measurements[i_col], spectra[i_col], nns_response, workspaces[i_col], j_thresholds[i_col],
+                j_factors[i_col]
+            );
+        }
+    }
+
+    //----------------------------------------------------------------------------------------------
+    // Determine the uncertainties and quantities of interest, and save the results, for each
+    // measurement set
+    //----------------------------------------------------------------------------------------------
+    // Preallocated buffers shared by the j_bounds uncertainty estimates, and the threads used to
+    // unfold the sampled measurement sets (shared by all measurement sets)
+    UnfoldingWorkspace sample_workspace(num_measurements, num_bins);
+    ThreadPool pool(settings.num_threads);
+    if (settings.seed == 0) {
+        settings.set_seed(generateRandomSeed());
+    }
+
+    // Reports are written by a thread of their own while the next measurement sets are processed
+    ReportWriter report_writer;
+
+    int num_failed = 0;
+    for (int i_col = 0; i_col < num_columns; i_col++) {
+        UnfoldingSettings& entry_settings = batch[i_col].settings;
+        std::vector<double>& entry_measurements = batch[i_col].measurements;
+        std::vector<double>& spectrum = spectra[i_col];
+        std::string name = entry_settings.irradiation_conditions;
+
+        std::cout << "\nUnfolded: " << name << " (" << num_iterations[i_col] << " iterations)\n";
+
+        if (!converged[i_col]) {
+            std::cout << "MLEM-STOP reached cutoff # of iterations before reaching J threshold. "
+                << "No results saved for " << name << "\n";
+            num_failed++;
+            continue;
+        }
+
+        double ambient_dose_eq = calculateDose(num_bins, spectrum, icrp_factors);
+        double total_flux = calculateTotalFlux(num_bins,spectrum);
+        double avg_energy = calculateAverageEnergy(num_bins,spectrum,energy_bins);
+
+        std::vector<double> spectrum_uncertainty_lower;
+        std::vector<double> spectrum_uncertainty_upper;
+        double ambient_dose_eq_uncertainty_upper = 0;
+        double ambient_dose_eq_uncertainty_lower = 0;
+
+        UncertaintyManagerJ j_manager_low(j_thresholds[i_col],1+settings.sigma_j);
+        UncertaintyManagerJ j_manager_high(j_thresholds[i_col],1-settings.sigma_j);
+        int num_toss = 0;
+        StreamingStatistics sample_iterations;
+        int num_input_starts = 0;
+        int num_samples = 0;
+        bool uncertainty_converged = false;
+
+        // Every measurement set uses the same seed, each sample drawing from its own substream
+        // (as in unfold_spectrum), so results match running unfold_spectrum with that seed
+        if (settings.uncertainty_type == "poisson" || settings.uncertainty_type == "gaussian") {
+            UncertaintyStatistics statistics(spectrum, ambient_dose_eq, settings.uncertainty_bands);
+            num_toss = runUncertaintySamples(entry_settings, pool, settings.seed, num_measurements,
+                num_bins, entry_measurements, batch[i_col].std_errors, initial_spectrum, spectrum,
+                nns_response, icrp_factors, statistics
+            );
+
+            statistics.getSpectrumUncertainty(spectrum_uncertainty_lower, spectrum_uncertainty_upper);
+            statistics.getDoseUncertainty(ambient_dose_eq_uncertainty_lower, ambient_dose_eq_uncertainty_upper);
+            sample_iterations = statistics.num_iterations;
+            num_input_starts = statistics.num_input_starts;
+            num_samples = statistics.num_samples();
+            uncertainty_converged = statistics.converged;
+        }
+        else if (settings.uncertainty_type == "j_bounds") {
+            // Both bound spectra are captured from one MLEM-STOP trajectory (see mlemstop_capture.h)
+            std::vector<double> bound_spectrum = initial_spectrum;
+            std::vector<MLEMSTOPCapture> j_captures;
+            j_captures.push_back(MLEMSTOPCapture(j_manager_low.j_threshold));
+            j_captures.push_back(MLEMSTOPCapture(j_manager_high.j_threshold));
+            runMLEMSTOPCapture(settings.cutoff, num_measurements, num_bins, entry_measurements, bound_spectrum,
+                nns_response, sample_workspace, j_captures
+            );
+
+            j_manager_low.determineSpectrumUncertainty(spectrum,num_bins,j_captures[0]);
+            spectrum_uncertainty_lower = j_manager_low.spectrum_uncertainty;
+
+            j_manager_high.determineSpectrumUncertainty(spectrum,num_bins,j_captures[1]);
+            spectrum_uncertainty_upper = j_manager_high.spectrum_uncertainty;
+
+            j_manager_low.determineDoseUncertainty(ambient_dose_eq,spectrum,num_bins,icrp_factors);
+            ambient_dose_eq_uncertainty_lower = j_manager_low.dose_uncertainty;
+
+            j_manager_high.determineDoseUncertainty(ambient_dose_eq,spectrum,num_bins,icrp_factors);
+            ambient_dose_eq_uncertainty_upper = j_manager_high.dose_uncertainty;
+        }
+        else {
+            throw std::logic_error("Unrecognized uncertainty type: " + settings.uncertainty_type);
+        }
+
+        double total_flux_uncertainty_upper = calculateSumUncertainty(num_bins,spectrum_uncertainty_upper);
+        double total_flux_uncertainty_lower = calculateSumUncertainty(num_bins,spectrum_uncertainty_lower);
+
+        double avg_energy_uncertainty_upper = calculateEnergyUncertainty(num_bins,energy_bins,spectrum,
+            spectrum_uncertainty_upper,total_flux,total_flux_uncertainty_upper
+        );
+        double avg_energy_uncertainty_lower = calculateEnergyUncertainty(num_bins,energy_bins,spectrum,
+            spectrum_uncertainty_lower,total_flux,total_flux_uncertainty_lower
+        );
+
+        std::cout << "The equivalent dose is: " << ambient_dose_eq << " mSv/h"
+            << " (+" << ambient_dose_eq_uncertainty_upper << ", -" << ambient_dose_eq_uncertainty_lower << ")\n";
+
+        //------------------------------------------------------------------------------------------
+        // Save spectrum to file
+        //------------------------------------------------------------------------------------------
+        saveSpectrumAsRow(settings.path_output_spectra, num_bins, name, spectrum,
+            spectrum_uncertainty_upper, spectrum_uncertainty_lower, energy_bins
+        );
+        if (!settings.path_results_store.empty()) {
+            saveSpectrumToStore(settings.path_results_store, energy_bins, name, settings.algorithm, spectrum,
+                spectrum_uncertainty_upper, spectrum_uncertainty_lower, ambient_dose_eq,
+                ambient_dose_eq_uncertainty_upper, ambient_dose_eq_uncertainty_lower
+            );
+        }
+
+        //------------------------------------------------------------------------------------------
+        // Plot the spectrum. In batch mode path_figure is the directory the figures are written to.
+        //------------------------------------------------------------------------------------------
+        if (settings.generate_figure) {
+            std::string path_figure = getBatchOutputPath(settings.path_figure, "figure_", name, ".png");
+            plotSpectrumFigure(path_figure, name, num_measurements, num_bins, energy_bins, spectrum,
+                spectrum_uncertainty_upper, spectrum_uncertainty_lower
+            );
+        }
+
+        //------------------------------------------------------------------------------------------
+        // Generate report. In batch mode path_report is the directory the reports are written to.
+        // The results of the measurement set are no longer needed, so they are moved into the
+        // report, which is written by report_writer.
+        //------------------------------------------------------------------------------------------
+        if (settings.generate_report) {
+            std::unique_ptr<UnfoldingReport> report(new UnfoldingReport());
+            UnfoldingReport& myreport = *report;
+            std::string path_report = getBatchOutputPath(settings.path_report, "report_", name, ".txt");
+
+            myreport.set_algorithm(settings.algorithm);
+            myreport.set_path(path_report);
+            myreport.set_irradiation_conditions(name);
+            myreport.set_input_files(input_files);
+            myreport.set_input_file_flags(input_file_flags);
+            myreport.set_cutoff(settings.cutoff);
+            myreport.set_error(settings.error);
+            myreport.set_norm(settings.norm);
+            myreport.set_f_factor(f_factor_report);
+            myreport.set_num_measurements(num_measurements);
+            myreport.set_uncertainty_type(settings.uncertainty_type);
+            myreport.set_num_bins(num_bins);
+            myreport.set_num_uncertainty_samples(num_samples);
+            myreport.set_max_uncertainty_samples(settings.num_uncertainty_samples);
+            myreport.set_uncertainty_rel_tol(settings.uncertainty_rel_tol);
+            myreport.set_uncertainty_converged(uncertainty_converged);
+            myreport.set_uncertainty_bands(settings.uncertainty_bands);
+            myreport.set_sample_initialization(settings.sample_initialization);
+            myreport.set_sample_iterations(sample_iterations);
+            myreport.set_num_input_starts(num_input_starts);
+            myreport.set_seed(settings.seed);
+            myreport.set_git_commit(GIT_COMMIT);
+            myreport.set_measurements(std::move(entry_measurements));
+            myreport.set_measurements_nc(std::move(batch[i_col].measurements_nc));
+            myreport.set_dose_mu(entry_settings.dose_mu);
+            myreport.set_doserate_mu(entry_settings.doserate_mu);
+            myreport.set_duration(entry_settings.duration);
+            myreport.set_meas_units(settings.meas_units);
+            myreport.set_initial_spectrum(shared_initial_spectrum);
+            myreport.set_energy_bins(shared_energy_bins);
+            myreport.set_nns_response(shared_nns_response);
+            myreport.set_icrp_factors(shared_icrp_factors);
+            myreport.set_spectrum(std::move(spectrum));
+            myreport.set_spectrum_uncertainty_upper(std::move(spectrum_uncertainty_upper));
+            myreport.set_spectrum_uncertainty_lower(std::move(spectrum_uncertainty_lower));
+            myreport.set_num_iterations(num_iterations[i_col]);
+            myreport.set_mlem_ratio(std::move(workspaces[i_col].mlem_ratio));
+            myreport.set_dose(ambient_dose_eq);
+            myreport.set_dose_uncertainty_upper(ambient_dose_eq_uncertainty_upper);
+            myreport.set_dose_uncertainty_lower(ambient_dose_eq_uncertainty_lower);
+            myreport.set_total_flux(total_flux);
+            myreport.set_total_flux_uncertainty_upper(total_flux_uncertainty_upper);
+            myreport.set_total_flux_uncertainty_lower(total_flux_uncertainty_lower);
+            myreport.set_avg_energy(avg_energy);
+            myreport.set_avg_energy_uncertainty_upper(avg_energy_uncertainty_upper);
+            myreport.set_avg_energy_uncertainty_lower(avg_energy_uncertainty_lower);
+            if (settings.algorithm == "mlemstop") {
+                myreport.set_cps_crossover(settings.cps_crossover);
+                myreport.set_j_threshold(j_thresholds[i_col]);
+                myreport.set_j_final(j_factors[i_col]);
+                myreport.set_j_manager_low(std::move(j_manager_low));
+                myreport.set_j_manager_high(std::move(j_manager_high));
+                myreport.set_num_toss(num_toss);
+            }
+            report_writer.submit(std::move(report));
+        }
+    }
+
+    report_writer.finish();
+
+    std::cout << "\nSaved " << num_columns-num_failed << "/" << num_columns << " unfolded spectra to "
+        << settings.path_output_spectra << "\n";
+
+    return 0;
+}
@@ -8,6 +8,12 @@
 //  - the dose and its uncertainty
 //  - the spectrum and its uncertainty (numeric and graphical forms)
 //  - a report that details the execution of this program for archival and reproducibility
+// With --serve, the inputs are read once and measurement sets are instead unfolded on request (see
+// unfolding_service.h), from stdin or from a Unix socket (--socket <path>). With --stream, a live
+// feed of shell readings is read from stdin and unfolded incrementally (see live_unfolding.h).
+// With --campaign <spec>,
+// measurements files are unfolded with every combination of the settings swept by the spec (see
+// campaign_runner.h).
 //**************************************************************************************************
 
 #include <iostream>
@@ -16,16 +22,28 @@
 #include <sstream>
 #include <cmath>
 #include <chrono>
+#include <memory>
 #include <random>
 #include <stdlib.h>
 #include <vector>
 
 // Local
+#include "campaign_runner.h"
 #include "custom_classes.h"
 #include "fileio.h"
 #include "handle_args.h"
-#include "root_helpers.h"
+#include "live_unfolding.h"
+#include "plot_plugin.h"
 #include "physics_calculations.h"
+#include "profiler.h"
+#include "mlem_kernels.h"
+#include "mlemstop_capture.h"
+#include "random_streams.h"
+#include "results_store.h"
+#include "streaming_statistics.h"
+#include "thread_pool.h"
+#include "uncertainty_sampling.h"
+#include "unfolding_service.h"
 
 int main(int argc, char* argv[])
 {
@@ -48,6 +66,10 @@ int main(int argc, char* argv[])
         "input/unfold_spectrum.cfg"
     };
 
+    // Options that take no value are removed before the input files are determined
+    bool serve = checkFlag(arg_vector, "--serve");
+    bool stream = checkFlag(arg_vector, "--stream");
+
     // Convert arrays to vectors b/c easier to work with
     std::vector<std::string> input_files; // Store the actual input filenames to be used
     std::vector<std::string> input_file_flags;
@@ -63,16 +85,97 @@ int main(int argc, char* argv[])
         setfile(arg_vector, input_file_flags[i], input_file_defaults[i], input_files[i]);
     }
 
+    // Path of the Unix socket used by the service (stdin & stdout are used if not provided)
+    std::string path_socket;
+    setfile(arg_vector, "--socket", "", path_socket);
+
+    // Campaign spec, and the file its results are written to
+    std::string path_campaign;
+    setfile(arg_vector, "--campaign", "", path_campaign);
+    std::string path_campaign_output;
+    setfile(arg_vector, "--campaign_output", "output/campaign.jsonl", path_campaign_output);
+
+    // File the phase timings & counters are written to (not profiled if not provided)
+    std::string path_profile;
+    setfile(arg_vector, "--profile", "", path_profile);
+
     // Notify user if unknown parameters were received
-    checkUnknownParameters(arg_vector, input_file_flags);
+    std::vector<std::string> allowed_flags = input_file_flags;
+    allowed_flags.push_back("--socket");
+    allowed_flags.push_back("--profile");
+    allowed_flags.push_back("--campaign");
+    allowed_flags.push_back("--campaign_output");
+    checkUnknownParameters(arg_vector, allowed_flags);
+    if (!path_socket.empty() && !serve) {
+        throw std::logic_error("Error: --socket can only be used with --serve");
+    }
+    if (!path_campaign.empty() && serve) {
+        throw std::logic_error("Error: --campaign cannot be used with --serve");
+    }
+    if (stream && (serve || !path_campaign.empty())) {
+        throw std::logic_error("Error: --stream cannot be used with --serve or --campaign");
+    }
+
+    Profiler profiler;
+    if (!path_profile.empty()) {
+        profiler.enable("unfold_spectrum");
+    }
+    ScopedTimer input_timer(profiler, "input_parsing");
 
     // Apply some settings read in from a config file
     UnfoldingSettings settings;
     setSettings(input_files[0], settings);
 
+    // Select the MLEM kernel implementation (instruction set) used for unfolding
+    setMLEMKernels(settings.mlem_kernel);
+
     double f_factor_report = settings.f_factor; // original value read in
     settings.set_f_factor(settings.f_factor / 1e6); // Convert f_factor from fA/cps to nA/cps
 
+    // Resident service: the measurements are provided by the requests, and the results are returned
+    // in the responses instead of being written to the output files
+    if (serve) {
+        UnfoldingService service(settings);
+        if (path_socket.empty()) {
+            service.serveStream(std::cin, std::cout);
+        }
+        else {
+            service.serveSocket(path_socket);
+        }
+        return 0;
+    }
+
+    // Live feed: the shell readings are read from stdin, and the updates are written to stdout
+    if (stream) {
+        LiveUnfolding live_unfolding(settings);
+        live_unfolding.run(std::cin, std::cout);
+        return 0;
+    }
+
+    // Campaign: the results of every job are written to a single file instead of the output files
+    if (!path_campaign.empty()) {
+        CampaignSpec spec = readCampaignSpec(path_campaign, settings);
+        input_timer.stop();
+        ScopedTimer campaign_timer(profiler, "campaign");
+        CampaignSummary summary = runCampaign(settings, spec, path_campaign_output);
+        campaign_timer.stop();
+
+        std::cout << "Campaign: " << summary.num_jobs << " jobs (" << spec.measurement_files.size()
+            << " measurements files x " << spec.numVariants() << " settings variants), "
+            << summary.num_failed << " failed\n";
+        std::cout << "Completed in " << summary.seconds << " s (" << summary.num_jobs / summary.seconds
+            << " jobs/s)\n";
+        std::cout << "Results written to: " << path_campaign_output << "\n";
+
+        if (profiler.enabled) {
+            profiler.setCounter("campaign_jobs", summary.num_jobs);
+            profiler.setCounter("campaign_failed_jobs", summary.num_failed);
+            profiler.setCounter("campaign_measurement_files_read", summary.num_measurement_files_read);
+            profiler.writeJSON(path_profile);
+        }
+        return 0;
+    }
+
     // Read in measurements from file
     std::vector<double> measurements_nc;
     std::vector<double> measurements;
@@ -169,7 +272,9 @@ int main(int argc, char* argv[])
     // Input the energies from energy bins file
     //  - values in units of [MeV]
     //----------------------------------------------------------------------------------------------
-    std::vector<double> energy_bins;
+    // The inputs are shared with the report rather than copied into it
+    std::shared_ptr<std::vector<double>> shared_energy_bins = std::make_shared<std::vector<double>>();
+    std::vector<double>& energy_bins = *shared_energy_bins;
     readInputFile1D(settings.path_energy_bins,energy_bins);
 
     int num_bins = energy_bins.size();
@@ -185,10 +290,14 @@ int main(int argc, char* argv[])
     // The response function accounts for variable number of (n,p) reactions in He-3 for each
     // moderators, as a function of energy. Calculated by vendor using MC
     //----------------------------------------------------------------------------------------------
-    std::vector<std::vector<double>> nns_response;
-    readInputFile2D(settings.path_system_response,nns_response);
-    checkDimensions(num_measurements, "number of measurements", nns_response.size(), "NNS response");
-    checkDimensions(num_bins, "number of energy bins", nns_response[0].size(), "NNS response");
+    // Read directly into the contiguous storage used by the unfolding algorithms. The normalized
+    // system matrix (column sums of the response) is calculated once here, as it is a constant value.
+    std::shared_ptr<ResponseMatrix> shared_nns_response = std::make_shared<ResponseMatrix>(
+        readResponseFile(settings.path_system_response)
+    );
+    ResponseMatrix& nns_response = *shared_nns_response;
+    checkDimensions(num_measurements, "number of measurements", nns_response.num_measurements, "NNS response");
+    checkDimensions(num_bins, "number of energy bins", nns_response.num_bins, "NNS response");
 
     //----------------------------------------------------------------------------------------------
     // Generate the inital spectrum matrix to input into the unfolding algorithm:
@@ -198,7 +307,8 @@ int main(int argc, char* argv[])
     //  - Currently (2017-08-16) input a step function (high at thermals & lower), because a flat 
     //  spectrum underestimates (does not yield any) thermal neutrons
     //----------------------------------------------------------------------------------------------
-    std::vector<double> initial_spectrum;
+    std::shared_ptr<std::vector<double>> shared_initial_spectrum = std::make_shared<std::vector<double>>();
+    std::vector<double>& initial_spectrum = *shared_initial_spectrum;
     readInputFile1D(settings.path_input_spectrum,initial_spectrum);
     checkDimensions(num_bins, "number of energy bins", initial_spectrum.size(), "Input spectrum");
 
@@ -212,54 +322,54 @@ int main(int argc, char* argv[])
     //  - H values were obtained by linearly interopolating tabulated data to match energy bins used
     // Page 200 of document (ICRP 74 - ATables.pdf)
     //----------------------------------------------------------------------------------------------
-    std::vector<double> icrp_factors;
+    std::shared_ptr<std::vector<double>> shared_icrp_factors = std::make_shared<std::vector<double>>();
+    std::vector<double>& icrp_factors = *shared_icrp_factors;
     readInputFile1D(settings.path_icrp_factors,icrp_factors);
     checkDimensions(num_bins, "number of energy bins", icrp_factors.size(), "Number of ICRP factors");
+    input_timer.stop();
 
     //----------------------------------------------------------------------------------------------
     // Run the unfolding algorithm, iterating <cutoff> times.
     // Final result, i.e. unfolded spectrum, outputted in 'ini' matrix
-    // Note: the normalized system matrix is calculated first. It is required in unfolding, and is
-    // a constant value.
+    // Note: the normalized system matrix is precomputed by ResponseMatrix (see above).
     //----------------------------------------------------------------------------------------------
-    std::vector<double> normalized_response = normalizeResponse(num_bins, num_measurements, nns_response);
-
-    std::vector<double> mlem_ratio; // vector that stores the ratio between measured data and MLEM estimated data
-    std::vector<double> mlem_correction; // vector that stores the correction factors applied in each spectral bin
-    std::vector<double> mlem_estimate; // vector that stores the MLEM estimated data
+    // Preallocated buffers used by the unfolding algorithm. After unfolding, these hold the values
+    // from the final iteration.
+    UnfoldingWorkspace workspace(num_measurements, num_bins);
+    std::vector<double> &mlem_ratio = workspace.mlem_ratio; // ratio between measured data and MLEM estimated data
+    std::vector<double> &mlem_estimate = workspace.mlem_estimate; // MLEM estimated data
     int num_iterations;
 
     // MLEM-STOP specific parameters, initialized here for use later
     double j_factor = 0;
     double j_threshold = 0;
+    // Spectra at the lower & upper J bounds, if captured from the nominal MLEM-STOP trajectory
+    std::vector<MLEMSTOPCapture> j_captures;
 
     // Unfold spectrum according to user-specified algorithm
-    if (settings.algorithm == "mlem") {
-        num_iterations = runMLEM(settings.cutoff, settings.error, num_measurements, num_bins,
-            measurements, spectrum, nns_response, normalized_response, mlem_ratio, mlem_correction, 
-            mlem_estimate
-        );
-    }
-    else if (settings.algorithm == "mlemstop") {
+    ScopedTimer unfolding_timer(profiler, "nominal_unfolding");
+    if (settings.algorithm == "mlemstop" && settings.uncertainty_type == "j_bounds") {
+        // The nominal spectrum and the j_bounds spectra lie on the same trajectory (from the input
+        // spectrum), so all three are captured from a single run
         j_threshold = determineJThreshold(num_measurements,measurements,settings.cps_crossover);
-
-        num_iterations = runMLEMSTOP(settings.cutoff, num_measurements, num_bins, measurements,
-            spectrum, nns_response, normalized_response, mlem_ratio, mlem_correction, mlem_estimate,
-            j_threshold, j_factor
-        );
-    }
-    else if (settings.algorithm == "map") {
-        std::vector<double> energy_correction;
-        num_iterations = runMAP(energy_correction, settings.beta, settings.prior, settings.cutoff, 
-            settings.error, num_measurements, num_bins, measurements, spectrum, nns_response, 
-            normalized_response, mlem_ratio
+        j_captures.push_back(MLEMSTOPCapture(j_threshold));
+        j_captures.push_back(MLEMSTOPCapture(j_threshold*(1+settings.sigma_j)));
+        j_captures.push_back(MLEMSTOPCapture(j_threshold*(1-settings.sigma_j)));
+        runMLEMSTOPCapture(settings.cutoff, num_measurements, num_bins, measurements, spectrum,
+            nns_response, workspace, j_captures
         );
+        j_captures[0].restore(spectrum, workspace);
+        num_iterations = j_captures[0].num_iterations;
+        j_factor = j_captures[0].j_factor;
+        j_captures.erase(j_captures.begin());
     }
     else {
-        //throw error
-        throw std::logic_error("Unrecognized unfolding algorithm: " + settings.algorithm);
-        // std::cout << "No unfolding algorithm found for: " + settings.algorithm + '\n';
+        num_iterations = runUnfoldingAlgorithm(settings, num_measurements, num_bins, measurements, spectrum,
+            nns_response, workspace, j_threshold, j_factor
+        );
     }
+    unfolding_timer.stop();
+    profiler.setCounter("num_iterations", num_iterations);
 
     // Need to "unscale" spectrum back to true values in order to calculate quantities of interest
     // for (int i_bin = 0; i_bin < num_bins; i_bin++) {
@@ -338,119 +448,74 @@ int main(int argc, char* argv[])
     UncertaintyManagerJ j_manager_high(j_threshold,1-settings.sigma_j);
     // The # of sampled measurement sets that are discarded b/c don't converge with MLEM-STOP
     int num_toss = 0;
+    // The # of iterations used to unfold each sample, and the # of samples that could not be warm
+    // started (if sample_initialization = nominal)
+    StreamingStatistics sample_iterations;
+    int num_input_starts = 0;
+    // The # of samples drawn, and whether sampling stopped early (if uncertainty_rel_tol > 0)
+    int num_samples = 0;
+    bool uncertainty_converged = false;
+
+    // Preallocated buffers shared by the j_bounds uncertainty estimates (the sampling approach below
+    // keeps one set per thread)
+    UnfoldingWorkspace sample_workspace(num_measurements, num_bins);
 
     // This approach generates a series of sampled measurements (using original measurements as the
     // means). Unfolding is performed for each of these spectra. The uncertainty in the unfolded
     // spectrum is taken to be the Root-Mean-Square-Deviation between the unfolded spectrum and each
-    // sampled spectrum. The number of samples is set by the user via num_uncertainty_samples
+    // sampled spectrum. The number of samples is set by the user via num_uncertainty_samples, or is
+    // the number needed for the uncertainties to converge within uncertainty_rel_tol (at most
+    // num_uncertainty_samples)
     if (settings.uncertainty_type == "poisson" || settings.uncertainty_type == "gaussian") {
-        std::vector<std::vector<double>> sampled_spectra; // dimensions: num_uncertainty_samples x num_bins
-        std::vector<double> sampled_dose; // dimension: num_uncertainty_samples
-
-        for (int i_samp = 0; i_samp < settings.num_uncertainty_samples; i_samp++) {
-            std::vector<double> sampled_measurements; // dimension: num_measurements
-            std::vector<double> sampled_mlem_ratio; // dimension: num_measurements
-            std::vector<double> sampled_mlem_correction; // dimension: num_measurements
-            std::vector<double> sampled_mlem_estimate; // dimension: num_measurements
-            std::vector<double> sampled_spectrum = initial_spectrum; // dimension: num_bins
-
-            bool toss_sample = false; // Track if sample was tossed
-
-            // If doing Poisson-sampling to generate pseudo-measurement set:
-            if (settings.uncertainty_type == "poisson") {
-                for (int i_meas = 0; i_meas < num_measurements; i_meas++) {
-                    double sampled_value = 0;
-                    for (int i_samp =0; i_samp < settings.num_meas_per_shell; i_samp++) {
-                        sampled_value += poisson(measurements[i_meas]);
-                    }
-                    sampled_value /= settings.num_meas_per_shell;
-                    sampled_measurements.push_back(sampled_value);
-                }
-            }
-            // If doing Gaussian-sampling to generate pseudo-measurement set
-            else if (settings.uncertainty_type == "gaussian") {
-                for (int i_meas = 0; i_meas < num_measurements; i_meas++) {
-                    unsigned seed = std::chrono::system_clock::now().time_since_epoch().count();
-                    std::default_random_engine generator (seed);
-                    std::normal_distribution<double> distribution(measurements[i_meas],std_errors[i_meas]);
-
-                    double new_sample = distribution(generator);
-                    sampled_measurements.push_back(new_sample);
-                }
-            }
-
-            // Do unfolding on the initial spectrum & sampled measurement values
-            if (settings.algorithm == "mlem") {
-                runMLEM(settings.cutoff, settings.error, num_measurements, num_bins, sampled_measurements, 
-                    sampled_spectrum, nns_response, normalized_response, sampled_mlem_ratio, 
-                    sampled_mlem_correction, sampled_mlem_estimate
-                );
-            }
-            // MLEM-STOP requires special handling of unfolding the sampled measurement sets.
-            // Despite best efforts, sometimes MLEM-STOP will never converge for some samples. 
-            // Current best approach is to discard those samples. A record is kept of the number
-            // of samples discarded and reported to the user so they may interpret the final
-            // uncertainty accordingly.
-            else if (settings.algorithm == "mlemstop") {
-                // Calculate unique J threshold for the current sample
-                double sampled_j_threshold = determineJThreshold(num_measurements,sampled_measurements,settings.cps_crossover);
-                double sampled_j_factor = 0;
-
-                // Try running MLEM-STOP for the current sample but catch an error if never
-                // converges. Increment num_toss if so, and decrement the sample index (i.e scrap
-                // the current sample and retry)
-                try {
-                    runMLEMSTOP(settings.cutoff, num_measurements, num_bins, sampled_measurements,
-                        sampled_spectrum, nns_response, normalized_response, sampled_mlem_ratio, sampled_mlem_correction, 
-                        sampled_mlem_estimate, sampled_j_threshold, sampled_j_factor
-                    );
-                }
-                catch (std::logic_error e) {
-                    i_samp = i_samp - 1;
-                    num_toss = num_toss + 1;
-                    toss_sample = true;
-                }
-            }
-            else if (settings.algorithm == "map") {
-                std::vector<double> sampled_energy_correction;
-                runMAP(sampled_energy_correction, settings.beta, settings.prior, settings.cutoff, 
-                    settings.error, num_measurements, num_bins, sampled_measurements, sampled_spectrum, 
-                    nns_response, normalized_response, sampled_mlem_ratio
-                );
-            }
-            else {
-                //throw error
-                throw std::logic_error("Unrecognized unfolding algorithm: " + settings.algorithm);
-            }
-
-            // Note the sampled CPS values were based on the scaled CPS, so need to scale back the
-            // sampled spectra to correct magnitude 
-            // for (int i_bin = 0; i_bin < num_bins; i_bin++) {
-            //     sampled_spectrum[i_bin] /= scale_factor;
-            // }
-
-            if (!toss_sample) {
-                sampled_spectra.push_back(sampled_spectrum); // add to growing array of sampled spectra
-            }
-
-            // Calculate the ambient dose equivalent associated with the sampled spectrum
-            double sdose = calculateDose(num_bins, sampled_spectrum, icrp_factors);
-
-            sampled_dose.push_back(sdose);
+        // The sampled spectra & doses are not stored: each one updates running statistics (per
+        // energy bin) around the nominal spectrum & dose as it completes, so memory does not grow
+        // with num_uncertainty_samples. See streaming_statistics.h for the uncertainty_bands.
+        UncertaintyStatistics statistics(spectrum, ambient_dose_eq, settings.uncertainty_bands);
+
+        // The samples are independent, so they are unfolded concurrently (see uncertainty_sampling.h).
+        // Samples that do not converge with MLEM-STOP are discarded and redrawn; num_toss records
+        // how many so the final uncertainty can be interpreted accordingly.
+        // Samples start from the input spectrum, or from the nominal unfolded spectrum if
+        // sample_initialization = nominal (fewer iterations per sample).
+        // Each sample draws from its own substream of the run seed, so a run can be reproduced by
+        // providing the same seed (the seed used is written to the report)
+        if (settings.seed == 0) {
+            settings.set_seed(generateRandomSeed());
         }
+        ScopedTimer sampling_timer(profiler, "uncertainty_sampling");
+        ThreadPool pool(settings.num_threads);
+        num_toss = runUncertaintySamples(settings, pool, settings.seed, num_measurements, num_bins,
+            measurements, std_errors, initial_spectrum, spectrum, nns_response, icrp_factors,
+            statistics
+        );
+        sampling_timer.stop();
 
         // Finally, "unscale" spectrum back to true values for remaining calculations & logging
         // for (int i_bin = 0; i_bin < num_bins; i_bin++) {
         //     spectrum[i_bin] /= scale_factor;
         // }
 
-        // Calculate the spectrum uncertainty (same upper & lower)
-        calculateRMSD_vector(settings.num_uncertainty_samples, spectrum, sampled_spectra, spectrum_uncertainty_lower);
-        spectrum_uncertainty_upper = spectrum_uncertainty_lower;
+        // Calculate the spectrum & dose uncertainties (same upper & lower for rmsd bands)
+        statistics.getSpectrumUncertainty(spectrum_uncertainty_lower, spectrum_uncertainty_upper);
+        statistics.getDoseUncertainty(ambient_dose_eq_uncertainty_lower, ambient_dose_eq_uncertainty_upper);
+
+        sample_iterations = statistics.num_iterations;
+        num_input_starts = statistics.num_input_starts;
+        num_samples = statistics.num_samples();
+        uncertainty_converged = statistics.converged;
+        std::cout << "Mean # of iterations per uncertainty sample: " << sample_iterations.mean << "\n";
+        if (settings.uncertainty_rel_tol > 0) {
+            std::cout << "# of uncertainty samples: " << num_samples << "/" << settings.num_uncertainty_samples
+                << (uncertainty_converged ? " (converged)" : " (not converged)") << "\n";
+        }
 
-        // Calculate the dose uncertainty (same upper & lower)
-        ambient_dose_eq_uncertainty_upper = calculateRMSD(settings.num_uncertainty_samples, ambient_dose_eq, sampled_dose);
-        ambient_dose_eq_uncertainty_lower = ambient_dose_eq_uncertainty_upper;
+        profiler.setCounter("num_threads", pool.size());
+        profiler.setCounter("num_uncertainty_samples", num_samples);
+        profiler.setCounter("num_toss", num_toss);
+        profiler.setCounter("num_input_starts", num_input_starts);
+        profiler.setCounter("sample_iterations_mean", sample_iterations.mean);
+        profiler.setCounter("sample_iterations_min", sample_iterations.minimum);
+        profiler.setCounter("sample_iterations_max", sample_iterations.maximum);
 
         // If want to print the number of sample sets kept vs tossed:
         // std::cout << "Number of sampled measurement sets kept: " << settings.num_uncertainty_samples << "\n";
@@ -469,16 +534,22 @@ int main(int argc, char* argv[])
     // is determined for both upper and lower, and MLEM-STOP is performed using both thresholds. The
     // upper uncertainty is then the difference betwen the "upper" spectrum and the MLEM-STOP estimated 
     // spectrum. Similarly for the lower uncertainty. This is all handled in the UncertaintyManagerJ
-    // class.
+    // class. Both bound spectra are captured from one MLEM-STOP trajectory (already done during the
+    // nominal unfolding if algorithm = mlemstop).
     else if (settings.uncertainty_type == "j_bounds") {
-        j_manager_low.determineSpectrumUncertainty(spectrum,settings.cutoff,num_measurements,
-            num_bins,measurements,nns_response,normalized_response,initial_spectrum
-        );
+        ScopedTimer j_bounds_timer(profiler, "j_bounds");
+        if (j_captures.empty()) {
+            std::vector<double> bound_spectrum = initial_spectrum;
+            j_captures.push_back(MLEMSTOPCapture(j_manager_low.j_threshold));
+            j_captures.push_back(MLEMSTOPCapture(j_manager_high.j_threshold));
+            runMLEMSTOPCapture(settings.cutoff, num_measurements, num_bins, measurements, bound_spectrum,
+                nns_response, sample_workspace, j_captures
+            );
+        }
+        j_manager_low.determineSpectrumUncertainty(spectrum,num_bins,j_captures[0]);
         spectrum_uncertainty_lower = j_manager_low.spectrum_uncertainty;
 
-        j_manager_high.determineSpectrumUncertainty(spectrum,settings.cutoff,num_measurements,
-            num_bins,measurements,nns_response,normalized_response,initial_spectrum
-        );
+        j_manager_high.determineSpectrumUncertainty(spectrum,num_bins,j_captures[1]);
         spectrum_uncertainty_upper = j_manager_high.spectrum_uncertainty;
 
         j_manager_low.determineDoseUncertainty(ambient_dose_eq,spectrum,num_bins,icrp_factors);
@@ -486,6 +557,10 @@ int main(int argc, char* argv[])
 
         j_manager_high.determineDoseUncertainty(ambient_dose_eq,spectrum,num_bins,icrp_factors);
         ambient_dose_eq_uncertainty_upper = j_manager_high.dose_uncertainty;
+
+        j_bounds_timer.stop();
+        profiler.setCounter("j_bounds_iterations_low", j_manager_low.num_iterations);
+        profiler.setCounter("j_bounds_iterations_high", j_manager_high.num_iterations);
     }
     else {
         throw std::logic_error("Unrecognized uncertainty type: " + settings.uncertainty_type);
@@ -534,15 +609,27 @@ int main(int argc, char* argv[])
     //----------------------------------------------------------------------------------------------
     // Save spectrum to file
     //----------------------------------------------------------------------------------------------
+    ScopedTimer output_timer(profiler, "output_writing");
     saveSpectrumAsRow(settings.path_output_spectra, num_bins, settings.irradiation_conditions, spectrum, 
         spectrum_uncertainty_upper, spectrum_uncertainty_lower, energy_bins
     );
+    if (!settings.path_results_store.empty()) {
+        saveSpectrumToStore(settings.path_results_store, energy_bins, settings.irradiation_conditions,
+            settings.algorithm, spectrum, spectrum_uncertainty_upper, spectrum_uncertainty_lower, ambient_dose_eq,
+            ambient_dose_eq_uncertainty_upper, ambient_dose_eq_uncertainty_lower
+        );
+    }
+    output_timer.stop();
     std::cout << "Saved unfolded spectrum to " << settings.path_output_spectra << "\n";
+    if (!settings.path_results_store.empty()) {
+        std::cout << "Saved unfolded spectrum to results store " << settings.path_results_store << "\n";
+    }
 
     //----------------------------------------------------------------------------------------------
     // Generate report
     //----------------------------------------------------------------------------------------------
     if (settings.generate_report) {
+        ScopedTimer report_timer(profiler, "report_writing");
         // std::vector<double> measurements_report;
         // if (settings.meas_units == "cps") {
         //     measurements_report = measurements;
@@ -569,23 +656,31 @@ int main(int argc, char* argv[])
         myreport.set_num_measurements(num_measurements);
         myreport.set_uncertainty_type(settings.uncertainty_type);
         myreport.set_num_bins(num_bins);
-        myreport.set_num_uncertainty_samples(settings.num_uncertainty_samples);
+        myreport.set_num_uncertainty_samples(num_samples);
+        myreport.set_max_uncertainty_samples(settings.num_uncertainty_samples);
+        myreport.set_uncertainty_rel_tol(settings.uncertainty_rel_tol);
+        myreport.set_uncertainty_converged(uncertainty_converged);
+        myreport.set_uncertainty_bands(settings.uncertainty_bands);
+        myreport.set_sample_initialization(settings.sample_initialization);
+        myreport.set_sample_iterations(sample_iterations);
+        myreport.set_num_input_starts(num_input_starts);
+        myreport.set_seed(settings.seed);
         myreport.set_git_commit(GIT_COMMIT);
-        myreport.set_measurements(measurements);
-        myreport.set_measurements_nc(measurements_nc);
+        myreport.set_measurements(std::move(measurements));
+        myreport.set_measurements_nc(std::move(measurements_nc));
         myreport.set_dose_mu(settings.dose_mu);
         myreport.set_doserate_mu(settings.doserate_mu);
         myreport.set_duration(settings.duration);
         myreport.set_meas_units(settings.meas_units);
-        myreport.set_initial_spectrum(initial_spectrum);
-        myreport.set_energy_bins(energy_bins);
-        myreport.set_nns_response(nns_response);
-        myreport.set_icrp_factors(icrp_factors);
+        myreport.set_initial_spectrum(shared_initial_spectrum);
+        myreport.set_energy_bins(shared_energy_bins);
+        myreport.set_nns_response(shared_nns_response);
+        myreport.set_icrp_factors(shared_icrp_factors);
         myreport.set_spectrum(spectrum);
         myreport.set_spectrum_uncertainty_upper(spectrum_uncertainty_upper);
         myreport.set_spectrum_uncertainty_lower(spectrum_uncertainty_lower);
         myreport.set_num_iterations(num_iterations);
-        myreport.set_mlem_ratio(mlem_ratio);
+        myreport.set_mlem_ratio(std::move(mlem_ratio));
         myreport.set_dose(ambient_dose_eq);
         myreport.set_dose_uncertainty_upper(ambient_dose_eq_uncertainty_upper);
         myreport.set_dose_uncertainty_lower(ambient_dose_eq_uncertainty_lower);
@@ -599,10 +694,11 @@ int main(int argc, char* argv[])
             myreport.set_cps_crossover(settings.cps_crossover);
             myreport.set_j_threshold(j_threshold);
             myreport.set_j_final(j_factor);
-            myreport.set_j_manager_low(j_manager_low);
-            myreport.set_j_manager_high(j_manager_high);
+            myreport.set_j_manager_low(std::move(j_manager_low));
+            myreport.set_j_manager_high(std::move(j_manager_high));
             myreport.set_num_toss(num_toss);
         }
+        myreport.set_profile(profiler);
         myreport.prepare_report();
 
         std::cout << "Generated summary report: " << settings.path_report << "\n\n";
@@ -612,15 +708,21 @@ int main(int argc, char* argv[])
     // Plot the spectrum
     //----------------------------------------------------------------------------------------------
     if (settings.generate_figure) {
+        ScopedTimer plotting_timer(profiler, "plotting");
         std::cout << "Plotting spectrum: \n";
         if (settings.path_figure.empty()) {
             settings.path_figure = "output/figure_" + settings.irradiation_conditions + ".png";
         }
-        plotSpectrum(settings.path_figure, settings.irradiation_conditions, num_measurements, 
+        plotSpectrumFigure(settings.path_figure, settings.irradiation_conditions, num_measurements, 
             num_bins, energy_bins, spectrum, spectrum_uncertainty_upper, spectrum_uncertainty_lower
         );
         std::cout << "\n";
     }
 
+    if (profiler.enabled) {
+        profiler.writeJSON(path_profile);
+        std::cout << "Saved profile to " << path_profile << "\n";
+    }
+
     return 0;
 }
\ No newline at end of file
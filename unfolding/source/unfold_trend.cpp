@@ -17,15 +17,73 @@
 #include <fstream>
 #include <sstream>
 #include <cmath>
+#include <memory>
 #include <stdlib.h>
+#include <string>
 #include <vector>
 
 // Local
 #include "custom_classes.h"
 #include "fileio.h"
 #include "handle_args.h"
-#include "root_helpers.h"
 #include "physics_calculations.h"
+#include "mlem_kernels.h"
+#include "profiler.h"
+#include "thread_pool.h"
+#include "trajectory_file.h"
+#include "trend_metrics.h"
+
+//==================================================================================================
+// Open the trajectory file (path_trajectory) of the trajectory unfolded with algorithm, or return
+// a null pointer if no trajectory file is used
+//==================================================================================================
+static std::unique_ptr<TrajectoryFile> openTrajectory(UnfoldingSettings& settings, std::string algorithm,
+    int num_measurements, int num_bins, std::vector<double>& measurements,
+    std::vector<double>& initial_spectrum, ResponseMatrix& nns_response)
+{
+    std::unique_ptr<TrajectoryFile> trajectory;
+    if (settings.path_trajectory != "") {
+        trajectory.reset(new TrajectoryFile(settings.path_trajectory, algorithm, settings.error,
+            settings.relaxation, num_measurements, num_bins, measurements, initial_spectrum, nns_response));
+        std::cout << "Loaded " << trajectory->num_checkpoints() << " checkpoints from "
+            << settings.path_trajectory << "\n";
+    }
+    return trajectory;
+}
+
+//==================================================================================================
+// Advance the trajectory (current_spectrum, after current_iterations iterations) to
+// target_iterations iterations of trajectory_settings.algorithm (mlem, mlem_or or squarem). If a
+// trajectory file is used, the state is first restored from its latest checkpoint that is further
+// along, and the new state is saved as a checkpoint; only the remaining iterations are unfolded.
+// trajectory_settings is a copy of the settings owned by the caller: its cutoff is overwritten with
+// the # of remaining iterations.
+//==================================================================================================
+static void advanceTrajectory(UnfoldingSettings& trajectory_settings, TrajectoryFile* trajectory,
+    int& current_iterations, int target_iterations, int num_measurements, int num_bins,
+    std::vector<double>& measurements, std::vector<double>& current_spectrum, ResponseMatrix& nns_response,
+    UnfoldingWorkspace& workspace)
+{
+    if (trajectory) {
+        current_iterations = trajectory->restoreLatest(target_iterations, current_iterations, measurements,
+            current_spectrum, workspace);
+    }
+    if (current_iterations >= target_iterations) {
+        return;
+    }
+
+    trajectory_settings.cutoff = target_iterations - current_iterations;
+    double j_threshold = 0;
+    double j_factor = 0;
+    runUnfoldingAlgorithm(trajectory_settings, num_measurements, num_bins, measurements, current_spectrum,
+        nns_response, workspace, j_threshold, j_factor
+    );
+    current_iterations = target_iterations;
+
+    if (trajectory) {
+        trajectory->save(current_iterations, current_spectrum, workspace);
+    }
+}
 
 int main(int argc, char* argv[])
 {
@@ -63,13 +121,28 @@ int main(int argc, char* argv[])
         setfile(arg_vector, input_file_flags[i], input_file_defaults[i], input_files[i]);
     }
 
+    // File the phase timings & counters are written to (not profiled if not provided)
+    std::string path_profile;
+    setfile(arg_vector, "--profile", "", path_profile);
+
     // Notify user if unknown parameters were received
-    checkUnknownParameters(arg_vector, input_file_flags);
+    std::vector<std::string> allowed_flags = input_file_flags;
+    allowed_flags.push_back("--profile");
+    checkUnknownParameters(arg_vector, allowed_flags);
+
+    Profiler profiler;
+    if (!path_profile.empty()) {
+        profiler.enable("unfold_trend");
+    }
+    ScopedTimer input_timer(profiler, "input_parsing");
 
     // Apply some settings read in from a config file
     UnfoldingSettings settings;
     setSettings(input_files[0], settings);
 
+    // Select the MLEM kernel implementation (instruction set) used for unfolding
+    setMLEMKernels(settings.mlem_kernel);
+
     settings.set_f_factor(settings.f_factor / 1e6); // Convert f_factor from fA/cps to nA/cps
 
     // Read in measurements from file
@@ -138,10 +211,11 @@ int main(int argc, char* argv[])
     // The response function accounts for variable number of (n,p) reactions in He-3 for each
     // moderators, as a function of energy. Calculated by vendor using MC
     //----------------------------------------------------------------------------------------------
-    std::vector<std::vector<double>> nns_response;
-    readInputFile2D(settings.path_system_response,nns_response);
-    checkDimensions(num_measurements, "number of measurements", nns_response.size(), "NNS response");
-    checkDimensions(num_bins, "number of energy bins", nns_response[0].size(), "NNS response");
+    // Read directly into the contiguous storage used by the unfolding algorithms. The normalized
+    // system matrix (column sums of the response) is calculated once here, as it is a constant value.
+    ResponseMatrix nns_response = readResponseFile(settings.path_system_response);
+    checkDimensions(num_measurements, "number of measurements", nns_response.num_measurements, "NNS response");
+    checkDimensions(num_bins, "number of energy bins", nns_response.num_bins, "NNS response");
 
     //----------------------------------------------------------------------------------------------
     // Generate the inital spectrum matrix to input into the unfolding algorithm:
@@ -171,14 +245,14 @@ int main(int argc, char* argv[])
 
     //----------------------------------------------------------------------------------------------
     // Run the automatic unfolding algorithm.
-    // Note: the normalized system matrix is calculated first. It is required in unfolding, and is
-    // a constant value.
+    // Note: the normalized system matrix is precomputed by ResponseMatrix (see above).
     //----------------------------------------------------------------------------------------------
-    std::vector<double> normalized_response = normalizeResponse(num_bins, num_measurements, nns_response);
+    input_timer.stop();
 
-    std::vector<double> mlem_ratio; // vector that stores the ratio between measured data and MLEM estimated data
-    std::vector<double> mlem_correction; // vector that stores the ratio between measured data and MLEM estimated data
-    std::vector<double> mlem_estimate;
+    // Preallocated buffers reused by every unfolding run below
+    UnfoldingWorkspace workspace(num_measurements, num_bins);
+    std::vector<double> &mlem_ratio = workspace.mlem_ratio; // ratio between measured data and MLEM estimated data
+    std::vector<double> &mlem_correction = workspace.mlem_correction; // correction factors applied in each spectral bin
 
     //----------------------------------------------------------------------------------------------
     // Output correction factors (52 values applied to spectrum, NOT to measurements).
@@ -194,6 +268,11 @@ int main(int argc, char* argv[])
         int num_iteration_samples = num_iterations_vector.size();
 
         std::vector<double> current_spectrum = initial_spectrum; // the reconstructed spectrum
+        int current_iterations = 0;
+        std::unique_ptr<TrajectoryFile> trajectory = openTrajectory(settings, "mlem", num_measurements, num_bins,
+            measurements, initial_spectrum, nns_response);
+        UnfoldingSettings trajectory_settings = settings; // see advanceTrajectory
+        trajectory_settings.algorithm = "mlem";
 
         // Add the energy bins to the file
         std::ostringstream results_stream;
@@ -205,6 +284,7 @@ int main(int argc, char* argv[])
         }
         results_stream << "\n";
 
+        ScopedTimer unfolding_timer(profiler, "trend_unfolding");
         int total_num_iterations = 0;
         for (int i_num=0; i_num < num_iteration_samples; i_num++) {
             int num_iterations;
@@ -215,8 +295,8 @@ int main(int argc, char* argv[])
                 num_iterations = num_iterations_vector[i_num];
             else
                 num_iterations = num_iterations_vector[i_num]-num_iterations_vector[i_num-1];
-            runMLEM(num_iterations, settings.error, num_measurements, num_bins, measurements, 
-                current_spectrum, nns_response, normalized_response, mlem_ratio, mlem_correction, mlem_estimate
+            advanceTrajectory(trajectory_settings, trajectory.get(), current_iterations, num_iterations_vector[i_num],
+                num_measurements, num_bins, measurements, current_spectrum, nns_response, workspace
             );
 
             total_num_iterations += num_iterations;
@@ -232,8 +312,11 @@ int main(int argc, char* argv[])
             }
             results_stream << "\n";
         }        
+        unfolding_timer.stop();
+        profiler.setCounter("num_iteration_samples", num_iteration_samples);
 
         // Save results for parameter of interest to CSV file
+        ScopedTimer output_timer(profiler, "output_writing");
         std::ofstream output_file;
         output_file.open(settings.path_output_trend, std::ios_base::out);
         std::string results_string = results_stream.str();
@@ -260,6 +343,11 @@ int main(int argc, char* argv[])
         int num_iteration_samples = num_iterations_vector.size();
 
         std::vector<double> current_spectrum = initial_spectrum; // the reconstructed spectrum
+        int current_iterations = 0;
+        std::unique_ptr<TrajectoryFile> trajectory = openTrajectory(settings, "mlem", num_measurements, num_bins,
+            measurements, initial_spectrum, nns_response);
+        UnfoldingSettings trajectory_settings = settings; // see advanceTrajectory
+        trajectory_settings.algorithm = "mlem";
 
         // Add the Moderator numbers to the file
         std::ostringstream results_stream;
@@ -289,6 +377,7 @@ int main(int argc, char* argv[])
         }
         results_stream << "\n";
 
+        ScopedTimer unfolding_timer(profiler, "trend_unfolding");
         int total_num_iterations = 0;
         for (int i_num=0; i_num < num_iteration_samples; i_num++) {
             int num_iterations;
@@ -299,8 +388,8 @@ int main(int argc, char* argv[])
                 num_iterations = num_iterations_vector[i_num];
             else
                 num_iterations = num_iterations_vector[i_num]-num_iterations_vector[i_num-1];
-            runMLEM(num_iterations, settings.error, num_measurements, num_bins, measurements, 
-                current_spectrum, nns_response, normalized_response, mlem_ratio, mlem_correction, mlem_estimate
+            advanceTrajectory(trajectory_settings, trajectory.get(), current_iterations, num_iterations_vector[i_num],
+                num_measurements, num_bins, measurements, current_spectrum, nns_response, workspace
             );
 
             total_num_iterations += num_iterations;
@@ -323,8 +412,11 @@ int main(int argc, char* argv[])
             }
             results_stream << "\n";
         }        
+        unfolding_timer.stop();
+        profiler.setCounter("num_iteration_samples", num_iteration_samples);
 
         // Save results for parameter of interest to CSV file
+        ScopedTimer output_timer(profiler, "output_writing");
         std::ofstream output_file;
         output_file.open(settings.path_output_trend, std::ios_base::out);
         std::string results_string = results_stream.str();
@@ -344,7 +436,7 @@ int main(int argc, char* argv[])
     //  data to append to existing file
     // Visualize with plot_lines
     //----------------------------------------------------------------------------------------------
-    if (settings.algorithm == "mlem") {
+    if (settings.algorithm == "mlem" || settings.algorithm == "mlem_or" || settings.algorithm == "squarem") {
         // Create vector of number of iterations
         int num_increments = ((settings.iteration_max - settings.iteration_min) / settings.iteration_increment)+1;
         std::vector<int> num_iterations_vector = linearSpacedIntegerVector(
@@ -353,166 +445,119 @@ int main(int argc, char* argv[])
         int num_iteration_samples = num_iterations_vector.size();
 
         std::vector<double> current_spectrum = initial_spectrum; // the reconstructed spectrum
+        int current_iterations = 0;
+        std::unique_ptr<TrajectoryFile> trajectory = openTrajectory(settings, settings.algorithm, num_measurements,
+            num_bins, measurements, initial_spectrum, nns_response);
+        UnfoldingSettings trajectory_settings = settings; // see advanceTrajectory
+
+        // Parameters of interest, each saved to its own output file
+        std::vector<TrendMetric> metrics = getTrendMetrics(settings.parameter_of_interest, settings.algorithm);
+        int num_metrics = metrics.size();
 
-        std::vector<double> derivative_poi_values; // hold poi_values in vector if doing derivative calculations
+        std::vector<std::vector<double>> derivative_poi_values(num_metrics); // hold poi_values in vector if doing derivative calculations
 
         // Create stream to append results. First row is number of iteration increments
         // determine if file exists
         // std::string map_filename = "output/poi_output_mlem.csv";
-        std::ifstream rfile(settings.path_output_trend);
-        bool file_empty = is_empty(rfile);
-        // bool file_exists = rfile.good();
-        rfile.close();
-
         // If the file is empty, make the first line the number of iterations
-        std::ostringstream results_stream;
-        if (file_empty) {
-            results_stream << "Number of iterations,";
-            for (int i_num = 0; i_num < num_iteration_samples; i_num++) {
-                results_stream << num_iterations_vector[i_num];
-                if (i_num != num_iteration_samples-1)
-                    results_stream << ",";
+        std::vector<std::ostringstream> results_streams(num_metrics);
+        for (int i_metric = 0; i_metric < num_metrics; i_metric++) {
+            std::ifstream rfile(getTrendOutputPath(settings.path_output_trend, metrics[i_metric].name, num_metrics));
+            bool file_empty = is_empty(rfile);
+            // bool file_exists = rfile.good();
+            rfile.close();
+
+            std::ostringstream& results_stream = results_streams[i_metric];
+            if (file_empty) {
+                results_stream << "Number of iterations,";
+                for (int i_num = 0; i_num < num_iteration_samples; i_num++) {
+                    results_stream << num_iterations_vector[i_num];
+                    if (i_num != num_iteration_samples-1)
+                        results_stream << ",";
+                }
+                results_stream << "\n";
             }
-            results_stream << "\n";
+            if (metrics[i_metric].label != "")
+                results_stream << metrics[i_metric].label << ",";
+            else
+                results_stream << settings.irradiation_conditions << ",";
         }
         // Used if calculating RMSD
         std::vector<double> ref_spectrum;
-        if (settings.parameter_of_interest == "rms" || settings.parameter_of_interest == "nrmsd" 
-            || settings.parameter_of_interest == "chi_squared_g") 
-        {
+        if (requiresRefSpectrum(metrics)) {
             readInputFile1D(settings.path_ref_spectrum,ref_spectrum);
         }
 
         // Loop through number of iterations
+        ScopedTimer unfolding_timer(profiler, "trend_unfolding");
         for (int i_num=0; i_num < num_iteration_samples; i_num++) {
-            int num_iterations;
-
-            // only do # of iterations since previous run (i.e. don't do 3000, then 4000. Do
-            // 3000 then iteration_size more, etc.)
-            if (i_num == 0)
-                num_iterations = num_iterations_vector[i_num];
-            else
-                num_iterations = num_iterations_vector[i_num]-num_iterations_vector[i_num-1];
-            runMLEM(num_iterations, settings.error, num_measurements, num_bins, measurements, current_spectrum, 
-                nns_response, normalized_response, mlem_ratio, mlem_correction, mlem_estimate
+            advanceTrajectory(trajectory_settings, trajectory.get(), current_iterations,
+                num_iterations_vector[i_num], num_measurements, num_bins, measurements, current_spectrum,
+                nns_response, workspace
             );
         
-            // Calculate one of the following parameters of interest & save to results stream
-            double poi_value = 0;
-            // Total fluence
-            if (settings.parameter_of_interest == "total_fluence") {
-                if (i_num == 0)
-                    results_stream << settings.irradiation_conditions << ",";
-                poi_value = calculateTotalFlux(num_bins,current_spectrum);
-            }
-            // Total dose:
-            else if (settings.parameter_of_interest == "total_dose") {
-                if (i_num == 0)
-                    results_stream << "Total dose,";
-                poi_value = calculateDose(num_bins, current_spectrum, icrp_factors);
-            }
-            // Maximum "error" in MLEM ratio
-            else if (settings.parameter_of_interest == "max_mlem_ratio") {
-                if (i_num == 0)
-                    results_stream << settings.irradiation_conditions << ",";
-                poi_value = calculateMaxRatio(num_measurements,mlem_ratio);
-            }
-            // Average "error" in MLEM ratio
-            else if (settings.parameter_of_interest == "avg_mlem_ratio") {
-                if (i_num == 0)
-                    results_stream << settings.irradiation_conditions << ",";
-                poi_value = calculateAvgRatio(num_measurements,mlem_ratio);
-            }
-            else if (settings.parameter_of_interest == "j_factor") {
-                if (i_num == 0)
-                    results_stream << settings.irradiation_conditions << ",";
-                poi_value = calculateJFactor(num_measurements,measurements,mlem_estimate);
-            }
-            else if (settings.parameter_of_interest == "j_factor2") {
-                if (i_num == 0)
-                    results_stream << settings.irradiation_conditions << ",";
-                poi_value = calculateJFactor2(num_measurements,measurements,mlem_estimate);
-            }
-            else if (settings.parameter_of_interest == "noise") {
-                if (i_num == 0)
-                    results_stream << settings.irradiation_conditions << ",";
-                poi_value = calculateNoise(15,30,current_spectrum);
-            }
-            else if (settings.parameter_of_interest == "reduced_chi_squared") {
-                if (i_num == 0)
-                    results_stream << settings.irradiation_conditions << ",";
-                poi_value = calculateChiSquared(i_num,num_bins,num_measurements,current_spectrum,measurements,mlem_ratio);
-            }
-            else if (settings.parameter_of_interest == "rms") {
-                if (i_num == 0)
-                    results_stream << settings.irradiation_conditions << ",";
-                // std::vector<double> normalized_spectrum = normalizeVector(current_spectrum);
-                std::vector<double> normalized_spectrum = current_spectrum;
-                poi_value = calculateRMSEstimator(num_bins,ref_spectrum,normalized_spectrum);
-            }
-            else if (settings.parameter_of_interest == "nrmsd") {
-                if (i_num == 0)
-                    results_stream << settings.irradiation_conditions << ",";
-                // std::vector<double> normalized_spectrum = normalizeVector(current_spectrum);
-                std::vector<double> normalized_spectrum = current_spectrum;
-                poi_value = calculateNRMSD(num_bins,ref_spectrum,normalized_spectrum);
-            }
-            else if (settings.parameter_of_interest == "chi_squared_g") {
-                if (i_num == 0)
-                    results_stream << settings.irradiation_conditions << ",";
-                // std::vector<double> normalized_spectrum = normalizeVector(current_spectrum);
-                std::vector<double> normalized_spectrum = current_spectrum;
-                poi_value = calculateChiSquaredG(num_bins,ref_spectrum,normalized_spectrum);
+            // Calculate every parameter of interest from the current point of the trajectory & save
+            // to its results stream
+            TrendPoint point(i_num, num_measurements, num_bins, measurements, current_spectrum, icrp_factors,
+                ref_spectrum, workspace);
+            for (int i_metric = 0; i_metric < num_metrics; i_metric++) {
+                double poi_value = metrics[i_metric].calculate(point);
+
+                if (!settings.derivatives) {
+                    std::ostringstream& results_stream = results_streams[i_metric];
+                    results_stream << poi_value;
+                    if (i_num == num_iteration_samples-1)
+                        results_stream << "\n";
+
+                    else
+                        results_stream << ",";
+                }
+                else {
+                    derivative_poi_values[i_metric].push_back(poi_value);
+                }
             }
-            else {
-                throw std::logic_error("Unrecognized parameter of interest: " 
-                    + settings.parameter_of_interest 
-                    + ". Please refer to the README for allowed parameters"
-                );
+        }
+        unfolding_timer.stop();
+        profiler.setCounter("num_iteration_samples", num_iteration_samples);
+        profiler.setCounter("num_metrics", num_metrics);
+
+        ScopedTimer output_timer(profiler, "output_writing");
+        for (int i_metric = 0; i_metric < num_metrics; i_metric++) {
+            std::ostringstream& results_stream = results_streams[i_metric];
+            std::string path_output_trend = getTrendOutputPath(settings.path_output_trend, metrics[i_metric].name,
+                num_metrics);
+
+            if (settings.derivatives) {
+                std::vector<double> derivative_vector;
+                calculateDerivatives(derivative_vector, num_iteration_samples, num_iterations_vector,
+                    derivative_poi_values[i_metric]);
+
+                for (int i_num=0; i_num < num_iteration_samples; i_num++) {
+                    results_stream << derivative_vector[i_num];
+                    if (i_num == num_iteration_samples-1)
+                        results_stream << "\n";
+                    else
+                        results_stream << ",";
+                }
             }
 
-            if (!settings.derivatives) {
-                results_stream << poi_value;
-                if (i_num == num_iteration_samples-1)
-                    results_stream << "\n";
+            // Save results for parameter of interest to CSV file
+            std::ofstream output_file;
+            output_file.open(path_output_trend, std::ios_base::app);
+            std::string results_string = results_stream.str();
+            output_file << results_string;
+            output_file.close();
 
-                else
-                    results_stream << ",";
+            if (!settings.derivatives) {
+                std::cout << "Saved 2D matrix of " << metrics[i_metric].name << " values to " 
+                    << path_output_trend << "\n";
             }
             else {
-                derivative_poi_values.push_back(poi_value);
-            }
-        }
-
-        if (settings.derivatives) {
-            std::vector<double> derivative_vector;
-            calculateDerivatives(derivative_vector, num_iteration_samples, num_iterations_vector, derivative_poi_values);
-
-            for (int i_num=0; i_num < num_iteration_samples; i_num++) {
-                results_stream << derivative_vector[i_num];
-                if (i_num == num_iteration_samples-1)
-                    results_stream << "\n";
-                else
-                    results_stream << ",";
+                std::cout << "Saved 2D matrix of derivatives of " << metrics[i_metric].name 
+                    << " values to " << path_output_trend << "\n";
             }
         }
 
-        // Save results for parameter of interest to CSV file
-        std::ofstream output_file;
-        output_file.open(settings.path_output_trend, std::ios_base::app);
-        std::string results_string = results_stream.str();
-        output_file << results_string;
-        output_file.close();
-
-        if (!settings.derivatives) {
-            std::cout << "Saved 2D matrix of " << settings.parameter_of_interest << " values to " 
-                << settings.path_output_trend << "\n";
-        }
-        else {
-            std::cout << "Saved 2D matrix of derivatives of " << settings.parameter_of_interest 
-                << " values to " << settings.path_output_trend << "\n";
-        }
-
         // // Save results for parameter of interest to CSV file
         // std::ofstream output_file;
         // std::string settings.path_output_trend = settings.path_output_trend;
@@ -556,23 +601,50 @@ int main(int argc, char* argv[])
         int num_beta_samples = beta_vector.size();
         int num_iteration_samples = num_iterations_vector.size();
 
-        std::vector<double> current_spectrum; // the reconstructed spectrum
-        std::vector<double> energy_correction; // energy correction term used in MAP
+        // Each beta is a separate trajectory, so none is saved
+        if (settings.path_trajectory != "") {
+            throw std::logic_error("path_trajectory is not supported with algorithm=map");
+        }
+
+        // Parameters of interest, each saved to its own output file
+        std::vector<TrendMetric> metrics = getTrendMetrics(settings.parameter_of_interest, settings.algorithm);
+        int num_metrics = metrics.size();
 
-        // Create stream to append results. First row is number of iteration increments
-        std::ostringstream results_stream;
-        // results_stream << std::scientific;
-        results_stream << "0"; // empty first "cell"
+        std::vector<double> ref_spectrum;
+        if (requiresRefSpectrum(metrics)) {
+            readInputFile1D(settings.path_ref_spectrum,ref_spectrum);
+        }
+
+        // First row of each file is number of iteration increments
+        std::ostringstream header_stream;
+        // header_stream << std::scientific;
+        header_stream << "0"; // empty first "cell"
         for (int i_num = 0; i_num < num_iteration_samples; i_num++) {
-            results_stream << ",";
-            results_stream << num_iterations_vector[i_num];
+            header_stream << ",";
+            header_stream << num_iterations_vector[i_num];
         }
-        results_stream << "\n";
+        header_stream << "\n";
+
+        // The betas are independent, so they are unfolded in parallel. Each thread has its own
+        // workspace & spectrum. The rows of each beta are saved separately and the rows are written
+        // in beta order, so the output does not depend on the # of threads.
+        ScopedTimer unfolding_timer(profiler, "trend_unfolding");
+        ThreadPool pool(settings.num_threads);
+        std::vector<UnfoldingWorkspace> workspaces(pool.size(), UnfoldingWorkspace(num_measurements, num_bins));
+        std::vector<std::vector<double>> thread_spectra(pool.size());
+        std::vector<std::vector<std::string>> beta_rows(num_metrics, std::vector<std::string>(num_beta_samples));
 
         // Loop through betas
-        for (int i_beta=0; i_beta < num_beta_samples; i_beta++) {
+        pool.parallelFor(num_beta_samples, [&](int i_thread, int i_beta) {
+            UnfoldingWorkspace &beta_workspace = workspaces[i_thread];
+            beta_workspace.num_adjacent = settings.num_adjacent;
+            std::vector<double> &current_spectrum = thread_spectra[i_thread]; // the reconstructed spectrum
+
+            std::vector<std::ostringstream> row_streams(num_metrics);
             current_spectrum = initial_spectrum; // re-initialize spectrum for each beta
-            results_stream << beta_vector[i_beta] << ",";
+            for (int i_metric = 0; i_metric < num_metrics; i_metric++) {
+                row_streams[i_metric] << beta_vector[i_beta] << ",";
+            }
 
             // Loop through number of iterations
             for (int i_num=0; i_num < num_iteration_samples; i_num++) {
@@ -584,56 +656,54 @@ int main(int argc, char* argv[])
                     num_iterations = num_iterations_vector[i_num];
                 else
                     num_iterations = num_iterations_vector[i_num]-num_iterations_vector[i_num-1];
-                runMAP(energy_correction, beta_vector[i_beta], settings.prior, num_iterations, 
-                    settings.error, num_measurements, num_bins, measurements, current_spectrum, 
-                    nns_response, normalized_response, mlem_ratio
+                runMAP(beta_vector[i_beta], settings.prior, num_iterations, settings.error, 
+                    num_measurements, num_bins, measurements, current_spectrum, nns_response, beta_workspace
                 );
             
-                // Calculate one of the following parameters of interest & save to results stream
-                double poi_value = 0;
-                // Total fluence
-                if (settings.parameter_of_interest == "total_fluence")
-                    poi_value = calculateTotalFlux(num_bins,current_spectrum);
-                // Total dose:
-                else if (settings.parameter_of_interest == "total_dose")
-                    poi_value = calculateDose(num_bins, current_spectrum, icrp_factors);
-                // Total energy (penalty) term:
-                else if (settings.parameter_of_interest == "total_energy_correction") {
-                    poi_value = calculateTotalEnergyCorrection(energy_correction);
-                }
-                // Maximum "error" in MLEM ratio
-                else if (settings.parameter_of_interest == "max_mlem_ratio") {
-                    poi_value = calculateMaxRatio(num_measurements,mlem_ratio);
+                // Calculate every parameter of interest & save to its row
+                TrendPoint point(i_num, num_measurements, num_bins, measurements, current_spectrum,
+                    icrp_factors, ref_spectrum, beta_workspace);
+                for (int i_metric = 0; i_metric < num_metrics; i_metric++) {
+                    std::ostringstream& row_stream = row_streams[i_metric];
+                    row_stream << metrics[i_metric].calculate(point);
+                    if (i_num == num_iteration_samples-1)
+                        row_stream << "\n";
+
+                    else
+                        row_stream << ",";
                 }
-                // Average "error" in MLEM ratio
-                else if (settings.parameter_of_interest == "avg_mlem_ratio") {
-                    poi_value = calculateAvgRatio(num_measurements,mlem_ratio);
-                }
-                else {
-                    throw std::logic_error("Unrecognized parameter of interest: " 
-                        + settings.parameter_of_interest 
-                        + ". Please refer to the README for allowed parameters"
-                    );
-                }
-
-                results_stream << poi_value;
-                if (i_num == num_iteration_samples-1)
-                    results_stream << "\n";
-
-                else
-                    results_stream << ",";
             }
-        }
+            for (int i_metric = 0; i_metric < num_metrics; i_metric++) {
+                beta_rows[i_metric][i_beta] = row_streams[i_metric].str();
+            }
+        });
+        unfolding_timer.stop();
+        profiler.setCounter("num_iteration_samples", num_iteration_samples);
+        profiler.setCounter("num_beta_samples", num_beta_samples);
+        profiler.setCounter("num_metrics", num_metrics);
+        profiler.setCounter("num_threads", pool.size());
+
+        // Save results for each parameter of interest to CSV file
+        ScopedTimer output_timer(profiler, "output_writing");
+        for (int i_metric = 0; i_metric < num_metrics; i_metric++) {
+            std::string path_output_trend = getTrendOutputPath(settings.path_output_trend, metrics[i_metric].name,
+                num_metrics);
+            std::ofstream output_file;
+            output_file.open(path_output_trend, std::ios_base::out);
+            output_file << header_stream.str();
+            for (int i_beta=0; i_beta < num_beta_samples; i_beta++) {
+                output_file << beta_rows[i_metric][i_beta];
+            }
+            output_file.close();
 
-        // Save results for parameter of interest to CSV file
-        std::ofstream output_file;
-        output_file.open(settings.path_output_trend, std::ios_base::out);
-        std::string results_string = results_stream.str();
-        output_file << results_string;
-        output_file.close();
+            std::cout << "Saved 2D matrix of " << metrics[i_metric].name << " values to " 
+                << path_output_trend << "\n";
+        }
+    }
 
-        std::cout << "Saved 2D matrix of " << settings.parameter_of_interest << " values to " 
-            << settings.path_output_trend << "\n";
+    if (profiler.enabled) {
+        profiler.writeJSON(path_profile);
+        std::cout << "Saved profile to " << path_profile << "\n";
     }
 
     return 0;
@@ -694,7 +764,7 @@ int main(int argc, char* argv[])
 //         else
 //             num_iterations = num_iterations_vector[i_num]-num_iterations_vector[i_num-1];
         // runMLEM(num_iterations, settings.error, num_measurements, num_bins, measurements, 
-        //     current_spectrum, nns_response, normalized_response, mlem_ratio, mlem_correction, mlem_estimate
+        //     current_spectrum, nns_response, mlem_ratio, mlem_correction, mlem_estimate
         // );
 
 //         // on first iteration, save the deviations and iteration # for each bin
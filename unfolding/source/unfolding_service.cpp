@@ -0,0 +1,817 @@
+//**************************************************************************************************
+// The functions included in this module implement the resident unfolding service (see
+// unfolding_service.h): parsing the JSON-lines requests, unfolding each measurement set as
+// unfold_spectrum does, and reading requests from stdin or from the connections to a Unix socket.
+//**************************************************************************************************
+
+#include "unfolding_service.h"
+#include "custom_classes.h"
+#include "fileio.h"
+#include "mlemstop_capture.h"
+#include "physics_calculations.h"
+#include "random_streams.h"
+#include "streaming_statistics.h"
+#include "thread_pool.h"
+#include "uncertainty_sampling.h"
+#include "unfolding_workspace.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Settings that a request may change for its own measurement set. The remaining settings (e.g.
+// input & output files, num_threads) apply to the whole service.
+static const std::string REQUEST_SETTINGS[] = {
+    "algorithm", "beta", "cps_crossover", "dose_mu", "doserate_mu", "duration", "f_factor",
+    "irradiation_conditions", "meas_units", "mlem_cutoff", "mlem_max_error", "mlem_multigrid_iterations",
+    "mlem_multigrid_levels", "mlem_relaxation", "nns_normalization", "num_adjacent", "num_meas_per_shell",
+    "num_uncertainty_samples", "prior",
+    "sample_initialization", "seed", "sigma_j", "uncertainty_bands", "uncertainty_batch_size",
+    "uncertainty_rel_tol", "uncertainty_type"
+};
+static const int NUM_REQUEST_SETTINGS = sizeof(REQUEST_SETTINGS)/sizeof(REQUEST_SETTINGS[0]);
+
+bool isRequestSetting(std::string name) {
+    return std::find(REQUEST_SETTINGS, REQUEST_SETTINGS + NUM_REQUEST_SETTINGS, name) != REQUEST_SETTINGS + NUM_REQUEST_SETTINGS;
+}
+
+//==================================================================================================
+// Apply a per-request setting (value as written in a settings file) to request_settings. f_factor
+// is provided in fA/cps, as in the settings file, and stored in nA/cps.
+//==================================================================================================
+void applyRequestSetting(UnfoldingSettings& request_settings, std::string name, std::string value) {
+    if (!isRequestSetting(name)) {
+        throw std::logic_error("Unrecognized request member or setting not allowed per request: " + name);
+    }
+    request_settings.set_setting(name, value);
+    if (name == "f_factor") {
+        request_settings.set_f_factor(request_settings.f_factor / 1e6); // fA/cps to nA/cps
+    }
+}
+
+//==================================================================================================
+// JSON requests & responses
+//==================================================================================================
+//--------------------------------------------------------------------------------------------------
+// A value of a request member. Requests are flat objects, so arrays may only hold numbers.
+//--------------------------------------------------------------------------------------------------
+class JsonValue {
+    public:
+        std::string type; // "string", "number", "boolean", "null" or "array"
+        std::string text; // contents of a string, or the number or literal as written
+        std::vector<double> numbers; // elements of an array
+};
+
+static void skipWhitespace(const std::string& text, size_t& pos) {
+    while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\n' || text[pos] == '\r')) {
+        pos++;
+    }
+}
+
+static void expectCharacter(const std::string& text, size_t& pos, char character) {
+    skipWhitespace(text, pos);
+    if (pos >= text.size() || text[pos] != character) {
+        throw std::logic_error(std::string("Invalid JSON request: expected '") + character + "'");
+    }
+    pos++;
+}
+
+static void appendUTF8(std::string& result, unsigned long code_point) {
+    if (code_point < 0x80) {
+        result += (char) code_point;
+    }
+    else if (code_point < 0x800) {
+        result += (char) (0xC0 | (code_point >> 6));
+        result += (char) (0x80 | (code_point & 0x3F));
+    }
+    else if (code_point < 0x10000) {
+        result += (char) (0xE0 | (code_point >> 12));
+        result += (char) (0x80 | ((code_point >> 6) & 0x3F));
+        result += (char) (0x80 | (code_point & 0x3F));
+    }
+    else {
+        result += (char) (0xF0 | (code_point >> 18));
+        result += (char) (0x80 | ((code_point >> 12) & 0x3F));
+        result += (char) (0x80 | ((code_point >> 6) & 0x3F));
+        result += (char) (0x80 | (code_point & 0x3F));
+    }
+}
+
+static unsigned long parseHex4(const std::string& text, size_t& pos) {
+    if (pos + 4 > text.size()) {
+        throw std::logic_error("Invalid JSON request: incomplete \\u escape");
+    }
+    std::string digits = text.substr(pos, 4);
+    char* end;
+    unsigned long value = strtoul(digits.c_str(), &end, 16);
+    if (*end != '\0') {
+        throw std::logic_error("Invalid JSON request: invalid \\u escape");
+    }
+    pos += 4;
+    return value;
+}
+
+static std::string parseJsonString(const std::string& text, size_t& pos) {
+    expectCharacter(text, pos, '"');
+    std::string result;
+    while (true) {
+        if (pos >= text.size()) {
+            throw std::logic_error("Invalid JSON request: unterminated string");
+        }
+        char character = text[pos++];
+        if (character == '"') {
+            return result;
+        }
+        if (character != '\\') {
+            result += character;
+            continue;
+        }
+        if (pos >= text.size()) {
+            throw std::logic_error("Invalid JSON request: unterminated string");
+        }
+        char escape = text[pos++];
+        if (escape == '"' || escape == '\\' || escape == '/') result += escape;
+        else if (escape == 'b') result += '\b';
+        else if (escape == 'f') result += '\f';
+        else if (escape == 'n') result += '\n';
+        else if (escape == 'r') result += '\r';
+        else if (escape == 't') result += '\t';
+        else if (escape == 'u') {
+            unsigned long code_point = parseHex4(text, pos);
+            // Combine a UTF-16 surrogate pair
+            if (code_point >= 0xD800 && code_point < 0xDC00 && text.compare(pos, 2, "\\u") == 0) {
+                pos += 2;
+                unsigned long low_surrogate = parseHex4(text, pos);
+                code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low_surrogate - 0xDC00);
+            }
+            appendUTF8(result, code_point);
+        }
+        else {
+            throw std::logic_error(std::string("Invalid JSON request: invalid escape \\") + escape);
+        }
+    }
+}
+
+static std::string parseJsonNumber(const std::string& text, size_t& pos) {
+    size_t start = pos;
+    while (pos < text.size() && strchr("+-0123456789.eE", text[pos]) != NULL) {
+        pos++;
+    }
+    std::string number = text.substr(start, pos - start);
+    char* end;
+    strtod(number.c_str(), &end);
+    if (number.empty() || *end != '\0') {
+        throw std::logic_error("Invalid JSON request: invalid number " + number);
+    }
+    return number;
+}
+
+static JsonValue parseJsonValue(const std::string& text, size_t& pos) {
+    JsonValue value;
+    skipWhitespace(text, pos);
+    if (pos >= text.size()) {
+        throw std::logic_error("Invalid JSON request: missing value");
+    }
+    if (text[pos] == '"') {
+        value.type = "string";
+        value.text = parseJsonString(text, pos);
+    }
+    else if (text[pos] == '[') {
+        value.type = "array";
+        pos++;
+        skipWhitespace(text, pos);
+        if (pos < text.size() && text[pos] == ']') {
+            pos++;
+            return value;
+        }
+        while (true) {
+            JsonValue element = parseJsonValue(text, pos);
+            if (element.type != "number") {
+                throw std::logic_error("Invalid JSON request: arrays may only contain numbers");
+            }
+            value.numbers.push_back(strtod(element.text.c_str(), NULL));
+            skipWhitespace(text, pos);
+            if (pos < text.size() && text[pos] == ',') {
+                pos++;
+                continue;
+            }
+            expectCharacter(text, pos, ']');
+            break;
+        }
+    }
+    else if (text.compare(pos, 4, "true") == 0 || text.compare(pos, 5, "false") == 0) {
+        value.type = "boolean";
+        value.text = text[pos] == 't' ? "true" : "false";
+        pos += value.text.size();
+    }
+    else if (text.compare(pos, 4, "null") == 0) {
+        value.type = "null";
+        value.text = "null";
+        pos += 4;
+    }
+    else if (text[pos] == '{') {
+        throw std::logic_error("Invalid JSON request: nested objects are not supported");
+    }
+    else {
+        value.type = "number";
+        value.text = parseJsonNumber(text, pos);
+    }
+    return value;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Parse a request: a single JSON object whose values are strings, numbers, booleans, null or arrays
+// of numbers
+//--------------------------------------------------------------------------------------------------
+static std::map<std::string, JsonValue> parseJsonRequest(const std::string& text) {
+    std::map<std::string, JsonValue> members;
+    size_t pos = 0;
+    expectCharacter(text, pos, '{');
+    skipWhitespace(text, pos);
+    if (pos < text.size() && text[pos] == '}') {
+        pos++;
+    }
+    else {
+        while (true) {
+            std::string key = parseJsonString(text, pos);
+            expectCharacter(text, pos, ':');
+            members[key] = parseJsonValue(text, pos);
+            skipWhitespace(text, pos);
+            if (pos < text.size() && text[pos] == ',') {
+                pos++;
+                continue;
+            }
+            expectCharacter(text, pos, '}');
+            break;
+        }
+    }
+    skipWhitespace(text, pos);
+    if (pos != text.size()) {
+        throw std::logic_error("Invalid JSON request: unexpected characters after the object");
+    }
+    return members;
+}
+
+std::string jsonString(const std::string& text) {
+    std::ostringstream result;
+    result << '"';
+    for (size_t i_char = 0; i_char < text.size(); i_char++) {
+        unsigned char character = text[i_char];
+        if (character == '"' || character == '\\') {
+            result << '\\' << character;
+        }
+        else if (character == '\n') {
+            result << "\\n";
+        }
+        else if (character < 0x20) {
+            result << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int) character
+                << std::dec << std::setfill(' ');
+        }
+        else {
+            result << character;
+        }
+    }
+    result << '"';
+    return result.str();
+}
+
+// Numbers are written with enough digits to be read back exactly. JSON has no NaN or infinity.
+void writeJsonNumber(std::ostream& output, double value) {
+    if (std::isfinite(value)) {
+        output << value;
+    }
+    else {
+        output << "null";
+    }
+}
+
+void writeJsonArray(std::ostream& output, std::vector<double>& values) {
+    output << '[';
+    for (int i_value = 0; i_value < (int) values.size(); i_value++) {
+        if (i_value > 0) {
+            output << ',';
+        }
+        writeJsonNumber(output, values[i_value]);
+    }
+    output << ']';
+}
+
+//==================================================================================================
+// Request transport
+//==================================================================================================
+//--------------------------------------------------------------------------------------------------
+// Destination of the responses to the requests read from one input: an output stream (stdout) or
+// a socket connection. The socket is closed once its reader and all of its pending requests have
+// released the connection.
+//--------------------------------------------------------------------------------------------------
+class ServiceConnection {
+    public:
+        ServiceConnection(std::ostream* output) {
+            this->output = output;
+            socket_descriptor = -1;
+        }
+        ServiceConnection(int socket_descriptor) {
+            output = NULL;
+            this->socket_descriptor = socket_descriptor;
+        }
+        ~ServiceConnection() {
+            if (socket_descriptor >= 0) {
+                close(socket_descriptor);
+            }
+        }
+
+        // Write a response line. Responses to a client that has disconnected are dropped.
+        void send(const std::string& response) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (output != NULL) {
+                *output << response << '\n' << std::flush;
+                return;
+            }
+            std::string line = response + '\n';
+            size_t num_sent = 0;
+            while (num_sent < line.size()) {
+                ssize_t num_written = ::send(socket_descriptor, line.data() + num_sent, line.size() - num_sent, 0);
+                if (num_written < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (num_written <= 0) {
+                    return;
+                }
+                num_sent += num_written;
+            }
+        }
+
+    private:
+        std::ostream* output;
+        int socket_descriptor;
+        std::mutex mutex;
+
+        ServiceConnection(const ServiceConnection&);
+        ServiceConnection& operator=(const ServiceConnection&);
+};
+
+class ServiceRequest {
+    public:
+        std::string line;
+        std::shared_ptr<ServiceConnection> connection;
+};
+
+//--------------------------------------------------------------------------------------------------
+// Requests waiting for a worker, fed by num_sources readers. pop blocks until a request is
+// available, and returns false once every source is closed and no requests remain.
+//--------------------------------------------------------------------------------------------------
+class RequestQueue {
+    public:
+        RequestQueue(int num_sources) {
+            this->num_sources = num_sources;
+        }
+
+        void push(ServiceRequest& request) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                requests.push_back(request);
+            }
+            condition.notify_one();
+        }
+
+        void closeSource() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                num_sources--;
+            }
+            condition.notify_all();
+        }
+
+        bool pop(ServiceRequest& request) {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this] { return !requests.empty() || num_sources <= 0; });
+            if (requests.empty()) {
+                return false;
+            }
+            request = requests.front();
+            requests.pop_front();
+            return true;
+        }
+
+    private:
+        std::deque<ServiceRequest> requests;
+        int num_sources;
+        std::mutex mutex;
+        std::condition_variable condition;
+};
+
+static void pushRequestLine(RequestQueue& queue, std::string line,
+    const std::shared_ptr<ServiceConnection>& connection)
+{
+    line.erase(std::remove(line.begin(), line.end(), '\r'), line.end());
+    if (line.find_first_not_of(" \t") == std::string::npos) {
+        return;
+    }
+    ServiceRequest request;
+    request.line = line;
+    request.connection = connection;
+    queue.push(request);
+}
+
+// Read the request lines sent over one socket connection until the client closes it
+static void readSocketConnection(int socket_descriptor, RequestQueue* queue) {
+    std::shared_ptr<ServiceConnection> connection(new ServiceConnection(socket_descriptor));
+    std::string pending;
+    char chunk[4096];
+    while (true) {
+        ssize_t num_read = recv(socket_descriptor, chunk, sizeof(chunk), 0);
+        if (num_read < 0 && errno == EINTR) {
+            continue;
+        }
+        if (num_read <= 0) {
+            break;
+        }
+        pending.append(chunk, num_read);
+        size_t line_start = 0;
+        size_t line_end;
+        while ((line_end = pending.find('\n', line_start)) != std::string::npos) {
+            pushRequestLine(*queue, pending.substr(line_start, line_end - line_start), connection);
+            line_start = line_end + 1;
+        }
+        pending.erase(0, line_start);
+    }
+    pushRequestLine(*queue, pending, connection);
+}
+
+//==================================================================================================
+// UnfoldingService
+//==================================================================================================
+//--------------------------------------------------------------------------------------------------
+// Read the inputs shared by all requests (see unfold_spectrum for details). settings.f_factor must
+// already be converted to nA/cps.
+//--------------------------------------------------------------------------------------------------
+UnfoldingService::UnfoldingService(UnfoldingSettings& settings) {
+    this->settings = settings;
+
+    readInputFile1D(settings.path_energy_bins,energy_bins);
+    num_bins = energy_bins.size();
+
+    nns_response = readResponseFile(settings.path_system_response);
+    num_measurements = nns_response.num_measurements;
+    checkDimensions(num_bins, "number of energy bins", nns_response.num_bins, "NNS response");
+
+    readInputFile1D(settings.path_input_spectrum,initial_spectrum);
+    checkDimensions(num_bins, "number of energy bins", initial_spectrum.size(), "Input spectrum");
+
+    readInputFile1D(settings.path_icrp_factors,icrp_factors);
+    checkDimensions(num_bins, "number of energy bins", icrp_factors.size(), "Number of ICRP factors");
+}
+
+//--------------------------------------------------------------------------------------------------
+// Unfold the measurement set of one request and return the response (a single line). Errors are
+// returned as responses with "status":"error" rather than thrown.
+//--------------------------------------------------------------------------------------------------
+std::string UnfoldingService::handleRequest(std::string request) {
+    std::string id = "null";
+    UnfoldingSettings request_settings = settings;
+    std::vector<double> measurements;
+
+    try {
+        std::map<std::string, JsonValue> members = parseJsonRequest(request);
+        if (members.count("id")) {
+            JsonValue& id_value = members["id"];
+            if (id_value.type == "array") {
+                throw std::logic_error("Request id must be a string or a number");
+            }
+            id = id_value.type == "string" ? jsonString(id_value.text) : id_value.text;
+        }
+
+        // Apply the per-request settings
+        for (std::map<std::string, JsonValue>::iterator member = members.begin(); member != members.end(); ++member) {
+            const std::string& key = member->first;
+            JsonValue& value = member->second;
+            if (key == "id") {
+                continue;
+            }
+            if (key == "measurements") {
+                if (value.type != "array") {
+                    throw std::logic_error("measurements must be an array of numbers");
+                }
+                measurements = value.numbers;
+                continue;
+            }
+            if (isRequestSetting(key) && value.type != "string" && value.type != "number") {
+                throw std::logic_error("Setting " + key + " must be a string or a number");
+            }
+            applyRequestSetting(request_settings, key, value.text);
+        }
+    }
+    catch (std::exception& error) {
+        return "{\"id\":" + id + ",\"status\":\"error\",\"error\":" + jsonString(error.what()) + "}";
+    }
+
+    bool succeeded;
+    return unfoldMeasurements(id, request_settings, measurements, succeeded);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Unfold one measurement set (values in the same order & units as in a measurements file) with the
+// provided settings, and return the response (a single line) with the provided id (JSON text).
+// Errors are returned as responses with "status":"error" (and succeeded set to false) rather than
+// thrown.
+//--------------------------------------------------------------------------------------------------
+std::string UnfoldingService::unfoldMeasurements(std::string id, UnfoldingSettings& request_settings,
+    std::vector<double> measurements, bool& succeeded)
+{
+    std::ostringstream response;
+    response << std::setprecision(17);
+    succeeded = false;
+
+    try {
+
+        //------------------------------------------------------------------------------------------
+        // Process the measurements as unfold_spectrum does (values are in the same order as in a
+        // measurements file)
+        //------------------------------------------------------------------------------------------
+        if (measurements.empty()) {
+            throw std::logic_error("No measurements provided");
+        }
+        int num_values = measurements.size();
+        for (int i_meas = 0; i_meas < num_values; i_meas++) {
+            measurements[i_meas] = std::fabs(measurements[i_meas]);
+        }
+        std::reverse(measurements.begin(),measurements.end()); // provided 7-0 but want 0-7
+
+        if (request_settings.meas_units == "nc") {
+            if (request_settings.duration <= 0) {
+                throw std::logic_error("A request with meas_units=nc requires the duration of the measurements (duration > 0)");
+            }
+            for (int i_meas=0; i_meas < num_values; i_meas++) {
+                measurements[i_meas] = measurements[i_meas]*request_settings.norm/request_settings.f_factor/request_settings.duration;
+            }
+        }
+        else if (request_settings.meas_units != "cps") {
+            throw std::logic_error("Unrecognized meas_units: " + request_settings.meas_units);
+        }
+
+        std::vector<double> std_errors;
+        if (request_settings.num_meas_per_shell > 1) {
+            processMeasurements(num_values,request_settings.num_meas_per_shell,measurements,std_errors);
+        }
+        else if (request_settings.num_meas_per_shell == 1 && request_settings.uncertainty_type == "gaussian"){
+            throw std::logic_error("Cannot generate Gaussian-sampled pseudo-measurements with only single measurement per shell.");
+        }
+        else if (request_settings.num_meas_per_shell < 1) {
+            throw std::logic_error("Number of measurements per shell must be >= 1");
+        }
+        checkDimensions(num_measurements, "number of measurements", measurements.size(), "Request measurements");
+
+        //------------------------------------------------------------------------------------------
+        // Unfold
+        //------------------------------------------------------------------------------------------
+        std::vector<double> spectrum = initial_spectrum;
+        UnfoldingWorkspace workspace(num_measurements, num_bins);
+        int num_iterations;
+        double j_factor = 0;
+        double j_threshold = 0;
+        std::vector<MLEMSTOPCapture> j_captures; // j_bounds spectra, see unfold_spectrum.cpp
+
+        if (request_settings.algorithm == "mlemstop" && request_settings.uncertainty_type == "j_bounds") {
+            j_threshold = determineJThreshold(num_measurements,measurements,request_settings.cps_crossover);
+            j_captures.push_back(MLEMSTOPCapture(j_threshold));
+            j_captures.push_back(MLEMSTOPCapture(j_threshold*(1+request_settings.sigma_j)));
+            j_captures.push_back(MLEMSTOPCapture(j_threshold*(1-request_settings.sigma_j)));
+            runMLEMSTOPCapture(request_settings.cutoff, num_measurements, num_bins, measurements, spectrum,
+                nns_response, workspace, j_captures
+            );
+            j_captures[0].restore(spectrum, workspace);
+            num_iterations = j_captures[0].num_iterations;
+            j_factor = j_captures[0].j_factor;
+            j_captures.erase(j_captures.begin());
+        }
+        else {
+            num_iterations = runUnfoldingAlgorithm(request_settings, num_measurements, num_bins, measurements,
+                spectrum, nns_response, workspace, j_threshold, j_factor
+            );
+        }
+
+        double ambient_dose_eq = calculateDose(num_bins, spectrum, icrp_factors);
+        double total_flux = calculateTotalFlux(num_bins,spectrum);
+        double avg_energy = calculateAverageEnergy(num_bins,spectrum,energy_bins);
+
+        //------------------------------------------------------------------------------------------
+        // Uncertainties. Requests already run concurrently, so the samples of a request are
+        // unfolded serially by the thread handling it.
+        //------------------------------------------------------------------------------------------
+        std::vector<double> spectrum_uncertainty_lower;
+        std::vector<double> spectrum_uncertainty_upper;
+        double ambient_dose_eq_uncertainty_upper = 0;
+        double ambient_dose_eq_uncertainty_lower = 0;
+        bool sampled = false;
+        long num_samples = 0;
+
+        if (request_settings.uncertainty_type == "poisson" || request_settings.uncertainty_type == "gaussian") {
+            if (request_settings.seed == 0) {
+                request_settings.set_seed(generateRandomSeed());
+            }
+            sampled = true;
+            UncertaintyStatistics statistics(spectrum, ambient_dose_eq, request_settings.uncertainty_bands);
+            ThreadPool serial_pool(1);
+            runUncertaintySamples(request_settings, serial_pool, request_settings.seed, num_measurements,
+                num_bins, measurements, std_errors, initial_spectrum, spectrum, nns_response, icrp_factors,
+                statistics
+            );
+            statistics.getSpectrumUncertainty(spectrum_uncertainty_lower, spectrum_uncertainty_upper);
+            statistics.getDoseUncertainty(ambient_dose_eq_uncertainty_lower, ambient_dose_eq_uncertainty_upper);
+            num_samples = statistics.num_samples();
+        }
+        else if (request_settings.uncertainty_type == "j_bounds") {
+            UncertaintyManagerJ j_manager_low(j_threshold,1+request_settings.sigma_j);
+            UncertaintyManagerJ j_manager_high(j_threshold,1-request_settings.sigma_j);
+            if (j_captures.empty()) {
+                UnfoldingWorkspace sample_workspace(num_measurements, num_bins);
+                std::vector<double> bound_spectrum = initial_spectrum;
+                j_captures.push_back(MLEMSTOPCapture(j_manager_low.j_threshold));
+                j_captures.push_back(MLEMSTOPCapture(j_manager_high.j_threshold));
+                runMLEMSTOPCapture(request_settings.cutoff, num_measurements, num_bins, measurements,
+                    bound_spectrum, nns_response, sample_workspace, j_captures
+                );
+            }
+            j_manager_low.determineSpectrumUncertainty(spectrum,num_bins,j_captures[0]);
+            spectrum_uncertainty_lower = j_manager_low.spectrum_uncertainty;
+
+            j_manager_high.determineSpectrumUncertainty(spectrum,num_bins,j_captures[1]);
+            spectrum_uncertainty_upper = j_manager_high.spectrum_uncertainty;
+
+            j_manager_low.determineDoseUncertainty(ambient_dose_eq,spectrum,num_bins,icrp_factors);
+            ambient_dose_eq_uncertainty_lower = j_manager_low.dose_uncertainty;
+
+            j_manager_high.determineDoseUncertainty(ambient_dose_eq,spectrum,num_bins,icrp_factors);
+            ambient_dose_eq_uncertainty_upper = j_manager_high.dose_uncertainty;
+        }
+        else {
+            throw std::logic_error("Unrecognized uncertainty type: " + request_settings.uncertainty_type);
+        }
+
+        double total_flux_uncertainty_upper = calculateSumUncertainty(num_bins,spectrum_uncertainty_upper);
+        double total_flux_uncertainty_lower = calculateSumUncertainty(num_bins,spectrum_uncertainty_lower);
+
+        double avg_energy_uncertainty_upper = calculateEnergyUncertainty(num_bins,energy_bins,spectrum,
+            spectrum_uncertainty_upper,total_flux,total_flux_uncertainty_upper
+        );
+        double avg_energy_uncertainty_lower = calculateEnergyUncertainty(num_bins,energy_bins,spectrum,
+            spectrum_uncertainty_lower,total_flux,total_flux_uncertainty_lower
+        );
+
+        //------------------------------------------------------------------------------------------
+        // Response
+        //------------------------------------------------------------------------------------------
+        response << "{\"id\":" << id << ",\"status\":\"ok\"";
+        response << ",\"irradiation_conditions\":" << jsonString(request_settings.irradiation_conditions);
+        response << ",\"algorithm\":" << jsonString(request_settings.algorithm);
+        response << ",\"num_iterations\":" << num_iterations;
+        if (request_settings.algorithm == "mlemstop") {
+            response << ",\"j_factor\":";
+            writeJsonNumber(response, j_factor);
+            response << ",\"j_threshold\":";
+            writeJsonNumber(response, j_threshold);
+        }
+        if (sampled) {
+            response << ",\"seed\":" << request_settings.seed;
+            response << ",\"num_uncertainty_samples\":" << num_samples;
+        }
+        response << ",\"dose\":";
+        writeJsonNumber(response, ambient_dose_eq);
+        response << ",\"dose_uncertainty_upper\":";
+        writeJsonNumber(response, ambient_dose_eq_uncertainty_upper);
+        response << ",\"dose_uncertainty_lower\":";
+        writeJsonNumber(response, ambient_dose_eq_uncertainty_lower);
+        response << ",\"total_flux\":";
+        writeJsonNumber(response, total_flux);
+        response << ",\"total_flux_uncertainty_upper\":";
+        writeJsonNumber(response, total_flux_uncertainty_upper);
+        response << ",\"total_flux_uncertainty_lower\":";
+        writeJsonNumber(response, total_flux_uncertainty_lower);
+        response << ",\"avg_energy\":";
+        writeJsonNumber(response, avg_energy);
+        response << ",\"avg_energy_uncertainty_upper\":";
+        writeJsonNumber(response, avg_energy_uncertainty_upper);
+        response << ",\"avg_energy_uncertainty_lower\":";
+        writeJsonNumber(response, avg_energy_uncertainty_lower);
+        response << ",\"spectrum\":";
+        writeJsonArray(response, spectrum);
+        response << ",\"spectrum_uncertainty_upper\":";
+        writeJsonArray(response, spectrum_uncertainty_upper);
+        response << ",\"spectrum_uncertainty_lower\":";
+        writeJsonArray(response, spectrum_uncertainty_lower);
+        response << "}";
+        succeeded = true;
+    }
+    catch (std::exception& error) {
+        response.str("");
+        response << "{\"id\":" << id << ",\"status\":\"error\",\"error\":" << jsonString(error.what()) << "}";
+    }
+    return response.str();
+}
+
+//--------------------------------------------------------------------------------------------------
+// Run the workers until the queue is closed: each thread of the pool takes requests from the queue
+// one at a time and sends the response as soon as the request is unfolded
+//--------------------------------------------------------------------------------------------------
+void UnfoldingService::dispatch(RequestQueue& queue) {
+    ThreadPool pool(settings.num_threads);
+    pool.parallelFor(pool.size(), [&](int i_thread, int i_worker) {
+        ServiceRequest request;
+        while (queue.pop(request)) {
+            request.connection->send(handleRequest(request.line));
+            request = ServiceRequest(); // release the connection
+        }
+    });
+}
+
+//--------------------------------------------------------------------------------------------------
+// Serve the requests read from input (one per line) until it is closed, writing the responses to
+// output
+//--------------------------------------------------------------------------------------------------
+void UnfoldingService::serveStream(std::istream& input, std::ostream& output) {
+    RequestQueue queue(1);
+    std::shared_ptr<ServiceConnection> connection(new ServiceConnection(&output));
+
+    std::thread reader([&]() {
+        std::string line;
+        while (getline(input, line)) {
+            pushRequestLine(queue, line, connection);
+        }
+        queue.closeSource();
+    });
+    dispatch(queue);
+    reader.join();
+}
+
+//--------------------------------------------------------------------------------------------------
+// Serve the requests sent over connections to a Unix socket created at path_socket (each client
+// receives the responses to its own requests). Runs until the process is terminated. A stale socket
+// left at path_socket by a previous service is replaced.
+//--------------------------------------------------------------------------------------------------
+void UnfoldingService::serveSocket(std::string path_socket) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path_socket.size() >= sizeof(address.sun_path)) {
+        throw std::logic_error("Socket path is too long: " + path_socket);
+    }
+    strncpy(address.sun_path, path_socket.c_str(), sizeof(address.sun_path) - 1);
+
+    struct stat socket_status;
+    if (lstat(path_socket.c_str(), &socket_status) == 0) {
+        if (!S_ISSOCK(socket_status.st_mode)) {
+            throw std::logic_error("Cannot create socket, a file already exists at: " + path_socket);
+        }
+        unlink(path_socket.c_str());
+    }
+
+    int listen_descriptor = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_descriptor < 0
+        || bind(listen_descriptor, (struct sockaddr*) &address, sizeof(address)) != 0
+        || listen(listen_descriptor, SOMAXCONN) != 0)
+    {
+        throw std::logic_error("Unable to listen on socket " + path_socket + ": " + strerror(errno));
+    }
+
+    // Responses to disconnected clients must not terminate the service
+    signal(SIGPIPE, SIG_IGN);
+
+    RequestQueue queue(1);
+    std::thread acceptor([&]() {
+        while (true) {
+            int client_descriptor = accept(listen_descriptor, NULL, NULL);
+            if (client_descriptor < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) {
+                    continue;
+                }
+                break;
+            }
+            std::thread(readSocketConnection, client_descriptor, &queue).detach();
+        }
+        queue.closeSource();
+    });
+    dispatch(queue);
+    acceptor.join();
+    close(listen_descriptor);
+    unlink(path_socket.c_str());
+}
@@ -0,0 +1,50 @@
+//**************************************************************************************************
+// The functions included in this module manage the preallocated buffers shared by the unfolding
+// algorithms and the Monte Carlo uncertainty samples.
+//**************************************************************************************************
+
+#include "unfolding_workspace.h"
+
+#include <vector>
+
+//--------------------------------------------------------------------------------------------------
+// Default constructor for an empty UnfoldingWorkspace. Buffers are sized on first use.
+//--------------------------------------------------------------------------------------------------
+UnfoldingWorkspace::UnfoldingWorkspace() {
+    num_measurements = 0;
+    num_bins = 0;
+    num_adjacent = 1;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Construct an UnfoldingWorkspace with all buffers sized for the provided problem dimensions
+//--------------------------------------------------------------------------------------------------
+UnfoldingWorkspace::UnfoldingWorkspace(int num_measurements, int num_bins) {
+    this->num_measurements = 0;
+    this->num_bins = 0;
+    this->num_adjacent = 1;
+    resize(num_measurements, num_bins);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Size all buffers for the provided problem dimensions. Nothing is reallocated if the dimensions
+// are unchanged, so algorithms may call this on entry at no cost.
+//--------------------------------------------------------------------------------------------------
+void UnfoldingWorkspace::resize(int num_measurements, int num_bins) {
+    if (num_measurements == this->num_measurements && num_bins == this->num_bins) {
+        return;
+    }
+    this->num_measurements = num_measurements;
+    this->num_bins = num_bins;
+
+    mlem_ratio.assign(num_measurements, 0.0);
+    mlem_correction.assign(num_bins, 0.0);
+    mlem_estimate.assign(num_measurements, 0.0);
+    energy_correction.assign(num_bins, 0.0);
+    neighbours.assign(2*num_adjacent+1, 0.0);
+    squarem_start.assign(num_bins, 0.0);
+    squarem_step.assign(num_bins, 0.0);
+
+    sampled_measurements.assign(num_measurements, 0.0);
+    sampled_spectrum.assign(num_bins, 0.0);
+}